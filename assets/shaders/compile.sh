@@ -1,4 +0,0 @@
-#!/bin/sh
-glslangValidator -o shader.vert.spv -V shader.vert 
-glslangValidator -o shader.frag.spv -V shader.frag 
-
@@ -1,14 +1,15 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(binding = 0) uniform sampler2D texAtlasSampler;
+// a layer for each face of each block, see new_TextureImage
+layout(binding = 0) uniform sampler2DArray texAtlasSampler;
 
 layout(location = 0) in vec3 fragNormal;
 layout(location = 1) in vec2 fragTexCoord;
+layout(location = 2) flat in uint fragTexLayer;
 
 layout(location = 0) out vec4 outColor;
 
-
 void main() {
   // const float ambientStrength = 0.5;
   // vec3 lightColor = normalize(vec3(1.0, 1.0, 1.0));
@@ -20,6 +21,6 @@ void main() {
   // vec3 result = (ambient + diffuse) * objectColor;
   // outColor = vec4(result, 1.0);
 
-  outColor = texture(texAtlasSampler, fragTexCoord);
+  outColor = texture(texAtlasSampler, vec3(fragTexCoord, fragTexLayer));
 
 }
@@ -1,19 +1,108 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
-layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNormal;
-layout(location = 2) in vec2 inTexCoord;
+// the Faces of the draw's vertex pool block, see src/vertex.h
+layout(std430, set = 1, binding = 0) readonly buffer Faces {
+  uint faces[];
+};
 
-layout(std140, push_constant) uniform Constants {
+// VertexDisplayUniforms in src/vulkan_utils.h
+layout(std140, set = 0, binding = 1) uniform Uniforms {
   mat4 mvp;
-} constants;
+  ivec4 centerChunk;
+} uniforms;
+
+// the depth prepass draws with this shader too, and the depths it writes are
+// compared with the ones drawn after it
+invariant gl_Position;
 
 layout(location = 0) out vec3 fragNormal;
 layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTexLayer;
+
+// CHUNK_*_SIZE in src/world_utils.h
+const ivec3 CHUNK_SIZE = ivec3(32, 32, 32);
+// CHUNK_ORIGIN_*_BITS in src/world_utils.h
+const ivec3 ORIGIN_BITS = ivec3(11, 10, 11);
+
+// VERTEXES_PER_FACE corners of each BlockFaceKind, relative to the block, and
+// where they are on the face's texture
+const vec3 CORNERS[36] = vec3[](
+  // down
+  vec3(0, 1, 0), vec3(1, 1, 0), vec3(0, 1, 1),
+  vec3(1, 1, 0), vec3(1, 1, 1), vec3(0, 1, 1),
+  // up
+  vec3(0, 0, 1), vec3(1, 0, 0), vec3(0, 0, 0),
+  vec3(0, 0, 1), vec3(1, 0, 1), vec3(1, 0, 0),
+  // left
+  vec3(0, 0, 0), vec3(0, 1, 0), vec3(0, 0, 1),
+  vec3(0, 0, 1), vec3(0, 1, 0), vec3(0, 1, 1),
+  // right
+  vec3(1, 0, 0), vec3(1, 0, 1), vec3(1, 1, 0),
+  vec3(1, 0, 1), vec3(1, 1, 1), vec3(1, 1, 0),
+  // back
+  vec3(0, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0),
+  vec3(1, 0, 0), vec3(1, 1, 0), vec3(0, 1, 0),
+  // front
+  vec3(0, 1, 1), vec3(1, 0, 1), vec3(0, 0, 1),
+  vec3(0, 1, 1), vec3(1, 1, 1), vec3(1, 0, 1)
+);
+
+const vec2 TEX_CORNERS[36] = vec2[](
+  // down
+  vec2(1, 0), vec2(0, 0), vec2(1, 1), vec2(0, 0), vec2(0, 1), vec2(1, 1),
+  // up
+  vec2(0, 1), vec2(1, 0), vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1, 0),
+  // left
+  vec2(0, 0), vec2(0, 1), vec2(1, 0), vec2(1, 0), vec2(0, 1), vec2(1, 1),
+  // right
+  vec2(1, 0), vec2(0, 0), vec2(1, 1), vec2(0, 0), vec2(0, 1), vec2(1, 1),
+  // back
+  vec2(1, 0), vec2(0, 0), vec2(1, 1), vec2(0, 0), vec2(0, 1), vec2(1, 1),
+  // front
+  vec2(0, 1), vec2(1, 0), vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1, 0)
+);
+
+const vec3 NORMALS[6] = vec3[](
+  vec3(0, 1, 0), vec3(0, -1, 0), vec3(-1, 0, 0),
+  vec3(1, 0, 0), vec3(0, 0, -1), vec3(0, 0, 1)
+);
 
 void main() {
-    gl_Position = constants.mvp * vec4(inPosition, 1.0);
-    fragNormal = inNormal;
-    fragTexCoord = inTexCoord;
+    uint vertex = uint(gl_VertexIndex);
+    uint face = faces[vertex / 6u];
+    ivec3 block = ivec3(bitfieldExtract(face, 0, 7),
+                        bitfieldExtract(face, 7, 7),
+                        bitfieldExtract(face, 14, 7));
+    uint kind = bitfieldExtract(face, 21, 3);
+    uint blockIndex = bitfieldExtract(face, 24, 8);
+    uint corner = kind * 6u + vertex % 6u;
+
+    // a blank face, the room a mesh region has to spare. Its corners all go
+    // to one point beyond the far plane, so it's clipped away.
+    if (face == 0u) {
+        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+        return;
+    }
+
+    // the origin is the chunk at the corner of the faces' mesh region. It
+    // only has the low bits of the chunk's coordinates, so take the chunk
+    // with those bits that's nearest the center
+    uint origin = uint(gl_InstanceIndex);
+    ivec3 originBits = ivec3(
+        bitfieldExtract(origin, 0, ORIGIN_BITS.x),
+        bitfieldExtract(origin, ORIGIN_BITS.x, ORIGIN_BITS.y),
+        bitfieldExtract(origin, ORIGIN_BITS.x + ORIGIN_BITS.y, ORIGIN_BITS.z));
+    ivec3 range = ivec3(1) << ORIGIN_BITS;
+    ivec3 offset = (originBits - uniforms.centerChunk.xyz) & (range - 1);
+    offset -= range * ivec3(greaterThanEqual(offset, range / 2));
+    ivec3 chunk = uniforms.centerChunk.xyz + offset;
+
+    vec3 position = vec3(chunk * CHUNK_SIZE + block) + CORNERS[corner];
+    gl_Position = uniforms.mvp * vec4(position, 1.0);
+    fragNormal = NORMALS[kind];
+    // BLOCK_TEXTURE_LAYERS in src/block.h has a layer for each face of each
+    // block
+    fragTexCoord = TEX_CORNERS[corner];
+    fragTexLayer = blockIndex * 6u + kind;
 }
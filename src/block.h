@@ -33,9 +33,9 @@ const static BlockDef BLOCKS[] = {
 #define BLOCK_TEXTURE_ATLAS_LEN                                                \
   (BLOCK_TEXTURE_ATLAS_WIDTH * BLOCK_TEXTURE_ATLAS_HEIGHT * 4)
 
-// the size of the tile in normalized texture corodinates
-#define BLOCK_TILE_TEX_XSIZE ((float)(1.0/6))
-#define BLOCK_TILE_TEX_YSIZE (1.0f / ((float)sizeof(BLOCKS) / sizeof(BlockDef)))
+/// the number of layers in the block texture array, one per tile of the
+/// atlas. The tile of face f of block b is layer b * 6 + f
+#define BLOCK_TEXTURE_LAYERS (BLOCKS_LEN * 6)
 
 typedef enum {
   Block_DOWN,
@@ -0,0 +1,134 @@
+#include "buddy.h"
+
+#include <stdlib.h>
+
+// end of a free list
+#define BUDDY_NONE UINT32_MAX
+// set in pOrders for free runs
+#define BUDDY_FREE 0x80
+
+static void bud_pushFree(   //
+    BuddyAllocator *pBuddy, //
+    const uint32_t unit,    //
+    const uint32_t order    //
+) {
+  pBuddy->pOrders[unit] = (uint8_t)(order | BUDDY_FREE);
+  pBuddy->pPrev[unit] = BUDDY_NONE;
+  pBuddy->pNext[unit] = pBuddy->freeHeads[order];
+  if (pBuddy->freeHeads[order] != BUDDY_NONE) {
+    pBuddy->pPrev[pBuddy->freeHeads[order]] = unit;
+  }
+  pBuddy->freeHeads[order] = unit;
+}
+
+static void bud_removeFree( //
+    BuddyAllocator *pBuddy, //
+    const uint32_t unit,    //
+    const uint32_t order    //
+) {
+  uint32_t prev = pBuddy->pPrev[unit];
+  uint32_t next = pBuddy->pNext[unit];
+  if (prev == BUDDY_NONE) {
+    pBuddy->freeHeads[order] = next;
+  } else {
+    pBuddy->pNext[prev] = next;
+  }
+  if (next != BUDDY_NONE) {
+    pBuddy->pPrev[next] = prev;
+  }
+  pBuddy->pOrders[unit] = (uint8_t)order;
+}
+
+void new_BuddyAllocator(    //
+    BuddyAllocator *pBuddy, //
+    const uint32_t maxOrder //
+) {
+  uint32_t unitCount = 1u << maxOrder;
+  pBuddy->maxOrder = maxOrder;
+  pBuddy->freeUnits = unitCount;
+  pBuddy->pOrders = malloc(unitCount * sizeof(uint8_t));
+  pBuddy->pNext = malloc(unitCount * sizeof(uint32_t));
+  pBuddy->pPrev = malloc(unitCount * sizeof(uint32_t));
+  for (uint32_t order = 0; order < BUDDY_MAX_ORDERS; order++) {
+    pBuddy->freeHeads[order] = BUDDY_NONE;
+  }
+  bud_pushFree(pBuddy, 0, maxOrder);
+}
+
+void delete_BuddyAllocator( //
+    BuddyAllocator *pBuddy  //
+) {
+  free(pBuddy->pOrders);
+  free(pBuddy->pNext);
+  free(pBuddy->pPrev);
+}
+
+bool bud_alloc(              //
+    uint32_t *pUnit,         //
+    BuddyAllocator *pBuddy,  //
+    const uint32_t unitCount //
+) {
+  uint32_t order = 0;
+  while ((1u << order) < unitCount) {
+    order++;
+  }
+  if (order > pBuddy->maxOrder) {
+    return false;
+  }
+
+  // the smallest free run that's big enough
+  uint32_t found = order;
+  while (found <= pBuddy->maxOrder &&
+         pBuddy->freeHeads[found] == BUDDY_NONE) {
+    found++;
+  }
+  if (found > pBuddy->maxOrder) {
+    return false;
+  }
+
+  uint32_t unit = pBuddy->freeHeads[found];
+  bud_removeFree(pBuddy, unit, found);
+
+  // give back the upper halves until it's the right size
+  while (found > order) {
+    found--;
+    bud_pushFree(pBuddy, unit + (1u << found), found);
+  }
+
+  pBuddy->pOrders[unit] = (uint8_t)order;
+  pBuddy->freeUnits -= 1u << order;
+  *pUnit = unit;
+  return true;
+}
+
+void bud_free(              //
+    BuddyAllocator *pBuddy, //
+    const uint32_t unit     //
+) {
+  uint32_t order = pBuddy->pOrders[unit];
+  pBuddy->freeUnits += 1u << order;
+
+  // merge with the other half as long as it's free too
+  uint32_t head = unit;
+  while (order < pBuddy->maxOrder) {
+    uint32_t buddy = head ^ (1u << order);
+    if (pBuddy->pOrders[buddy] != (order | BUDDY_FREE)) {
+      break;
+    }
+    bud_removeFree(pBuddy, buddy, order);
+    head = head < buddy ? head : buddy;
+    order++;
+  }
+  bud_pushFree(pBuddy, head, order);
+}
+
+uint32_t bud_largestFree(        //
+    const BuddyAllocator *pBuddy //
+) {
+  for (uint32_t order = pBuddy->maxOrder + 1; order > 0; order--) {
+    if (pBuddy->freeHeads[order - 1] != BUDDY_NONE) {
+      return 1u << (order - 1);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef SRC_BUDDY_H_
+#define SRC_BUDDY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// the most orders a BuddyAllocator can have
+#define BUDDY_MAX_ORDERS 31
+
+/// BuddyAllocator
+/// ---------------------
+/// Hands out power of two sized runs of units from a range of
+/// 2^maxOrder units, splitting bigger runs in half when it runs out of the
+/// right size and merging freed runs back with their other half. Only keeps
+/// track of offsets, the caller decides what a unit is.
+typedef struct {
+  uint32_t maxOrder;
+  uint32_t freeUnits;
+  // for the first unit of each run, the run's order, with BUDDY_FREE set if
+  // it's free. Entries for other units are stale.
+  uint8_t *pOrders;
+  // links of the free lists, one per order, through the first unit of each
+  // free run
+  uint32_t *pNext;
+  uint32_t *pPrev;
+  uint32_t freeHeads[BUDDY_MAX_ORDERS];
+} BuddyAllocator;
+
+/// --- PRECONDITIONS ---
+/// * pBuddy is a valid pointer
+/// * maxOrder < BUDDY_MAX_ORDERS
+/// --- POSTCONDITIONS ---
+/// * pBuddy is a valid BuddyAllocator with all 2^maxOrder units free
+void new_BuddyAllocator(    //
+    BuddyAllocator *pBuddy, //
+    const uint32_t maxOrder //
+);
+
+/// --- PRECONDITIONS ---
+/// * pBuddy is valid
+/// --- POSTCONDITIONS ---
+/// * the memory held by pBuddy is released
+void delete_BuddyAllocator( //
+    BuddyAllocator *pBuddy  //
+);
+
+/// allocates a run of at least unitCount units
+/// --- PRECONDITIONS ---
+/// * pBuddy is valid
+/// * unitCount > 0
+/// --- POSTCONDITIONS ---
+/// * if there's room, returns true and sets *pUnit to the first unit of the
+///   run, which is unitCount rounded up to a power of two long
+/// * otherwise returns false
+bool bud_alloc(              //
+    uint32_t *pUnit,         //
+    BuddyAllocator *pBuddy,  //
+    const uint32_t unitCount //
+);
+
+/// frees a run
+/// --- PRECONDITIONS ---
+/// * pBuddy is valid
+/// * unit was returned by bud_alloc and hasn't been freed since
+void bud_free(              //
+    BuddyAllocator *pBuddy, //
+    const uint32_t unit     //
+);
+
+/// returns the length in units of the longest run bud_alloc could return
+uint32_t bud_largestFree(        //
+    const BuddyAllocator *pBuddy //
+);
+
+#endif // SRC_BUDDY_H_
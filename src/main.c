@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <vulkan/vulkan.h>
 #define GLFW_INCLUDE_VULKAN
@@ -21,8 +22,34 @@
 #define WINDOW_HEIGHT 500
 #define WINDOW_WIDTH 500
 #define MAX_FRAMES_IN_FLIGHT 2
+// how many draws the indirect buffers have room for at first
+#define INITIAL_INDIRECT_CAPACITY 512
+// how many vertex pool blocks the GPU culling has room for at first
+#define INITIAL_CULL_BLOCK_CAPACITY 4
+// how many vertex pool blocks each frame has command buffers for at first
+#define INITIAL_BLOCK_CAPACITY 4
+// compiled by make. Without it, draws are culled on the CPU.
+#define CULL_SHADER_PATH "assets/shaders/cull.comp.spv"
+// whether to draw everything's depth before shading any of it, so that only
+// the nearest fragments get shaded. Worth it when a lot of faces are drawn
+// behind each other, like in caves and forests.
+#define DEPTH_PREPASS false
+// where compiled pipelines are kept between runs
+#define PIPELINE_CACHE_PATH "pipeline_cache.bin"
 
 // contins state associated with the vulkan instance
+// what a block's command buffer was recorded with. It's only recorded again
+// when that changes.
+typedef struct {
+  // false if it has to be recorded again regardless
+  bool recorded;
+  // the buffer the block's face descriptor set points at
+  VkBuffer faceBuffer;
+  // where its draws are in the indirect buffer
+  VkDeviceSize commandOffset;
+  uint32_t commandCount;
+} BlockRecord;
+
 typedef struct {
   VkInstance instance;
   VkDebugUtilsMessengerEXT callback;
@@ -41,24 +68,387 @@ typedef struct {
   VkShaderModule fragShaderModule;
   VkShaderModule vertShaderModule;
   VkRenderPass renderPass;
+  // loaded from PIPELINE_CACHE_PATH, and saved back to it on exit
+  VkPipelineCache pipelineCache;
   VkPipelineLayout graphicsPipelineLayout;
   VkDescriptorSetLayout graphicsDescriptorSetLayout;
+  VkDescriptorSetLayout faceDescriptorSetLayout;
+  // the viewport is dynamic, so these don't depend on the window's size.
+  // depthPrepassPipeline is VK_NULL_HANDLE without the depth prepass.
+  VkPipeline graphicsPipeline;
+  VkPipeline depthPrepassPipeline;
   // descriptor pool stuff
   VkDescriptorPool graphicsDescriptorPool;
-  VkDescriptorSet graphicsDescriptorSet;
+  VkDescriptorSet pGraphicsDescriptorSets[MAX_FRAMES_IN_FLIGHT];
+  // the uniforms of each frame in flight. They stay mapped, and are written
+  // every frame.
+  VkBuffer pUniformBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pUniformBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  VertexDisplayUniforms *ppUniforms[MAX_FRAMES_IN_FLIGHT];
+  // each frame in flight draws each vertex pool block with a secondary
+  // command buffer that pulls the block's faces through a face descriptor
+  // set. Both are kept from frame to frame, and only recorded or pointed at
+  // the block again when pBlockRecords says something changed. There's room
+  // for blockCapacity blocks, those of frame f start at f * blockCapacity.
+  uint32_t blockCapacity;
+  VkDescriptorPool faceDescriptorPool;
+  VkDescriptorSet *pFaceDescriptorSets;
+  VkCommandBuffer *pBlockCommandBuffers;
+  BlockRecord *pBlockRecords;
+  // with the depth prepass, each block also has a command buffer that draws
+  // its depth, recorded along with the other one. NULL without it.
+  bool depthPrepass;
+  VkCommandBuffer *pPrepassCommandBuffers;
+  // the vertex pool's block generation when each frame in flight last
+  // looked at the blocks
+  uint64_t pBlockGenerations[MAX_FRAMES_IN_FLIGHT];
+  // the block command buffers the frame being recorded runs, and their
+  // prepass command buffers
+  VkCommandBuffer *pExecutedCommandBuffers;
+  VkCommandBuffer *pExecutedPrepassCommandBuffers;
   VkImage textureAtlasImage;
   VkDeviceMemory textureAtlasImageMemory;
   VkImageView textureAtlasImageView;
   VkSampler textureAtlasSampler;
   VkCommandBuffer pVertexDisplayCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+  // whether one indirect draw can hold many draw commands
+  bool multiDrawIndirect;
+  // whether draws are culled on the GPU, by assets/shaders/cull.comp,
+  // instead of by wld_getDrawList
+  bool gpuCulling;
+  // the draw commands of each frame in flight, when culling on the CPU. They
+  // stay mapped, and grow when a frame has more draws than fit.
+  VkBuffer pIndirectBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pIndirectBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  VkDrawIndirectCommand *ppIndirectCommands[MAX_FRAMES_IN_FLIGHT];
+  uint32_t pIndirectCapacities[MAX_FRAMES_IN_FLIGHT];
+  // when culling on the GPU: the culling pipeline, and a descriptor set for
+  // each frame in flight
+  VkShaderModule cullShaderModule;
+  VkPipelineLayout cullPipelineLayout;
+  VkDescriptorSetLayout cullDescriptorSetLayout;
+  VkPipeline cullPipeline;
+  VkDescriptorPool cullDescriptorPool;
+  VkDescriptorSet pCullDescriptorSets[MAX_FRAMES_IN_FLIGHT];
+  // the GPU's copy of the draw list, with room for cullDrawCapacity draws.
+  // It's only sent what changed, and resent from scratch if resendDraws.
+  uint32_t cullDrawCapacity;
+  VkBuffer drawRecordBuffer;
+  VkDeviceMemory drawRecordBufferMemory;
+  bool resendDraws;
+  // where each frame in flight stages the records it sends, packed together
+  // by stageCullDrawRecords. They stay mapped. The copies into the draw list
+  // are worked out in pRecordCopies, which any frame can use while recording.
+  VkBuffer pRecordStagingBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pRecordStagingBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  void *ppRecordStaging[MAX_FRAMES_IN_FLIGHT];
+  VkBufferCopy *pRecordCopies;
+  // the commands each frame in flight culls the draw list into. There's a
+  // run of cullDrawCapacity of them for each of cullBlockCapacity vertex
+  // pool blocks.
+  uint32_t cullBlockCapacity;
+  VkBuffer pCulledDrawBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pCulledDrawBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  // how many commands each frame in flight culled into each block. They stay
+  // mapped, to be read back once the frame is done.
+  VkBuffer pDrawCountBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pDrawCountBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  uint32_t *ppDrawCounts[MAX_FRAMES_IN_FLIGHT];
+  // where each chunk of draws puts its commands in each block, which only
+  // the culling uses
+  VkBuffer pCullOffsetBuffers[MAX_FRAMES_IN_FLIGHT];
+  VkDeviceMemory pCullOffsetBufferMemories[MAX_FRAMES_IN_FLIGHT];
+  // the number of draws in the last frame that finished recording or, when
+  // culling on the GPU, the last frame that finished drawing
+  uint32_t drawnCount;
   VkSemaphore pImageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
   VkSemaphore pRenderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
   VkFence pInFlightFences[MAX_FRAMES_IN_FLIGHT];
   // this number counts which frame we're on
   // up to MAX_FRAMES_IN_FLIGHT, at whcich points it resets to 0
   uint32_t currentFrame;
+  // the number of frames submitted so far
+  uint64_t frameNumber;
 } AppGraphicsGlobalState;
 
+// creates the indirect buffer of a frame in flight, with room for capacity
+// draws
+static void new_IndirectBuffer(      //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t frame,            //
+    const uint32_t capacity          //
+) {
+  VkDeviceSize size = capacity * sizeof(VkDrawIndirectCommand);
+  ErrVal result = new_Buffer_DeviceMemory(
+      &pGlobal->pIndirectBuffers[frame],
+      &pGlobal->pIndirectBufferMemories[frame], size, pGlobal->physicalDevice,
+      pGlobal->device, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create indirect buffer");
+    PANIC();
+  }
+  void *pMapped;
+  VkResult mapResult =
+      vkMapMemory(pGlobal->device, pGlobal->pIndirectBufferMemories[frame], 0,
+                  size, 0, &pMapped);
+  if (mapResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to map indirect buffer: %s",
+                   vkstrerror(mapResult));
+    PANIC();
+  }
+  pGlobal->ppIndirectCommands[frame] = pMapped;
+  pGlobal->pIndirectCapacities[frame] = capacity;
+}
+
+static void delete_IndirectBuffer(   //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t frame             //
+) {
+  vkUnmapMemory(pGlobal->device, pGlobal->pIndirectBufferMemories[frame]);
+  delete_Buffer(&pGlobal->pIndirectBuffers[frame], pGlobal->device);
+  delete_DeviceMemory(&pGlobal->pIndirectBufferMemories[frame],
+                      pGlobal->device);
+}
+
+// creates the uniform buffer of a frame in flight, and maps it
+static void new_UniformBuffer(       //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t frame             //
+) {
+  VkDeviceSize size = sizeof(VertexDisplayUniforms);
+  ErrVal result = new_Buffer_DeviceMemory(
+      &pGlobal->pUniformBuffers[frame],
+      &pGlobal->pUniformBufferMemories[frame], size, pGlobal->physicalDevice,
+      pGlobal->device, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create uniform buffer");
+    PANIC();
+  }
+  void *pMapped;
+  VkResult mapResult =
+      vkMapMemory(pGlobal->device, pGlobal->pUniformBufferMemories[frame], 0,
+                  size, 0, &pMapped);
+  if (mapResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to map uniform buffer: %s",
+                   vkstrerror(mapResult));
+    PANIC();
+  }
+  pGlobal->ppUniforms[frame] = pMapped;
+}
+
+static void delete_UniformBuffer(    //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t frame             //
+) {
+  vkUnmapMemory(pGlobal->device, pGlobal->pUniformBufferMemories[frame]);
+  delete_Buffer(&pGlobal->pUniformBuffers[frame], pGlobal->device);
+  delete_DeviceMemory(&pGlobal->pUniformBufferMemories[frame],
+                      pGlobal->device);
+}
+
+// creates the face descriptor sets and command buffers of the blocks, with
+// room for capacity vertex pool blocks. None of them are recorded yet.
+static void new_Blocks(              //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t capacity          //
+) {
+  const uint32_t count = MAX_FRAMES_IN_FLIGHT * capacity;
+  pGlobal->pFaceDescriptorSets = malloc(count * sizeof(VkDescriptorSet));
+  new_StorageDescriptorPoolAndSets(
+      &pGlobal->faceDescriptorPool, pGlobal->pFaceDescriptorSets, count, 1,
+      pGlobal->faceDescriptorSetLayout, pGlobal->device);
+  pGlobal->pBlockCommandBuffers = malloc(count * sizeof(VkCommandBuffer));
+  new_SecondaryCommandBuffers(pGlobal->pBlockCommandBuffers, count,
+                              pGlobal->commandPool, pGlobal->device);
+  pGlobal->pBlockRecords = malloc(count * sizeof(BlockRecord));
+  for (uint32_t i = 0; i < count; i++) {
+    pGlobal->pBlockRecords[i] = (BlockRecord){
+        .recorded = false,
+        .faceBuffer = VK_NULL_HANDLE,
+    };
+  }
+  pGlobal->pExecutedCommandBuffers =
+      malloc(capacity * sizeof(VkCommandBuffer));
+  pGlobal->pPrepassCommandBuffers = NULL;
+  pGlobal->pExecutedPrepassCommandBuffers = NULL;
+  if (pGlobal->depthPrepass) {
+    pGlobal->pPrepassCommandBuffers = malloc(count * sizeof(VkCommandBuffer));
+    new_SecondaryCommandBuffers(pGlobal->pPrepassCommandBuffers, count,
+                                pGlobal->commandPool, pGlobal->device);
+    pGlobal->pExecutedPrepassCommandBuffers =
+        malloc(capacity * sizeof(VkCommandBuffer));
+  }
+  pGlobal->blockCapacity = capacity;
+}
+
+// the GPU must be done with the blocks
+static void delete_Blocks(          //
+    AppGraphicsGlobalState *pGlobal //
+) {
+  const uint32_t count = MAX_FRAMES_IN_FLIGHT * pGlobal->blockCapacity;
+  delete_CommandBuffers(pGlobal->pBlockCommandBuffers, count,
+                        pGlobal->commandPool, pGlobal->device);
+  delete_DescriptorPool(&pGlobal->faceDescriptorPool, pGlobal->device);
+  free(pGlobal->pFaceDescriptorSets);
+  free(pGlobal->pBlockCommandBuffers);
+  free(pGlobal->pBlockRecords);
+  free(pGlobal->pExecutedCommandBuffers);
+  if (pGlobal->depthPrepass) {
+    delete_CommandBuffers(pGlobal->pPrepassCommandBuffers, count,
+                          pGlobal->commandPool, pGlobal->device);
+    free(pGlobal->pPrepassCommandBuffers);
+    free(pGlobal->pExecutedPrepassCommandBuffers);
+  }
+}
+
+// makes a frame record all of its blocks' command buffers again, for when
+// something they use has been replaced
+static void invalidateBlocks(        //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t frame             //
+) {
+  BlockRecord *pRecords =
+      &pGlobal->pBlockRecords[frame * pGlobal->blockCapacity];
+  for (uint32_t i = 0; i < pGlobal->blockCapacity; i++) {
+    pRecords[i].recorded = false;
+  }
+}
+
+// creates a buffer for culling on the GPU, panicking if it can't
+static void new_CullBuffer(                //
+    VkBuffer *pBuffer,                     //
+    VkDeviceMemory *pBufferMemory,         //
+    const AppGraphicsGlobalState *pGlobal, //
+    const VkDeviceSize size,               //
+    const VkBufferUsageFlags usage,        //
+    const VkMemoryPropertyFlags properties //
+) {
+  ErrVal result =
+      new_Buffer_DeviceMemory(pBuffer, pBufferMemory, size,
+                              pGlobal->physicalDevice, pGlobal->device,
+                              VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | usage,
+                              properties);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create culling buffer");
+    PANIC();
+  }
+}
+
+// creates the buffers for culling on the GPU, with room for drawCapacity
+// draws in each of blockCapacity vertex pool blocks
+static void new_CullBuffers(         //
+    AppGraphicsGlobalState *pGlobal, //
+    const uint32_t drawCapacity,     //
+    const uint32_t blockCapacity     //
+) {
+  new_CullBuffer(&pGlobal->drawRecordBuffer, &pGlobal->drawRecordBufferMemory,
+                 pGlobal, drawCapacity * sizeof(CullDrawRecord),
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  // no more records change in a frame than there are draws
+  pGlobal->pRecordCopies = malloc(drawCapacity * sizeof(VkBufferCopy));
+  if (pGlobal->pRecordCopies == NULL) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to allocate draw record copies");
+    PANIC();
+  }
+
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    VkDeviceSize stagingSize = drawCapacity * sizeof(CullDrawRecord);
+    new_CullBuffer(&pGlobal->pRecordStagingBuffers[i],
+                   &pGlobal->pRecordStagingBufferMemories[i], pGlobal,
+                   stagingSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    VkResult stagingMapResult = vkMapMemory(
+        pGlobal->device, pGlobal->pRecordStagingBufferMemories[i], 0,
+        stagingSize, 0, &pGlobal->ppRecordStaging[i]);
+    if (stagingMapResult != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                     "failed to map draw record staging buffer: %s",
+                     vkstrerror(stagingMapResult));
+      PANIC();
+    }
+
+    new_CullBuffer(&pGlobal->pCulledDrawBuffers[i],
+                   &pGlobal->pCulledDrawBufferMemories[i], pGlobal,
+                   (VkDeviceSize)blockCapacity * drawCapacity *
+                       sizeof(VkDrawIndirectCommand),
+                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    VkDeviceSize countSize = blockCapacity * sizeof(uint32_t);
+    new_CullBuffer(&pGlobal->pDrawCountBuffers[i],
+                   &pGlobal->pDrawCountBufferMemories[i], pGlobal, countSize,
+                   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    void *pMapped;
+    VkResult mapResult =
+        vkMapMemory(pGlobal->device, pGlobal->pDrawCountBufferMemories[i], 0,
+                    countSize, 0, &pMapped);
+    if (mapResult != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to map draw count buffer: %s",
+                     vkstrerror(mapResult));
+      PANIC();
+    }
+    // nothing's been drawn with them yet
+    memset(pMapped, 0, (size_t)countSize);
+    pGlobal->ppDrawCounts[i] = pMapped;
+
+    uint32_t chunkCapacity =
+        (drawCapacity + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+    new_CullBuffer(&pGlobal->pCullOffsetBuffers[i],
+                   &pGlobal->pCullOffsetBufferMemories[i], pGlobal,
+                   (VkDeviceSize)blockCapacity * chunkCapacity *
+                       sizeof(uint32_t),
+                   0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    updateCullDescriptorSet(
+        pGlobal->pCullDescriptorSets[i], pGlobal->device,
+        pGlobal->drawRecordBuffer, pGlobal->pCulledDrawBuffers[i],
+        pGlobal->pDrawCountBuffers[i], pGlobal->pCullOffsetBuffers[i]);
+  }
+
+  pGlobal->cullDrawCapacity = drawCapacity;
+  pGlobal->cullBlockCapacity = blockCapacity;
+  // the new copy of the draw list starts out empty
+  pGlobal->resendDraws = true;
+  // and the blocks draw from the new buffers
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    invalidateBlocks(pGlobal, i);
+  }
+}
+
+// the GPU must be done with the buffers
+static void delete_CullBuffers(     //
+    AppGraphicsGlobalState *pGlobal //
+) {
+  delete_Buffer(&pGlobal->drawRecordBuffer, pGlobal->device);
+  delete_DeviceMemory(&pGlobal->drawRecordBufferMemory, pGlobal->device);
+  free(pGlobal->pRecordCopies);
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    vkUnmapMemory(pGlobal->device, pGlobal->pRecordStagingBufferMemories[i]);
+    delete_Buffer(&pGlobal->pRecordStagingBuffers[i], pGlobal->device);
+    delete_DeviceMemory(&pGlobal->pRecordStagingBufferMemories[i],
+                        pGlobal->device);
+    delete_Buffer(&pGlobal->pCulledDrawBuffers[i], pGlobal->device);
+    delete_DeviceMemory(&pGlobal->pCulledDrawBufferMemories[i],
+                        pGlobal->device);
+    vkUnmapMemory(pGlobal->device, pGlobal->pDrawCountBufferMemories[i]);
+    delete_Buffer(&pGlobal->pDrawCountBuffers[i], pGlobal->device);
+    delete_DeviceMemory(&pGlobal->pDrawCountBufferMemories[i],
+                        pGlobal->device);
+    delete_Buffer(&pGlobal->pCullOffsetBuffers[i], pGlobal->device);
+    delete_DeviceMemory(&pGlobal->pCullOffsetBufferMemories[i],
+                        pGlobal->device);
+  }
+}
+
 static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
   glfwInit();
 
@@ -87,9 +477,10 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
 
   /* find queues on graphics pGlobal->device */
   {
+    // the graphics queue also runs the culling compute shader
     uint32_t ret1 = getQueueFamilyIndexByCapability(
         &pGlobal->graphicsIndex, &pGlobal->graphicsQueueCount,
-        pGlobal->physicalDevice, VK_QUEUE_GRAPHICS_BIT);
+        pGlobal->physicalDevice, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
     uint32_t ret3 = getPresentQueueFamilyIndex(
         &pGlobal->presentIndex, pGlobal->physicalDevice, pGlobal->surface);
     /* Panic if indices are unavailable */
@@ -103,10 +494,11 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
   const uint32_t deviceExtensionCount = 1;
   const char *ppDeviceExtensionNames[] = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
-  // create pGlobal->device
+  // create pGlobal->device. The world's uploads overwrite faces earlier
+  // frames draw, so they go on the graphics queue too, after those frames.
   new_Device(&pGlobal->device, pGlobal->physicalDevice, pGlobal->graphicsIndex,
-             pGlobal->graphicsQueueCount, deviceExtensionCount,
-             ppDeviceExtensionNames);
+             pGlobal->graphicsQueueCount, pGlobal->graphicsIndex,
+             deviceExtensionCount, ppDeviceExtensionNames);
 
   // create queues
   getQueue(&pGlobal->graphicsQueue, pGlobal->device, pGlobal->graphicsIndex, 0);
@@ -140,7 +532,8 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
     free(vertShaderFileContents);
   }
 
-  // create texture and samplers
+  // create texture and samplers, the atlas's tiles are uploaded as the
+  // layers of an image array
   uint8_t textureAtlasData[BLOCK_TEXTURE_ATLAS_LEN];
   block_buildTextureAtlas(textureAtlasData, "assets/blocks");
 
@@ -150,6 +543,7 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
       textureAtlasData,                                  //
       (VkExtent2D){.height = BLOCK_TEXTURE_ATLAS_HEIGHT, //
                    .width = BLOCK_TEXTURE_ATLAS_WIDTH},  //
+      BLOCK_TEXTURE_SIZE,                                //
       pGlobal->device,                                   //
       pGlobal->physicalDevice,                           //
       pGlobal->commandPool,                              //
@@ -157,7 +551,8 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
   );
   new_TextureImageView(&pGlobal->textureAtlasImageView,
                        pGlobal->textureAtlasImage, pGlobal->device);
-  new_TextureSampler(&pGlobal->textureAtlasSampler, pGlobal->device);
+  new_TextureSampler(&pGlobal->textureAtlasSampler, pGlobal->device,
+                     pGlobal->physicalDevice);
 
   // Create graphics pipeline layout
   new_VertexDisplayRenderPass(&pGlobal->renderPass, pGlobal->device,
@@ -165,21 +560,91 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
 
   new_VertexDisplayPipelineLayoutDescriptorSetLayout(
       &pGlobal->graphicsPipelineLayout, &pGlobal->graphicsDescriptorSetLayout,
-      pGlobal->device);
+      &pGlobal->faceDescriptorSetLayout, pGlobal->device);
+
+  // create the pipelines, from the last run's cache if there's one
+  new_PipelineCache(&pGlobal->pipelineCache, PIPELINE_CACHE_PATH,
+                    pGlobal->physicalDevice, pGlobal->device);
+  pGlobal->depthPrepass = DEPTH_PREPASS;
+  new_VertexDisplayPipeline(
+      &pGlobal->graphicsPipeline, pGlobal->device, pGlobal->vertShaderModule,
+      pGlobal->fragShaderModule, pGlobal->renderPass,
+      pGlobal->graphicsPipelineLayout, pGlobal->pipelineCache,
+      pGlobal->depthPrepass);
+  pGlobal->depthPrepassPipeline = VK_NULL_HANDLE;
+  if (pGlobal->depthPrepass) {
+    new_DepthPrepassPipeline(&pGlobal->depthPrepassPipeline, pGlobal->device,
+                             pGlobal->vertShaderModule, pGlobal->renderPass,
+                             pGlobal->graphicsPipelineLayout,
+                             pGlobal->pipelineCache);
+  }
 
-  // create descriptor set using the texture and the descriptor set layout
-  new_VertexDisplayDescriptorPoolAndSet(    //
+  // create a descriptor set for each frame in flight using the texture, the
+  // frame's uniforms and the descriptor set layout
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    new_UniformBuffer(pGlobal, i);
+  }
+  new_VertexDisplayDescriptorPoolAndSets(   //
       &pGlobal->graphicsDescriptorPool,     //
-      &pGlobal->graphicsDescriptorSet,      //
+      pGlobal->pGraphicsDescriptorSets,     //
+      MAX_FRAMES_IN_FLIGHT,                 //
       pGlobal->graphicsDescriptorSetLayout, //
       pGlobal->device,                      //
       pGlobal->textureAtlasSampler,         //
-      pGlobal->textureAtlasImageView        //
+      pGlobal->textureAtlasImageView,       //
+      pGlobal->pUniformBuffers              //
   );
 
   new_CommandBuffers(pGlobal->pVertexDisplayCommandBuffers,
                      MAX_FRAMES_IN_FLIGHT, pGlobal->commandPool,
                      pGlobal->device);
+  new_Blocks(pGlobal, INITIAL_BLOCK_CAPACITY);
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    pGlobal->pBlockGenerations[i] = 0;
+  }
+
+  // new_Device turned these on if they're supported
+  VkPhysicalDeviceFeatures features;
+  vkGetPhysicalDeviceFeatures(pGlobal->physicalDevice, &features);
+  pGlobal->multiDrawIndirect = features.multiDrawIndirect;
+  bool drawIndirectCount = getDrawIndirectCountSupport(pGlobal->physicalDevice);
+
+  // cull on the GPU if it can draw what the culling shader left, and the
+  // shader has been compiled
+  pGlobal->gpuCulling = pGlobal->multiDrawIndirect && drawIndirectCount;
+  if (pGlobal->gpuCulling && access(CULL_SHADER_PATH, R_OK) != 0) {
+    LOG_ERROR(ERR_LEVEL_WARN,
+              "no " CULL_SHADER_PATH ", culling draws on the CPU instead");
+    pGlobal->gpuCulling = false;
+  }
+
+  if (pGlobal->gpuCulling) {
+    uint32_t *cullShaderFileContents;
+    uint32_t cullShaderFileLength;
+    readShaderFile(CULL_SHADER_PATH, &cullShaderFileLength,
+                   &cullShaderFileContents);
+    new_ShaderModule(&pGlobal->cullShaderModule, pGlobal->device,
+                     cullShaderFileLength, cullShaderFileContents);
+    free(cullShaderFileContents);
+
+    new_CullPipelineLayoutDescriptorSetLayout(
+        &pGlobal->cullPipelineLayout, &pGlobal->cullDescriptorSetLayout,
+        pGlobal->device);
+    new_CullPipeline(&pGlobal->cullPipeline, pGlobal->device,
+                     pGlobal->cullShaderModule, pGlobal->cullPipelineLayout,
+                     pGlobal->pipelineCache);
+    new_StorageDescriptorPoolAndSets(
+        &pGlobal->cullDescriptorPool, pGlobal->pCullDescriptorSets,
+        MAX_FRAMES_IN_FLIGHT, CULL_BINDING_COUNT,
+        pGlobal->cullDescriptorSetLayout, pGlobal->device);
+    new_CullBuffers(pGlobal, INITIAL_INDIRECT_CAPACITY,
+                    INITIAL_CULL_BLOCK_CAPACITY);
+  } else {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      new_IndirectBuffer(pGlobal, i, INITIAL_INDIRECT_CAPACITY);
+    }
+  }
+  pGlobal->drawnCount = 0;
 
   // Create image synchronization primitives
   new_Semaphores(pGlobal->pImageAvailableSemaphores, MAX_FRAMES_IN_FLIGHT,
@@ -191,12 +656,17 @@ static void new_AppGraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
              true);
   // set current frame to 0
   pGlobal->currentFrame = 0;
+  pGlobal->frameNumber = 0;
 }
 
 static void delete_GraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
   vkDeviceWaitIdle(pGlobal->device);
 
+  delete_Blocks(pGlobal);
   delete_DescriptorPool(&pGlobal->graphicsDescriptorPool, pGlobal->device);
+  for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    delete_UniformBuffer(pGlobal, i);
+  }
   delete_TextureSampler(&pGlobal->textureAtlasSampler, pGlobal->device);
   delete_ImageView(&pGlobal->textureAtlasImageView, pGlobal->device);
   delete_Image(&pGlobal->textureAtlasImage, pGlobal->device);
@@ -212,14 +682,35 @@ static void delete_GraphicsGlobalState(AppGraphicsGlobalState *pGlobal) {
   delete_Semaphores(pGlobal->pImageAvailableSemaphores, MAX_FRAMES_IN_FLIGHT,
                     pGlobal->device);
 
+  if (pGlobal->gpuCulling) {
+    delete_CullBuffers(pGlobal);
+    delete_DescriptorPool(&pGlobal->cullDescriptorPool, pGlobal->device);
+    delete_Pipeline(&pGlobal->cullPipeline, pGlobal->device);
+    delete_CullPipelineLayoutDescriptorSetLayout(
+        &pGlobal->cullPipelineLayout, &pGlobal->cullDescriptorSetLayout,
+        pGlobal->device);
+    delete_ShaderModule(&pGlobal->cullShaderModule, pGlobal->device);
+  } else {
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      delete_IndirectBuffer(pGlobal, i);
+    }
+  }
   delete_CommandBuffers(pGlobal->pVertexDisplayCommandBuffers,
                         MAX_FRAMES_IN_FLIGHT, pGlobal->commandPool,
                         pGlobal->device);
   delete_CommandPool(&pGlobal->commandPool, pGlobal->device);
 
+  delete_Pipeline(&pGlobal->graphicsPipeline, pGlobal->device);
+  if (pGlobal->depthPrepassPipeline != VK_NULL_HANDLE) {
+    delete_Pipeline(&pGlobal->depthPrepassPipeline, pGlobal->device);
+  }
+  // the next run starts from every pipeline this one compiled
+  savePipelineCache(pGlobal->pipelineCache, PIPELINE_CACHE_PATH,
+                    pGlobal->physicalDevice, pGlobal->device);
+  delete_PipelineCache(&pGlobal->pipelineCache, pGlobal->device);
   delete_VertexDisplayPipelineLayoutDescriptorSetLayout(
       &pGlobal->graphicsPipelineLayout, &pGlobal->graphicsDescriptorSetLayout,
-      pGlobal->device);
+      &pGlobal->faceDescriptorSetLayout, pGlobal->device);
   delete_RenderPass(&pGlobal->renderPass, pGlobal->device);
   delete_Device(&pGlobal->device);
   delete_Surface(&pGlobal->surface, pGlobal->instance);
@@ -238,7 +729,6 @@ typedef struct {
   VkImage depthImage;
   VkImageView depthImageView;
   VkFramebuffer *pSwapchainFramebuffers;
-  VkPipeline graphicsPipeline;
   VkExtent2D swapchainExtent;
 } AppGraphicsWindowState;
 
@@ -292,12 +782,6 @@ static void new_AppGraphicsWindowState(    //
       swapchainExtent, pWindow->swapchainImageCount, pWindow->depthImageView,
       pWindow->pSwapchainImageViews);
 
-  // create pipeline
-  new_VertexDisplayPipeline(
-      &pWindow->graphicsPipeline, pGlobal->device, pGlobal->vertShaderModule,
-      pGlobal->fragShaderModule, swapchainExtent, pGlobal->renderPass,
-      pGlobal->graphicsPipelineLayout);
-
   // remember swapchain extent
   pWindow->swapchainExtent = swapchainExtent;
 }
@@ -324,9 +808,79 @@ delete_AppGraphicsWindowState(AppGraphicsWindowState *pWindow,
   delete_ImageView(&pWindow->depthImageView, pGlobal->device);
   delete_Image(&pWindow->depthImage, pGlobal->device);
   delete_DeviceMemory(&pWindow->depthImageMemory, pGlobal->device);
+}
 
-  // delete pipeline
-  delete_Pipeline(&pWindow->graphicsPipeline, pGlobal->device);
+// records the draws of a block of a frame into the command buffer with the
+// pipeline
+static void recordBlock(                   //
+    const AppGraphicsWindowState *pWindow, //
+    AppGraphicsGlobalState *pGlobal,       //
+    VkCommandBuffer commandBuffer,         //
+    const VkPipeline pipeline,             //
+    const uint32_t frame,                  //
+    const uint32_t i,                      //
+    const VkBuffer indirectBuffer,         //
+    const VkDeviceSize commandOffset,      //
+    const uint32_t commandCount,           //
+    const VkBuffer countBuffer,            //
+    const VkDeviceSize countOffset         //
+) {
+  recordBlockCommands(                         //
+      commandBuffer,                           //
+      pGlobal->renderPass,                     //
+      pWindow->swapchainExtent,                //
+      pGlobal->graphicsPipelineLayout,         //
+      pipeline,                                //
+      pGlobal->pGraphicsDescriptorSets[frame], //
+      pGlobal->pFaceDescriptorSets[i],         //
+      indirectBuffer,                          //
+      commandOffset,                           //
+      commandCount,                            //
+      countBuffer,                             //
+      countOffset,                             //
+      pGlobal->multiDrawIndirect               //
+  );
+}
+
+// adds the command buffers that draw a block of a frame to the ones it runs,
+// recording them again if they were recorded to draw something else. The last
+// frame to use them must be done.
+static void executeBlock(                  //
+    const AppGraphicsWindowState *pWindow, //
+    AppGraphicsGlobalState *pGlobal,       //
+    uint32_t *pExecutedCount,              //
+    const uint32_t frame,                  //
+    const uint32_t block,                  //
+    const VkBuffer indirectBuffer,         //
+    const VkDeviceSize commandOffset,      //
+    const uint32_t commandCount,           //
+    const VkBuffer countBuffer,            //
+    const VkDeviceSize countOffset         //
+) {
+  const uint32_t i = frame * pGlobal->blockCapacity + block;
+  BlockRecord *pRecord = &pGlobal->pBlockRecords[i];
+  if (!pRecord->recorded || pRecord->commandOffset != commandOffset ||
+      pRecord->commandCount != commandCount) {
+    recordBlock(pWindow, pGlobal, pGlobal->pBlockCommandBuffers[i],
+                pGlobal->graphicsPipeline, frame, i, indirectBuffer,
+                commandOffset, commandCount, countBuffer, countOffset);
+    if (pGlobal->depthPrepass) {
+      recordBlock(pWindow, pGlobal, pGlobal->pPrepassCommandBuffers[i],
+                  pGlobal->depthPrepassPipeline, frame, i, indirectBuffer,
+                  commandOffset, commandCount, countBuffer, countOffset);
+    }
+    pRecord->recorded = true;
+    pRecord->commandOffset = commandOffset;
+    pRecord->commandCount = commandCount;
+  }
+
+  const uint32_t executed = (*pExecutedCount)++;
+  pGlobal->pExecutedCommandBuffers[executed] =
+      pGlobal->pBlockCommandBuffers[i];
+  if (pGlobal->depthPrepass) {
+    pGlobal->pExecutedPrepassCommandBuffers[executed] =
+        pGlobal->pPrepassCommandBuffers[i];
+  }
 }
 
 static void drawAppFrame(            //
@@ -339,6 +893,15 @@ static void drawAppFrame(            //
   waitAndResetFence(pGlobal->pInFlightFences[pGlobal->currentFrame],
                     pGlobal->device);
 
+  // the last frame to use this fence is done, and the frames before it were
+  // submitted before it, so they're done too. Free what only they used.
+  if (pGlobal->frameNumber >= MAX_FRAMES_IN_FLIGHT) {
+    wld_clearGarbage(pWs, pGlobal->frameNumber - MAX_FRAMES_IN_FLIGHT + 1);
+  }
+
+  // submit this frame's uploads, the frame waits for them before drawing
+  VkSemaphore uploadSemaphore = wld_flushUploads(pWs);
+
   // the imageIndex is the index of the swapchain framebuffer that is
   // available next
   uint32_t imageIndex;
@@ -361,6 +924,10 @@ static void drawAppFrame(            //
     // destroy and recreate window dependent data
     delete_AppGraphicsWindowState(pWindow, pGlobal);
     new_AppGraphicsWindowState(pWindow, pGlobal, swapchainExtent);
+    // the blocks set the old viewport
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+      invalidateBlocks(pGlobal, i);
+    }
 
     // finally we can retry getting the swapchain
     getNextSwapchainImage(
@@ -368,41 +935,183 @@ static void drawAppFrame(            //
         pGlobal->pImageAvailableSemaphores[pGlobal->currentFrame]);
   }
 
-  uint32_t vertexBufferCount;
-  wld_count_vertexBuffers(&vertexBufferCount, pWs);
+  uint32_t frame = pGlobal->currentFrame;
+
+  // the last frame to use this frame's uniforms is done, so they can be
+  // written. Chunk origins are packed into a few bits, which the vertex
+  // shader unwraps around the center chunk.
+  VertexDisplayUniforms uniforms;
+  getMvpCamera(uniforms.mvp, pCamera);
+  uniforms.centerChunk[0] = pWs->centerLoc[0];
+  uniforms.centerChunk[1] = pWs->centerLoc[1];
+  uniforms.centerChunk[2] = pWs->centerLoc[2];
+  uniforms.centerChunk[3] = 0;
+  memcpy(pGlobal->ppUniforms[frame], &uniforms, sizeof(uniforms));
+
+  // the blocks only need more room when the vertex pool grows past them.
+  // The other frame's go too, so wait for it.
+  const VkBuffer *pBlockBuffers;
+  uint32_t blockCount;
+  uint64_t blockGeneration;
+  wld_getBlockBuffers(&pBlockBuffers, &blockCount, &blockGeneration, pWs);
+  if (blockCount > pGlobal->blockCapacity) {
+    uint32_t capacity = pGlobal->blockCapacity;
+    while (capacity < blockCount) {
+      capacity *= 2;
+    }
+    vkDeviceWaitIdle(pGlobal->device);
+    delete_Blocks(pGlobal);
+    new_Blocks(pGlobal, capacity);
+  }
 
-  VkBuffer *pVertexBuffers = malloc(vertexBufferCount * sizeof(VkBuffer));
-  uint32_t *pVertexCounts = malloc(vertexBufferCount * sizeof(uint32_t));
+  // point the face descriptor sets of the blocks that changed at their new
+  // buffers. The last frame to use them is done. If a block was freed, its
+  // buffer handle may have been reused, so check them all.
+  BlockRecord *pRecords =
+      &pGlobal->pBlockRecords[frame * pGlobal->blockCapacity];
+  VkDescriptorSet *pFaceSets =
+      &pGlobal->pFaceDescriptorSets[frame * pGlobal->blockCapacity];
+  bool sameBlocks = blockGeneration == pGlobal->pBlockGenerations[frame];
+  pGlobal->pBlockGenerations[frame] = blockGeneration;
+  for (uint32_t i = 0; i < blockCount; i++) {
+    if (sameBlocks && pRecords[i].faceBuffer == pBlockBuffers[i]) {
+      continue;
+    }
+    updateFaceDescriptorSets(&pFaceSets[i], &pBlockBuffers[i], 1,
+                             pGlobal->device);
+    pRecords[i].faceBuffer = pBlockBuffers[i];
+    // updating the set invalidated the command buffer it's bound in
+    pRecords[i].recorded = false;
+  }
 
-  wld_getVertexBuffers(pVertexBuffers, pVertexCounts, pWs);
+  VkCommandBuffer commandBuffer = pGlobal->pVertexDisplayCommandBuffers[frame];
+  beginOneTimeCommandBuffer(commandBuffer);
 
-  mat4x4 mvp;
-  getMvpCamera(mvp, pCamera);
+  uint32_t executedCount = 0;
+  if (pGlobal->gpuCulling) {
+    // the last frame to use these counts is done, so they can be read back
+    pGlobal->drawnCount = 0;
+    for (uint32_t i = 0; i < pGlobal->cullBlockCapacity; i++) {
+      pGlobal->drawnCount += pGlobal->ppDrawCounts[frame][i];
+    }
 
-  // record buffer
-  recordVertexDisplayCommandBuffer(                                 //
-      pGlobal->pVertexDisplayCommandBuffers[pGlobal->currentFrame], //
-      pWindow->pSwapchainFramebuffers[imageIndex],                  //
-      vertexBufferCount,                                            //
-      pVertexBuffers,                                               //
-      pVertexCounts,                                                //
-      pGlobal->renderPass,                                          //
-      pGlobal->graphicsPipelineLayout,                              //
-      pWindow->graphicsPipeline,                                    //
-      pWindow->swapchainExtent,                                     //
-      mvp,                                                          //
-      pGlobal->graphicsDescriptorSet,                               //
-      (VkClearColorValue){.float32 = {0, 0, 0, 0}}                  //
+    // both frames in flight cull from the copy of the draw list, so wait for
+    // them before making room for more. It doubles, so this is rare.
+    uint32_t drawCount;
+    uint32_t drawBlockCount;
+    wld_getDrawListSize(&drawCount, &drawBlockCount, pWs);
+    if (drawCount > pGlobal->cullDrawCapacity ||
+        drawBlockCount > pGlobal->cullBlockCapacity) {
+      uint32_t drawCapacity = pGlobal->cullDrawCapacity;
+      while (drawCapacity < drawCount) {
+        drawCapacity *= 2;
+      }
+      uint32_t blockCapacity = pGlobal->cullBlockCapacity;
+      while (blockCapacity < drawBlockCount) {
+        blockCapacity *= 2;
+      }
+      vkDeviceWaitIdle(pGlobal->device);
+      delete_CullBuffers(pGlobal);
+      new_CullBuffers(pGlobal, drawCapacity, blockCapacity);
+    }
+
+    const uint32_t *pChangedIndexes;
+    const CullDrawRecord *pChangedRecords;
+    uint32_t changeCount;
+    wld_getDrawChanges(&pChangedIndexes, &pChangedRecords, &changeCount,
+                       &drawCount, pGlobal->resendDraws, pWs);
+    pGlobal->resendDraws = false;
+    // the last frame to copy out of this staging buffer is done too
+    uint32_t copyCount = stageCullDrawRecords(
+        pGlobal->pRecordCopies, pGlobal->ppRecordStaging[frame], changeCount,
+        pChangedIndexes, pChangedRecords);
+    // blocks made since wld_getDrawListSize don't have any draws yet
+    if (blockCount > pGlobal->cullBlockCapacity) {
+      blockCount = pGlobal->cullBlockCapacity;
+    }
+
+    CullPushConstants constants;
+    wld_getFrustumPlanes(constants.planes, uniforms.mvp);
+    constants.drawCount = drawCount;
+    constants.commandsPerBlock = pGlobal->cullDrawCapacity;
+    recordCullCommands(                        //
+        commandBuffer,                         //
+        pGlobal->cullPipelineLayout,           //
+        pGlobal->cullPipeline,                 //
+        pGlobal->pCullDescriptorSets[frame],   //
+        pGlobal->drawRecordBuffer,             //
+        pGlobal->pRecordStagingBuffers[frame], //
+        copyCount,                             //
+        pGlobal->pRecordCopies,                //
+        blockCount,                            //
+        &constants                             //
+    );
+
+    // each block draws what was culled into its part of the culled draws,
+    // which is the same every frame
+    const VkDeviceSize blockCommandsSize =
+        pGlobal->cullDrawCapacity * sizeof(VkDrawIndirectCommand);
+    for (uint32_t i = 0; i < blockCount; i++) {
+      if (pBlockBuffers[i] == VK_NULL_HANDLE) {
+        continue;
+      }
+      executeBlock(pWindow, pGlobal, &executedCount, frame, i,
+                   pGlobal->pCulledDrawBuffers[frame], i * blockCommandsSize,
+                   pGlobal->cullDrawCapacity,
+                   pGlobal->pDrawCountBuffers[frame], i * sizeof(uint32_t));
+    }
+  } else {
+    const VkDrawIndirectCommand *pCommands;
+    uint32_t drawCount;
+    const uint32_t *pBatchBlocks;
+    const uint32_t *pBatchCounts;
+    uint32_t batchCount;
+    wld_getDrawList(&pCommands, &drawCount, &pBatchBlocks, &pBatchCounts,
+                    &batchCount, uniforms.mvp, pWs);
+    pGlobal->drawnCount = drawCount;
+
+    // the last frame to use this indirect buffer is done, so it can be
+    // written to, or replaced with a bigger one
+    if (drawCount > pGlobal->pIndirectCapacities[frame]) {
+      uint32_t capacity = 2 * pGlobal->pIndirectCapacities[frame];
+      delete_IndirectBuffer(pGlobal, frame);
+      new_IndirectBuffer(pGlobal, frame,
+                         drawCount > capacity ? drawCount : capacity);
+      invalidateBlocks(pGlobal, frame);
+    }
+    memcpy(pGlobal->ppIndirectCommands[frame], pCommands,
+           drawCount * sizeof(VkDrawIndirectCommand));
+
+    // each batch is a block, which only has to be recorded again when its
+    // draws move
+    VkDeviceSize commandOffset = 0;
+    for (uint32_t i = 0; i < batchCount; i++) {
+      executeBlock(pWindow, pGlobal, &executedCount, frame, pBatchBlocks[i],
+                   pGlobal->pIndirectBuffers[frame], commandOffset,
+                   pBatchCounts[i], VK_NULL_HANDLE, 0);
+      commandOffset += pBatchCounts[i] * sizeof(VkDrawIndirectCommand);
+    }
+  }
+
+  recordVertexDisplayCommands(                     //
+      commandBuffer,                               //
+      pWindow->pSwapchainFramebuffers[imageIndex], //
+      pGlobal->renderPass,                         //
+      pWindow->swapchainExtent,                    //
+      executedCount,                               //
+      pGlobal->pExecutedPrepassCommandBuffers,     //
+      pGlobal->pExecutedCommandBuffers,            //
+      (VkClearColorValue){.float32 = {0, 0, 0, 0}} //
   );
 
-  free(pVertexBuffers);
-  free(pVertexCounts);
+  endCommandBuffer(commandBuffer);
 
   drawFrame(                                                        //
       pGlobal->pVertexDisplayCommandBuffers[pGlobal->currentFrame], //
       pWindow->swapchain,                                           //
       imageIndex,                                                   //
       pGlobal->pImageAvailableSemaphores[pGlobal->currentFrame],    //
+      uploadSemaphore,                                              //
       pGlobal->pRenderFinishedSemaphores[pGlobal->currentFrame],    //
       pGlobal->pInFlightFences[pGlobal->currentFrame],              //
       pGlobal->graphicsQueue,                                       //
@@ -411,6 +1120,7 @@ static void drawAppFrame(            //
 
   // increment frame
   pGlobal->currentFrame = (pGlobal->currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+  pGlobal->frameNumber++;
 }
 
 int main(void) {
@@ -421,12 +1131,13 @@ int main(void) {
   // set up world generation
   worldgen_state *pWg = new_worldgen_state(42);
   WorldState ws;
-  wld_new_WorldState(       //
-      &ws,                  //
-      (ivec3){0, 0, 0},     //
-      pWg,                  //
+  wld_new_WorldState(   //
+      &ws,              //
+      (ivec3){0, 0, 0}, //
+      pWg,              //
+      0,                    // one worker per online CPU
       global.graphicsQueue, //
-      global.commandPool,   //
+      global.graphicsIndex, //
       global.device,        //
       global.physicalDevice //
   );
@@ -446,8 +1157,6 @@ int main(void) {
   uint32_t fpsFrameCounter = 0;
   double fpsStartTime = glfwGetTime();
 
-  uint32_t frameCounter = 0;
-
   // wait till close
   while (!glfwWindowShouldClose(global.pWindow)) {
     // glfw check for new events
@@ -456,6 +1165,11 @@ int main(void) {
     // update camera
     updateCamera(&camera, global.pWindow);
 
+    // have a worker draw the occluders for this frame while the world updates
+    mat4x4 mvp;
+    getMvpCamera(mvp, &camera);
+    wld_startOcclusion(mvp, &ws);
+
     // update world
     wld_update(&ws);
 
@@ -497,18 +1211,12 @@ int main(void) {
     // draw frame
     drawAppFrame(&window, &global, &camera, &ws);
 
-    frameCounter++;
-
-    if (frameCounter % 100 == 0) {
-      vkDeviceWaitIdle(global.device);
-      wld_clearGarbage(&ws);
-    }
-
     fpsFrameCounter++;
     if (fpsFrameCounter >= 100) {
       double fpsEndTime = glfwGetTime();
       double fps = fpsFrameCounter / (fpsEndTime - fpsStartTime);
-      LOG_ERROR_ARGS(ERR_LEVEL_INFO, "fps: %f", fps);
+      LOG_ERROR_ARGS(ERR_LEVEL_INFO, "fps: %f, draws: %u", fps,
+                     global.drawnCount);
       fpsFrameCounter = 0;
       fpsStartTime = fpsEndTime;
     }
@@ -0,0 +1,345 @@
+#include "occlusion.h"
+
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t occ_levelWidth(uint32_t level) {
+  uint32_t width = OCCLUSION_WIDTH >> level;
+  return width > 0 ? width : 1;
+}
+
+static uint32_t occ_levelHeight(uint32_t level) {
+  uint32_t height = OCCLUSION_HEIGHT >> level;
+  return height > 0 ? height : 1;
+}
+
+// rounds v to an int in [0, max], even if it's far outside of it
+static int32_t occ_clampTexel(float v, int32_t max) {
+  return (int32_t)fminf(fmaxf(v, 0), (float)max);
+}
+
+void new_OcclusionBuffer(       //
+    OcclusionBuffer *pOcclusion //
+) {
+  mat4x4_identity(pOcclusion->mvp);
+  for (uint32_t level = 0; level < OCCLUSION_LEVELS; level++) {
+    pOcclusion->levels[level] =
+        malloc(occ_levelWidth(level) * occ_levelHeight(level) * sizeof(float));
+  }
+  occ_clear(pOcclusion, pOcclusion->mvp);
+  occ_buildPyramid(pOcclusion);
+}
+
+void delete_OcclusionBuffer(    //
+    OcclusionBuffer *pOcclusion //
+) {
+  for (uint32_t level = 0; level < OCCLUSION_LEVELS; level++) {
+    free(pOcclusion->levels[level]);
+  }
+}
+
+void occ_clear(                  //
+    OcclusionBuffer *pOcclusion, //
+    const mat4x4 mvp             //
+) {
+  memcpy(pOcclusion->mvp, mvp, sizeof(mat4x4));
+  float *pDepth = pOcclusion->levels[0];
+  for (uint32_t i = 0; i < OCCLUSION_WIDTH * OCCLUSION_HEIGHT; i++) {
+    pDepth[i] = FLT_MAX;
+  }
+}
+
+// projects the corners of a box to texel coordinates and normalized device z.
+// Corner i has bit 0 of i set if it's on the max side in x, bit 1 for y and
+// bit 2 for z. Returns false if any corner is in front of the near plane.
+static bool occ_projectBox(            //
+    vec3 corners[8],                   //
+    const OcclusionBuffer *pOcclusion, //
+    const vec3 min,                    //
+    const vec3 max                     //
+) {
+  for (uint32_t i = 0; i < 8; i++) {
+    vec4 world = {i & 1 ? max[0] : min[0], i & 2 ? max[1] : min[1],
+                  i & 4 ? max[2] : min[2], 1.0f};
+    vec4 clip;
+    mat4x4_mul_vec4(clip, pOcclusion->mvp, world);
+    if (clip[3] <= 0.0f || clip[2] < -clip[3]) {
+      return false;
+    }
+    corners[i][0] = (clip[0] / clip[3] * 0.5f + 0.5f) * OCCLUSION_WIDTH;
+    corners[i][1] = (clip[1] / clip[3] * 0.5f + 0.5f) * OCCLUSION_HEIGHT;
+    corners[i][2] = clip[2] / clip[3];
+  }
+  return true;
+}
+
+// true if the texel at x, on a row whose part of the edge's value is rowEdge,
+// is on the inside of the edge
+static bool occ_edgeInside( //
+    const float ex,         //
+    const float cornerX,    //
+    const float rowEdge,    //
+    const float e0,         //
+    const int32_t x         //
+) {
+  return ex * ((float)x + cornerX) + rowEdge + e0 >= 0;
+}
+
+// the first texel in [start, end] inside an edge that rises along the row,
+// or end + 1 if there isn't one
+static int32_t occ_firstInside( //
+    const float ex,             //
+    const float cornerX,        //
+    const float rowEdge,        //
+    const float e0,             //
+    int32_t start,              //
+    int32_t end                 //
+) {
+  end++;
+  while (start < end) {
+    int32_t mid = start + (end - start) / 2;
+    if (occ_edgeInside(ex, cornerX, rowEdge, e0, mid)) {
+      end = mid;
+    } else {
+      start = mid + 1;
+    }
+  }
+  return start;
+}
+
+// the last texel in [start, end] inside an edge that falls along the row, or
+// start - 1 if there isn't one
+static int32_t occ_lastInside( //
+    const float ex,            //
+    const float cornerX,       //
+    const float rowEdge,       //
+    const float e0,            //
+    int32_t start,             //
+    int32_t end                //
+) {
+  start--;
+  while (start < end) {
+    int32_t mid = end - (end - start) / 2;
+    if (occ_edgeInside(ex, cornerX, rowEdge, e0, mid)) {
+      start = mid;
+    } else {
+      end = mid - 1;
+    }
+  }
+  return end;
+}
+
+// fills the texels entirely inside the convex quad with the farthest depth of
+// the quad over them, unless they already hold something nearer
+static void occ_drawQuad(        //
+    OcclusionBuffer *pOcclusion, //
+    const vec3 v0,               //
+    const vec3 v1,               //
+    const vec3 v2,               //
+    const vec3 v3                //
+) {
+  const float *quad[4] = {v0, v1, v2, v3};
+
+  // twice the signed area, to orient the edges so the inside is positive
+  float area = 0;
+  for (uint32_t i = 0; i < 4; i++) {
+    const float *a = quad[i];
+    const float *b = quad[(i + 1) % 4];
+    area += a[0] * b[1] - b[0] * a[1];
+  }
+  // seen edge on, covers nothing
+  if (fabsf(area) < 1e-6f) {
+    return;
+  }
+  float winding = area > 0 ? 1.0f : -1.0f;
+
+  // each edge as ex * x + ey * y + e0, positive inside
+  float ex[4];
+  float ey[4];
+  float e0[4];
+  for (uint32_t i = 0; i < 4; i++) {
+    const float *a = quad[i];
+    const float *b = quad[(i + 1) % 4];
+    ex[i] = -(b[1] - a[1]) * winding;
+    ey[i] = (b[0] - a[0]) * winding;
+    e0[i] = -(ex[i] * a[0] + ey[i] * a[1]);
+  }
+
+  // the quad is flat, so its depth is dx * x + dy * y + d0 across the screen.
+  // Take the plane through whichever 3 corners are furthest from lining up.
+  const float *p0 = v0;
+  const float *p1 = v1;
+  const float *p2 = v2;
+  float det = (p1[0] - p0[0]) * (p2[1] - p0[1]) -
+              (p2[0] - p0[0]) * (p1[1] - p0[1]);
+  float otherDet = (v2[0] - v0[0]) * (v3[1] - v0[1]) -
+                   (v3[0] - v0[0]) * (v2[1] - v0[1]);
+  if (fabsf(otherDet) > fabsf(det)) {
+    p1 = v2;
+    p2 = v3;
+    det = otherDet;
+  }
+  float dx = ((p1[2] - p0[2]) * (p2[1] - p0[1]) -
+              (p2[2] - p0[2]) * (p1[1] - p0[1])) /
+             det;
+  float dy = ((p2[2] - p0[2]) * (p1[0] - p0[0]) -
+              (p1[2] - p0[2]) * (p2[0] - p0[0])) /
+             det;
+  float d0 = p0[2] - dx * p0[0] - dy * p0[1];
+
+  float minX = fminf(fminf(v0[0], v1[0]), fminf(v2[0], v3[0]));
+  float maxX = fmaxf(fmaxf(v0[0], v1[0]), fmaxf(v2[0], v3[0]));
+  float minY = fminf(fminf(v0[1], v1[1]), fminf(v2[1], v3[1]));
+  float maxY = fmaxf(fmaxf(v0[1], v1[1]), fmaxf(v2[1], v3[1]));
+  // texels whose whole square fits inside the quad's bounding rectangle
+  int32_t x0 = occ_clampTexel(ceilf(minX), OCCLUSION_WIDTH);
+  int32_t x1 = occ_clampTexel(floorf(maxX), OCCLUSION_WIDTH) - 1;
+  int32_t y0 = occ_clampTexel(ceilf(minY), OCCLUSION_HEIGHT);
+  int32_t y1 = occ_clampTexel(floorf(maxY), OCCLUSION_HEIGHT) - 1;
+
+  // Every test below is linear, so the corner of the texel that matters is
+  // picked by the signs of the coefficients: the one with the lowest edge
+  // value, and the one with the farthest depth.
+  float cornerX[4];
+  float cornerY[4];
+  for (uint32_t i = 0; i < 4; i++) {
+    cornerX[i] = ex[i] < 0 ? 1.0f : 0.0f;
+    cornerY[i] = ey[i] < 0 ? 1.0f : 0.0f;
+  }
+  float depthX = dx > 0 ? 1.0f : 0.0f;
+  float depthY = dy > 0 ? 1.0f : 0.0f;
+
+  float *pDepth = pOcclusion->levels[0];
+  for (int32_t y = y0; y <= y1; y++) {
+    // Along a row each edge's value only rises or only falls, so the texels
+    // inside all four edges are a run. Find where each edge cuts it off.
+    int32_t start = x0;
+    int32_t end = x1;
+    for (uint32_t i = 0; i < 4 && start <= end; i++) {
+      float rowEdge = ey[i] * ((float)y + cornerY[i]);
+      if (ex[i] > 0) {
+        start = occ_firstInside(ex[i], cornerX[i], rowEdge, e0[i], start, end);
+      } else if (ex[i] < 0) {
+        end = occ_lastInside(ex[i], cornerX[i], rowEdge, e0[i], start, end);
+      } else if (!(ex[i] == 0 && rowEdge + e0[i] >= 0)) {
+        end = start - 1;
+      }
+    }
+
+    float rowDepth = dy * ((float)y + depthY);
+    float *pRow = &pDepth[y * OCCLUSION_WIDTH];
+    for (int32_t x = start; x <= end; x++) {
+      float depth = dx * ((float)x + depthX) + rowDepth + d0;
+      // not fminf, which is a call per texel unless NaNs are ruled out
+      pRow[x] = depth < pRow[x] ? depth : pRow[x];
+    }
+  }
+}
+
+void occ_drawBox(                //
+    OcclusionBuffer *pOcclusion, //
+    const vec3 min,              //
+    const vec3 max               //
+) {
+  vec3 corners[8];
+  if (!occ_projectBox(corners, pOcclusion, min, max)) {
+    return;
+  }
+
+  // the corners of each face, in order around it. Back faces are drawn too,
+  // the front faces are nearer, so they win.
+  static const uint8_t faces[6][4] = {
+      {0, 2, 6, 4}, {1, 3, 7, 5}, {0, 1, 5, 4},
+      {2, 3, 7, 6}, {0, 1, 3, 2}, {4, 5, 7, 6},
+  };
+  for (uint32_t i = 0; i < 6; i++) {
+    occ_drawQuad(pOcclusion, corners[faces[i][0]], corners[faces[i][1]],
+                 corners[faces[i][2]], corners[faces[i][3]]);
+  }
+}
+
+void occ_buildPyramid(          //
+    OcclusionBuffer *pOcclusion //
+) {
+  for (uint32_t level = 1; level < OCCLUSION_LEVELS; level++) {
+    const float *pBelow = pOcclusion->levels[level - 1];
+    uint32_t belowWidth = occ_levelWidth(level - 1);
+    uint32_t belowHeight = occ_levelHeight(level - 1);
+    float *pLevel = pOcclusion->levels[level];
+    uint32_t width = occ_levelWidth(level);
+    uint32_t height = occ_levelHeight(level);
+    for (uint32_t y = 0; y < height; y++) {
+      uint32_t y0 = y * 2;
+      uint32_t y1 = y * 2 + 1 < belowHeight ? y * 2 + 1 : y0;
+      for (uint32_t x = 0; x < width; x++) {
+        uint32_t x0 = x * 2;
+        uint32_t x1 = x * 2 + 1 < belowWidth ? x * 2 + 1 : x0;
+        pLevel[y * width + x] =
+            fmaxf(fmaxf(pBelow[y0 * belowWidth + x0],
+                        pBelow[y0 * belowWidth + x1]),
+                  fmaxf(pBelow[y1 * belowWidth + x0],
+                        pBelow[y1 * belowWidth + x1]));
+      }
+    }
+  }
+}
+
+bool occ_testBox(                      //
+    const OcclusionBuffer *pOcclusion, //
+    const vec3 min,                    //
+    const vec3 max                     //
+) {
+  vec3 corners[8];
+  if (!occ_projectBox(corners, pOcclusion, min, max)) {
+    return true;
+  }
+
+  float minX = corners[0][0];
+  float maxX = corners[0][0];
+  float minY = corners[0][1];
+  float maxY = corners[0][1];
+  float nearest = corners[0][2];
+  for (uint32_t i = 1; i < 8; i++) {
+    minX = fminf(minX, corners[i][0]);
+    maxX = fmaxf(maxX, corners[i][0]);
+    minY = fminf(minY, corners[i][1]);
+    maxY = fmaxf(maxY, corners[i][1]);
+    nearest = fminf(nearest, corners[i][2]);
+  }
+
+  if (maxX < 0 || maxY < 0 || minX >= OCCLUSION_WIDTH ||
+      minY >= OCCLUSION_HEIGHT) {
+    // off screen, the frustum test is the one that should cull it
+    return true;
+  }
+
+  // the texels the box's screen rectangle touches
+  int32_t x0 = occ_clampTexel(floorf(minX), OCCLUSION_WIDTH - 1);
+  int32_t x1 = occ_clampTexel(floorf(maxX), OCCLUSION_WIDTH - 1);
+  int32_t y0 = occ_clampTexel(floorf(minY), OCCLUSION_HEIGHT - 1);
+  int32_t y1 = occ_clampTexel(floorf(maxY), OCCLUSION_HEIGHT - 1);
+
+  // go up the pyramid until the rectangle is at most 2x2 texels
+  uint32_t level = 0;
+  while (level + 1 < OCCLUSION_LEVELS &&
+         ((x1 >> level) - (x0 >> level) > 1 ||
+          (y1 >> level) - (y0 >> level) > 1)) {
+    level++;
+  }
+
+  const float *pLevel = pOcclusion->levels[level];
+  uint32_t width = occ_levelWidth(level);
+  uint32_t height = occ_levelHeight(level);
+  float farthest = -FLT_MAX;
+  for (uint32_t y = (uint32_t)y0 >> level; y <= (uint32_t)y1 >> level; y++) {
+    for (uint32_t x = (uint32_t)x0 >> level; x <= (uint32_t)x1 >> level;
+         x++) {
+      if (x < width && y < height) {
+        farthest = fmaxf(farthest, pLevel[y * width + x]);
+      }
+    }
+  }
+  return nearest <= farthest;
+}
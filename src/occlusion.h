@@ -0,0 +1,88 @@
+#ifndef SRC_OCCLUSION_H_
+#define SRC_OCCLUSION_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <linmath.h>
+
+// size of the depth buffer occluders are drawn into, in texels
+#define OCCLUSION_WIDTH 256
+#define OCCLUSION_HEIGHT 128
+// number of levels in the depth pyramid, down to 1x1
+#define OCCLUSION_LEVELS 9
+
+/// OcclusionBuffer
+/// ---------------------
+/// A small depth buffer that boxes known to be opaque are drawn into on the
+/// CPU, so that boxes behind them can be culled before they're drawn on the
+/// GPU. Depths are normalized device z, nearer is smaller.
+typedef struct {
+  mat4x4 mvp;
+  // level 0 is the depth buffer. Every other level is half the size of the
+  // one before it, and each texel holds the farthest depth of the texels
+  // under it
+  float *levels[OCCLUSION_LEVELS];
+} OcclusionBuffer;
+
+/// --- PRECONDITIONS ---
+/// * pOcclusion is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * pOcclusion is a valid OcclusionBuffer
+void new_OcclusionBuffer(       //
+    OcclusionBuffer *pOcclusion //
+);
+
+/// --- PRECONDITIONS ---
+/// * pOcclusion is valid
+/// --- POSTCONDITIONS ---
+/// * the memory held by pOcclusion is released
+void delete_OcclusionBuffer(    //
+    OcclusionBuffer *pOcclusion //
+);
+
+/// starts a new frame, rendered with mvp
+/// --- PRECONDITIONS ---
+/// * pOcclusion is valid
+/// --- POSTCONDITIONS ---
+/// * nothing is drawn in the depth buffer
+void occ_clear(                  //
+    OcclusionBuffer *pOcclusion, //
+    const mat4x4 mvp             //
+);
+
+/// draws a box that is completely opaque
+/// --- PRECONDITIONS ---
+/// * pOcclusion is valid
+/// * min is less than max on every axis
+/// --- POSTCONDITIONS ---
+/// * every texel entirely covered by the box has a depth no nearer than the
+///   box's surface over that texel
+/// * boxes that cross the near plane are left out
+void occ_drawBox(                //
+    OcclusionBuffer *pOcclusion, //
+    const vec3 min,              //
+    const vec3 max               //
+);
+
+/// rebuilds the depth pyramid from the depth buffer
+/// --- PRECONDITIONS ---
+/// * pOcclusion is valid
+/// * must be called after the last occ_drawBox and before occ_testBox
+void occ_buildPyramid(          //
+    OcclusionBuffer *pOcclusion //
+);
+
+/// checks if a box might be visible
+/// --- PRECONDITIONS ---
+/// * pOcclusion is valid
+/// * min is less than or equal to max on every axis
+/// --- POSTCONDITIONS ---
+/// * returns false only if the box is entirely behind the boxes drawn
+bool occ_testBox(                      //
+    const OcclusionBuffer *pOcclusion, //
+    const vec3 min,                    //
+    const vec3 max                     //
+);
+
+#endif // SRC_OCCLUSION_H_
@@ -0,0 +1,453 @@
+#include "staging.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void new_StagingRing(                      //
+    StagingRing *pRing,                    //
+    const VkDevice device,                 //
+    const VkPhysicalDevice physicalDevice, //
+    const VkQueue queue,                   //
+    const uint32_t queueFamilyIndex,       //
+    const VkPipelineStageFlags readStages  //
+) {
+  pRing->device = device;
+  pRing->physicalDevice = physicalDevice;
+  pRing->queue = queue;
+  pRing->readStages = readStages;
+
+  ErrVal poolResult =
+      new_CommandPool(&pRing->commandPool, device, queueFamilyIndex);
+  if (poolResult != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create staging command pool");
+    PANIC();
+  }
+
+  // create and map the ring
+  ErrVal ringResult = new_Buffer_DeviceMemory(
+      &pRing->buffer, &pRing->memory, STAGING_RING_SIZE, physicalDevice,
+      device, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (ringResult != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create staging ring");
+    PANIC();
+  }
+  void *pMapped;
+  VkResult mapResult =
+      vkMapMemory(device, pRing->memory, 0, STAGING_RING_SIZE, 0, &pMapped);
+  if (mapResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to map staging ring: %s",
+                   vkstrerror(mapResult));
+    PANIC();
+  }
+  pRing->pMapped = pMapped;
+  pRing->head = 0;
+  pRing->tail = 0;
+  pRing->used = 0;
+  pRing->currentBytes = 0;
+
+  new_VertexPool(&pRing->arena, device, physicalDevice,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                 1, &queueFamilyIndex);
+
+  for (uint32_t i = 0; i < STAGING_BATCHES; i++) {
+    StagingBatch *pBatch = &pRing->batches[i];
+    new_CommandBuffers(&pBatch->commandBuffer, 1, pRing->commandPool, device);
+    new_Fence(&pBatch->fence, device, false);
+    new_Semaphore(&pBatch->semaphore, device);
+    pBatch->inFlight = false;
+    pBatch->ringEnd = 0;
+    pBatch->ringBytes = 0;
+    pBatch->overflow_cap = 4;
+    pBatch->overflow_len = 0;
+    pBatch->overflowBuffers = malloc(pBatch->overflow_cap * sizeof(VkBuffer));
+    pBatch->overflowMemories =
+        malloc(pBatch->overflow_cap * sizeof(VkDeviceMemory));
+    pBatch->staged_cap = 16;
+    pBatch->staged_len = 0;
+    pBatch->staged = malloc(pBatch->staged_cap * sizeof(VertexAllocation));
+  }
+  pRing->current = 0;
+
+  pRing->copy_cap = 64;
+  pRing->copy_len = 0;
+  pRing->copySources = malloc(pRing->copy_cap * sizeof(VkBuffer));
+  pRing->copyDestinations = malloc(pRing->copy_cap * sizeof(VkBuffer));
+  pRing->copyRegions = malloc(pRing->copy_cap * sizeof(VkBufferCopy));
+}
+
+// frees what a batch held on to: overflow buffers and arena allocations
+static void stg_clearHeld( //
+    StagingRing *pRing,    //
+    StagingBatch *pBatch   //
+) {
+  for (uint32_t i = 0; i < pBatch->overflow_len; i++) {
+    delete_Buffer(&pBatch->overflowBuffers[i], pRing->device);
+    delete_DeviceMemory(&pBatch->overflowMemories[i], pRing->device);
+  }
+  pBatch->overflow_len = 0;
+
+  for (uint32_t i = 0; i < pBatch->staged_len; i++) {
+    vtp_free(&pRing->arena, &pBatch->staged[i]);
+  }
+  if (pBatch->staged_len > 0) {
+    vtp_trim(&pRing->arena);
+  }
+  pBatch->staged_len = 0;
+}
+
+void delete_StagingRing( //
+    StagingRing *pRing   //
+) {
+  for (uint32_t i = 0; i < STAGING_BATCHES; i++) {
+    StagingBatch *pBatch = &pRing->batches[i];
+    stg_clearHeld(pRing, pBatch);
+    free(pBatch->overflowBuffers);
+    free(pBatch->overflowMemories);
+    free(pBatch->staged);
+    delete_Fence(&pBatch->fence, pRing->device);
+    delete_Semaphore(&pBatch->semaphore, pRing->device);
+  }
+  // frees the command buffers too
+  delete_CommandPool(&pRing->commandPool, pRing->device);
+
+  vkUnmapMemory(pRing->device, pRing->memory);
+  delete_Buffer(&pRing->buffer, pRing->device);
+  delete_DeviceMemory(&pRing->memory, pRing->device);
+  delete_VertexPool(&pRing->arena);
+
+  free(pRing->copySources);
+  free(pRing->copyDestinations);
+  free(pRing->copyRegions);
+}
+
+void stg_retireBatch(    //
+    StagingRing *pRing,  //
+    StagingBatch *pBatch //
+) {
+  // A batch of copies alone holds no ring space, and the ring may have
+  // started over from the beginning since it was flushed, which would put
+  // its end somewhere in the middle of newer uploads.
+  if (pBatch->ringBytes > 0) {
+    pRing->tail = pBatch->ringEnd;
+    pRing->used -= pBatch->ringBytes;
+  }
+  stg_clearHeld(pRing, pBatch);
+  pBatch->inFlight = false;
+}
+
+void stg_claimRing(      //
+    StagingRing *pRing,  //
+    StagingBatch *pBatch //
+) {
+  pBatch->ringEnd = pRing->head;
+  pBatch->ringBytes = pRing->currentBytes;
+  pRing->currentBytes = 0;
+}
+
+// retires the batches that are done, oldest first
+static void stg_retireFinished( //
+    StagingRing *pRing          //
+) {
+  for (uint32_t i = 1; i < STAGING_BATCHES; i++) {
+    StagingBatch *pBatch =
+        &pRing->batches[(pRing->current + i) % STAGING_BATCHES];
+    if (!pBatch->inFlight) {
+      continue;
+    }
+    // batches finish in the order they were submitted in
+    if (vkGetFenceStatus(pRing->device, pBatch->fence) != VK_SUCCESS) {
+      break;
+    }
+    stg_retireBatch(pRing, pBatch);
+  }
+}
+
+bool stg_reserve(           //
+    VkDeviceSize *pOffset,  //
+    StagingRing *pRing,     //
+    const VkDeviceSize size //
+) {
+  VkDeviceSize aligned =
+      (size + STAGING_ALIGNMENT - 1) / STAGING_ALIGNMENT * STAGING_ALIGNMENT;
+  if (pRing->used == 0) {
+    // start over from the beginning while it's empty
+    pRing->head = 0;
+    pRing->tail = 0;
+  } else if (pRing->head == pRing->tail) {
+    // full
+    return false;
+  }
+
+  VkDeviceSize skipped = 0;
+  if (pRing->head >= pRing->tail) {
+    if (pRing->head + aligned > STAGING_RING_SIZE) {
+      // doesn't fit before the end, so wrap around to the start
+      if (aligned > pRing->tail) {
+        return false;
+      }
+      skipped = STAGING_RING_SIZE - pRing->head;
+      pRing->head = 0;
+    }
+  } else if (pRing->head + aligned > pRing->tail) {
+    return false;
+  }
+
+  *pOffset = pRing->head;
+  pRing->head += aligned;
+  pRing->used += skipped + aligned;
+  pRing->currentBytes += skipped + aligned;
+  return true;
+}
+
+// records a copy into the current batch. A copy that carries on where the
+// last one left off is merged into it.
+static void stg_pushCopy(       //
+    StagingRing *pRing,         //
+    const VkBuffer source,      //
+    const VkBuffer destination, //
+    const VkBufferCopy *pRegion //
+) {
+  if (pRing->copy_len > 0) {
+    uint32_t last = pRing->copy_len - 1;
+    VkBufferCopy *pLast = &pRing->copyRegions[last];
+    if (pRing->copySources[last] == source &&
+        pRing->copyDestinations[last] == destination &&
+        pLast->srcOffset + pLast->size == pRegion->srcOffset &&
+        pLast->dstOffset + pLast->size == pRegion->dstOffset) {
+      pLast->size += pRegion->size;
+      return;
+    }
+  }
+  if (pRing->copy_len == pRing->copy_cap) {
+    pRing->copy_cap *= 2;
+    pRing->copySources =
+        realloc(pRing->copySources, pRing->copy_cap * sizeof(VkBuffer));
+    pRing->copyDestinations =
+        realloc(pRing->copyDestinations, pRing->copy_cap * sizeof(VkBuffer));
+    pRing->copyRegions =
+        realloc(pRing->copyRegions, pRing->copy_cap * sizeof(VkBufferCopy));
+  }
+  pRing->copySources[pRing->copy_len] = source;
+  pRing->copyDestinations[pRing->copy_len] = destination;
+  pRing->copyRegions[pRing->copy_len] = *pRegion;
+  pRing->copy_len++;
+}
+
+void stg_upload(                          //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const void *pData,                    //
+    const VkDeviceSize size               //
+) {
+  stg_retireFinished(pRing);
+
+  VkBufferCopy region = {.size = size, .dstOffset = destinationOffset};
+  if (stg_reserve(&region.srcOffset, pRing, size)) {
+    memcpy(pRing->pMapped + region.srcOffset, pData, (size_t)size);
+    stg_pushCopy(pRing, pRing->buffer, destination, &region);
+    return;
+  }
+
+  // the ring is full, so make a staging buffer just for this. It's freed
+  // along with the batch.
+  StagingBatch *pBatch = &pRing->batches[pRing->current];
+  if (pBatch->overflow_len == pBatch->overflow_cap) {
+    pBatch->overflow_cap *= 2;
+    pBatch->overflowBuffers = realloc(
+        pBatch->overflowBuffers, pBatch->overflow_cap * sizeof(VkBuffer));
+    pBatch->overflowMemories =
+        realloc(pBatch->overflowMemories,
+                pBatch->overflow_cap * sizeof(VkDeviceMemory));
+  }
+  VkBuffer *pBuffer = &pBatch->overflowBuffers[pBatch->overflow_len];
+  VkDeviceMemory *pMemory = &pBatch->overflowMemories[pBatch->overflow_len];
+  ErrVal result = new_Buffer_DeviceMemory(
+      pBuffer, pMemory, size, pRing->physicalDevice, pRing->device,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create overflow staging buffer");
+    PANIC();
+  }
+  pBatch->overflow_len++;
+  copyToDeviceMemory(pMemory, size, pData, pRing->device);
+
+  region.srcOffset = 0;
+  stg_pushCopy(pRing, *pBuffer, destination, &region);
+}
+
+void *stg_stage(            //
+    StagedData *pStaged,    //
+    StagingRing *pRing,     //
+    const VkDeviceSize size //
+) {
+  void *pMapped;
+  vtp_alloc(&pStaged->buffer, &pStaged->offset, &pMapped,
+            &pStaged->allocation, &pRing->arena, size);
+  return pMapped;
+}
+
+void stg_uploadStaged(                    //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const StagedData *pStaged,            //
+    const VkDeviceSize size               //
+) {
+  stg_retireFinished(pRing);
+
+  VkBufferCopy region = {.srcOffset = pStaged->offset,
+                         .dstOffset = destinationOffset,
+                         .size = size};
+  stg_pushCopy(pRing, pStaged->buffer, destination, &region);
+
+  // hold on to the room until the copy is done
+  StagingBatch *pBatch = &pRing->batches[pRing->current];
+  if (pBatch->staged_len == pBatch->staged_cap) {
+    pBatch->staged_cap *= 2;
+    pBatch->staged = realloc(pBatch->staged,
+                             pBatch->staged_cap * sizeof(VertexAllocation));
+  }
+  pBatch->staged[pBatch->staged_len++] = pStaged->allocation;
+}
+
+void stg_copy(                            //
+    StagingRing *pRing,                   //
+    const VkBuffer source,                //
+    const VkDeviceSize sourceOffset,      //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const VkDeviceSize size               //
+) {
+  stg_retireFinished(pRing);
+
+  VkBufferCopy region = {.srcOffset = sourceOffset,
+                         .dstOffset = destinationOffset,
+                         .size = size};
+  stg_pushCopy(pRing, source, destination, &region);
+}
+
+void stg_fill(                            //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const VkDeviceSize size               //
+) {
+  stg_retireFinished(pRing);
+
+  // the source offset follows the destination, so fills next to each other
+  // are merged like copies
+  VkBufferCopy region = {.srcOffset = destinationOffset,
+                         .dstOffset = destinationOffset,
+                         .size = size};
+  stg_pushCopy(pRing, VK_NULL_HANDLE, destination, &region);
+}
+
+void stg_discardStaged(       //
+    StagingRing *pRing,       //
+    const StagedData *pStaged //
+) {
+  vtp_free(&pRing->arena, &pStaged->allocation);
+}
+
+VkSemaphore stg_flush( //
+    StagingRing *pRing //
+) {
+  if (pRing->copy_len == 0) {
+    return VK_NULL_HANDLE;
+  }
+
+  StagingBatch *pBatch = &pRing->batches[pRing->current];
+
+  VkCommandBufferBeginInfo beginInfo = {0};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VkResult beginResult =
+      vkBeginCommandBuffer(pBatch->commandBuffer, &beginInfo);
+  if (beginResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to begin upload batch: %s",
+                   vkstrerror(beginResult));
+    PANIC();
+  }
+
+  // the submissions before may still be reading what's overwritten, and
+  // the batches before may still be writing what's copied
+  if (pRing->readStages != 0) {
+    VkMemoryBarrier barrier = {0};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask =
+        VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+    vkCmdPipelineBarrier(pBatch->commandBuffer,
+                         pRing->readStages | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0,
+                         NULL, 0, NULL);
+  }
+
+  // runs of copies between the same pair of buffers go in one command
+  uint32_t start = 0;
+  for (uint32_t i = 1; i <= pRing->copy_len; i++) {
+    if (i < pRing->copy_len &&
+        pRing->copySources[i] == pRing->copySources[start] &&
+        pRing->copyDestinations[i] == pRing->copyDestinations[start]) {
+      continue;
+    }
+    if (pRing->copySources[start] == VK_NULL_HANDLE) {
+      for (uint32_t j = start; j < i; j++) {
+        vkCmdFillBuffer(pBatch->commandBuffer, pRing->copyDestinations[j],
+                        pRing->copyRegions[j].dstOffset,
+                        pRing->copyRegions[j].size, 0);
+      }
+    } else {
+      vkCmdCopyBuffer(pBatch->commandBuffer, pRing->copySources[start],
+                      pRing->copyDestinations[start], i - start,
+                      &pRing->copyRegions[start]);
+    }
+    start = i;
+  }
+
+  VkResult endResult = vkEndCommandBuffer(pBatch->commandBuffer);
+  if (endResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to end upload batch: %s",
+                   vkstrerror(endResult));
+    PANIC();
+  }
+
+  VkSubmitInfo submitInfo = {0};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &pBatch->commandBuffer;
+  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pSignalSemaphores = &pBatch->semaphore;
+
+  vkResetFences(pRing->device, 1, &pBatch->fence);
+  VkResult submitResult =
+      vkQueueSubmit(pRing->queue, 1, &submitInfo, pBatch->fence);
+  if (submitResult != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to submit upload batch: %s",
+                   vkstrerror(submitResult));
+    PANIC();
+  }
+
+  pBatch->inFlight = true;
+  stg_claimRing(pRing, pBatch);
+  pRing->copy_len = 0;
+
+  // move on to the next batch. It's the oldest, so if the GPU were to still
+  // be on it, nothing later would be done either. With more batches than
+  // frames in flight, this doesn't wait.
+  pRing->current = (pRing->current + 1) % STAGING_BATCHES;
+  StagingBatch *pNext = &pRing->batches[pRing->current];
+  if (pNext->inFlight) {
+    waitAndResetFence(pNext->fence, pRing->device);
+    stg_retireBatch(pRing, pNext);
+  }
+
+  return pBatch->semaphore;
+}
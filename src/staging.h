@@ -0,0 +1,272 @@
+#ifndef SRC_STAGING_H_
+#define SRC_STAGING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vertex_pool.h"
+#include "vulkan_utils.h"
+
+// size of the persistently mapped staging ring (32 MiB)
+#define STAGING_RING_SIZE ((VkDeviceSize)32 << 20)
+// how many batches of copies can be in flight at once. This should be more
+// than the frames in flight, so a batch is done by the time it's reused
+#define STAGING_BATCHES 3
+// uploads are placed in the ring at multiples of this
+#define STAGING_ALIGNMENT 16
+
+// one submission of copies, and what it holds on to until it's done
+typedef struct {
+  VkCommandBuffer commandBuffer;
+  // signaled when the copies are done, for the CPU
+  VkFence fence;
+  // signaled when the copies are done, for the graphics queue
+  VkSemaphore semaphore;
+  bool inFlight;
+  // where the ring's tail moves once the batch is done, and how many bytes
+  // of the ring that frees
+  VkDeviceSize ringEnd;
+  VkDeviceSize ringBytes;
+  // staging buffers made for uploads that didn't fit in the ring
+  uint32_t overflow_cap;
+  uint32_t overflow_len;
+  VkBuffer *overflowBuffers;
+  VkDeviceMemory *overflowMemories;
+  // arena allocations copied from, freed along with the batch
+  uint32_t staged_cap;
+  uint32_t staged_len;
+  VertexAllocation *staged;
+} StagingBatch;
+
+// room in the staging arena, see stg_stage
+typedef struct {
+  VkBuffer buffer;
+  VkDeviceSize offset;
+  VertexAllocation allocation;
+} StagedData;
+
+/// StagingRing
+/// ---------------------
+/// Uploads data to device local buffers through a host visible ring buffer
+/// that stays mapped. Uploads are recorded as they come in and submitted
+/// together by stg_flush, which doesn't wait for them to finish. Ring space
+/// is taken back once the fence of the batch that used it is signaled.
+/// Data that's produced on other threads can be written straight into a
+/// mapped arena instead, see stg_stage. The uploads, copies and fills of a
+/// batch may happen in any order.
+/// --- THREAD SAFETY ---
+/// stg_stage and stg_discardStaged may be called from any thread. Do not use
+/// the rest from more than 1 thread.
+typedef struct {
+  // borrowed, not owned
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  VkQueue queue;
+  // the stages earlier submissions to queue may read destinations in
+  VkPipelineStageFlags readStages;
+
+  VkCommandPool commandPool;
+
+  // the ring, and where it's mapped to
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  uint8_t *pMapped;
+  // the bytes in use run from tail to head, wrapping around the end.
+  // used counts them, including ones skipped at the end to wrap around
+  VkDeviceSize head;
+  VkDeviceSize tail;
+  VkDeviceSize used;
+  // bytes taken by uploads since the last flush
+  VkDeviceSize currentBytes;
+
+  // host visible memory that other threads write uploads into
+  VertexPool arena;
+
+  // batches are used in order, so the oldest one in flight is the first one
+  // after current that's in flight
+  StagingBatch batches[STAGING_BATCHES];
+  // the batch being recorded
+  uint32_t current;
+
+  // copies recorded since the last flush, and fills, which have no source.
+  // These are parallel arrays of length copy_len.
+  uint32_t copy_cap;
+  uint32_t copy_len;
+  VkBuffer *copySources;
+  VkBuffer *copyDestinations;
+  VkBufferCopy *copyRegions;
+} StagingRing;
+
+/// --- PRECONDITIONS ---
+/// * pRing is a valid pointer
+/// * queue belongs to the queue family queueFamilyIndex of device
+/// * readStages are the stages in which submissions to queue may still be
+///   reading what uploads overwrite, or 0 if uploads only ever go to room
+///   nothing is using
+/// --- POSTCONDITIONS ---
+/// * pRing is a valid StagingRing submitting to queue
+/// * if readStages isn't 0, each batch waits for them in what was submitted
+///   to queue before it, and for the batches before it, so it can write what
+///   they were reading and read what they wrote
+void new_StagingRing(                      //
+    StagingRing *pRing,                    //
+    const VkDevice device,                 //
+    const VkPhysicalDevice physicalDevice, //
+    const VkQueue queue,                   //
+    const uint32_t queueFamilyIndex,       //
+    const VkPipelineStageFlags readStages  //
+);
+
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * the device is idle
+/// --- POSTCONDITIONS ---
+/// * all resources held by pRing are released
+void delete_StagingRing( //
+    StagingRing *pRing   //
+);
+
+/// records an upload of size bytes from pData to destination at
+/// destinationOffset. It happens at the next stg_flush.
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * destination was created with VK_BUFFER_USAGE_TRANSFER_DST_BIT, and can
+///   be used from the ring's queue
+/// * the GPU isn't using that range of destination, other than in the ring's
+///   readStages of what was submitted to its queue
+/// * nothing else recorded since the last flush writes to that range
+/// --- POSTCONDITIONS ---
+/// * pData has been copied, and can be freed
+/// * never waits on the GPU. If the ring is full, the data goes in a staging
+///   buffer of its own instead
+void stg_upload(                          //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const void *pData,                    //
+    const VkDeviceSize size               //
+);
+
+/// finds size bytes of room in the staging arena, for data that will be
+/// uploaded with stg_uploadStaged
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * 0 < size <= VERTEX_POOL_BLOCK_SIZE
+/// --- POSTCONDITIONS ---
+/// * returns where the room is mapped to. It's the caller's to write to until
+///   it's passed to stg_uploadStaged or stg_discardStaged
+/// * *pStaged is set to what to pass to them
+void *stg_stage(            //
+    StagedData *pStaged,    //
+    StagingRing *pRing,     //
+    const VkDeviceSize size //
+);
+
+/// records an upload of the first size bytes of pStaged to destination at
+/// destinationOffset. It happens at the next stg_flush.
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * pStaged came from stg_stage with at least size bytes, and whatever wrote
+///   to it is done
+/// * destination and destinationOffset are as in stg_upload
+/// --- POSTCONDITIONS ---
+/// * pStaged is freed once the upload is done
+void stg_uploadStaged(                    //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const StagedData *pStaged,            //
+    const VkDeviceSize size               //
+);
+
+/// records a copy of size bytes from source at sourceOffset to destination
+/// at destinationOffset, for moving data that's already on the GPU. It
+/// happens at the next stg_flush.
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * source was created with VK_BUFFER_USAGE_TRANSFER_SRC_BIT, destination is
+///   as in stg_upload, and the ranges don't overlap
+/// * the source range stays as it is until the frame waiting on the flush is
+///   done
+void stg_copy(                            //
+    StagingRing *pRing,                   //
+    const VkBuffer source,                //
+    const VkDeviceSize sourceOffset,      //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const VkDeviceSize size               //
+);
+
+/// records zeroing size bytes of destination at destinationOffset. It
+/// happens at the next stg_flush.
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * destination and destinationOffset are as in stg_upload
+/// * destinationOffset and size are multiples of 4
+void stg_fill(                            //
+    StagingRing *pRing,                   //
+    const VkBuffer destination,           //
+    const VkDeviceSize destinationOffset, //
+    const VkDeviceSize size               //
+);
+
+/// frees room from stg_stage that won't be uploaded after all
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * pStaged came from stg_stage and hasn't been uploaded or discarded
+void stg_discardStaged(       //
+    StagingRing *pRing,       //
+    const StagedData *pStaged //
+);
+
+/// submits the uploads recorded since the last call in one command buffer
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * called at most once per frame, after waiting on the frame in flight
+///   fence, and the returned semaphore is waited on by the frame's submission
+/// --- POSTCONDITIONS ---
+/// * returns a semaphore that's signaled once the uploads are done, or
+///   VK_NULL_HANDLE if there was nothing to upload
+VkSemaphore stg_flush( //
+    StagingRing *pRing //
+);
+
+// The ring's bookkeeping, used by the functions above. None of it calls into
+// Vulkan for a batch that holds no overflow buffers or staged data.
+
+/// takes size bytes of the ring for the batch being recorded
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// --- POSTCONDITIONS ---
+/// * returns false if there isn't room, and leaves the ring as it was
+/// * otherwise *pOffset is where in the ring the bytes start, rounded up to
+///   STAGING_ALIGNMENT, and they're counted towards the batch being recorded
+bool stg_reserve(           //
+    VkDeviceSize *pOffset,  //
+    StagingRing *pRing,     //
+    const VkDeviceSize size //
+);
+
+/// hands the ring bytes reserved since the last call over to pBatch
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * pBatch is the batch being submitted
+/// --- POSTCONDITIONS ---
+/// * pBatch gives the bytes back when it's retired
+void stg_claimRing(      //
+    StagingRing *pRing,  //
+    StagingBatch *pBatch //
+);
+
+/// gives back what a finished batch held
+/// --- PRECONDITIONS ---
+/// * pRing is valid
+/// * pBatch is the oldest batch in flight, and its copies are done
+/// --- POSTCONDITIONS ---
+/// * the ring bytes, overflow buffers and staged data of pBatch are freed
+void stg_retireBatch(    //
+    StagingRing *pRing,  //
+    StagingBatch *pBatch //
+);
+
+#endif // SRC_STAGING_H_
@@ -1,14 +1,25 @@
 #ifndef SRC_VERTEX_H_
 #define SRC_VERTEX_H_
 
-#include <linmath.h>
 #include <stdint.h>
-#include <stdbool.h>
 
-typedef struct {
-  vec3 position;
-  vec3 normal;
-  vec2 texCoords;
-} Vertex;
+// a visible face of a block. Meshes are arrays of these in the vertex pool,
+// and assets/shaders/shader.vert pulls the corners of each one out of it by
+// gl_VertexIndex. Packed as:
+// * bits 0-6, 7-13 and 14-20: x, y and z of the block in its mesh region,
+//   the group of chunks whose meshes are drawn together (see world.h)
+// * bits 21-23: the BlockFaceKind
+// * bits 24-31: the BlockIndex
+// A face that's all zeros is blank, and isn't drawn. Air is block 0, and
+// never has faces, so no real face is all zeros.
+typedef uint32_t Face;
+
+// each face is drawn as two triangles
+#define VERTEXES_PER_FACE 6
+
+#define FACE_Y_SHIFT 7
+#define FACE_Z_SHIFT 14
+#define FACE_KIND_SHIFT 21
+#define FACE_BLOCK_SHIFT 24
 
 #endif
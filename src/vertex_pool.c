@@ -0,0 +1,218 @@
+#include "vertex_pool.h"
+
+#include <stdlib.h>
+
+void new_VertexPool(                        //
+    VertexPool *pPool,                      //
+    const VkDevice device,                  //
+    const VkPhysicalDevice physicalDevice,  //
+    const VkBufferUsageFlags usage,         //
+    const VkMemoryPropertyFlags properties, //
+    const uint32_t queueFamilyIndexCount,   //
+    const uint32_t *pQueueFamilyIndices     //
+) {
+  pPool->device = device;
+  pPool->physicalDevice = physicalDevice;
+  pPool->usage = usage;
+  pPool->properties = properties;
+  pPool->mapped = (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) != 0;
+  pPool->queueFamilyIndexCount = queueFamilyIndexCount;
+  for (uint32_t i = 0; i < queueFamilyIndexCount; i++) {
+    pPool->queueFamilyIndices[i] = pQueueFamilyIndices[i];
+  }
+  pthread_mutex_init(&pPool->lock, NULL);
+  pPool->block_len = 0;
+  pPool->block_cap = 4;
+  pPool->blocks = malloc(pPool->block_cap * sizeof(VertexPoolBlock));
+  pPool->generation = 0;
+}
+
+static void delete_VertexPoolBlock( //
+    VertexPoolBlock *pBlock,        //
+    const VkDevice device           //
+) {
+  if (pBlock->pMapped != NULL) {
+    vkUnmapMemory(device, pBlock->memory);
+  }
+  delete_Buffer(&pBlock->buffer, device);
+  delete_DeviceMemory(&pBlock->memory, device);
+  delete_BuddyAllocator(&pBlock->allocator);
+  pBlock->live = false;
+}
+
+void delete_VertexPool( //
+    VertexPool *pPool   //
+) {
+  for (uint32_t i = 0; i < pPool->block_len; i++) {
+    if (pPool->blocks[i].live) {
+      delete_VertexPoolBlock(&pPool->blocks[i], pPool->device);
+    }
+  }
+  free(pPool->blocks);
+  pthread_mutex_destroy(&pPool->lock);
+}
+
+// creates a block, reusing the slot of a trimmed one if there is one
+static uint32_t vtp_newBlock( //
+    VertexPool *pPool         //
+) {
+  uint32_t i = 0;
+  while (i < pPool->block_len && pPool->blocks[i].live) {
+    i++;
+  }
+  if (i == pPool->block_len) {
+    if (pPool->block_len >= pPool->block_cap) {
+      pPool->block_cap *= 2;
+      pPool->blocks =
+          realloc(pPool->blocks, pPool->block_cap * sizeof(VertexPoolBlock));
+    }
+    pPool->block_len++;
+  }
+
+  VertexPoolBlock *pBlock = &pPool->blocks[i];
+  ErrVal result = new_SharedBuffer_DeviceMemory(
+      &pBlock->buffer, &pBlock->memory, VERTEX_POOL_BLOCK_SIZE,
+      pPool->physicalDevice, pPool->device, pPool->usage, pPool->properties,
+      pPool->queueFamilyIndexCount, pPool->queueFamilyIndices);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create vertex pool block");
+    PANIC();
+  }
+  pBlock->pMapped = NULL;
+  if (pPool->mapped) {
+    void *pMapped;
+    VkResult mapResult = vkMapMemory(pPool->device, pBlock->memory, 0,
+                                     VERTEX_POOL_BLOCK_SIZE, 0, &pMapped);
+    if (mapResult != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to map vertex pool block: %s",
+                     vkstrerror(mapResult));
+      PANIC();
+    }
+    pBlock->pMapped = pMapped;
+  }
+  new_BuddyAllocator(&pBlock->allocator, VERTEX_POOL_BLOCK_ORDER);
+  pBlock->allocationCount = 0;
+  pBlock->live = true;
+  return i;
+}
+
+void vtp_alloc(                    //
+    VkBuffer *pBuffer,             //
+    VkDeviceSize *pOffset,         //
+    void **ppMapped,               //
+    VertexAllocation *pAllocation, //
+    VertexPool *pPool,             //
+    const VkDeviceSize size        //
+) {
+  uint32_t unitCount =
+      (uint32_t)((size + VERTEX_POOL_UNIT_SIZE - 1) / VERTEX_POOL_UNIT_SIZE);
+
+  pthread_mutex_lock(&pPool->lock);
+
+  // first fit over the blocks, so the early ones fill up and later ones
+  // empty out and can be trimmed
+  uint32_t unit = 0;
+  uint32_t block = 0;
+  while (block < pPool->block_len &&
+         !(pPool->blocks[block].live &&
+           bud_alloc(&unit, &pPool->blocks[block].allocator, unitCount))) {
+    block++;
+  }
+  if (block == pPool->block_len) {
+    block = vtp_newBlock(pPool);
+    if (!bud_alloc(&unit, &pPool->blocks[block].allocator, unitCount)) {
+      LOG_ERROR(ERR_LEVEL_FATAL, "vertex data doesn't fit in a pool block");
+      PANIC();
+    }
+  }
+
+  VertexPoolBlock *pBlock = &pPool->blocks[block];
+  pBlock->allocationCount++;
+  *pBuffer = pBlock->buffer;
+  *pOffset = (VkDeviceSize)unit * VERTEX_POOL_UNIT_SIZE;
+  *ppMapped = pBlock->pMapped == NULL ? NULL : pBlock->pMapped + *pOffset;
+  pAllocation->block = block;
+  pAllocation->unit = unit;
+  pthread_mutex_unlock(&pPool->lock);
+}
+
+void vtp_free(                          //
+    VertexPool *pPool,                  //
+    const VertexAllocation *pAllocation //
+) {
+  pthread_mutex_lock(&pPool->lock);
+  VertexPoolBlock *pBlock = &pPool->blocks[pAllocation->block];
+  bud_free(&pBlock->allocator, pAllocation->unit);
+  pBlock->allocationCount--;
+  pthread_mutex_unlock(&pPool->lock);
+}
+
+void vtp_trim(        //
+    VertexPool *pPool //
+) {
+  pthread_mutex_lock(&pPool->lock);
+  bool kept = false;
+  for (uint32_t i = 0; i < pPool->block_len; i++) {
+    VertexPoolBlock *pBlock = &pPool->blocks[i];
+    if (!pBlock->live || pBlock->allocationCount > 0) {
+      kept = kept || pBlock->live;
+      continue;
+    }
+    // keep the first empty block if nothing's been kept before it
+    if (!kept) {
+      kept = true;
+      continue;
+    }
+    delete_VertexPoolBlock(pBlock, pPool->device);
+    pPool->generation++;
+  }
+  pthread_mutex_unlock(&pPool->lock);
+}
+
+void vtp_getStats(           //
+    VertexPoolStats *pStats, //
+    VertexPool *pPool        //
+) {
+  pthread_mutex_lock(&pPool->lock);
+  pStats->blockCount = 0;
+  pStats->allocationCount = 0;
+  pStats->capacity = 0;
+  pStats->used = 0;
+  pStats->largestFree = 0;
+  for (uint32_t i = 0; i < pPool->block_len; i++) {
+    const VertexPoolBlock *pBlock = &pPool->blocks[i];
+    if (!pBlock->live) {
+      continue;
+    }
+    VkDeviceSize largestFree =
+        (VkDeviceSize)bud_largestFree(&pBlock->allocator) *
+        VERTEX_POOL_UNIT_SIZE;
+    pStats->blockCount++;
+    pStats->allocationCount += pBlock->allocationCount;
+    pStats->capacity += VERTEX_POOL_BLOCK_SIZE;
+    pStats->used += VERTEX_POOL_BLOCK_SIZE -
+                    (VkDeviceSize)pBlock->allocator.freeUnits *
+                        VERTEX_POOL_UNIT_SIZE;
+    if (largestFree > pStats->largestFree) {
+      pStats->largestFree = largestFree;
+    }
+  }
+  pthread_mutex_unlock(&pPool->lock);
+}
+
+uint32_t vtp_getBlockBuffers( //
+    VkBuffer *pBuffers,       //
+    uint64_t *pGeneration,    //
+    const uint32_t capacity,  //
+    VertexPool *pPool         //
+) {
+  pthread_mutex_lock(&pPool->lock);
+  *pGeneration = pPool->generation;
+  uint32_t blockCount = pPool->block_len;
+  for (uint32_t i = 0; i < blockCount && i < capacity; i++) {
+    const VertexPoolBlock *pBlock = &pPool->blocks[i];
+    pBuffers[i] = pBlock->live ? pBlock->buffer : VK_NULL_HANDLE;
+  }
+  pthread_mutex_unlock(&pPool->lock);
+  return blockCount;
+}
@@ -0,0 +1,164 @@
+#ifndef SRC_VERTEX_POOL_H_
+#define SRC_VERTEX_POOL_H_
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "buddy.h"
+#include "vulkan_utils.h"
+
+// allocations are made in multiples of this many bytes
+#define VERTEX_POOL_UNIT_SIZE 1024
+// each block holds 2^VERTEX_POOL_BLOCK_ORDER units (64 MiB)
+#define VERTEX_POOL_BLOCK_ORDER 16
+#define VERTEX_POOL_BLOCK_SIZE                                                 \
+  ((VkDeviceSize)VERTEX_POOL_UNIT_SIZE << VERTEX_POOL_BLOCK_ORDER)
+
+// one big vertex buffer, and what's allocated in it
+typedef struct {
+  // false if the block was trimmed, and its slot can be reused
+  bool live;
+  VkBuffer buffer;
+  VkDeviceMemory memory;
+  // where memory is mapped to, or NULL if the pool isn't host visible
+  uint8_t *pMapped;
+  BuddyAllocator allocator;
+  uint32_t allocationCount;
+} VertexPoolBlock;
+
+/// VertexPool
+/// ---------------------
+/// Places vertex data in a few big shared vertex buffers instead of giving
+/// each mesh its own buffer and memory allocation. Blocks are created as they
+/// fill up, and freed by vtp_trim once they're empty. If the blocks are host
+/// visible, they stay mapped, and allocations can be written to directly.
+/// --- THREAD SAFETY ---
+/// vtp_alloc, vtp_free, vtp_trim, vtp_getStats and vtp_getBlockBuffers may be
+/// called from any thread
+typedef struct {
+  VkDevice device;
+  VkPhysicalDevice physicalDevice;
+  VkBufferUsageFlags usage;
+  VkMemoryPropertyFlags properties;
+  // blocks are host visible and mapped
+  bool mapped;
+  // the queue families blocks are shared between
+  uint32_t queueFamilyIndexCount;
+  uint32_t queueFamilyIndices[2];
+  // guards the blocks, so workers can allocate while the main thread frees
+  pthread_mutex_t lock;
+  uint32_t block_len;
+  uint32_t block_cap;
+  VertexPoolBlock *blocks;
+  // incremented whenever a block is freed. A new block can get the buffer
+  // handle a freed one had, so this is how to tell them apart.
+  uint64_t generation;
+} VertexPool;
+
+// where an allocation lives in a VertexPool
+typedef struct {
+  uint32_t block;
+  uint32_t unit;
+} VertexAllocation;
+
+// how full a VertexPool is, in bytes
+typedef struct {
+  uint32_t blockCount;
+  uint32_t allocationCount;
+  VkDeviceSize capacity;
+  VkDeviceSize used;
+  // the biggest allocation that fits without creating a new block
+  VkDeviceSize largestFree;
+} VertexPoolStats;
+
+/// --- PRECONDITIONS ---
+/// * pPool is a valid pointer
+/// * device and physicalDevice are valid
+/// * blocks are used from the queue families in pQueueFamilyIndices, of
+///   which there are at most 2
+/// --- POSTCONDITIONS ---
+/// * pPool is a valid VertexPool with no blocks
+/// * blocks will be buffers with the given usage, in memory with the given
+///   properties. They're mapped if that includes
+///   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT.
+void new_VertexPool(                        //
+    VertexPool *pPool,                      //
+    const VkDevice device,                  //
+    const VkPhysicalDevice physicalDevice,  //
+    const VkBufferUsageFlags usage,         //
+    const VkMemoryPropertyFlags properties, //
+    const uint32_t queueFamilyIndexCount,   //
+    const uint32_t *pQueueFamilyIndices     //
+);
+
+/// --- PRECONDITIONS ---
+/// * pPool is valid
+/// * the GPU is done with all of its blocks
+/// --- POSTCONDITIONS ---
+/// * all blocks and the memory held by pPool are released
+void delete_VertexPool( //
+    VertexPool *pPool   //
+);
+
+/// allocates room for size bytes of vertexes
+/// --- PRECONDITIONS ---
+/// * pPool is valid
+/// * 0 < size <= VERTEX_POOL_BLOCK_SIZE
+/// --- POSTCONDITIONS ---
+/// * *pBuffer and *pOffset are set to where the room is
+/// * *ppMapped is set to where the room is mapped to, or NULL if the pool
+///   isn't host visible. It stays valid until the allocation is freed.
+/// * *pAllocation is set to what to pass to vtp_free
+/// * creates a new block if none of the others have room
+void vtp_alloc(                    //
+    VkBuffer *pBuffer,             //
+    VkDeviceSize *pOffset,         //
+    void **ppMapped,               //
+    VertexAllocation *pAllocation, //
+    VertexPool *pPool,             //
+    const VkDeviceSize size        //
+);
+
+/// frees an allocation
+/// --- PRECONDITIONS ---
+/// * pPool is valid
+/// * pAllocation came from vtp_alloc and hasn't been freed
+/// * the GPU is done with it
+void vtp_free(                          //
+    VertexPool *pPool,                  //
+    const VertexAllocation *pAllocation //
+);
+
+/// frees the blocks that have nothing in them, except one to start from
+/// --- PRECONDITIONS ---
+/// * pPool is valid
+/// * the GPU is done with the empty blocks
+void vtp_trim(        //
+    VertexPool *pPool //
+);
+
+/// gets how full the pool is
+void vtp_getStats(           //
+    VertexPoolStats *pStats, //
+    VertexPool *pPool        //
+);
+
+/// gets the buffer of each block, by the index in VertexAllocation::block
+/// --- PRECONDITIONS ---
+/// * pPool is valid
+/// * pBuffers has room for capacity buffers
+/// --- POSTCONDITIONS ---
+/// * returns the number of blocks, trimmed ones included
+/// * the first capacity of them are written to pBuffers, VK_NULL_HANDLE for
+///   the trimmed ones
+/// * *pGeneration is set to the pool's generation. If it's the same as at an
+///   earlier call, every buffer that's the same is the same block.
+uint32_t vtp_getBlockBuffers( //
+    VkBuffer *pBuffers,       //
+    uint64_t *pGeneration,    //
+    const uint32_t capacity,  //
+    VertexPool *pPool         //
+);
+
+#endif // SRC_VERTEX_POOL_H_
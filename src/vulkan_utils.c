@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -280,6 +281,36 @@ ErrVal getQueueFamilyIndexByCapability(uint32_t *pQueueFamilyIndex,
   return (ERR_NOTSUPPORTED);
 }
 
+ErrVal getTransferQueueFamilyIndex( //
+    uint32_t *pQueueFamilyIndex,    //
+    const VkPhysicalDevice device   //
+) {
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, NULL);
+  VkQueueFamilyProperties *pFamilyProperties =
+      (VkQueueFamilyProperties *)malloc(queueFamilyCount *
+                                        sizeof(VkQueueFamilyProperties));
+  if (!pFamilyProperties) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "Failed to get transfer queue index: %s",
+                   strerror(errno));
+    PANIC();
+  }
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
+                                           pFamilyProperties);
+  for (uint32_t i = 0; i < queueFamilyCount; i++) {
+    VkQueueFlags flags = pFamilyProperties[i].queueFlags;
+    if (pFamilyProperties[i].queueCount > 0 &&
+        (flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      *pQueueFamilyIndex = i;
+      free(pFamilyProperties);
+      return (ERR_OK);
+    }
+  }
+  free(pFamilyProperties);
+  return (ERR_NOTSUPPORTED);
+}
+
 ErrVal getPresentQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
                                   const VkPhysicalDevice physicalDevice,
                                   const VkSurfaceKHR surface) {
@@ -313,11 +344,29 @@ ErrVal getPresentQueueFamilyIndex(uint32_t *pQueueFamilyIndex,
   return (ERR_NOTSUPPORTED);
 }
 
+bool getDrawIndirectCountSupport(const VkPhysicalDevice physicalDevice) {
+  // the feature is core since 1.2, and there's nothing to ask before that
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+  if (properties.apiVersion < VK_API_VERSION_1_2) {
+    return false;
+  }
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {0};
+  vulkan12Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDeviceFeatures2 features = {0};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &vulkan12Features;
+  vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+  return vulkan12Features.drawIndirectCount;
+}
+
 ErrVal new_Device(                             //
     VkDevice *pDevice,                         //
     const VkPhysicalDevice physicalDevice,     //
     const uint32_t queueFamilyIndex,           //
     const uint32_t queueCount,                 //
+    const uint32_t transferQueueFamilyIndex,   //
     const uint32_t enabledExtensionCount,      //
     const char *const *ppEnabledExtensionNames //
 ) {
@@ -327,18 +376,51 @@ ErrVal new_Device(                             //
     pQueuePriorities[i] = 1.0f;
   }
 
+  // drawing many chunks in one indirect draw needs multiDrawIndirect, turn it
+  // on if it's there
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
   VkPhysicalDeviceFeatures deviceFeatures = {0};
-  VkDeviceQueueCreateInfo queueCreateInfo = {0};
-  queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-  queueCreateInfo.queueFamilyIndex = queueFamilyIndex;
-  queueCreateInfo.queueCount = queueCount;
-  queueCreateInfo.pQueuePriorities = pQueuePriorities;
+  deviceFeatures.multiDrawIndirect = supportedFeatures.multiDrawIndirect;
+  // so does anisotropic filtering of the block textures
+  deviceFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+  // the vertex shader finds each draw's chunk from its firstInstance
+  if (!supportedFeatures.drawIndirectFirstInstance) {
+    LOG_ERROR(ERR_LEVEL_FATAL,
+              "device doesn't support drawIndirectFirstInstance");
+    PANIC();
+  }
+  deviceFeatures.drawIndirectFirstInstance = VK_TRUE;
+  // as does drawing as many chunks as a compute shader says are visible
+  VkPhysicalDeviceVulkan12Features vulkan12Features = {0};
+  vulkan12Features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  vulkan12Features.drawIndirectCount =
+      getDrawIndirectCountSupport(physicalDevice);
+  VkDeviceQueueCreateInfo queueCreateInfos[2] = {0};
+  queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queueCreateInfos[0].queueFamilyIndex = queueFamilyIndex;
+  queueCreateInfos[0].queueCount = queueCount;
+  queueCreateInfos[0].pQueuePriorities = pQueuePriorities;
+
+  // the transfer queue gets a family of its own only if it's a different one
+  uint32_t queueCreateInfoCount = 1;
+  if (transferQueueFamilyIndex != queueFamilyIndex) {
+    queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfos[1].queueFamilyIndex = transferQueueFamilyIndex;
+    queueCreateInfos[1].queueCount = 1;
+    queueCreateInfos[1].pQueuePriorities = pQueuePriorities;
+    queueCreateInfoCount = 2;
+  }
 
   VkDeviceCreateInfo createInfo = {0};
   createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  createInfo.pQueueCreateInfos = &queueCreateInfo;
-  createInfo.queueCreateInfoCount = 1;
+  createInfo.pQueueCreateInfos = queueCreateInfos;
+  createInfo.queueCreateInfoCount = queueCreateInfoCount;
   createInfo.pEnabledFeatures = &deviceFeatures;
+  if (vulkan12Features.drawIndirectCount) {
+    createInfo.pNext = &vulkan12Features;
+  }
   createInfo.enabledExtensionCount = enabledExtensionCount;
   createInfo.ppEnabledExtensionNames = ppEnabledExtensionNames;
   createInfo.enabledLayerCount = 0;
@@ -503,22 +585,23 @@ ErrVal getPreferredSurfaceFormat(VkSurfaceFormatKHR *pSurfaceFormat,
 }
 
 void new_ImageView(VkImageView *pImageView, const VkDevice device,
-                   const VkImage image, const VkFormat format,
-                   const uint32_t aspectMask) {
+                   const VkImage image, const VkImageViewType viewType,
+                   const VkFormat format, const uint32_t aspectMask) {
   VkImageViewCreateInfo createInfo = {0};
   createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   createInfo.image = image;
-  createInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  createInfo.viewType = viewType;
   createInfo.format = format;
   createInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
   createInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
   createInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
   createInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
   createInfo.subresourceRange.aspectMask = aspectMask;
+  // the view sees every level and layer the image has
   createInfo.subresourceRange.baseMipLevel = 0;
-  createInfo.subresourceRange.levelCount = 1;
+  createInfo.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
   createInfo.subresourceRange.baseArrayLayer = 0;
-  createInfo.subresourceRange.layerCount = 1;
+  createInfo.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
   VkResult ret = vkCreateImageView(device, &createInfo, NULL, pImageView);
   if (ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
@@ -541,8 +624,8 @@ void new_SwapchainImageViews(        //
     const VkFormat format            //
 ) {
   for (uint32_t i = 0; i < imageCount; i++) {
-    new_ImageView(&(pImageViews[i]), device, pSwapchainImages[i], format,
-                  VK_IMAGE_ASPECT_COLOR_BIT);
+    new_ImageView(&(pImageViews[i]), device, pSwapchainImages[i],
+                  VK_IMAGE_VIEW_TYPE_2D, format, VK_IMAGE_ASPECT_COLOR_BIT);
   }
 }
 
@@ -621,6 +704,8 @@ static void submitEndOneTimeCmdBuffer(VkCommandBuffer buffer,
 
 static void transitionImageLayout(   //
     VkImage image,                   //
+    const uint32_t levelCount,       //
+    const uint32_t layerCount,       //
     const VkImageLayout oldLayout,   //
     const VkImageLayout newLayout,   //
     const VkCommandPool commandPool, //
@@ -639,9 +724,9 @@ static void transitionImageLayout(   //
   barrier.image = image;
   barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.levelCount = levelCount;
   barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
+  barrier.subresourceRange.layerCount = layerCount;
 
   VkPipelineStageFlags sourceStage;
   VkPipelineStageFlags destinationStage;
@@ -677,30 +762,127 @@ static void transitionImageLayout(   //
   submitEndOneTimeCmdBuffer(commandBuffer, queue, device);
 }
 
-static void copyBufferToImage(       //
+// copies each tile of the atlas in buffer to a layer of its own. The tiles
+// are counted along each row of the atlas, then down the rows
+static void copyAtlasToImageLayers(  //
     VkImage image,                   //
     const VkBuffer buffer,           //
-    VkExtent2D dimensions,           //
+    const VkExtent2D dimensions,     //
+    const uint32_t tileSize,         //
     const VkCommandPool commandPool, //
     const VkDevice device,           //
     const VkQueue queue              //
 ) {
+  const uint32_t columns = dimensions.width / tileSize;
+  const uint32_t rows = dimensions.height / tileSize;
+
+  VkBufferImageCopy *pRegions =
+      malloc(columns * rows * sizeof(VkBufferImageCopy));
+  for (uint32_t row = 0; row < rows; row++) {
+    for (uint32_t column = 0; column < columns; column++) {
+      VkBufferImageCopy region = {0};
+      // each pix has 4 channels, and the tile's rows are an atlas row apart
+      region.bufferOffset =
+          ((VkDeviceSize)row * tileSize * dimensions.width +
+           column * tileSize) *
+          4;
+      region.bufferRowLength = dimensions.width;
+      region.bufferImageHeight = tileSize;
+      region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.imageSubresource.mipLevel = 0;
+      region.imageSubresource.baseArrayLayer = row * columns + column;
+      region.imageSubresource.layerCount = 1;
+      region.imageOffset = (VkOffset3D){0, 0, 0};
+      region.imageExtent = (VkExtent3D){tileSize, tileSize, 1};
+      pRegions[row * columns + column] = region;
+    }
+  }
+
   VkCommandBuffer commandBuffer =
       createBeginOneTimeCmdBuffer(commandPool, device);
 
-  VkBufferImageCopy region = {0};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = (VkOffset3D){0, 0, 0};
-  region.imageExtent = (VkExtent3D){dimensions.width, dimensions.height, 1};
-
   vkCmdCopyBufferToImage(commandBuffer, buffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, columns * rows,
+                         pRegions);
+
+  submitEndOneTimeCmdBuffer(commandBuffer, queue, device);
+  free(pRegions);
+}
+
+// fills every mip level of every layer by blitting down the level above it,
+// and leaves the whole image ready for shaders to read. All the levels must
+// be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, with level 0 written.
+static void generateMipmaps(         //
+    VkImage image,                   //
+    const uint32_t tileSize,         //
+    const uint32_t mipLevels,        //
+    const uint32_t layerCount,       //
+    const VkCommandPool commandPool, //
+    const VkDevice device,           //
+    const VkQueue queue              //
+) {
+  VkCommandBuffer commandBuffer =
+      createBeginOneTimeCmdBuffer(commandPool, device);
+
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = layerCount;
+
+  int32_t size = (int32_t)tileSize;
+  for (uint32_t level = 1; level < mipLevels; level++) {
+    // the level above has been written, and now it's read by the blit
+    barrier.subresourceRange.baseMipLevel = level - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                         1, &barrier);
+
+    const int32_t nextSize = size > 1 ? size / 2 : 1;
+    VkImageBlit blit = {0};
+    blit.srcOffsets[1] = (VkOffset3D){size, size, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = level - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = layerCount;
+    blit.dstOffsets[1] = (VkOffset3D){nextSize, nextSize, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = level;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = layerCount;
+    vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    // after that it's only read by shaders
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
+                         NULL, 1, &barrier);
+
+    size = nextSize;
+  }
+
+  // the last level is never blitted from
+  barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
+                       NULL, 1, &barrier);
 
   submitEndOneTimeCmdBuffer(commandBuffer, queue, device);
 }
@@ -710,11 +892,33 @@ void new_TextureImage(                     //
     VkDeviceMemory *pImageMemory,          //
     const uint8_t *rgbaPxArr,              //
     const VkExtent2D dimensions,           //
+    const uint32_t tileSize,               //
     const VkDevice device,                 //
     const VkPhysicalDevice physicalDevice, //
     const VkCommandPool commandPool,       //
     const VkQueue queue                    //
 ) {
+  const uint32_t layerCount =
+      (dimensions.width / tileSize) * (dimensions.height / tileSize);
+
+  // a level for each halving of the tile down to one pix, if the levels can
+  // be blitted from each other
+  uint32_t mipLevels = 1;
+  const VkFormatFeatureFlags blitFeatures =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(physicalDevice, VK_FORMAT_R8G8B8A8_SRGB,
+                                      &formatProperties);
+  if ((formatProperties.optimalTilingFeatures & blitFeatures) ==
+      blitFeatures) {
+    for (uint32_t size = tileSize; size > 1; size /= 2) {
+      mipLevels++;
+    }
+  } else {
+    LOG_ERROR(ERR_LEVEL_WARN,
+              "texture format can't be blitted, textures will have no mipmaps");
+  }
 
   // each pix has 4 channels
   VkDeviceSize bufferSize = dimensions.height * dimensions.width * 4;
@@ -736,22 +940,28 @@ void new_TextureImage(                     //
 
   copyToDeviceMemory(&stagingBufferMemory, bufferSize, rgbaPxArr, device);
 
-  // create new image
-  new_Image(                                                        //
-      pImage,                                                       //
-      pImageMemory,                                                 //
-      dimensions,                                                   //
-      VK_FORMAT_R8G8B8A8_SRGB,                                      //
-      VK_IMAGE_TILING_OPTIMAL,                                      //
-      VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, //
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,                          //
-      physicalDevice,                                               //
-      device                                                        //
-  );                                                                //
+  // create new image, with a layer the size of each tile
+  new_Image(                                               //
+      pImage,                                              //
+      pImageMemory,                                        //
+      (VkExtent2D){.width = tileSize, .height = tileSize}, //
+      mipLevels,                                           //
+      layerCount,                                          //
+      VK_FORMAT_R8G8B8A8_SRGB,                             //
+      VK_IMAGE_TILING_OPTIMAL,                             //
+      VK_IMAGE_USAGE_TRANSFER_SRC_BIT |                    //
+          VK_IMAGE_USAGE_TRANSFER_DST_BIT |                //
+          VK_IMAGE_USAGE_SAMPLED_BIT,                      //
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,                 //
+      physicalDevice,                                      //
+      device                                               //
+  );                                                       //
 
   // prepare image for data transfer
   transitionImageLayout(                    //
       *pImage,                              //
+      mipLevels,                            //
+      layerCount,                           //
       VK_IMAGE_LAYOUT_UNDEFINED,            //
       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, //
       commandPool,                          //
@@ -759,18 +969,13 @@ void new_TextureImage(                     //
       queue                                 //
   );
 
-  copyBufferToImage(*pImage, stagingBuffer, dimensions, commandPool, device,
-                    queue);
-
-  // prepare image to only be read by shaders
-  transitionImageLayout(                        //
-      *pImage,                                  //
-      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,     //
-      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, //
-      commandPool,                              //
-      device,                                   //
-      queue                                     //
-  );
+  copyAtlasToImageLayers(*pImage, stagingBuffer, dimensions, tileSize,
+                         commandPool, device, queue);
+
+  // fill in the smaller levels, which prepares the image to only be read by
+  // shaders
+  generateMipmaps(*pImage, tileSize, mipLevels, layerCount, commandPool,
+                  device, queue);
 
   /* Delete the temporary staging buffers */
   delete_Buffer(&stagingBuffer, device);
@@ -783,7 +988,8 @@ void new_TextureImageView(          //
     const VkDevice device           //
 ) {
   new_ImageView(pTextureImageView, device, textureImage,
-                VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
+                VK_IMAGE_VIEW_TYPE_2D_ARRAY, VK_FORMAT_R8G8B8A8_SRGB,
+                VK_IMAGE_ASPECT_COLOR_BIT);
 }
 
 ErrVal new_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device,
@@ -800,24 +1006,34 @@ ErrVal new_ShaderModule(VkShaderModule *pShaderModule, const VkDevice device,
   return (ERR_OK);
 }
 
-void new_TextureSampler(VkSampler *pTextureSampler, const VkDevice device) {
+void new_TextureSampler(VkSampler *pTextureSampler, const VkDevice device,
+                        const VkPhysicalDevice physicalDevice) {
   VkSamplerCreateInfo samplerInfo = {0};
   samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
   samplerInfo.magFilter = VK_FILTER_NEAREST;
   samplerInfo.minFilter = VK_FILTER_LINEAR;
-  // white border to check for error in uv mapping
-  samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_WHITE;
-  // we clamp to border to make errors more obvious
-  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
-  // no anisotropy for now
-  samplerInfo.anisotropyEnable = VK_FALSE;
-  samplerInfo.maxAnisotropy = 1.0f;
+  // each tile is a layer of its own, so wrapping around stays on the tile
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  // new_Device turns anisotropy on when the device has it
+  VkPhysicalDeviceFeatures supportedFeatures;
+  vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+  if (supportedFeatures.samplerAnisotropy) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    samplerInfo.anisotropyEnable = VK_TRUE;
+    samplerInfo.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+  } else {
+    samplerInfo.anisotropyEnable = VK_FALSE;
+    samplerInfo.maxAnisotropy = 1.0f;
+  }
   samplerInfo.unnormalizedCoordinates = VK_FALSE;
   samplerInfo.compareEnable = VK_FALSE;
   samplerInfo.compareOp = VK_COMPARE_OP_ALWAYS;
   samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.minLod = 0.0f;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
 
   VkResult ret = vkCreateSampler(device, &samplerInfo, NULL, pTextureSampler);
   if (ret != VK_SUCCESS) {
@@ -912,25 +1128,31 @@ void delete_RenderPass(VkRenderPass *pRenderPass, const VkDevice device) {
   *pRenderPass = VK_NULL_HANDLE;
 }
 
-// makes a new descriptor set layout and pipeline layout
+// makes the new descriptor set layouts and pipeline layout
 void new_VertexDisplayPipelineLayoutDescriptorSetLayout(      //
     VkPipelineLayout *pVertexDisplayPipelineLayout,           //
     VkDescriptorSetLayout *pVertexDisplayDescriptorSetLayout, //
+    VkDescriptorSetLayout *pFaceDescriptorSetLayout,          //
     const VkDevice device                                     //
 ) {
-  // create a descriptor set at 0 for the sampler
-  VkDescriptorSetLayoutBinding samplerLayoutBinding = {0};
-  samplerLayoutBinding.binding = 0;
-  samplerLayoutBinding.descriptorCount = 1;
-  samplerLayoutBinding.descriptorType =
-      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  samplerLayoutBinding.pImmutableSamplers = NULL;
-  samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  // create a descriptor set at 0 for the sampler, and the uniforms
+  VkDescriptorSetLayoutBinding layoutBindings[2] = {0};
+  layoutBindings[0].binding = 0;
+  layoutBindings[0].descriptorCount = 1;
+  layoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  layoutBindings[0].pImmutableSamplers = NULL;
+  layoutBindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  layoutBindings[1].binding = 1;
+  layoutBindings[1].descriptorCount = 1;
+  layoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  layoutBindings[1].pImmutableSamplers = NULL;
+  layoutBindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
   VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
   layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  layoutInfo.bindingCount = 1;
-  layoutInfo.pBindings = &samplerLayoutBinding;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = layoutBindings;
 
   VkResult ret = vkCreateDescriptorSetLayout(device, &layoutInfo, NULL,
                                              pVertexDisplayDescriptorSetLayout);
@@ -941,18 +1163,36 @@ void new_VertexDisplayPipelineLayoutDescriptorSetLayout(      //
     PANIC();
   }
 
-  // push our mvp matrix
-  VkPushConstantRange pushConstantRange = {0};
-  pushConstantRange.offset = 0;
-  pushConstantRange.size = sizeof(mat4x4);
-  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  // and one at 1 for the faces the vertex shader pulls its vertexes from
+  VkDescriptorSetLayoutBinding faceLayoutBinding = {0};
+  faceLayoutBinding.binding = 0;
+  faceLayoutBinding.descriptorCount = 1;
+  faceLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  faceLayoutBinding.pImmutableSamplers = NULL;
+  faceLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  VkDescriptorSetLayoutCreateInfo faceLayoutInfo = {0};
+  faceLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  faceLayoutInfo.bindingCount = 1;
+  faceLayoutInfo.pBindings = &faceLayoutBinding;
 
+  ret = vkCreateDescriptorSetLayout(device, &faceLayoutInfo, NULL,
+                                    pFaceDescriptorSetLayout);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                   "failed to create descriptor set layout with error: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+
+  const VkDescriptorSetLayout setLayouts[2] = {
+      *pVertexDisplayDescriptorSetLayout, *pFaceDescriptorSetLayout};
   VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
   pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipelineLayoutInfo.setLayoutCount = 1;
-  pipelineLayoutInfo.pSetLayouts = pVertexDisplayDescriptorSetLayout;
-  pipelineLayoutInfo.pushConstantRangeCount = 1;
-  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  pipelineLayoutInfo.setLayoutCount = 2;
+  pipelineLayoutInfo.pSetLayouts = setLayouts;
+  pipelineLayoutInfo.pushConstantRangeCount = 0;
+  pipelineLayoutInfo.pPushConstantRanges = NULL;
   VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL,
                                         pVertexDisplayPipelineLayout);
   if (res != VK_SUCCESS) {
@@ -966,67 +1206,38 @@ void new_VertexDisplayPipelineLayoutDescriptorSetLayout(      //
 void delete_VertexDisplayPipelineLayoutDescriptorSetLayout( //
     VkPipelineLayout *pPipelineLayout,                      //
     VkDescriptorSetLayout *pDescriptorSetLayout,            //
+    VkDescriptorSetLayout *pFaceDescriptorSetLayout,        //
     const VkDevice device                                   //
 ) {
   vkDestroyPipelineLayout(device, *pPipelineLayout, NULL);
   *pPipelineLayout = VK_NULL_HANDLE;
   vkDestroyDescriptorSetLayout(device, *pDescriptorSetLayout, NULL);
   *pDescriptorSetLayout = VK_NULL_HANDLE;
-}
-
-void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
-                               const VkDevice device,
-                               const VkShaderModule vertShaderModule,
-                               const VkShaderModule fragShaderModule,
-                               const VkExtent2D extent,
-                               const VkRenderPass renderPass,
-                               const VkPipelineLayout pipelineLayout) {
-  VkPipelineShaderStageCreateInfo vertShaderStageInfo = {0};
-  vertShaderStageInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
-  vertShaderStageInfo.module = vertShaderModule;
-  vertShaderStageInfo.pName = "main";
-
-  VkPipelineShaderStageCreateInfo fragShaderStageInfo = {0};
-  fragShaderStageInfo.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  fragShaderStageInfo.module = fragShaderModule;
-  fragShaderStageInfo.pName = "main";
-
-  VkPipelineShaderStageCreateInfo shaderStages[2] = {vertShaderStageInfo,
-                                                     fragShaderStageInfo};
-
-  VkVertexInputBindingDescription bindingDescription = {0};
-  bindingDescription.binding = 0;
-  bindingDescription.stride = sizeof(Vertex);
-  bindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-  VkVertexInputAttributeDescription attributeDescriptions[3];
-
-  attributeDescriptions[0].binding = 0;
-  attributeDescriptions[0].location = 0;
-  attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[0].offset = offsetof(Vertex, position);
-
-  attributeDescriptions[1].binding = 0;
-  attributeDescriptions[1].location = 1;
-  attributeDescriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  attributeDescriptions[1].offset = offsetof(Vertex, normal);
-
-  attributeDescriptions[2].binding = 0;
-  attributeDescriptions[2].location = 2;
-  attributeDescriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-  attributeDescriptions[2].offset = offsetof(Vertex, texCoords);
-
+  vkDestroyDescriptorSetLayout(device, *pFaceDescriptorSetLayout, NULL);
+  *pFaceDescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+// makes a pipeline that draws faces with the shader stages, which write
+// depth and the color components in colorWriteMask
+static void new_FacePipeline(                             //
+    VkPipeline *pGraphicsPipeline,                        //
+    const VkDevice device,                                //
+    const uint32_t stageCount,                            //
+    const VkPipelineShaderStageCreateInfo *pShaderStages, //
+    const VkBool32 depthWriteEnable,                      //
+    const VkCompareOp depthCompareOp,                     //
+    const VkColorComponentFlags colorWriteMask,           //
+    const VkRenderPass renderPass,                        //
+    const VkPipelineLayout pipelineLayout,                //
+    const VkPipelineCache pipelineCache                   //
+) {
+  // there are no vertex attributes, the vertex shader pulls faces out of a
+  // storage buffer instead
   VkPipelineVertexInputStateCreateInfo vertexInputInfo = {0};
   vertexInputInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 1;
-  vertexInputInfo.pVertexBindingDescriptions = &bindingDescription;
-  vertexInputInfo.vertexAttributeDescriptionCount = 3;
-  vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+  vertexInputInfo.vertexBindingDescriptionCount = 0;
+  vertexInputInfo.vertexAttributeDescriptionCount = 0;
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly = {0};
   inputAssembly.sType =
@@ -1034,34 +1245,30 @@ void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-  VkViewport viewport = {0};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)extent.width;
-  viewport.height = (float)extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-
-  VkRect2D scissor = {0};
-  scissor.offset.x = 0;
-  scissor.offset.y = 0;
-  scissor.extent = extent;
-
   VkPipelineDepthStencilStateCreateInfo depthStencil = {0};
   depthStencil.sType =
       VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
   depthStencil.depthTestEnable = VK_TRUE;
-  depthStencil.depthWriteEnable = VK_TRUE;
-  depthStencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depthStencil.depthWriteEnable = depthWriteEnable;
+  depthStencil.depthCompareOp = depthCompareOp;
   depthStencil.depthBoundsTestEnable = VK_FALSE;
   depthStencil.stencilTestEnable = VK_FALSE;
 
+  // the viewport and scissor are set when drawing, so that the pipeline
+  // outlives the swapchain
   VkPipelineViewportStateCreateInfo viewportState = {0};
   viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
   viewportState.viewportCount = 1;
-  viewportState.pViewports = &viewport;
+  viewportState.pViewports = NULL;
   viewportState.scissorCount = 1;
-  viewportState.pScissors = &scissor;
+  viewportState.pScissors = NULL;
+
+  const VkDynamicState dynamicStates[2] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                           VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dynamicState = {0};
+  dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamicState.dynamicStateCount = 2;
+  dynamicState.pDynamicStates = dynamicStates;
 
   VkPipelineRasterizationStateCreateInfo rasterizer = {0};
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
@@ -1080,9 +1287,7 @@ void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
   VkPipelineColorBlendAttachmentState colorBlendAttachment = {0};
-  colorBlendAttachment.colorWriteMask =
-      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  colorBlendAttachment.colorWriteMask = colorWriteMask;
   colorBlendAttachment.blendEnable = VK_FALSE;
 
   VkPipelineColorBlendStateCreateInfo colorBlending = {0};
@@ -1099,8 +1304,8 @@ void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
 
   VkGraphicsPipelineCreateInfo pipelineInfo = {0};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipelineInfo.stageCount = 2;
-  pipelineInfo.pStages = shaderStages;
+  pipelineInfo.stageCount = stageCount;
+  pipelineInfo.pStages = pShaderStages;
   pipelineInfo.pVertexInputState = &vertexInputInfo;
   pipelineInfo.pInputAssemblyState = &inputAssembly;
   pipelineInfo.pViewportState = &viewportState;
@@ -1108,22 +1313,349 @@ void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
   pipelineInfo.pMultisampleState = &multisampling;
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.pDepthStencilState = &depthStencil;
+  pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = pipelineLayout;
   pipelineInfo.renderPass = renderPass;
   pipelineInfo.subpass = 0;
   pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
 
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, NULL,
+  if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, NULL,
                                 pGraphicsPipeline) != VK_SUCCESS) {
     LOG_ERROR(ERR_LEVEL_FATAL, "failed to create graphics pipeline!");
     PANIC();
   }
 }
 
+void new_VertexDisplayPipeline(VkPipeline *pGraphicsPipeline,
+                               const VkDevice device,
+                               const VkShaderModule vertShaderModule,
+                               const VkShaderModule fragShaderModule,
+                               const VkRenderPass renderPass,
+                               const VkPipelineLayout pipelineLayout,
+                               const VkPipelineCache pipelineCache,
+                               const bool afterDepthPrepass) {
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo = {0};
+  vertShaderStageInfo.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+
+  VkPipelineShaderStageCreateInfo fragShaderStageInfo = {0};
+  fragShaderStageInfo.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  fragShaderStageInfo.module = fragShaderModule;
+  fragShaderStageInfo.pName = "main";
+
+  VkPipelineShaderStageCreateInfo shaderStages[2] = {vertShaderStageInfo,
+                                                     fragShaderStageInfo};
+
+  // after the prepass, the depth buffer already has the nearest faces in it,
+  // and only fragments of those get through
+  new_FacePipeline(
+      pGraphicsPipeline, device, 2, shaderStages,
+      afterDepthPrepass ? VK_FALSE : VK_TRUE,
+      afterDepthPrepass ? VK_COMPARE_OP_LESS_OR_EQUAL : VK_COMPARE_OP_LESS,
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+          VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+      renderPass, pipelineLayout, pipelineCache);
+}
+
+void new_DepthPrepassPipeline(VkPipeline *pDepthPrepassPipeline,
+                              const VkDevice device,
+                              const VkShaderModule vertShaderModule,
+                              const VkRenderPass renderPass,
+                              const VkPipelineLayout pipelineLayout,
+                              const VkPipelineCache pipelineCache) {
+  // there's no fragment shader, rasterizing only writes depth
+  VkPipelineShaderStageCreateInfo vertShaderStageInfo = {0};
+  vertShaderStageInfo.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vertShaderStageInfo.module = vertShaderModule;
+  vertShaderStageInfo.pName = "main";
+
+  new_FacePipeline(pDepthPrepassPipeline, device, 1, &vertShaderStageInfo,
+                   VK_TRUE, VK_COMPARE_OP_LESS, 0, renderPass, pipelineLayout,
+                   pipelineCache);
+}
+
 void delete_Pipeline(VkPipeline *pPipeline, const VkDevice device) {
   vkDestroyPipeline(device, *pPipeline, NULL);
 }
 
+#define PIPELINE_CACHE_FILE_MAGIC 0x48435056u
+
+// comes before the data in a pipeline cache file. The driver only knows what
+// to do with data from the same device and driver version, and some don't
+// check.
+typedef struct {
+  uint32_t magic;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  // of the data after the header, to tell if it was cut short or corrupted
+  uint32_t dataSize;
+  uint32_t dataHash;
+} PipelineCacheFileHeader;
+
+// the header a pipeline cache file of size bytes of data from the device
+// should have
+static PipelineCacheFileHeader
+getPipelineCacheFileHeader(const VkPhysicalDevice physicalDevice,
+                           const void *pData, const size_t size) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+  PipelineCacheFileHeader header = {0};
+  header.magic = PIPELINE_CACHE_FILE_MAGIC;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+         VK_UUID_SIZE);
+  header.dataSize = (uint32_t)size;
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ ((const uint8_t *)pData)[i]) * 16777619u;
+  }
+  header.dataHash = hash;
+  return (header);
+}
+
+void readPipelineCacheFile(void **ppData, size_t *pSize, const char *path,
+                           const VkPhysicalDevice physicalDevice) {
+  *ppData = NULL;
+  *pSize = 0;
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return;
+  }
+  PipelineCacheFileHeader header;
+  if (fread(&header, sizeof(header), 1, fp) != 1 ||
+      header.magic != PIPELINE_CACHE_FILE_MAGIC || header.dataSize == 0) {
+    LOG_ERROR(ERR_LEVEL_WARN, "ignoring invalid pipeline cache file");
+    fclose(fp);
+    return;
+  }
+  void *pData = malloc(header.dataSize);
+  if (pData == NULL || fread(pData, header.dataSize, 1, fp) != 1) {
+    LOG_ERROR(ERR_LEVEL_WARN, "ignoring truncated pipeline cache file");
+    free(pData);
+    fclose(fp);
+    return;
+  }
+  fclose(fp);
+
+  PipelineCacheFileHeader expected =
+      getPipelineCacheFileHeader(physicalDevice, pData, header.dataSize);
+  if (header.vendorID != expected.vendorID ||
+      header.deviceID != expected.deviceID ||
+      header.driverVersion != expected.driverVersion ||
+      memcmp(header.pipelineCacheUUID, expected.pipelineCacheUUID,
+             VK_UUID_SIZE) != 0 ||
+      header.dataHash != expected.dataHash) {
+    LOG_ERROR(ERR_LEVEL_INFO,
+              "pipeline cache file is from another device or driver, or "
+              "corrupted, starting over");
+    free(pData);
+    return;
+  }
+  *ppData = pData;
+  *pSize = header.dataSize;
+}
+
+void new_PipelineCache(VkPipelineCache *pPipelineCache, const char *path,
+                       const VkPhysicalDevice physicalDevice,
+                       const VkDevice device) {
+  void *pData;
+  size_t size;
+  readPipelineCacheFile(&pData, &size, path, physicalDevice);
+
+  VkPipelineCacheCreateInfo cacheInfo = {0};
+  cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  cacheInfo.initialDataSize = size;
+  cacheInfo.pInitialData = pData;
+  VkResult ret =
+      vkCreatePipelineCache(device, &cacheInfo, NULL, pPipelineCache);
+  if (ret != VK_SUCCESS && pData != NULL) {
+    // the data is only a hint, so try again without it
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN,
+                   "failed to load pipeline cache, starting over: %s",
+                   vkstrerror(ret));
+    cacheInfo.initialDataSize = 0;
+    cacheInfo.pInitialData = NULL;
+    ret = vkCreatePipelineCache(device, &cacheInfo, NULL, pPipelineCache);
+  }
+  free(pData);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create pipeline cache: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+}
+
+ErrVal savePipelineCache(const VkPipelineCache pipelineCache, const char *path,
+                         const VkPhysicalDevice physicalDevice,
+                         const VkDevice device) {
+  size_t size;
+  VkResult ret = vkGetPipelineCacheData(device, pipelineCache, &size, NULL);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "failed to get pipeline cache size: %s",
+                   vkstrerror(ret));
+    return (ERR_UNKNOWN);
+  }
+  if (size == 0 || size > UINT32_MAX) {
+    return (ERR_OK);
+  }
+  void *pData = malloc(size);
+  if (pData == NULL) {
+    LOG_ERROR(ERR_LEVEL_WARN, "failed to allocate pipeline cache data");
+    return (ERR_ALLOCFAIL);
+  }
+  ret = vkGetPipelineCacheData(device, pipelineCache, &size, pData);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "failed to get pipeline cache data: %s",
+                   vkstrerror(ret));
+    free(pData);
+    return (ERR_UNKNOWN);
+  }
+  PipelineCacheFileHeader header =
+      getPipelineCacheFileHeader(physicalDevice, pData, size);
+
+  // write it next to the old file and then move it over, so that a crash
+  // halfway through doesn't leave half a file
+  size_t pathLength = strlen(path);
+  char *tmpPath = malloc(pathLength + sizeof(".tmp"));
+  if (tmpPath == NULL) {
+    LOG_ERROR(ERR_LEVEL_WARN, "failed to allocate pipeline cache path");
+    free(pData);
+    return (ERR_ALLOCFAIL);
+  }
+  memcpy(tmpPath, path, pathLength);
+  memcpy(tmpPath + pathLength, ".tmp", sizeof(".tmp"));
+  FILE *fp = fopen(tmpPath, "wb");
+  bool written = fp != NULL && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                 fwrite(pData, size, 1, fp) == 1;
+  if (fp != NULL && fclose(fp) != 0) {
+    written = false;
+  }
+  free(pData);
+  if (!written || rename(tmpPath, path) != 0) {
+    LOG_ERROR_ARGS(ERR_LEVEL_WARN, "failed to write pipeline cache: %s",
+                   strerror(errno));
+    remove(tmpPath);
+    free(tmpPath);
+    return (ERR_UNKNOWN);
+  }
+  free(tmpPath);
+  return (ERR_OK);
+}
+
+void delete_PipelineCache(VkPipelineCache *pPipelineCache,
+                          const VkDevice device) {
+  vkDestroyPipelineCache(device, *pPipelineCache, NULL);
+  *pPipelineCache = VK_NULL_HANDLE;
+}
+
+// makes a new descriptor set layout and pipeline layout for the culling
+// compute shader
+void new_CullPipelineLayoutDescriptorSetLayout(      //
+    VkPipelineLayout *pCullPipelineLayout,           //
+    VkDescriptorSetLayout *pCullDescriptorSetLayout, //
+    const VkDevice device                            //
+) {
+  // the draw records, the commands written for the visible ones, the number
+  // of commands for each block, and where each chunk's commands start in
+  // each block, all storage buffers
+  VkDescriptorSetLayoutBinding bindings[CULL_BINDING_COUNT] = {0};
+  for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorCount = 1;
+    bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].pImmutableSamplers = NULL;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo = {0};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = CULL_BINDING_COUNT;
+  layoutInfo.pBindings = bindings;
+
+  VkResult ret = vkCreateDescriptorSetLayout(device, &layoutInfo, NULL,
+                                             pCullDescriptorSetLayout);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                   "failed to create descriptor set layout with error: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+
+  // push the frustum planes, how many draws and blocks there are, and the
+  // pass
+  VkPushConstantRange pushConstantRange = {0};
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(CullPushConstants);
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo = {0};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = pCullDescriptorSetLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+  VkResult res = vkCreatePipelineLayout(device, &pipelineLayoutInfo, NULL,
+                                        pCullPipelineLayout);
+  if (res != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                   "failed to create pipeline layout with error: %s",
+                   vkstrerror(res));
+    PANIC();
+  }
+}
+
+void delete_CullPipelineLayoutDescriptorSetLayout( //
+    VkPipelineLayout *pPipelineLayout,             //
+    VkDescriptorSetLayout *pDescriptorSetLayout,   //
+    const VkDevice device                          //
+) {
+  vkDestroyPipelineLayout(device, *pPipelineLayout, NULL);
+  *pPipelineLayout = VK_NULL_HANDLE;
+  vkDestroyDescriptorSetLayout(device, *pDescriptorSetLayout, NULL);
+  *pDescriptorSetLayout = VK_NULL_HANDLE;
+}
+
+void new_CullPipeline(                         //
+    VkPipeline *pCullPipeline,                 //
+    const VkDevice device,                     //
+    const VkShaderModule cullShaderModule,     //
+    const VkPipelineLayout cullPipelineLayout, //
+    const VkPipelineCache pipelineCache        //
+) {
+  VkPipelineShaderStageCreateInfo shaderStageInfo = {0};
+  shaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  shaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  shaderStageInfo.module = cullShaderModule;
+  shaderStageInfo.pName = "main";
+
+  VkComputePipelineCreateInfo pipelineInfo = {0};
+  pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipelineInfo.stage = shaderStageInfo;
+  pipelineInfo.layout = cullPipelineLayout;
+  pipelineInfo.basePipelineHandle = VK_NULL_HANDLE;
+
+  VkResult ret = vkCreateComputePipelines(device, pipelineCache, 1,
+                                          &pipelineInfo, NULL, pCullPipeline);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create compute pipeline: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+}
+
 void new_Framebuffer(VkFramebuffer *pFramebuffer, const VkDevice device,
                      const VkRenderPass renderPass, const VkImageView imageView,
                      const VkImageView depthImageView,
@@ -1190,33 +1722,221 @@ void delete_CommandPool(VkCommandPool *pCommandPool, const VkDevice device) {
   vkDestroyCommandPool(device, *pCommandPool, NULL);
 }
 
-ErrVal recordVertexDisplayCommandBuffer(                //
+ErrVal beginOneTimeCommandBuffer(VkCommandBuffer commandBuffer) {
+  VkCommandBufferBeginInfo beginInfo = {0};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  VkResult beginRet = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+
+  if (beginRet != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                   "failed to record into graphics command buffer: %s",
+                   vkstrerror(beginRet));
+    PANIC();
+  }
+  return (ERR_OK);
+}
+
+ErrVal endCommandBuffer(VkCommandBuffer commandBuffer) {
+  VkResult endCommandBufferRetVal = vkEndCommandBuffer(commandBuffer);
+  if (endCommandBufferRetVal != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
+                   "Failed to record command buffer, error code: %s",
+                   vkstrerror(endCommandBufferRetVal));
+    PANIC();
+  }
+  return (ERR_OK);
+}
+
+uint32_t stageCullDrawRecords(            //
+    VkBufferCopy *pCopies,                //
+    void *pStaging,                       //
+    const uint32_t changeCount,           //
+    const uint32_t *pChangedIndexes,      //
+    const CullDrawRecord *pChangedRecords //
+) {
+  memcpy(pStaging, pChangedRecords, changeCount * sizeof(CullDrawRecord));
+  uint32_t copyCount = 0;
+  for (uint32_t i = 0; i < changeCount; i++) {
+    if (copyCount > 0 && pChangedIndexes[i] == pChangedIndexes[i - 1] + 1) {
+      pCopies[copyCount - 1].size += sizeof(CullDrawRecord);
+      continue;
+    }
+    pCopies[copyCount].srcOffset = i * sizeof(CullDrawRecord);
+    pCopies[copyCount].dstOffset =
+        pChangedIndexes[i] * sizeof(CullDrawRecord);
+    pCopies[copyCount].size = sizeof(CullDrawRecord);
+    copyCount++;
+  }
+  return copyCount;
+}
+
+ErrVal recordCullCommands(                     //
+    VkCommandBuffer commandBuffer,             //
+    const VkPipelineLayout cullPipelineLayout, //
+    const VkPipeline cullPipeline,             //
+    const VkDescriptorSet cullDescriptorSet,   //
+    const VkBuffer recordBuffer,               //
+    const VkBuffer stagingBuffer,              //
+    const uint32_t copyCount,                  //
+    const VkBufferCopy *pCopies,               //
+    const uint32_t blockCount,                 //
+    const CullPushConstants *pConstants        //
+) {
+  // earlier frames' culling has to be done reading the records before they
+  // change
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 0,
+                       NULL);
+  if (copyCount > 0) {
+    vkCmdCopyBuffer(commandBuffer, stagingBuffer, recordBuffer, copyCount,
+                    pCopies);
+  }
+
+  VkMemoryBarrier uploadBarrier = {0};
+  uploadBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  uploadBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  uploadBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                       &uploadBarrier, 0, NULL, 0, NULL);
+
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    cullPipeline);
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          cullPipelineLayout, 0, 1, &cullDescriptorSet, 0,
+                          NULL);
+  // the chunks and the blocks are culled in parallel, with a workgroup each.
+  // Without blocks, nothing is drawn.
+  const uint32_t chunkCount =
+      blockCount == 0 ? 0
+                      : (pConstants->drawCount + CULL_WORKGROUP_SIZE - 1) /
+                            CULL_WORKGROUP_SIZE;
+  const uint32_t passes[3] = {CULL_PASS_COUNT, CULL_PASS_SCAN,
+                              CULL_PASS_WRITE};
+  const uint32_t workgroupCounts[3] = {chunkCount, blockCount, chunkCount};
+  CullPushConstants constants = *pConstants;
+  constants.blockCount = blockCount;
+  for (uint32_t i = 0; i < 3; i++) {
+    if (i > 0) {
+      // each pass reads the offsets the one before it wrote
+      VkMemoryBarrier passBarrier = {0};
+      passBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+      passBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+      passBarrier.dstAccessMask =
+          VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+      vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                           VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                           &passBarrier, 0, NULL, 0, NULL);
+    }
+    constants.pass = passes[i];
+    vkCmdPushConstants(commandBuffer, cullPipelineLayout,
+                       VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                       sizeof(CullPushConstants), &constants);
+    // the scan still runs without draws, to set the counts to 0
+    if (workgroupCounts[i] > 0) {
+      vkCmdDispatch(commandBuffer, workgroupCounts[i], 1, 1);
+    }
+  }
+
+  // the draws read the commands and counts, and the counts are read back
+  // once the frame is done
+  VkMemoryBarrier cullBarrier = {0};
+  cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cullBarrier.dstAccessMask =
+      VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_HOST_READ_BIT;
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                           VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &cullBarrier, 0, NULL, 0, NULL);
+  return (ERR_OK);
+}
+
+ErrVal recordBlockCommands(                             //
     VkCommandBuffer commandBuffer,                      //
-    const VkFramebuffer swapchainFramebuffer,           //
-    const uint32_t vertexBufferCount,                   //
-    const VkBuffer *pVertexBuffers,                     //
-    const uint32_t *pVertexCounts,                      //
     const VkRenderPass renderPass,                      //
+    const VkExtent2D extent,                            //
     const VkPipelineLayout vertexDisplayPipelineLayout, //
     const VkPipeline vertexDisplayPipeline,             //
-    const VkExtent2D swapchainExtent,                   //
-    const mat4x4 cameraTransform,                       //
     const VkDescriptorSet vertexDisplayDescriptorSet,   //
-    const VkClearColorValue clearColor                  //
+    const VkDescriptorSet faceDescriptorSet,            //
+    const VkBuffer indirectBuffer,                      //
+    const VkDeviceSize commandOffset,                   //
+    const uint32_t commandCount,                        //
+    const VkBuffer countBuffer,                         //
+    const VkDeviceSize countOffset,                     //
+    const bool multiDrawIndirect                        //
 ) {
+  // it's run inside the render pass, by whichever framebuffer is drawn to
+  VkCommandBufferInheritanceInfo inheritanceInfo = {0};
+  inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritanceInfo.renderPass = renderPass;
+  inheritanceInfo.subpass = 0;
+  inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
   VkCommandBufferBeginInfo beginInfo = {0};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritanceInfo;
 
   VkResult beginRet = vkBeginCommandBuffer(commandBuffer, &beginInfo);
-
   if (beginRet != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
-                   "failed to record into graphics command buffer: %s",
+                   "failed to record into block command buffer: %s",
                    vkstrerror(beginRet));
     PANIC();
   }
 
+  // nothing is inherited from the primary command buffer, so bind it all
+  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    vertexDisplayPipeline);
+  VkViewport viewport = {0};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)extent.width;
+  viewport.height = (float)extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+  VkRect2D scissor = {0};
+  scissor.offset.x = 0;
+  scissor.offset.y = 0;
+  scissor.extent = extent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+  const VkDescriptorSet descriptorSets[2] = {vertexDisplayDescriptorSet,
+                                             faceDescriptorSet};
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          vertexDisplayPipelineLayout, 0, 2, descriptorSets, 0,
+                          NULL);
+  const VkDeviceSize stride = sizeof(VkDrawIndirectCommand);
+  if (countBuffer != VK_NULL_HANDLE) {
+    vkCmdDrawIndirectCount(commandBuffer, indirectBuffer, commandOffset,
+                           countBuffer, countOffset, commandCount,
+                           (uint32_t)stride);
+  } else if (multiDrawIndirect) {
+    vkCmdDrawIndirect(commandBuffer, indirectBuffer, commandOffset,
+                      commandCount, (uint32_t)stride);
+  } else {
+    for (uint32_t i = 0; i < commandCount; i++) {
+      vkCmdDrawIndirect(commandBuffer, indirectBuffer,
+                        commandOffset + i * stride, 1, (uint32_t)stride);
+    }
+  }
+  return (endCommandBuffer(commandBuffer));
+}
+
+ErrVal recordVertexDisplayCommands(                //
+    VkCommandBuffer commandBuffer,                 //
+    const VkFramebuffer swapchainFramebuffer,      //
+    const VkRenderPass renderPass,                 //
+    const VkExtent2D swapchainExtent,              //
+    const uint32_t blockCount,                     //
+    const VkCommandBuffer *pPrepassCommandBuffers, //
+    const VkCommandBuffer *pBlockCommandBuffers,   //
+    const VkClearColorValue clearColor             //
+) {
   VkRenderPassBeginInfo renderPassInfo = {0};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = renderPass;
@@ -1232,31 +1952,17 @@ ErrVal recordVertexDisplayCommandBuffer(                //
   renderPassInfo.clearValueCount = 2;
   renderPassInfo.pClearValues = pClearColors;
 
+  // the draws are all in the blocks' command buffers. Every block's depth
+  // goes in before any of them are shaded.
   vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
-  vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    vertexDisplayPipeline);
-  vkCmdPushConstants(commandBuffer, vertexDisplayPipelineLayout,
-                     VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4x4),
-                     cameraTransform);
-  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          vertexDisplayPipelineLayout, 0, 1,
-                          &vertexDisplayDescriptorSet, 0, NULL);
-  // bind all vertex buffers, assume offsets are zero
-  for (uint32_t i = 0; i < vertexBufferCount; i++) {
-    VkDeviceSize offsets[] = {0};
-    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &pVertexBuffers[i], offsets);
-    vkCmdDraw(commandBuffer, pVertexCounts[i], 1, 0, 0);
+                       VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+  if (blockCount > 0 && pPrepassCommandBuffers != NULL) {
+    vkCmdExecuteCommands(commandBuffer, blockCount, pPrepassCommandBuffers);
   }
-  vkCmdEndRenderPass(commandBuffer);
-
-  VkResult endCommandBufferRetVal = vkEndCommandBuffer(commandBuffer);
-  if (endCommandBufferRetVal != VK_SUCCESS) {
-    LOG_ERROR_ARGS(ERR_LEVEL_FATAL,
-                   "Failed to record command buffer, error code: %s",
-                   vkstrerror(endCommandBufferRetVal));
-    PANIC();
+  if (blockCount > 0) {
+    vkCmdExecuteCommands(commandBuffer, blockCount, pBlockCommandBuffers);
   }
+  vkCmdEndRenderPass(commandBuffer);
   return (ERR_OK);
 }
 
@@ -1390,6 +2096,7 @@ ErrVal drawFrame(                        //
     VkSwapchainKHR swapchain,            //
     const uint32_t swapchainImageIndex,  //
     VkSemaphore imageAvailableSemaphore, //
+    VkSemaphore uploadSemaphore,         //
     VkSemaphore renderFinishedSemaphore, //
     VkFence inFlightFence,               //
     const VkQueue graphicsQueue,         //
@@ -1397,13 +2104,15 @@ ErrVal drawFrame(                        //
 ) {
 
   // Sets up for next frame
+  VkSemaphore waitSemaphores[] = {imageAvailableSemaphore, uploadSemaphore};
   VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+      VK_PIPELINE_STAGE_VERTEX_SHADER_BIT};
 
   VkSubmitInfo submitInfo = {0};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.waitSemaphoreCount = 1;
-  submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+  submitInfo.waitSemaphoreCount = uploadSemaphore != VK_NULL_HANDLE ? 2 : 1;
+  submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
   submitInfo.pCommandBuffers = &commandBuffer;
@@ -1482,21 +2191,34 @@ ErrVal getMemoryTypeIndex(uint32_t *memoryTypeIndex,
                           const uint32_t memoryTypeBits,
                           const VkMemoryPropertyFlags memoryPropertyFlags,
                           const VkPhysicalDevice physicalDevice) {
+  ErrVal result = getMemoryTypeIndexInHeap(
+      memoryTypeIndex, memoryTypeBits, memoryPropertyFlags, 0, physicalDevice);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_ERROR, "failed to find suitable memory type");
+  }
+  return (result);
+}
 
+ErrVal getMemoryTypeIndexInHeap(                     //
+    uint32_t *memoryTypeIndex,                       //
+    const uint32_t memoryTypeBits,                   //
+    const VkMemoryPropertyFlags memoryPropertyFlags, //
+    const VkDeviceSize minHeapSize,                  //
+    const VkPhysicalDevice physicalDevice            //
+) {
   /* Retrieve memory properties */
   VkPhysicalDeviceMemoryProperties memProperties;
   vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
   /* Check each memory type to see if it conforms to our requirements */
   for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-    if ((memoryTypeBits &
-         (1 << i)) && /* TODO figure out what's going on over here */
-        (memProperties.memoryTypes[i].propertyFlags & memoryPropertyFlags) ==
-            memoryPropertyFlags) {
+    const VkMemoryType *pType = &memProperties.memoryTypes[i];
+    if ((memoryTypeBits & (1u << i)) &&
+        (pType->propertyFlags & memoryPropertyFlags) == memoryPropertyFlags &&
+        memProperties.memoryHeaps[pType->heapIndex].size >= minHeapSize) {
       *memoryTypeIndex = i;
       return (ERR_OK);
     }
   }
-  LOG_ERROR(ERR_LEVEL_ERROR, "failed to find suitable memory type");
   return (ERR_MEMORY);
 }
 
@@ -1506,11 +2228,33 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
                                const VkDevice device,
                                const VkBufferUsageFlags usage,
                                const VkMemoryPropertyFlags properties) {
+  return new_SharedBuffer_DeviceMemory(pBuffer, pBufferMemory, size,
+                                       physicalDevice, device, usage,
+                                       properties, 0, NULL);
+}
+
+ErrVal new_SharedBuffer_DeviceMemory(       //
+    VkBuffer *pBuffer,                      //
+    VkDeviceMemory *pBufferMemory,          //
+    const VkDeviceSize size,                //
+    const VkPhysicalDevice physicalDevice,  //
+    const VkDevice device,                  //
+    const VkBufferUsageFlags usage,         //
+    const VkMemoryPropertyFlags properties, //
+    const uint32_t queueFamilyIndexCount,   //
+    const uint32_t *pQueueFamilyIndices     //
+) {
   VkBufferCreateInfo bufferInfo = {0};
   bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   bufferInfo.size = size;
   bufferInfo.usage = usage;
-  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (queueFamilyIndexCount > 1) {
+    bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    bufferInfo.queueFamilyIndexCount = queueFamilyIndexCount;
+    bufferInfo.pQueueFamilyIndices = pQueueFamilyIndices;
+  } else {
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
   /* Create buffer */
   VkResult bufferCreateResult =
       vkCreateBuffer(device, &bufferInfo, NULL, pBuffer);
@@ -1563,6 +2307,29 @@ void copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
   return;
 }
 
+// submits a copy to the queue, you'll later need to wait for idle
+void copyBufferRegion(                    //
+    VkBuffer destinationBuffer,           //
+    const VkDeviceSize destinationOffset, //
+    const VkBuffer sourceBuffer,          //
+    const VkDeviceSize sourceOffset,      //
+    const VkDeviceSize size,              //
+    const VkCommandPool commandPool,      //
+    const VkQueue queue,                  //
+    const VkDevice device                 //
+) {
+  VkCommandBuffer copyCommandBuffer =
+      createBeginOneTimeCmdBuffer(commandPool, device);
+
+  VkBufferCopy copyRegion = {.size = size,
+                             .srcOffset = sourceOffset,
+                             .dstOffset = destinationOffset};
+  vkCmdCopyBuffer(copyCommandBuffer, sourceBuffer, destinationBuffer, 1,
+                  &copyRegion);
+
+  submitEndOneTimeCmdBuffer(copyCommandBuffer, queue, device);
+}
+
 void delete_Buffer(VkBuffer *pBuffer, const VkDevice device) {
   vkDestroyBuffer(device, *pBuffer, NULL);
   *pBuffer = VK_NULL_HANDLE;
@@ -1587,16 +2354,16 @@ void updateBuffer(VkBuffer destinationBuffer, const void *pSource,
   return;
 }
 
-// creates a command buffer that hasn't yet been begun
-ErrVal new_CommandBuffers(             //
-    VkCommandBuffer *pCommandBuffer,   //
-    const uint32_t commandBufferCount, //
-    const VkCommandPool commandPool,   //
-    const VkDevice device              //
+static ErrVal new_CommandBuffersOfLevel( //
+    VkCommandBuffer *pCommandBuffer,     //
+    const uint32_t commandBufferCount,   //
+    const VkCommandBufferLevel level,    //
+    const VkCommandPool commandPool,     //
+    const VkDevice device                //
 ) {
   VkCommandBufferAllocateInfo allocateInfo = {0};
   allocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocateInfo.level = level;
   allocateInfo.commandPool = commandPool;
   allocateInfo.commandBufferCount = commandBufferCount;
 
@@ -1611,6 +2378,29 @@ ErrVal new_CommandBuffers(             //
   return (ERR_OK);
 }
 
+// creates a command buffer that hasn't yet been begun
+ErrVal new_CommandBuffers(             //
+    VkCommandBuffer *pCommandBuffer,   //
+    const uint32_t commandBufferCount, //
+    const VkCommandPool commandPool,   //
+    const VkDevice device              //
+) {
+  return (new_CommandBuffersOfLevel(pCommandBuffer, commandBufferCount,
+                                    VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+                                    commandPool, device));
+}
+
+ErrVal new_SecondaryCommandBuffers(    //
+    VkCommandBuffer *pCommandBuffer,   //
+    const uint32_t commandBufferCount, //
+    const VkCommandPool commandPool,   //
+    const VkDevice device              //
+) {
+  return (new_CommandBuffersOfLevel(pCommandBuffer, commandBufferCount,
+                                    VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                                    commandPool, device));
+}
+
 void delete_CommandBuffers(            //
     VkCommandBuffer *pCommandBuffers,  //
     const uint32_t commandBufferCount, //
@@ -1649,6 +2439,8 @@ void new_Image(                             //
     VkImage *pImage,                        //
     VkDeviceMemory *pImageMemory,           //
     const VkExtent2D dimensions,            //
+    const uint32_t mipLevels,               //
+    const uint32_t arrayLayers,             //
     const VkFormat format,                  //
     const VkImageTiling tiling,             //
     const VkImageUsageFlags usage,          //
@@ -1662,8 +2454,8 @@ void new_Image(                             //
   imageInfo.extent.width = dimensions.width;
   imageInfo.extent.height = dimensions.height;
   imageInfo.extent.depth = 1;
-  imageInfo.mipLevels = 1;
-  imageInfo.arrayLayers = 1;
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = arrayLayers;
   imageInfo.format = format;
   imageInfo.tiling = tiling;
   imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -1730,7 +2522,7 @@ void new_DepthImage(VkImage *pImage, VkDeviceMemory *pImageMemory,
                     const VkDevice device) {
   VkFormat depthFormat;
   getDepthFormat(&depthFormat);
-  new_Image(pImage, pImageMemory, swapchainExtent, depthFormat,
+  new_Image(pImage, pImageMemory, swapchainExtent, 1, 1, depthFormat,
             VK_IMAGE_TILING_OPTIMAL,
             VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, physicalDevice, device);
@@ -1740,31 +2532,34 @@ void new_DepthImageView(VkImageView *pImageView, const VkDevice device,
                         const VkImage depthImage) {
   VkFormat depthFormat;
   getDepthFormat(&depthFormat);
-  new_ImageView(pImageView, device, depthImage, depthFormat,
-                VK_IMAGE_ASPECT_DEPTH_BIT);
+  new_ImageView(pImageView, device, depthImage, VK_IMAGE_VIEW_TYPE_2D,
+                depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
 
-// creates a descriptor pool to render an image sampler at binding 0
-// creates a descriptor set with the given texture sampler and texture image
-// view we can do this since in this application, the descriptors are 100%
-// static
-void new_VertexDisplayDescriptorPoolAndSet(                       //
+// creates a descriptor pool to render an image sampler at binding 0, and the
+// uniforms at binding 1. The sampler is the same in every set, and since
+// each frame in flight writes its own uniform buffer, the sets never change.
+void new_VertexDisplayDescriptorPoolAndSets(                      //
     VkDescriptorPool *pDescriptorPool,                            //
-    VkDescriptorSet *pDescriptorSet,                              //
+    VkDescriptorSet *pDescriptorSets,                             //
+    const uint32_t descriptorSetCount,                            //
     const VkDescriptorSetLayout vertexDisplayDescriptorSetLayout, //
     const VkDevice device,                                        //
     const VkSampler textureSampler,                               //
-    const VkImageView textureImageView                            //
+    const VkImageView textureImageView,                           //
+    const VkBuffer *pUniformBuffers                               //
 ) {
-  VkDescriptorPoolSize descriptorPoolSize = {0};
-  descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  descriptorPoolSize.descriptorCount = 1;
+  VkDescriptorPoolSize descriptorPoolSizes[2] = {0};
+  descriptorPoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptorPoolSizes[0].descriptorCount = descriptorSetCount;
+  descriptorPoolSizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  descriptorPoolSizes[1].descriptorCount = descriptorSetCount;
 
   VkDescriptorPoolCreateInfo poolInfo = {0};
   poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  poolInfo.poolSizeCount = 1;
-  poolInfo.pPoolSizes = &descriptorPoolSize;
-  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = descriptorPoolSizes;
+  poolInfo.maxSets = descriptorSetCount;
 
   /* Actually create descriptor pool */
   VkResult ret =
@@ -1776,19 +2571,25 @@ void new_VertexDisplayDescriptorPoolAndSet(                       //
     PANIC();
   }
 
+  // every set has the same layout
+  VkDescriptorSetLayout *pSetLayouts =
+      malloc(descriptorSetCount * sizeof(VkDescriptorSetLayout));
+  for (uint32_t i = 0; i < descriptorSetCount; i++) {
+    pSetLayouts[i] = vertexDisplayDescriptorSetLayout;
+  }
+
   VkDescriptorSetAllocateInfo allocInfo = {0};
   allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   allocInfo.descriptorPool = *pDescriptorPool;
-  // we would need an array of these corresponding to each element in the set,
-  // but since we only have 1 descriptor set layout, we are good
-  allocInfo.descriptorSetCount = 1;
-  allocInfo.pSetLayouts = &vertexDisplayDescriptorSetLayout;
+  allocInfo.descriptorSetCount = descriptorSetCount;
+  allocInfo.pSetLayouts = pSetLayouts;
 
   VkResult sets_ret =
-      vkAllocateDescriptorSets(device, &allocInfo, pDescriptorSet);
+      vkAllocateDescriptorSets(device, &allocInfo, pDescriptorSets);
+  free(pSetLayouts);
   if (sets_ret != VK_SUCCESS) {
     LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to allocate descriptor sets: %s",
-                   vkstrerror(ret));
+                   vkstrerror(sets_ret));
     PANIC();
   }
 
@@ -1797,16 +2598,148 @@ void new_VertexDisplayDescriptorPoolAndSet(                       //
   imageInfo.imageView = textureImageView;
   imageInfo.sampler = textureSampler;
 
-  VkWriteDescriptorSet descriptorWrite = {0};
-  descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-  descriptorWrite.dstSet = *pDescriptorSet;
-  descriptorWrite.dstBinding = 0;
-  descriptorWrite.dstArrayElement = 0;
-  descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  descriptorWrite.descriptorCount = 1;
-  descriptorWrite.pImageInfo = &imageInfo;
+  for (uint32_t i = 0; i < descriptorSetCount; i++) {
+    VkDescriptorBufferInfo bufferInfo = {0};
+    bufferInfo.buffer = pUniformBuffers[i];
+    bufferInfo.offset = 0;
+    bufferInfo.range = sizeof(VertexDisplayUniforms);
+
+    VkWriteDescriptorSet descriptorWrites[2] = {0};
+    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[0].dstSet = pDescriptorSets[i];
+    descriptorWrites[0].dstBinding = 0;
+    descriptorWrites[0].dstArrayElement = 0;
+    descriptorWrites[0].descriptorType =
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrites[0].descriptorCount = 1;
+    descriptorWrites[0].pImageInfo = &imageInfo;
+
+    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[1].dstSet = pDescriptorSets[i];
+    descriptorWrites[1].dstBinding = 1;
+    descriptorWrites[1].dstArrayElement = 0;
+    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrites[1].descriptorCount = 1;
+    descriptorWrites[1].pBufferInfo = &bufferInfo;
+
+    vkUpdateDescriptorSets(device, 2, descriptorWrites, 0, NULL);
+  }
+}
+
+// the sets start out empty, updateCullDescriptorSet or
+// updateFaceDescriptorSets points them at buffers
+void new_StorageDescriptorPoolAndSets(               //
+    VkDescriptorPool *pDescriptorPool,               //
+    VkDescriptorSet *pDescriptorSets,                //
+    const uint32_t descriptorSetCount,               //
+    const uint32_t bindingCount,                     //
+    const VkDescriptorSetLayout descriptorSetLayout, //
+    const VkDevice device                            //
+) {
+  VkDescriptorPoolSize descriptorPoolSize = {0};
+  descriptorPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptorPoolSize.descriptorCount = bindingCount * descriptorSetCount;
+
+  VkDescriptorPoolCreateInfo poolInfo = {0};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &descriptorPoolSize;
+  poolInfo.maxSets = descriptorSetCount;
+
+  VkResult ret =
+      vkCreateDescriptorPool(device, &poolInfo, NULL, pDescriptorPool);
+  if (ret != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to create descriptor pool: %s",
+                   vkstrerror(ret));
+    PANIC();
+  }
+
+  // every set has the same layout
+  VkDescriptorSetLayout *pSetLayouts =
+      malloc(descriptorSetCount * sizeof(VkDescriptorSetLayout));
+  for (uint32_t i = 0; i < descriptorSetCount; i++) {
+    pSetLayouts[i] = descriptorSetLayout;
+  }
+
+  VkDescriptorSetAllocateInfo allocInfo = {0};
+  allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocInfo.descriptorPool = *pDescriptorPool;
+  allocInfo.descriptorSetCount = descriptorSetCount;
+  allocInfo.pSetLayouts = pSetLayouts;
+
+  VkResult setsRet =
+      vkAllocateDescriptorSets(device, &allocInfo, pDescriptorSets);
+  free(pSetLayouts);
+  if (setsRet != VK_SUCCESS) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to allocate descriptor sets: %s",
+                   vkstrerror(setsRet));
+    PANIC();
+  }
+}
 
-  vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, NULL);
+void updateCullDescriptorSet(            //
+    const VkDescriptorSet descriptorSet, //
+    const VkDevice device,               //
+    const VkBuffer recordBuffer,         //
+    const VkBuffer commandBuffer,        //
+    const VkBuffer countBuffer,          //
+    const VkBuffer offsetBuffer          //
+) {
+  const VkBuffer buffers[CULL_BINDING_COUNT] = {recordBuffer, commandBuffer,
+                                                countBuffer, offsetBuffer};
+  VkDescriptorBufferInfo bufferInfos[CULL_BINDING_COUNT] = {0};
+  VkWriteDescriptorSet descriptorWrites[CULL_BINDING_COUNT] = {0};
+  for (uint32_t i = 0; i < CULL_BINDING_COUNT; i++) {
+    bufferInfos[i].buffer = buffers[i];
+    bufferInfos[i].offset = 0;
+    bufferInfos[i].range = VK_WHOLE_SIZE;
+
+    descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrites[i].dstSet = descriptorSet;
+    descriptorWrites[i].dstBinding = i;
+    descriptorWrites[i].dstArrayElement = 0;
+    descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrites[i].descriptorCount = 1;
+    descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+  }
+  vkUpdateDescriptorSets(device, CULL_BINDING_COUNT, descriptorWrites, 0,
+                         NULL);
+}
+
+void updateFaceDescriptorSets(              //
+    const VkDescriptorSet *pDescriptorSets, //
+    const VkBuffer *pBuffers,               //
+    const uint32_t count,                   //
+    const VkDevice device                   //
+) {
+  VkDescriptorBufferInfo *pBufferInfos =
+      malloc(count * sizeof(VkDescriptorBufferInfo));
+  VkWriteDescriptorSet *pDescriptorWrites =
+      malloc(count * sizeof(VkWriteDescriptorSet));
+  uint32_t writeCount = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (pBuffers[i] == VK_NULL_HANDLE) {
+      continue;
+    }
+    VkDescriptorBufferInfo *pBufferInfo = &pBufferInfos[writeCount];
+    pBufferInfo->buffer = pBuffers[i];
+    pBufferInfo->offset = 0;
+    pBufferInfo->range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet *pWrite = &pDescriptorWrites[writeCount];
+    *pWrite = (VkWriteDescriptorSet){0};
+    pWrite->sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    pWrite->dstSet = pDescriptorSets[i];
+    pWrite->dstBinding = 0;
+    pWrite->dstArrayElement = 0;
+    pWrite->descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    pWrite->descriptorCount = 1;
+    pWrite->pBufferInfo = pBufferInfo;
+    writeCount++;
+  }
+  vkUpdateDescriptorSets(device, writeCount, pDescriptorWrites, 0, NULL);
+  free(pBufferInfos);
+  free(pDescriptorWrites);
 }
 
 void delete_DescriptorPool(VkDescriptorPool *pDescriptorPool,
@@ -9,6 +9,7 @@
 #ifndef SRC_VULKAN_UTILS_H_
 #define SRC_VULKAN_UTILS_H_
 
+#include <linmath.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -18,7 +19,6 @@
 #include <GLFW/glfw3.h>
 
 #include "errors.h"
-#include "vertex.h"
 
 /// Creates a new VkInstance with the specified extensions and layers
 /// --- PRECONDITIONS ---
@@ -121,9 +121,16 @@ ErrVal getPhysicalDevice(VkPhysicalDevice *pDevice, const VkInstance instance);
 /// * `getPhysicalDevice` `queueFamilyIndex` must be the index of the queue
 /// family to use `ppEnabledExtensionNames` must be a pointer to at least
 /// * `enabledExtensionCount` extensions
+/// * `transferQueueFamilyIndex` is the index of a queue family to make one
+/// queue in, it may be the same as `queueFamilyIndex`
 /// --- POSTCONDITIONS ---
 /// returns error status
-/// on success, `*pDevice` will be a new logical device
+/// on success, `*pDevice` will be a new logical device, with the
+/// drawIndirectFirstInstance feature enabled, and the multiDrawIndirect,
+/// drawIndirectCount and samplerAnisotropy features enabled if the physical
+/// device supports them.
+/// Panics without drawIndirectFirstInstance, the draws' firstInstance is how
+/// the vertex shader knows where their chunk is.
 /// --- CLEANUP ---
 /// call delete_Device
 ErrVal new_Device(                             //
@@ -131,10 +138,15 @@ ErrVal new_Device(                             //
     const VkPhysicalDevice physicalDevice,     //
     const uint32_t queueFamilyIndex,           //
     const uint32_t pQueueCount,                //
+    const uint32_t transferQueueFamilyIndex,   //
     const uint32_t enabledExtensionCount,      //
     const char *const *ppEnabledExtensionNames //
 );
 
+/// whether the device can draw as many commands as a buffer on the GPU says
+/// with vkCmdDrawIndirectCount
+bool getDrawIndirectCountSupport(const VkPhysicalDevice physicalDevice);
+
 /// Deletes a logical device created from new_Device
 /// --- PRECONDITIONS ---
 /// * `pDevice` must be a valid pointer to a logical device created from
@@ -158,6 +170,19 @@ ErrVal getQueueFamilyIndexByCapability( //
     const VkQueueFlags bit              //
 );
 
+/// Gets the first queue family index that only supports transfers, the
+/// dedicated DMA queue some devices have
+/// --- PRECONDITIONS ---
+/// * `pQueueFamilyIndex` must be a valid pointer
+/// * `device` must be created by getPhysicalDevice
+/// --- POSTCONDITIONS ---
+/// * returns error status, ERR_NOTSUPPORTED if the device has no such queue
+/// * on success, sets `*pQueueFamilyIndex` to the index of the queue family
+ErrVal getTransferQueueFamilyIndex( //
+    uint32_t *pQueueFamilyIndex,    //
+    const VkPhysicalDevice device   //
+);
+
 /// Gets the first queue family index which can support rendering to `surface`
 /// --- PRECONDITIONS ---
 /// * `pQueueFamilyIndex` must be a valid pointer
@@ -260,6 +285,8 @@ void new_Image(                             //
     VkImage *pImage,                        //
     VkDeviceMemory *pImageMemory,           //
     const VkExtent2D dimensions,            //
+    const uint32_t mipLevels,               //
+    const uint32_t arrayLayers,             //
     const VkFormat format,                  //
     const VkImageTiling tiling,             //
     const VkImageUsageFlags usage,          //
@@ -278,12 +305,13 @@ void new_Image(                             //
 /// * `*pImage` is set to VK_NULL_HANDLE
 void delete_Image(VkImage *pImage, const VkDevice device);
 
-void new_ImageView(           //
-    VkImageView *pImageView,  //
-    const VkDevice device,    //
-    const VkImage image,      //
-    const VkFormat format,    //
-    const uint32_t aspectMask //
+void new_ImageView(                 //
+    VkImageView *pImageView,        //
+    const VkDevice device,          //
+    const VkImage image,            //
+    const VkImageViewType viewType, //
+    const VkFormat format,          //
+    const uint32_t aspectMask       //
 );
 
 /// Deletes a imageView created from new_ImageView
@@ -332,28 +360,185 @@ ErrVal new_VertexDisplayRenderPass(VkRenderPass *pRenderPass,
 
 void delete_RenderPass(VkRenderPass *pRenderPass, const VkDevice device);
 
+// the uniforms of the vertex display shaders, laid out like Uniforms in
+// assets/shaders/shader.vert. They're in a buffer rather than push constants
+// so that they can change without recording the draws again.
+typedef struct {
+  mat4x4 mvp;
+  // the world's center chunk, draws' origins are unpacked near it. w is
+  // unused.
+  int32_t centerChunk[4];
+} VertexDisplayUniforms;
+
+/// makes the descriptor set layouts and pipeline layout of the vertex display
+/// shaders
+/// --- POSTCONDITIONS ---
+/// * set 0 is the texture atlas and a VertexDisplayUniforms, see
+///   new_VertexDisplayDescriptorPoolAndSets
+/// * set 1 is the storage buffer the faces are pulled from, see
+///   updateFaceDescriptorSets
 void new_VertexDisplayPipelineLayoutDescriptorSetLayout(      //
     VkPipelineLayout *pVertexDisplayPipelineLayout,           //
     VkDescriptorSetLayout *pVertexDisplayDescriptorSetLayout, //
+    VkDescriptorSetLayout *pFaceDescriptorSetLayout,          //
     const VkDevice device                                     //
 );
 
 void delete_VertexDisplayPipelineLayoutDescriptorSetLayout( //
     VkPipelineLayout *pPipelineLayout,                      //
     VkDescriptorSetLayout *pDescriptorSetLayout,            //
+    VkDescriptorSetLayout *pFaceDescriptorSetLayout,        //
     const VkDevice device                                   //
 );
 
+/// makes the pipeline that draws the faces, with the layout from
+/// new_VertexDisplayPipelineLayoutDescriptorSetLayout
+/// --- PRECONDITIONS ---
+/// * if afterDepthPrepass, every face it draws was drawn by a pipeline from
+///   new_DepthPrepassPipeline first, in the same render pass
+/// --- POSTCONDITIONS ---
+/// * if afterDepthPrepass, it leaves the depth buffer alone, and only shades
+///   the fragments nearest the camera
+/// * otherwise, it tests and writes depth as it goes
+/// * the viewport and scissor are dynamic, so it can be used with any
+///   swapchain. recordBlockCommands sets them.
+/// * it's compiled with the help of pipelineCache, and added to it
 void new_VertexDisplayPipeline(VkPipeline *pVertexDisplayPipeline,
                                const VkDevice device,
                                const VkShaderModule vertShaderModule,
                                const VkShaderModule fragShaderModule,
-                               const VkExtent2D extent,
                                const VkRenderPass renderPass,
-                               const VkPipelineLayout pipelineLayout);
+                               const VkPipelineLayout pipelineLayout,
+                               const VkPipelineCache pipelineCache,
+                               const bool afterDepthPrepass);
+
+/// makes a pipeline like new_VertexDisplayPipeline's that only writes depth,
+/// for drawing everything with before it's drawn again and shaded. With a lot
+/// of faces behind each other, that's faster than shading them all.
+/// --- PRECONDITIONS ---
+/// * vertShaderModule is the same one the other pipeline uses, so that they
+///   get the same depths
+void new_DepthPrepassPipeline(VkPipeline *pDepthPrepassPipeline,
+                              const VkDevice device,
+                              const VkShaderModule vertShaderModule,
+                              const VkRenderPass renderPass,
+                              const VkPipelineLayout pipelineLayout,
+                              const VkPipelineCache pipelineCache);
 
 void delete_Pipeline(VkPipeline *pPipeline, const VkDevice device);
 
+/// makes a pipeline cache, starting from what savePipelineCache last wrote to
+/// path, so that pipelines compiled by an earlier run don't have to be
+/// compiled again
+/// --- POSTCONDITIONS ---
+/// * if path doesn't exist, or was written for another device or driver
+///   version, or is corrupted, the cache starts out empty
+/// --- CLEANUP ---
+/// call delete_PipelineCache
+void new_PipelineCache(VkPipelineCache *pPipelineCache, const char *path,
+                       const VkPhysicalDevice physicalDevice,
+                       const VkDevice device);
+
+/// reads what savePipelineCache wrote to path, for new_PipelineCache
+/// --- POSTCONDITIONS ---
+/// * if path was written for this device and driver version and its data
+///   is whole, *ppData is set to the data and *pSize to its size in bytes
+/// * otherwise, including if path doesn't exist, *ppData is set to NULL and
+///   *pSize to 0
+/// --- CLEANUP ---
+/// free *ppData
+void readPipelineCacheFile(void **ppData, size_t *pSize, const char *path,
+                           const VkPhysicalDevice physicalDevice);
+
+/// writes the pipeline cache's data to path, for new_PipelineCache
+/// --- POSTCONDITIONS ---
+/// * on success, path is replaced at once, and ERR_OK is returned
+/// * otherwise path is left as it was, and an error is returned
+ErrVal savePipelineCache(const VkPipelineCache pipelineCache, const char *path,
+                         const VkPhysicalDevice physicalDevice,
+                         const VkDevice device);
+
+void delete_PipelineCache(VkPipelineCache *pPipelineCache,
+                          const VkDevice device);
+
+// invocations per workgroup of the culling compute shader, local_size_x in
+// assets/shaders/cull.comp. The draws are culled in chunks of this many.
+#define CULL_WORKGROUP_SIZE 64
+// storage buffers the culling compute shader uses: the draw records, the
+// commands it writes for the visible ones, how many it wrote for each vertex
+// pool block, and the offsets of each chunk's commands in each block
+#define CULL_BINDING_COUNT 4
+// the passes of the culling compute shader, PASS_* in
+// assets/shaders/cull.comp. Each chunk counts its visible draws in each
+// block, then each block adds up the counts of the chunks before each one,
+// then each chunk writes its commands from there.
+#define CULL_PASS_COUNT 0
+#define CULL_PASS_SCAN 1
+#define CULL_PASS_WRITE 2
+
+// a draw as the culling compute shader sees it, laid out like DrawRecord in
+// assets/shaders/cull.comp
+typedef struct {
+  // box containing the draw's vertexes, w is unused
+  vec4 min;
+  vec4 max;
+  uint32_t vertexCount;
+  uint32_t firstVertex;
+  // the vertex pool block the draw's faces are in, whose part of the command
+  // buffer the draw is written to if visible
+  uint32_t block;
+  // the firstInstance of the draw's command
+  uint32_t origin;
+} CullDrawRecord;
+
+// push constants of the culling compute shader, laid out like Constants in
+// assets/shaders/cull.comp
+typedef struct {
+  // a point p is inside plane i of the view frustum when
+  // dot(planes[i], (p, 1)) >= 0
+  vec4 planes[6];
+  // the number of draw records to cull
+  uint32_t drawCount;
+  // how many commands each block's part of the command buffer has room for
+  uint32_t commandsPerBlock;
+  // the number of blocks and the CULL_PASS_* being run, which
+  // recordCullCommands sets
+  uint32_t blockCount;
+  uint32_t pass;
+} CullPushConstants;
+
+/// makes the descriptor set layout and pipeline layout of the culling compute
+/// shader
+/// --- POSTCONDITIONS ---
+/// * the descriptor set has CULL_BINDING_COUNT storage buffers, see
+///   updateCullDescriptorSet
+/// * the pipeline layout takes a CullPushConstants
+void new_CullPipelineLayoutDescriptorSetLayout(      //
+    VkPipelineLayout *pCullPipelineLayout,           //
+    VkDescriptorSetLayout *pCullDescriptorSetLayout, //
+    const VkDevice device                            //
+);
+
+void delete_CullPipelineLayoutDescriptorSetLayout( //
+    VkPipelineLayout *pPipelineLayout,             //
+    VkDescriptorSetLayout *pDescriptorSetLayout,   //
+    const VkDevice device                          //
+);
+
+/// makes the compute pipeline that culls draw records into indirect draws
+/// --- PRECONDITIONS ---
+/// * cullShaderModule is assets/shaders/cull.comp
+/// * cullPipelineLayout came from new_CullPipelineLayoutDescriptorSetLayout
+/// --- CLEANUP ---
+/// call delete_Pipeline
+void new_CullPipeline(                         //
+    VkPipeline *pCullPipeline,                 //
+    const VkDevice device,                     //
+    const VkShaderModule cullShaderModule,     //
+    const VkPipelineLayout cullPipelineLayout, //
+    const VkPipelineCache pipelineCache        //
+);
+
 void new_Framebuffer(VkFramebuffer *pFramebuffer, const VkDevice device,
                      const VkRenderPass renderPass, const VkImageView imageView,
                      const VkImageView depthImageView,
@@ -388,6 +573,15 @@ ErrVal new_CommandBuffers(             //
     const VkDevice device              //
 );
 
+/// like new_CommandBuffers, but the command buffers are secondary, to be run
+/// from a primary one with vkCmdExecuteCommands
+ErrVal new_SecondaryCommandBuffers(    //
+    VkCommandBuffer *pCommandBuffers,  //
+    const uint32_t commandBufferCount, //
+    const VkCommandPool commandPool,   //
+    const VkDevice device              //
+);
+
 void delete_CommandBuffers(            //
     VkCommandBuffer *pCommandBuffers,  //
     const uint32_t commandBufferCount, //
@@ -395,19 +589,123 @@ void delete_CommandBuffers(            //
     const VkDevice device              //
 );
 
-ErrVal recordVertexDisplayCommandBuffer(                //
+/// begins recording a command buffer that will be submitted once
+ErrVal beginOneTimeCommandBuffer(VkCommandBuffer commandBuffer);
+
+/// finishes recording a command buffer
+ErrVal endCommandBuffer(VkCommandBuffer commandBuffer);
+
+/// packs changed draw records together in a staging buffer, and works out the
+/// copies that put them where they go in the record buffer
+/// --- PRECONDITIONS ---
+/// * pStaging is the mapped memory of a buffer with room for changeCount
+///   records, and pCopies has room for changeCount copies
+/// * draw pChangedIndexes[i] is now pChangedRecords[i], for i < changeCount,
+///   and the indexes are in ascending order
+/// --- POSTCONDITIONS ---
+/// * the records are in pStaging, in order
+/// * returns the number of copies in pCopies, one for each run of draws with
+///   consecutive indexes
+uint32_t stageCullDrawRecords(            //
+    VkBufferCopy *pCopies,                //
+    void *pStaging,                       //
+    const uint32_t changeCount,           //
+    const uint32_t *pChangedIndexes,      //
+    const CullDrawRecord *pChangedRecords //
+);
+
+/// culls draw records on the GPU, writing an indirect draw for each visible
+/// one into its block's part of the command buffer. The draws are culled in
+/// parallel, a chunk of CULL_WORKGROUP_SIZE at a time, and put in order by
+/// adding up how many each chunk has in each block.
+/// --- PRECONDITIONS ---
+/// * commandBuffer is being recorded, outside of a render pass, and is
+///   submitted to a queue with compute support
+/// * cullDescriptorSet was pointed at recordBuffer by updateCullDescriptorSet,
+///   with room in its buffers for blockCount blocks and
+///   pConstants->drawCount draws
+/// * the copyCount copies in pCopies are from stageCullDrawRecords, and
+///   stagingBuffer is the buffer it staged the records in. The records they
+///   don't cover are the same as when they were last culled.
+/// * each block has room for pConstants->commandsPerBlock commands, and no
+///   more draws than that have it as their block. Draws in blocks past
+///   blockCount aren't drawn.
+/// --- POSTCONDITIONS ---
+/// * the changed records are copied into recordBuffer, with one command
+/// * the commands of the draws visible in pConstants->planes are written to
+///   the start of their blocks' parts, in the order of the records
+/// * counts[block] in the descriptor set's count buffer is the number of
+///   commands written for the block, for block < blockCount. The counts are
+///   ready to be read by indirect draws, and by the host once the command
+///   buffer is done.
+ErrVal recordCullCommands(                     //
+    VkCommandBuffer commandBuffer,             //
+    const VkPipelineLayout cullPipelineLayout, //
+    const VkPipeline cullPipeline,             //
+    const VkDescriptorSet cullDescriptorSet,   //
+    const VkBuffer recordBuffer,               //
+    const VkBuffer stagingBuffer,              //
+    const uint32_t copyCount,                  //
+    const VkBufferCopy *pCopies,               //
+    const uint32_t blockCount,                 //
+    const CullPushConstants *pConstants        //
+);
+
+/// records the indirect draws of one vertex pool block into a secondary
+/// command buffer, for recordVertexDisplayCommands to run
+/// --- PRECONDITIONS ---
+/// * commandBuffer is a secondary command buffer that isn't pending
+/// * vertexDisplayPipeline is from new_VertexDisplayPipeline or
+///   new_DepthPrepassPipeline, with vertexDisplayPipelineLayout
+/// * the block's draws are the commandCount VkDrawIndirectCommands at
+///   commandOffset in indirectBuffer, which was created with
+///   VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT. They pull faces from the buffer
+///   faceDescriptorSet points at.
+/// * if countBuffer isn't VK_NULL_HANDLE, the uint32_t at countOffset in it
+///   says how many of them to draw. The device must have the
+///   drawIndirectCount feature enabled.
+/// * otherwise, multiDrawIndirect is true only if that feature was enabled on
+///   the device. If not, each command gets an indirect draw of its own.
+/// --- POSTCONDITIONS ---
+/// * commandBuffer is recorded, and can be run inside renderPass any number
+///   of times, on framebuffers of size extent. Writing to the buffers it
+///   reads doesn't change that, but updating its descriptor sets or
+///   destroying anything it uses does.
+ErrVal recordBlockCommands(                             //
     VkCommandBuffer commandBuffer,                      //
-    const VkFramebuffer swapchainFramebuffer,           //
-    const uint32_t vertexBufferCount,                   //
-    const VkBuffer *pVertexBuffers,                     //
-    const uint32_t *pVertexCounts,                      //
     const VkRenderPass renderPass,                      //
+    const VkExtent2D extent,                            //
     const VkPipelineLayout vertexDisplayPipelineLayout, //
     const VkPipeline vertexDisplayPipeline,             //
-    const VkExtent2D swapchainExtent,                   //
-    const mat4x4 cameraTransform,                       //
     const VkDescriptorSet vertexDisplayDescriptorSet,   //
-    const VkClearColorValue clearColor                  //
+    const VkDescriptorSet faceDescriptorSet,            //
+    const VkBuffer indirectBuffer,                      //
+    const VkDeviceSize commandOffset,                   //
+    const uint32_t commandCount,                        //
+    const VkBuffer countBuffer,                         //
+    const VkDeviceSize countOffset,                     //
+    const bool multiDrawIndirect                        //
+);
+
+/// draws everything by running the secondary command buffers of the blocks
+/// --- PRECONDITIONS ---
+/// * commandBuffer is being recorded, outside of a render pass
+/// * pBlockCommandBuffers has blockCount command buffers recorded by
+///   recordBlockCommands with renderPass
+/// * pPrepassCommandBuffers is NULL, or has the blockCount command buffers
+///   of the same blocks recorded with a new_DepthPrepassPipeline
+/// --- POSTCONDITIONS ---
+/// * if there are prepass command buffers, they're all run before any of the
+///   others
+ErrVal recordVertexDisplayCommands(                //
+    VkCommandBuffer commandBuffer,                 //
+    const VkFramebuffer swapchainFramebuffer,      //
+    const VkRenderPass renderPass,                 //
+    const VkExtent2D swapchainExtent,              //
+    const uint32_t blockCount,                     //
+    const VkCommandBuffer *pPrepassCommandBuffers, //
+    const VkCommandBuffer *pBlockCommandBuffers,   //
+    const VkClearColorValue clearColor             //
 );
 
 ErrVal new_Semaphore(VkSemaphore *pSemaphore, const VkDevice device);
@@ -439,11 +737,14 @@ ErrVal getNextSwapchainImage(           //
     VkSemaphore imageAvailableSemaphore //
 );
 
+/// uploadSemaphore is waited on before reading vertexes, if it isn't
+/// VK_NULL_HANDLE
 ErrVal drawFrame(                        //
     VkCommandBuffer commandBuffer,       //
     VkSwapchainKHR swapchain,            //
     const uint32_t swapchainImageIndex,  //
     VkSemaphore imageAvailableSemaphore, //
+    VkSemaphore uploadSemaphore,         //
     VkSemaphore renderFinishedSemaphore, //
     VkFence inFlightFence,               //
     const VkQueue graphicsQueue,         //
@@ -462,10 +763,37 @@ ErrVal new_Buffer_DeviceMemory(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
                                const VkBufferUsageFlags usage,
                                const VkMemoryPropertyFlags properties);
 
+/// same as new_Buffer_DeviceMemory, but the buffer can be used from all of
+/// the queue families in pQueueFamilyIndices without ownership transfers.
+/// With fewer than 2 of them, it's exclusive like new_Buffer_DeviceMemory's.
+ErrVal new_SharedBuffer_DeviceMemory(       //
+    VkBuffer *pBuffer,                      //
+    VkDeviceMemory *pBufferMemory,          //
+    const VkDeviceSize size,                //
+    const VkPhysicalDevice physicalDevice,  //
+    const VkDevice device,                  //
+    const VkBufferUsageFlags usage,         //
+    const VkMemoryPropertyFlags properties, //
+    const uint32_t queueFamilyIndexCount,   //
+    const uint32_t *pQueueFamilyIndices     //
+);
+
 void copyBuffer(VkBuffer destinationBuffer, const VkBuffer sourceBuffer,
                 const VkDeviceSize size, const VkCommandPool commandPool,
                 const VkQueue queue, const VkDevice device);
 
+/// same as copyBuffer, but copies from and to the given offsets
+void copyBufferRegion(                    //
+    VkBuffer destinationBuffer,           //
+    const VkDeviceSize destinationOffset, //
+    const VkBuffer sourceBuffer,          //
+    const VkDeviceSize sourceOffset,      //
+    const VkDeviceSize size,              //
+    const VkCommandPool commandPool,      //
+    const VkQueue queue,                  //
+    const VkDevice device                 //
+);
+
 void updateBuffer(VkBuffer destinationBuffer, const void *pSource,
                   const VkDeviceSize size, const VkCommandPool commandPool,
                   const VkQueue queue, const VkDevice device);
@@ -493,11 +821,35 @@ ErrVal getMemoryTypeIndex(uint32_t *memoryTypeIndex,
                           const VkMemoryPropertyFlags memoryPropertyFlags,
                           const VkPhysicalDevice physicalDevice);
 
+/// same as getMemoryTypeIndex, but skips memory types whose heap is smaller
+/// than minHeapSize bytes, and doesn't log if none is found. Use it to check
+/// whether the device has some kind of memory.
+ErrVal getMemoryTypeIndexInHeap(                     //
+    uint32_t *memoryTypeIndex,                       //
+    const uint32_t memoryTypeBits,                   //
+    const VkMemoryPropertyFlags memoryPropertyFlags, //
+    const VkDeviceSize minHeapSize,                  //
+    const VkPhysicalDevice physicalDevice            //
+);
+
+/// Creates an image array from an atlas of square tiles, with each tile in a
+/// layer of its own, and a mip chain generated for every layer
+/// --- PRECONDITIONS ---
+/// * `rgbaPxArr` is an R8G8B8A8 image with the given `dimensions`
+/// * `dimensions.width` and `dimensions.height` are multiples of `tileSize`
+/// --- POSTCONDITIONS ---
+/// * `*pImage` has a layer for each tile, counted along each row of the atlas
+///   and then down the rows, in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+/// * the image has mip levels down to one pix, unless the device can't blit
+///   its format
+/// --- CLEANUP ---
+/// * call delete_Image on `*pImage` and delete_DeviceMemory on `*pImageMemory`
 void new_TextureImage(                     //
     VkImage *pImage,                       //
     VkDeviceMemory *pImageMemory,          //
     const uint8_t *rgbaPxArr,              //
     const VkExtent2D dimensions,           //
+    const uint32_t tileSize,               //
     const VkDevice device,                 //
     const VkPhysicalDevice physicalDevice, //
     const VkCommandPool commandPool,       //
@@ -510,16 +862,74 @@ void new_TextureImageView(          //
     const VkDevice device           //
 );
 
-void new_VertexDisplayDescriptorPoolAndSet(                       //
+/// makes descriptorSetCount sets for set 0 of the vertex display shaders
+/// --- PRECONDITIONS ---
+/// * pUniformBuffers has a buffer for each set, holding a
+///   VertexDisplayUniforms, created with VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT
+/// --- POSTCONDITIONS ---
+/// * set i samples the texture, and reads pUniformBuffers[i]
+/// --- CLEANUP ---
+/// call delete_DescriptorPool
+void new_VertexDisplayDescriptorPoolAndSets(                      //
     VkDescriptorPool *pDescriptorPool,                            //
-    VkDescriptorSet *pDescriptorSet,                              //
+    VkDescriptorSet *pDescriptorSets,                             //
+    const uint32_t descriptorSetCount,                            //
     const VkDescriptorSetLayout vertexDisplayDescriptorSetLayout, //
     const VkDevice device,                                        //
     const VkSampler textureSampler,                               //
-    const VkImageView textureImageView                            //
+    const VkImageView textureImageView,                           //
+    const VkBuffer *pUniformBuffers                               //
+);
+
+/// makes descriptorSetCount sets of bindingCount storage buffers each, for
+/// the culling compute shader or the faces of the vertex display shaders
+/// --- POSTCONDITIONS ---
+/// * the sets don't point at anything until updateCullDescriptorSet or
+///   updateFaceDescriptorSets is called
+/// --- CLEANUP ---
+/// call delete_DescriptorPool
+void new_StorageDescriptorPoolAndSets(               //
+    VkDescriptorPool *pDescriptorPool,               //
+    VkDescriptorSet *pDescriptorSets,                //
+    const uint32_t descriptorSetCount,               //
+    const uint32_t bindingCount,                     //
+    const VkDescriptorSetLayout descriptorSetLayout, //
+    const VkDevice device                            //
+);
+
+/// points a culling descriptor set at the buffers it reads and writes
+/// --- PRECONDITIONS ---
+/// * descriptorSet isn't in use by the GPU
+/// * recordBuffer holds an array of CullDrawRecord
+/// * commandBuffer has room for the VkDrawIndirectCommands of all the blocks
+/// * countBuffer holds a uint32_t for each block
+/// * offsetBuffer has room for a uint32_t for each block for each chunk of
+///   CULL_WORKGROUP_SIZE draws. Only the culling uses it.
+/// * all four were created with VK_BUFFER_USAGE_STORAGE_BUFFER_BIT
+void updateCullDescriptorSet(            //
+    const VkDescriptorSet descriptorSet, //
+    const VkDevice device,               //
+    const VkBuffer recordBuffer,         //
+    const VkBuffer commandBuffer,        //
+    const VkBuffer countBuffer,          //
+    const VkBuffer offsetBuffer          //
+);
+
+/// points face descriptor set i at pBuffers[i], for i < count
+/// --- PRECONDITIONS ---
+/// * none of the sets are in use by the GPU
+/// * the buffers hold Faces, and were created with
+///   VK_BUFFER_USAGE_STORAGE_BUFFER_BIT. Sets whose buffer is VK_NULL_HANDLE
+///   are left alone.
+void updateFaceDescriptorSets(              //
+    const VkDescriptorSet *pDescriptorSets, //
+    const VkBuffer *pBuffers,               //
+    const uint32_t count,                   //
+    const VkDevice device                   //
 );
 
-void new_TextureSampler(VkSampler *pTextureSampler, const VkDevice device);
+void new_TextureSampler(VkSampler *pTextureSampler, const VkDevice device,
+                        const VkPhysicalDevice physicalDevice);
 void delete_TextureSampler(VkSampler *pTextureSampler, const VkDevice device);
 
 void delete_DescriptorPool(VkDescriptorPool *pDescriptorPool,
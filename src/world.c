@@ -1,14 +1,15 @@
 #include <assert.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "block.h"
 #include "world.h"
 
-#define WORKER_THREADS 16
-
-// max chunks to mesh per tick
-#define MAX_CHUNKS_TO_MESH 1
+// max finished meshes to upload per tick
+#define MAX_CHUNKS_TO_UPLOAD 4
 // max chunks to unload per tick
 #define MAX_CHUNKS_TO_UNLOAD 10
 
@@ -17,111 +18,315 @@
 #define RENDER_RADIUS_Y 3
 #define RENDER_RADIUS_Z 3
 
+// number of rays each task of a batch raycast traces
+#define RAYS_PER_TASK 256
+
+// side length of the occupancy bricks chunks are split into, in blocks
+#define BRICK_SIZE 8
+#define BRICKS_X (CHUNK_X_SIZE / BRICK_SIZE)
+#define BRICKS_Y (CHUNK_Y_SIZE / BRICK_SIZE)
+#define BRICKS_Z (CHUNK_Z_SIZE / BRICK_SIZE)
+
+static const int32_t wld_chunkSize[3] = {CHUNK_X_SIZE, CHUNK_Y_SIZE,
+                                         CHUNK_Z_SIZE};
+
+// number of chunks nearest the camera whose solid bricks occlude the others
+#define OCCLUDER_CHUNKS 27
+// how much chunk bounds are grown by before the occlusion test, in blocks, so
+// that faces lying right on an occluder aren't culled by rounding errors
+#define OCCLUDEE_MARGIN 0.5f
+
+// draws are sorted front to back by the squared distance in chunks from the
+// center to their nearest chunk. Loaded chunks are never further than this,
+// so the highlight gets the key after it, to keep it last.
+#define HIGHLIGHT_DISTANCE_KEY                                                 \
+  (RENDER_RADIUS_X * RENDER_RADIUS_X + RENDER_RADIUS_Y * RENDER_RADIUS_Y +     \
+   RENDER_RADIUS_Z * RENDER_RADIUS_Z + 1)
+#define DISTANCE_KEYS (HIGHLIGHT_DISTANCE_KEY + 1)
+
+// members of a mesh region get room for a quarter more faces than they have,
+// and the region for a quarter more than its members' room, so that most
+// edits fit where the faces already are
+#define MESH_ROOM_SLACK 4
+
+// draws start at a whole face of their buffer
+_Static_assert(VERTEX_POOL_UNIT_SIZE % sizeof(Face) == 0,
+               "vertex pool units don't hold a whole number of faces");
+
+// chunk origins are unpacked relative to the center, so every mesh region
+// with a chunk in range must have an origin of its own. A region's corner can
+// be MESH_REGION_SIZE - 1 chunks further out than the chunk.
+_Static_assert(
+    (1 << (CHUNK_ORIGIN_X_BITS - 1)) > RENDER_RADIUS_X + MESH_REGION_SIZE - 1 &&
+        (1 << (CHUNK_ORIGIN_Y_BITS - 1)) >
+            RENDER_RADIUS_Y + MESH_REGION_SIZE - 1 &&
+        (1 << (CHUNK_ORIGIN_Z_BITS - 1)) >
+            RENDER_RADIUS_Z + MESH_REGION_SIZE - 1,
+    "chunk origins don't cover the render radius");
+
+// faces are placed relative to the corner of their mesh region
+_Static_assert(MESH_REGION_SIZE * CHUNK_X_SIZE <= 1 << FACE_Y_SHIFT &&
+                   MESH_REGION_SIZE * CHUNK_Y_SIZE <=
+                       1 << (FACE_Z_SHIFT - FACE_Y_SHIFT) &&
+                   MESH_REGION_SIZE * CHUNK_Z_SIZE <=
+                       1 << (FACE_KIND_SHIFT - FACE_Z_SHIFT),
+               "faces can't hold coordinates in a mesh region");
+
+// the members of a region are told apart by the bits of a uint64_t
+_Static_assert((MESH_REGION_SIZE & (MESH_REGION_SIZE - 1)) == 0 &&
+                   MESH_REGION_CHUNKS <= 64,
+               "mesh regions must be a power of two of at most 64 chunks");
+
+// a region's faces are in one allocation. A chunk has at most 3 faces per
+// block, when its blocks are a checkerboard.
+_Static_assert((VkDeviceSize)MESH_REGION_CHUNKS * CHUNK_X_SIZE * CHUNK_Y_SIZE *
+                       CHUNK_Z_SIZE * 3 * sizeof(Face) <=
+                   VERTEX_POOL_BLOCK_SIZE,
+               "mesh regions don't fit in a vertex pool block");
+
+// chunks in range must never share a clipmap slot
+_Static_assert(CLIPMAP_SIZE > 2 * RENDER_RADIUS_X &&
+                   CLIPMAP_SIZE > 2 * RENDER_RADIUS_Y &&
+                   CLIPMAP_SIZE > 2 * RENDER_RADIUS_Z,
+               "clipmap is smaller than the render radius");
+
 struct ChunkGeometry_s {
-  uint32_t vertexCount;
-  // these 2 are only defined if vertexCount > 0
+  uint32_t faceCount;
+  // these 5 are only defined if faceCount > 0
+  // the pool block holding the faces, and where in it they are
   VkBuffer vertexBuffer;
-  VkDeviceMemory vertexBufferMemory;
+  VkDeviceSize vertexOffset;
+  VertexAllocation allocation;
+  // where the faces are placed relative to, see wu_packChunkOrigin
+  uint32_t origin;
+  DrawBounds bounds;
 };
 
-static ErrVal
-new_VertexBuffer(VkBuffer *pBuffer, VkDeviceMemory *pBufferMemory,
-                 const Vertex *pVertices, const uint32_t vertexCount,
-                 const VkDevice device, const VkPhysicalDevice physicalDevice,
-                 const VkCommandPool commandPool, const VkQueue queue) {
-
-  /* Construct staging buffers */
-  VkDeviceSize bufferSize = sizeof(Vertex) * vertexCount;
-  VkBuffer stagingBuffer;
-  VkDeviceMemory stagingBufferMemory;
-  ErrVal stagingBufferCreateResult = new_Buffer_DeviceMemory(
-      &stagingBuffer, &stagingBufferMemory, bufferSize, physicalDevice, device,
-      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-  if (stagingBufferCreateResult != ERR_OK) {
-    LOG_ERROR(
-        ERR_LEVEL_FATAL,
-        "failed to create vertex buffer: failed to create staging buffer");
-    PANIC();
+static void new_ChunkGeometry( //
+    ChunkGeometry *c,          //
+    const Face *pFaces,        //
+    const uint32_t faceCount,  //
+    const uint32_t origin,     //
+    const DrawBounds *pBounds, //
+    WorldState *pWorldState    //
+) {
+  c->faceCount = faceCount;
+  if (c->faceCount > 0) {
+    c->origin = origin;
+    c->bounds = *pBounds;
+    VkDeviceSize size = sizeof(Face) * faceCount;
+    void *pMapped;
+    vtp_alloc(&c->vertexBuffer, &c->vertexOffset, &pMapped, &c->allocation,
+              &pWorldState->vertexPool, size);
+    stg_upload(&pWorldState->staging, c->vertexBuffer, c->vertexOffset,
+               pFaces, size);
+  }
+}
+
+static void delete_ChunkGeometry(ChunkGeometry *geometry, VertexPool *pPool) {
+  if (geometry->faceCount > 0) {
+    vtp_free(pPool, &geometry->allocation);
   }
+}
 
-  // Copy data to staging buffer, making sure to clean up leaks
-  copyToDeviceMemory(&stagingBufferMemory, bufferSize, pVertices, device);
+// lifecycle of a chunk's generation task
+typedef enum {
+  // submitted to the threadpool, no worker has picked it up yet
+  ChunkGen_QUEUED,
+  // a worker is generating the data
+  ChunkGen_RUNNING,
+  // data is valid
+  ChunkGen_DONE,
+  // the worker saw the cancel flag and dropped the task, data is garbage
+  ChunkGen_CANCELLED,
+} ChunkGenState;
+
+// lifecycle of a chunk as a whole
+// GENERATING -> WAITING -> MESHING -> MESHED -> READY, and from READY back to
+// MESHING when the chunk is edited, or back to GENERATING if its generation
+// was cancelled but it came back into range
+typedef enum {
+  // generation task queued or running
+  ChunkState_GENERATING,
+  // generation finished, mesh task waits on the neighbours' generation
+  ChunkState_WAITING,
+  // mesh task queued or running
+  ChunkState_MESHING,
+  // mesh is finished and sits on the completed list waiting for upload
+  ChunkState_MESHED,
+  // no tasks in flight, geometry (if any) is uploaded
+  ChunkState_READY,
+} ChunkState;
+
+struct Chunk_s {
+  ivec3 chunkCoord;
+  ChunkData data;
 
-  /* Create vertex buffer and allocate memory for it */
-  ErrVal vertexBufferCreateResult = new_Buffer_DeviceMemory(
-      pBuffer, pBufferMemory, bufferSize, physicalDevice, device,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  // number of opaque blocks in the chunk, and in each brick of it. Written by
+  // the generation task before it publishes the data, and by edits after
+  // that. Lets raycasts skip over air without reading it.
+  uint32_t solidCount;
+  uint16_t brickSolidCount[BRICKS_X][BRICKS_Y][BRICKS_Z];
+
+  // owning world, so that tasks can dispatch follow up tasks
+  WorldState *pWorldState;
+
+  // written by the worker, read by the main thread and neighbours' meshing
+  _Atomic ChunkGenState genState;
+  // set by the main thread when the chunk leaves the render radius, checked by
+  // the workers before and during generation, and before meshing
+  atomic_bool cancelled;
+
+  _Atomic ChunkState state;
+
+  // number of things the next mesh task still waits on: our own generation
+  // plus the generation of each neighbour that was still generating when we
+  // were linked to it. Whoever brings this to 0 dispatches the mesh task.
+  _Atomic uint32_t pendingDeps;
+  // number of pending mesh tasks of neighbouring chunks that will read our
+  // data. We can't be freed until this is 0.
+  _Atomic uint32_t pins;
+  // the neighbours the next mesh task reads, indexed by BlockFaceKind. Each
+  // non-NULL entry holds a pin on that neighbour.
+  Chunk *meshNeighbours[6];
+
+  // guards genFinished and dependents
+  pthread_mutex_t lock;
+  // guards data against edits from the main thread while mesh tasks read it.
+  // Generation doesn't need it, nobody reads data until genState is DONE.
+  pthread_rwlock_t dataLock;
+  // set once the generation task is over (done or cancelled)
+  bool genFinished;
+  // chunks whose mesh task waits on our generation
+  Chunk **dependents;
+  uint32_t dependents_len;
+  uint32_t dependents_cap;
+
+  // the rest is owned by the main thread
+
+  // the mesh region the chunk is drawn with, NULL until its first mesh is
+  // uploaded
+  MeshRegion *pRegion;
+  // how many faces the chunk has in the region's geometry, and the box
+  // around them. Only defined if pRegion isn't NULL, and bounds if
+  // faceCount > 0.
+  uint32_t faceCount;
+  DrawBounds bounds;
+  // a mesh uploaded since the region was last built, which takes the place
+  // of the chunk's faces when it's built again. NULL if there isn't one.
+  ChunkMeshResult *pNewMesh;
+  // the data changed since the last mesh task was dispatched
+  bool dirty;
+  // the chunk's coordinates are on the tounload list
+  bool queuedUnload;
+  // which pairs of faces are connected through air, see
+  // wu_getChunkDataFaceConnections. All of them until the first mesh.
+  uint16_t faceConnections;
+  // the last visibility search that reached the chunk, and the directions
+  // (bits indexed by BlockFaceKind) it travelled in to get here
+  uint32_t cullFrame;
+  uint8_t cullDirections;
+  // face the visibility search entered the chunk through
+  BlockFaceKind cullEntry;
+};
 
-  /* Handle errors */
-  if (vertexBufferCreateResult != ERR_OK) {
-    /* Delete the temporary staging buffers */
-    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create vertex buffer");
-    PANIC();
-  }
+// produced by a mesh task, consumed by the main thread
+struct ChunkMeshResult_s {
+  Chunk *pChunk;
+  // false if the task was skipped because the chunk had no data or was
+  // cancelled, in which case there's nothing to upload
+  bool valid;
+  uint32_t faceCount;
+  // the next 2 are only defined if faceCount > 0
+  // where in the staging arena the worker wrote the faces
+  StagedData staged;
+  DrawBounds bounds;
+  uint16_t faceConnections;
+  ChunkMeshResult *next;
+};
 
-  /* Copy the data over from the staging buffer to the vertex buffer */
-  copyBuffer(*pBuffer, stagingBuffer, bufferSize, commandPool, queue, device);
+// a cube of MESH_REGION_SIZE chunks on a side whose faces are placed relative
+// to its corner, and kept in one range of the vertex pool, each member's in
+// room of its own. Owned by the main thread.
+struct MeshRegion_s {
+  // the chunk at the region's lowest corner
+  ivec3 cornerCoord;
+  // the meshed chunks in the region, by wld_regionMember, NULL for the rest
+  Chunk *members[MESH_REGION_CHUNKS];
+  uint32_t memberCount;
+  // the members' faces, NULL until the region is built. Its faceCount is
+  // where the last member's room ends, and all of it is drawn.
+  ChunkGeometry *pGeometry;
+  // how many faces pGeometry has room for
+  uint32_t faceCapacity;
+  // where each member's room is in pGeometry, by wld_regionMember: it starts
+  // at firstFaces and has room for faceCapacities faces, the first
+  // faceCounts of which are used. The rest of it is blank, see vertex.h.
+  // Members that left keep their room in case they come back.
+  uint32_t firstFaces[MESH_REGION_CHUNKS];
+  uint32_t faceCounts[MESH_REGION_CHUNKS];
+  uint32_t faceCapacities[MESH_REGION_CHUNKS];
+  // how many faces the members have between them
+  uint32_t memberFaceCount;
+  // index of pGeometry in the draw list, or DRAW_LIST_NONE if it isn't in it
+  uint32_t drawIndex;
+  // the region's corner is on the torebuild list
+  bool queuedRebuild;
+  // the last visibility search that found one of the members visible, and
+  // which ones it found (bits indexed by wld_regionMember)
+  uint32_t cullFrame;
+  uint64_t visibleMembers;
+};
 
-  /* Delete the temporary staging buffers */
-  delete_Buffer(&stagingBuffer, device);
-  delete_DeviceMemory(&stagingBufferMemory, device);
+// the index of a chunk among the members of its mesh region. Two's
+// complement wraps negative coordinates around correctly.
+static uint32_t wld_regionMember(const ivec3 chunkCoord) {
+  const uint32_t x = (uint32_t)chunkCoord[0] & (MESH_REGION_SIZE - 1);
+  const uint32_t y = (uint32_t)chunkCoord[1] & (MESH_REGION_SIZE - 1);
+  const uint32_t z = (uint32_t)chunkCoord[2] & (MESH_REGION_SIZE - 1);
+  return (x * MESH_REGION_SIZE + y) * MESH_REGION_SIZE + z;
+}
 
-  return (ERR_OK);
+// the chunk at the corner of the mesh region the chunk is in
+static void wld_regionCorner(ivec3 cornerCoord, const ivec3 chunkCoord) {
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    cornerCoord[axis] = chunkCoord[axis] & ~(MESH_REGION_SIZE - 1);
+  }
 }
 
-static void new_ChunkGeometry(             //
-    ChunkGeometry *c,                      //
-    const ChunkData *data,                 //
-    const vec3 chunkOffset,                //
-    const VkDevice device,                 //
-    const VkPhysicalDevice physicalDevice, //
-    const VkCommandPool commandPool,       //
-    const VkQueue queue                    //
+// finds room for the mesh of pResult, and returns where to write it
+static Face *wld_reserveMesh( //
+    ChunkMeshResult *pResult, //
+    WorldState *pWorldState   //
 ) {
-  // count chunk vertexes
-  c->vertexCount = wu_countChunkDataVertexes(data);
-  if (c->vertexCount > 0) {
-    // write mesh to vertex
-    Vertex *vertexData = malloc(c->vertexCount * sizeof(Vertex));
-    wu_getVertexesChunkData(vertexData, chunkOffset, data);
-    new_VertexBuffer(&c->vertexBuffer, &c->vertexBufferMemory, vertexData,
-                     c->vertexCount, device, physicalDevice, commandPool,
-                     queue);
-    free(vertexData);
-  }
+  return stg_stage(&pResult->staged, &pWorldState->staging,
+                   sizeof(Face) * pResult->faceCount);
 }
 
-static void delete_ChunkGeometry(ChunkGeometry *geometry,
-                                 const VkDevice device) {
-  if (geometry->vertexCount > 0) {
-    delete_Buffer(&geometry->vertexBuffer, device);
-    delete_DeviceMemory(&geometry->vertexBufferMemory, device);
+// gives back the room of a mesh that won't be drawn
+static void wld_releaseMesh(        //
+    const ChunkMeshResult *pResult, //
+    WorldState *pWorldState         //
+) {
+  if (pResult->faceCount > 0) {
+    stg_discardStaged(&pWorldState->staging, &pResult->staged);
   }
 }
 
-typedef struct {
-  ChunkData data;
-  volatile bool initialized;
-} ChunkDataState;
+static bool wld_chunkDataReady(const Chunk *pChunk) {
+  return atomic_load_explicit(&pChunk->genState, memory_order_acquire) ==
+         ChunkGen_DONE;
+}
 
 typedef struct {
   ivec3 chunkCoord;
-  ChunkDataState *pDataAndState;
-  ChunkGeometry *pGeometry;
+  Chunk *pChunk;
 } ivec3_Chunk_KVPair;
 
-static int ivec3_Chunk_KVPair_compare(const void *a, const void *b,
-                                      UNUSED void *udata) {
-  const ivec3_Chunk_KVPair *pa = a;
-  const ivec3_Chunk_KVPair *pb = b;
-
-  int32_t d0 = pa->chunkCoord[0] - pb->chunkCoord[0];
-  int32_t d1 = pa->chunkCoord[1] - pb->chunkCoord[1];
-  int32_t d2 = pa->chunkCoord[2] - pb->chunkCoord[2];
+static int wld_ivec3Compare(const ivec3 a, const ivec3 b) {
+  int32_t d0 = a[0] - b[0];
+  int32_t d1 = a[1] - b[1];
+  int32_t d2 = a[2] - b[2];
 
   if (d0 != 0) {
     return d0;
@@ -132,20 +337,191 @@ static int ivec3_Chunk_KVPair_compare(const void *a, const void *b,
   return d2;
 }
 
+static int ivec3_Chunk_KVPair_compare(const void *a, const void *b,
+                                      UNUSED void *udata) {
+  const ivec3_Chunk_KVPair *pa = a;
+  const ivec3_Chunk_KVPair *pb = b;
+  return wld_ivec3Compare(pa->chunkCoord, pb->chunkCoord);
+}
+
 static uint64_t ivec3_Chunk_KVPair_hash(const void *item, uint64_t seed0,
                                         uint64_t seed1) {
   const ivec3_Chunk_KVPair *pair = item;
   return hashmap_sip(pair->chunkCoord, sizeof(ivec3), seed0, seed1);
 }
 
-void wld_new_WorldState(                  //
-    WorldState *pWorldState,              //
-    const ivec3 centerLoc,                //
-    worldgen_state *wgstate,              //
-    const VkQueue queue,                  //
-    const VkCommandPool commandPool,      //
-    const VkDevice device,                //
-    const VkPhysicalDevice physicalDevice //
+typedef struct {
+  ivec3 cornerCoord;
+  MeshRegion *pRegion;
+} ivec3_MeshRegion_KVPair;
+
+static int ivec3_MeshRegion_KVPair_compare(const void *a, const void *b,
+                                           UNUSED void *udata) {
+  const ivec3_MeshRegion_KVPair *pa = a;
+  const ivec3_MeshRegion_KVPair *pb = b;
+  return wld_ivec3Compare(pa->cornerCoord, pb->cornerCoord);
+}
+
+static uint64_t ivec3_MeshRegion_KVPair_hash(const void *item, uint64_t seed0,
+                                             uint64_t seed1) {
+  const ivec3_MeshRegion_KVPair *pair = item;
+  return hashmap_sip(pair->cornerCoord, sizeof(ivec3), seed0, seed1);
+}
+
+// the clipmap index of a chunk coordinate. Two's complement wraps negative
+// coordinates around correctly.
+static uint32_t wld_clipmapIndex(int32_t worldChunkCoord) {
+  return (uint32_t)worldChunkCoord & (CLIPMAP_SIZE - 1);
+}
+
+// the clipmap slot that the chunk at the coordinates maps to
+static Chunk **wld_clipmapSlot( //
+    WorldState *pWorldState,    //
+    const ivec3 worldChunkCoord //
+) {
+  return &pWorldState->clipmap[wld_clipmapIndex(worldChunkCoord[0])]
+                              [wld_clipmapIndex(worldChunkCoord[1])]
+                              [wld_clipmapIndex(worldChunkCoord[2])];
+}
+
+// returns the chunk at the coordinates, or NULL if it isn't loaded
+static Chunk *wld_lookupChunk(     //
+    const WorldState *pWorldState, //
+    const ivec3 worldChunkCoord    //
+) {
+  Chunk *pChunk = pWorldState->clipmap[wld_clipmapIndex(worldChunkCoord[0])]
+                                      [wld_clipmapIndex(worldChunkCoord[1])]
+                                      [wld_clipmapIndex(worldChunkCoord[2])];
+  if (pChunk != NULL && ivec3_eq(pChunk->chunkCoord, worldChunkCoord)) {
+    return pChunk;
+  }
+
+  // only chunks that lost their slot to a chunk in range live in the map
+  if (hashmap_count(pWorldState->chunk_map) == 0) {
+    return NULL;
+  }
+  ivec3_Chunk_KVPair key;
+  ivec3_dup(key.chunkCoord, worldChunkCoord);
+  ivec3_Chunk_KVPair *pPair = hashmap_get(pWorldState->chunk_map, &key);
+  return pPair == NULL ? NULL : pPair->pChunk;
+}
+
+// adds a chunk to the store. It goes in its clipmap slot unless the slot is
+// taken by a chunk in range, in which case it goes in the map.
+static void wld_storeChunk(WorldState *pWorldState, Chunk *pChunk);
+
+// removes a chunk from the store
+static void wld_unstoreChunk(WorldState *pWorldState, Chunk *pChunk) {
+  Chunk **ppSlot = wld_clipmapSlot(pWorldState, pChunk->chunkCoord);
+  if (*ppSlot == pChunk) {
+    *ppSlot = NULL;
+  } else {
+    hashmap_delete(pWorldState->chunk_map,
+                   &(ivec3_Chunk_KVPair){.chunkCoord = V3(pChunk->chunkCoord)});
+  }
+}
+
+typedef struct {
+  bool (*fn)(Chunk *pChunk, void *udata);
+  void *udata;
+} wld_ChunkScan;
+
+static bool wld_scan_HashmapData(const void *item, void *udata) {
+  const ivec3_Chunk_KVPair *pPair = item;
+  wld_ChunkScan *pScan = udata;
+  return pScan->fn(pPair->pChunk, pScan->udata);
+}
+
+// calls fn on every loaded chunk until it returns false. fn must not add or
+// remove chunks.
+static void wld_scanChunks(                 //
+    WorldState *pWorldState,                //
+    bool (*fn)(Chunk *pChunk, void *udata), //
+    void *udata                             //
+) {
+  for (uint32_t x = 0; x < CLIPMAP_SIZE; x++) {
+    for (uint32_t y = 0; y < CLIPMAP_SIZE; y++) {
+      for (uint32_t z = 0; z < CLIPMAP_SIZE; z++) {
+        Chunk *pChunk = pWorldState->clipmap[x][y][z];
+        if (pChunk != NULL && !fn(pChunk, udata)) {
+          return;
+        }
+      }
+    }
+  }
+  wld_ChunkScan scan = {.fn = fn, .udata = udata};
+  hashmap_scan(pWorldState->chunk_map, wld_scan_HashmapData, &scan);
+}
+
+// occluders drawn on a worker ahead of wld_getDrawList, see
+// wld_startOcclusion
+typedef struct wld_OcclusionJob {
+  // true from wld_startOcclusion until wld_getDrawList waits for it
+  bool pending;
+  // set by whoever draws the occluders, the worker or the thread that owns
+  // the world if it needs them first, so they're drawn just once
+  atomic_bool claimed;
+  // set when the worker has drawn them
+  bool done;
+  pthread_mutex_t lock;
+  pthread_cond_t doneCond;
+  // the view they're drawn for, and the world's editCount when collected
+  mat4x4 mvp;
+  uint64_t editCount;
+  // the boxes to draw, with room for occluder_cap of them
+  uint32_t occluder_cap;
+  uint32_t occluder_len;
+  DrawBounds *occluders;
+} wld_OcclusionJob;
+
+static void wld_finishOcclusion( //
+    WorldState *pWorldState,     //
+    const bool wanted            //
+);
+
+static Chunk *new_Chunk(WorldState *pWorldState, const ivec3 chunkCoord) {
+  Chunk *pChunk = malloc(sizeof(Chunk));
+  ivec3_dup(pChunk->chunkCoord, chunkCoord);
+  pChunk->pWorldState = pWorldState;
+  atomic_init(&pChunk->genState, ChunkGen_QUEUED);
+  atomic_init(&pChunk->cancelled, false);
+  atomic_init(&pChunk->state, ChunkState_GENERATING);
+  atomic_init(&pChunk->pendingDeps, 0);
+  atomic_init(&pChunk->pins, 0);
+  for (uint32_t i = 0; i < 6; i++) {
+    pChunk->meshNeighbours[i] = NULL;
+  }
+  pthread_mutex_init(&pChunk->lock, NULL);
+  pthread_rwlock_init(&pChunk->dataLock, NULL);
+  pChunk->genFinished = false;
+  pChunk->dependents = NULL;
+  pChunk->dependents_len = 0;
+  pChunk->dependents_cap = 0;
+  pChunk->pRegion = NULL;
+  pChunk->pNewMesh = NULL;
+  pChunk->dirty = false;
+  pChunk->queuedUnload = false;
+  pChunk->faceConnections = FACE_CONNECTIONS_ALL;
+  pChunk->cullFrame = 0;
+  return pChunk;
+}
+
+static void delete_Chunk(Chunk *pChunk) {
+  pthread_mutex_destroy(&pChunk->lock);
+  pthread_rwlock_destroy(&pChunk->dataLock);
+  free(pChunk->dependents);
+  free(pChunk);
+}
+
+void wld_new_WorldState(                     //
+    WorldState *pWorldState,                 //
+    const ivec3 centerLoc,                   //
+    worldgen_state *wgstate,                 //
+    const uint32_t workerThreads,            //
+    const VkQueue graphicsQueue,             //
+    const uint32_t graphicsQueueFamilyIndex, //
+    const VkDevice device,                   //
+    const VkPhysicalDevice physicalDevice    //
 ) {
   pWorldState->wgstate = wgstate;
   // set center location
@@ -154,29 +530,120 @@ void wld_new_WorldState(                  //
   // copy vulkan
   pWorldState->device = device;
   pWorldState->physicalDevice = physicalDevice;
-  pWorldState->queue = queue;
-  pWorldState->commandPool = commandPool;
 
   // initialize stacks to empty
   new_ivec3_vec(&pWorldState->togenerate);
-  new_ivec3_vec(&pWorldState->generating);
-  new_ivec3_vec(&pWorldState->tomesh);
-  new_ivec3_vec(&pWorldState->ready);
+  new_ivec3_vec(&pWorldState->toremesh);
   new_ivec3_vec(&pWorldState->tounload);
+  new_ivec3_vec(&pWorldState->torebuild);
+  new_ivec3_vec(&pWorldState->topromote);
+
+  // nothing has been meshed yet
+  atomic_init(&pWorldState->completedMeshes, NULL);
+  pWorldState->pendingUploads = NULL;
+
+  // initialize draw list to empty
+  pWorldState->draw_cap = 64;
+  pWorldState->draw_len = 0;
+  pWorldState->drawOffsets =
+      malloc(pWorldState->draw_cap * sizeof(VkDeviceSize));
+  pWorldState->drawCounts = malloc(pWorldState->draw_cap * sizeof(uint32_t));
+  pWorldState->drawOrigins = malloc(pWorldState->draw_cap * sizeof(uint32_t));
+  pWorldState->drawBounds =
+      malloc(pWorldState->draw_cap * sizeof(DrawBounds));
+  pWorldState->drawBlocks = malloc(pWorldState->draw_cap * sizeof(uint32_t));
+  pWorldState->drawIndexes =
+      malloc(pWorldState->draw_cap * sizeof(uint32_t *));
+  ivec3_dup(pWorldState->sortedCenter, centerLoc);
+  pWorldState->changed_len = 0;
+  pWorldState->changedDraws =
+      malloc(pWorldState->draw_cap * sizeof(uint32_t));
+  pWorldState->drawChanged = calloc(pWorldState->draw_cap, sizeof(bool));
+  pWorldState->changedRecords =
+      malloc(pWorldState->draw_cap * sizeof(CullDrawRecord));
+  pWorldState->blockBuffer_cap = 4;
+  pWorldState->blockBuffers =
+      malloc(pWorldState->blockBuffer_cap * sizeof(VkBuffer));
+  pWorldState->cull_cap = 64;
+  pWorldState->cullQueue = malloc(pWorldState->cull_cap * sizeof(Chunk *));
+  pWorldState->cullRegions =
+      malloc(pWorldState->cull_cap * sizeof(MeshRegion *));
+  pWorldState->cullFrame = 0;
+  new_OcclusionBuffer(&pWorldState->occlusion);
+  pWorldState->pOcclusionJob = malloc(sizeof(wld_OcclusionJob));
+  pWorldState->pOcclusionJob->pending = false;
+  atomic_init(&pWorldState->pOcclusionJob->claimed, true);
+  pWorldState->pOcclusionJob->done = false;
+  pthread_mutex_init(&pWorldState->pOcclusionJob->lock, NULL);
+  pthread_cond_init(&pWorldState->pOcclusionJob->doneCond, NULL);
+  pWorldState->pOcclusionJob->occluder_cap = 64;
+  pWorldState->pOcclusionJob->occluder_len = 0;
+  pWorldState->pOcclusionJob->occluders =
+      malloc(pWorldState->pOcclusionJob->occluder_cap * sizeof(DrawBounds));
+  pWorldState->editCount = 0;
+  pWorldState->visible_cap = 64;
+  pWorldState->visible_len = 0;
+  pWorldState->visibleBlocks =
+      malloc(pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->visibleCommands =
+      malloc(pWorldState->visible_cap * sizeof(VkDrawIndirectCommand));
+  pWorldState->visibleKeys =
+      malloc(pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->visibleOrder =
+      malloc(pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batch_len = 0;
+  pWorldState->batchBlocks =
+      malloc(pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batchCounts =
+      malloc(pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batchedCommands =
+      malloc(pWorldState->visible_cap * sizeof(VkDrawIndirectCommand));
 
   // initialize threadpool
-  pWorldState->pool = threadpool_create(WORKER_THREADS, MAX_QUEUE, 0);
+  pWorldState->pool = threadpool_create(workerThreads, MAX_QUEUE, 0);
+  if (pWorldState->pool == NULL) {
+    LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "couldn't create threadpool of %u workers",
+                   workerThreads);
+    PANIC();
+  }
+
+  // workers mesh into the staging arena, and the meshes are copied from
+  // there into their regions, so the vertex pool is only written by the GPU.
+  // The copies overwrite faces the frames before may still be drawing, so
+  // they wait for those frames' vertex shaders.
+  new_VertexPool(&pWorldState->vertexPool, device, physicalDevice,
+                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+                     VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 1,
+                 &graphicsQueueFamilyIndex);
+  new_StagingRing(&pWorldState->staging, device, physicalDevice, graphicsQueue,
+                  graphicsQueueFamilyIndex,
+                  VK_PIPELINE_STAGE_VERTEX_SHADER_BIT);
 
   // initialize garbage heap
   pWorldState->garbage_cap = 16;
   pWorldState->garbage_data =
-      malloc(pWorldState->garbage_cap * sizeof(ChunkGeometry *));
+      malloc(pWorldState->garbage_cap * sizeof(Garbage));
   pWorldState->garbage_len = 0;
+  pWorldState->frame = 0;
+
+  // initialize the clipmap to empty
+  for (uint32_t x = 0; x < CLIPMAP_SIZE; x++) {
+    for (uint32_t y = 0; y < CLIPMAP_SIZE; y++) {
+      for (uint32_t z = 0; z < CLIPMAP_SIZE; z++) {
+        pWorldState->clipmap[x][y][z] = NULL;
+      }
+    }
+  }
 
   // initialize hash maps
   pWorldState->chunk_map =
       hashmap_new(sizeof(ivec3_Chunk_KVPair), 0, 0, 0, ivec3_Chunk_KVPair_hash,
                   ivec3_Chunk_KVPair_compare, NULL, NULL);
+  pWorldState->region_map = hashmap_new(
+      sizeof(ivec3_MeshRegion_KVPair), 0, 0, 0, ivec3_MeshRegion_KVPair_hash,
+      ivec3_MeshRegion_KVPair_compare, NULL, NULL);
 
   // initialize all of our neighboring chunks to be on the load list
   for (int32_t x = -RENDER_RADIUS_X; x <= RENDER_RADIUS_X; x++) {
@@ -190,19 +657,8 @@ void wld_new_WorldState(                  //
   }
 
   // set up highlight
-  pWorldState->has_highlight = false;
-
-  ErrVal highlightBufferCreateResult = new_Buffer_DeviceMemory(
-      &pWorldState->highlightVertexBuffer,
-      &pWorldState->highlightVertexBufferMemory, sizeof(Vertex) * 6,
-      physicalDevice, device,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  if (highlightBufferCreateResult != ERR_OK) {
-    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create highlight vertex buffer");
-    PANIC();
-  }
+  pWorldState->highlightDrawIndex = DRAW_LIST_NONE;
+  pWorldState->pHighlightGeometry = NULL;
 }
 
 static bool wld_shouldBeLoaded(    //
@@ -217,423 +673,2561 @@ static bool wld_shouldBeLoaded(    //
          (disp[2] >= -RENDER_RADIUS_Z && disp[2] <= RENDER_RADIUS_Z);
 }
 
-static void wld_pushGarbage(WorldState *pWorldState, ChunkGeometry *geometry) {
+// throws out geometry once the frames before frame are done with it
+static void wld_pushGarbageUntil( //
+    WorldState *pWorldState,      //
+    ChunkGeometry *geometry,      //
+    const uint64_t frame          //
+) {
+  if (geometry == NULL) {
+    return;
+  }
   if (pWorldState->garbage_len >= pWorldState->garbage_cap) {
     pWorldState->garbage_cap *= 2;
     pWorldState->garbage_data =
         realloc(pWorldState->garbage_data,
-                pWorldState->garbage_cap * sizeof(ChunkGeometry *));
+                pWorldState->garbage_cap * sizeof(Garbage));
   }
 
-  pWorldState->garbage_data[pWorldState->garbage_len] = geometry;
+  pWorldState->garbage_data[pWorldState->garbage_len] =
+      (Garbage){.pGeometry = geometry, .frame = frame};
   pWorldState->garbage_len++;
 }
 
-void wld_clearGarbage(WorldState *pWorldState) {
-  for (uint32_t i = 0; i < pWorldState->garbage_len; i++) {
-    delete_ChunkGeometry(pWorldState->garbage_data[i], pWorldState->device);
-    free(pWorldState->garbage_data[i]);
+static void wld_pushGarbage(WorldState *pWorldState, ChunkGeometry *geometry) {
+  // the frames before the next one might have it in their draw lists
+  wld_pushGarbageUntil(pWorldState, geometry, pWorldState->frame);
+}
+
+// throws out geometry that's copied from by the uploads of this tick. The
+// next frame waits on them, so they're done once that frame is.
+static void wld_pushCopiedGarbage( //
+    WorldState *pWorldState,       //
+    ChunkGeometry *geometry        //
+) {
+  wld_pushGarbageUntil(pWorldState, geometry, pWorldState->frame + 1);
+}
+
+void wld_clearGarbage(             //
+    WorldState *pWorldState,       //
+    const uint64_t completedFrames //
+) {
+  // garbage is in the order it was thrown out, so the done part is in front
+  uint32_t done = 0;
+  while (done < pWorldState->garbage_len &&
+         pWorldState->garbage_data[done].frame <= completedFrames) {
+    delete_ChunkGeometry(pWorldState->garbage_data[done].pGeometry,
+                         &pWorldState->vertexPool);
+    free(pWorldState->garbage_data[done].pGeometry);
+    done++;
+  }
+  if (done == 0) {
+    return;
+  }
+  pWorldState->garbage_len -= done;
+  memmove(pWorldState->garbage_data, pWorldState->garbage_data + done,
+          pWorldState->garbage_len * sizeof(Garbage));
+
+  // blocks with nothing left in them aren't used by any frame either
+  vtp_trim(&pWorldState->vertexPool);
+}
+
+void wld_getVertexPoolStats( //
+    VertexPoolStats *pStats, //
+    WorldState *pWorldState  //
+) {
+  vtp_getStats(pStats, &pWorldState->vertexPool);
+}
+
+VkSemaphore wld_flushUploads( //
+    WorldState *pWorldState   //
+) {
+  return stg_flush(&pWorldState->staging);
+}
+
+// the key draws of the chunk are sorted by, see HIGHLIGHT_DISTANCE_KEY
+static uint32_t wld_chunkDistanceKey( //
+    const WorldState *pWorldState,    //
+    const ivec3 chunkCoord            //
+) {
+  uint32_t key = 0;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    int32_t d = chunkCoord[axis] - pWorldState->centerLoc[axis];
+    key += (uint32_t)(d * d);
+  }
+  return key < HIGHLIGHT_DISTANCE_KEY ? key : HIGHLIGHT_DISTANCE_KEY - 1;
+}
+
+// the key of the chunk the box's nearest point to the center is in
+static uint32_t wld_boundsDistanceKey( //
+    const WorldState *pWorldState,     //
+    const DrawBounds *pBounds          //
+) {
+  ivec3 chunkCoord;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    float center = ((float)pWorldState->centerLoc[axis] + 0.5f) *
+                   (float)wld_chunkSize[axis];
+    float nearest =
+        fminf(fmaxf(center, pBounds->min[axis]), pBounds->max[axis]);
+    chunkCoord[axis] = (int32_t)floorf(nearest / (float)wld_chunkSize[axis]);
+  }
+  return wld_chunkDistanceKey(pWorldState, chunkCoord);
+}
+
+// marks draw i as changed, for wld_getDrawChanges
+static void wld_drawListChanged(WorldState *pWorldState, uint32_t i) {
+  if (!pWorldState->drawChanged[i]) {
+    pWorldState->drawChanged[i] = true;
+    pWorldState->changedDraws[pWorldState->changed_len++] = i;
+  }
+}
+
+// appends a draw to the draw list. *pIndex is set to the draw's index and kept
+// up to date as other draws get removed.
+static void wld_drawListPush(  //
+    WorldState *pWorldState,   //
+    const VkDeviceSize offset, //
+    const uint32_t count,      //
+    const uint32_t origin,     //
+    const DrawBounds *pBounds, //
+    const uint32_t block,      //
+    uint32_t *pIndex           //
+) {
+  if (pWorldState->draw_len >= pWorldState->draw_cap) {
+    uint32_t oldCap = pWorldState->draw_cap;
+    pWorldState->draw_cap *= 2;
+    pWorldState->drawOffsets =
+        realloc(pWorldState->drawOffsets,
+                pWorldState->draw_cap * sizeof(VkDeviceSize));
+    pWorldState->drawCounts = realloc(
+        pWorldState->drawCounts, pWorldState->draw_cap * sizeof(uint32_t));
+    pWorldState->drawOrigins = realloc(
+        pWorldState->drawOrigins, pWorldState->draw_cap * sizeof(uint32_t));
+    pWorldState->drawBounds = realloc(
+        pWorldState->drawBounds, pWorldState->draw_cap * sizeof(DrawBounds));
+    pWorldState->drawBlocks = realloc(
+        pWorldState->drawBlocks, pWorldState->draw_cap * sizeof(uint32_t));
+    pWorldState->drawIndexes = realloc(
+        pWorldState->drawIndexes, pWorldState->draw_cap * sizeof(uint32_t *));
+    pWorldState->changedDraws = realloc(
+        pWorldState->changedDraws, pWorldState->draw_cap * sizeof(uint32_t));
+    pWorldState->drawChanged = realloc(
+        pWorldState->drawChanged, pWorldState->draw_cap * sizeof(bool));
+    memset(pWorldState->drawChanged + oldCap, 0,
+           (pWorldState->draw_cap - oldCap) * sizeof(bool));
+    pWorldState->changedRecords =
+        realloc(pWorldState->changedRecords,
+                pWorldState->draw_cap * sizeof(CullDrawRecord));
+  }
+
+  uint32_t i = pWorldState->draw_len++;
+  pWorldState->drawOffsets[i] = offset;
+  pWorldState->drawCounts[i] = count;
+  pWorldState->drawOrigins[i] = origin;
+  pWorldState->drawBounds[i] = *pBounds;
+  pWorldState->drawBlocks[i] = block;
+  pWorldState->drawIndexes[i] = pIndex;
+  wld_drawListChanged(pWorldState, i);
+  *pIndex = i;
+}
+
+// removes the draw at *pIndex by moving the last draw into its place
+static void wld_drawListRemove(WorldState *pWorldState, uint32_t *pIndex) {
+  uint32_t i = *pIndex;
+  uint32_t last = --pWorldState->draw_len;
+  if (i != last) {
+    pWorldState->drawOffsets[i] = pWorldState->drawOffsets[last];
+    pWorldState->drawCounts[i] = pWorldState->drawCounts[last];
+    pWorldState->drawOrigins[i] = pWorldState->drawOrigins[last];
+    pWorldState->drawBounds[i] = pWorldState->drawBounds[last];
+    pWorldState->drawBlocks[i] = pWorldState->drawBlocks[last];
+    pWorldState->drawIndexes[i] = pWorldState->drawIndexes[last];
+    *pWorldState->drawIndexes[i] = i;
+    wld_drawListChanged(pWorldState, i);
+  }
+  *pIndex = DRAW_LIST_NONE;
+}
+
+// swaps draws i and j, keeping their owners' indexes up to date
+static void wld_drawListSwap( //
+    WorldState *pWorldState,  //
+    const uint32_t i,         //
+    const uint32_t j          //
+) {
+  VkDeviceSize offset = pWorldState->drawOffsets[i];
+  pWorldState->drawOffsets[i] = pWorldState->drawOffsets[j];
+  pWorldState->drawOffsets[j] = offset;
+  uint32_t count = pWorldState->drawCounts[i];
+  pWorldState->drawCounts[i] = pWorldState->drawCounts[j];
+  pWorldState->drawCounts[j] = count;
+  uint32_t origin = pWorldState->drawOrigins[i];
+  pWorldState->drawOrigins[i] = pWorldState->drawOrigins[j];
+  pWorldState->drawOrigins[j] = origin;
+  DrawBounds bounds = pWorldState->drawBounds[i];
+  pWorldState->drawBounds[i] = pWorldState->drawBounds[j];
+  pWorldState->drawBounds[j] = bounds;
+  uint32_t block = pWorldState->drawBlocks[i];
+  pWorldState->drawBlocks[i] = pWorldState->drawBlocks[j];
+  pWorldState->drawBlocks[j] = block;
+  uint32_t *pIndex = pWorldState->drawIndexes[i];
+  pWorldState->drawIndexes[i] = pWorldState->drawIndexes[j];
+  pWorldState->drawIndexes[j] = pIndex;
+  *pWorldState->drawIndexes[i] = i;
+  *pWorldState->drawIndexes[j] = j;
+  wld_drawListChanged(pWorldState, i);
+  wld_drawListChanged(pWorldState, j);
+}
+
+// sorts the draw list front to back by wld_boundsDistanceKey. When the center
+// moves by a chunk most draws keep their order, so it's nearly sorted
+// already, and an insertion sort only moves the few draws that changed.
+static void wld_drawListSort(WorldState *pWorldState) {
+  for (uint32_t i = 1; i < pWorldState->draw_len; i++) {
+    uint32_t key =
+        wld_boundsDistanceKey(pWorldState, &pWorldState->drawBounds[i]);
+    uint32_t j = i;
+    while (j > 0 && wld_boundsDistanceKey(
+                        pWorldState, &pWorldState->drawBounds[j - 1]) > key) {
+      wld_drawListSwap(pWorldState, j - 1, j);
+      j--;
+    }
+  }
+}
+
+// points the region's draw (if any) at its current geometry
+static void wld_drawListSetRegion( //
+    WorldState *pWorldState,       //
+    MeshRegion *pRegion            //
+) {
+  const ChunkGeometry *pGeometry = pRegion->pGeometry;
+  bool visible = pRegion->memberFaceCount > 0;
+
+  if (!visible) {
+    if (pRegion->drawIndex != DRAW_LIST_NONE) {
+      wld_drawListRemove(pWorldState, &pRegion->drawIndex);
+    }
+  } else if (pRegion->drawIndex == DRAW_LIST_NONE) {
+    wld_drawListPush(pWorldState, pGeometry->vertexOffset,
+                     VERTEXES_PER_FACE * pGeometry->faceCount,
+                     pGeometry->origin, &pGeometry->bounds,
+                     pGeometry->allocation.block, &pRegion->drawIndex);
+  } else {
+    pWorldState->drawOffsets[pRegion->drawIndex] = pGeometry->vertexOffset;
+    pWorldState->drawCounts[pRegion->drawIndex] =
+        VERTEXES_PER_FACE * pGeometry->faceCount;
+    pWorldState->drawOrigins[pRegion->drawIndex] = pGeometry->origin;
+    pWorldState->drawBounds[pRegion->drawIndex] = pGeometry->bounds;
+    pWorldState->drawBlocks[pRegion->drawIndex] = pGeometry->allocation.block;
+    wld_drawListChanged(pWorldState, pRegion->drawIndex);
+  }
+}
+
+// returns the mesh region with the corner, or NULL if it has no meshed chunks
+static MeshRegion *wld_lookupRegion( //
+    const WorldState *pWorldState,   //
+    const ivec3 cornerCoord          //
+) {
+  ivec3_MeshRegion_KVPair key;
+  ivec3_dup(key.cornerCoord, cornerCoord);
+  const ivec3_MeshRegion_KVPair *pPair =
+      hashmap_get(pWorldState->region_map, &key);
+  return pPair == NULL ? NULL : pPair->pRegion;
+}
+
+// has the region built again at the end of the tick
+static void wld_queueRebuild(WorldState *pWorldState, MeshRegion *pRegion) {
+  if (!pRegion->queuedRebuild) {
+    pRegion->queuedRebuild = true;
+    ivec3_vec_push(pWorldState->torebuild, pRegion->cornerCoord);
+  }
+}
+
+// adds the chunk to its mesh region, making the region if it's the first
+static void wld_joinRegion(WorldState *pWorldState, Chunk *pChunk) {
+  ivec3 cornerCoord;
+  wld_regionCorner(cornerCoord, pChunk->chunkCoord);
+  MeshRegion *pRegion = wld_lookupRegion(pWorldState, cornerCoord);
+  if (pRegion == NULL) {
+    pRegion = malloc(sizeof(MeshRegion));
+    ivec3_dup(pRegion->cornerCoord, cornerCoord);
+    for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+      pRegion->members[m] = NULL;
+    }
+    pRegion->memberCount = 0;
+    pRegion->pGeometry = NULL;
+    pRegion->faceCapacity = 0;
+    memset(pRegion->firstFaces, 0, sizeof(pRegion->firstFaces));
+    memset(pRegion->faceCounts, 0, sizeof(pRegion->faceCounts));
+    memset(pRegion->faceCapacities, 0, sizeof(pRegion->faceCapacities));
+    pRegion->memberFaceCount = 0;
+    pRegion->drawIndex = DRAW_LIST_NONE;
+    pRegion->queuedRebuild = false;
+    pRegion->cullFrame = 0;
+    pRegion->visibleMembers = 0;
+    ivec3_MeshRegion_KVPair c = {.cornerCoord = V3(cornerCoord),
+                                 .pRegion = pRegion};
+    hashmap_set(pWorldState->region_map, &c);
+  }
+
+  pRegion->members[wld_regionMember(pChunk->chunkCoord)] = pChunk;
+  pRegion->memberCount++;
+  pChunk->pRegion = pRegion;
+  pChunk->faceCount = 0;
+}
+
+// takes the chunk out of its mesh region. Its faces stay in the region's
+// geometry until the region is built again, which blanks them.
+static void wld_leaveRegion(WorldState *pWorldState, Chunk *pChunk) {
+  MeshRegion *pRegion = pChunk->pRegion;
+  if (pRegion == NULL) {
+    return;
+  }
+  pRegion->members[wld_regionMember(pChunk->chunkCoord)] = NULL;
+  pRegion->memberCount--;
+  if (pChunk->pNewMesh != NULL) {
+    wld_releaseMesh(pChunk->pNewMesh, pWorldState);
+    free(pChunk->pNewMesh);
+    pChunk->pNewMesh = NULL;
+  }
+  pChunk->pRegion = NULL;
+  wld_queueRebuild(pWorldState, pRegion);
+}
+
+// gives the chunk a new mesh. It goes in the chunk's mesh region when the
+// region is built again.
+static void wld_setChunkMesh( //
+    WorldState *pWorldState,  //
+    Chunk *pChunk,            //
+    ChunkMeshResult *pResult  //
+) {
+  if (pChunk->pRegion == NULL) {
+    wld_joinRegion(pWorldState, pChunk);
+  }
+  if (pChunk->pNewMesh != NULL) {
+    wld_releaseMesh(pChunk->pNewMesh, pWorldState);
+    free(pChunk->pNewMesh);
+  }
+  pChunk->pNewMesh = pResult;
+  wld_queueRebuild(pWorldState, pChunk->pRegion);
+}
+
+// grows the bounds to contain pOther
+static void wld_growBounds(DrawBounds *pBounds, const DrawBounds *pOther) {
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    pBounds->min[axis] = fminf(pBounds->min[axis], pOther->min[axis]);
+    pBounds->max[axis] = fmaxf(pBounds->max[axis], pOther->max[axis]);
+  }
+}
+
+// how many faces there's room for around count of them, see MESH_ROOM_SLACK
+static uint32_t wld_faceRoom(const uint32_t count) {
+  return count + (count + MESH_ROOM_SLACK - 1) / MESH_ROOM_SLACK;
+}
+
+// how many faces the member has once its new mesh, if any, is placed
+static uint32_t wld_memberFaces(const Chunk *pChunk) {
+  return pChunk->pNewMesh != NULL ? pChunk->pNewMesh->faceCount
+                                  : pChunk->faceCount;
+}
+
+// zeroes count faces of the region's geometry from first on, which draws
+// them as nothing
+static void wld_blankFaces(    //
+    WorldState *pWorldState,   //
+    const MeshRegion *pRegion, //
+    const uint32_t first,      //
+    const uint32_t count       //
+) {
+  if (count == 0) {
+    return;
+  }
+  const ChunkGeometry *pGeometry = pRegion->pGeometry;
+  stg_fill(&pWorldState->staging, pGeometry->vertexBuffer,
+           pGeometry->vertexOffset + sizeof(Face) * first,
+           sizeof(Face) * count);
+}
+
+// has the member use only the first count faces of its room, blanking the
+// ones after them that were used
+static void wld_trimMember(  //
+    WorldState *pWorldState, //
+    MeshRegion *pRegion,     //
+    const uint32_t m,        //
+    const uint32_t count     //
+) {
+  if (pRegion->faceCounts[m] > count) {
+    wld_blankFaces(pWorldState, pRegion, pRegion->firstFaces[m] + count,
+                   pRegion->faceCounts[m] - count);
+  }
+  pRegion->faceCounts[m] = count;
+}
+
+// gives the member room for count faces after the last member's room. What
+// was in it before isn't known, so all of it counts as used.
+static void wld_appendMember( //
+    MeshRegion *pRegion,      //
+    const uint32_t m,         //
+    const uint32_t count      //
+) {
+  pRegion->firstFaces[m] = pRegion->pGeometry->faceCount;
+  pRegion->faceCapacities[m] = wld_faceRoom(count);
+  pRegion->faceCounts[m] = pRegion->faceCapacities[m];
+  pRegion->pGeometry->faceCount += pRegion->faceCapacities[m];
+}
+
+// copies the member's new mesh to the start of its room, lets go of where
+// the worker wrote it once the copy is done, and blanks the rest of the room
+static void wld_placeMember( //
+    WorldState *pWorldState, //
+    MeshRegion *pRegion,     //
+    const uint32_t m         //
+) {
+  Chunk *pChunk = pRegion->members[m];
+  ChunkMeshResult *pMesh = pChunk->pNewMesh;
+  if (pMesh->faceCount > 0) {
+    const ChunkGeometry *pGeometry = pRegion->pGeometry;
+    stg_uploadStaged(&pWorldState->staging, pGeometry->vertexBuffer,
+                     pGeometry->vertexOffset +
+                         sizeof(Face) * pRegion->firstFaces[m],
+                     &pMesh->staged, sizeof(Face) * pMesh->faceCount);
+    // so that trimming only blanks what's after it
+    pRegion->faceCounts[m] =
+        pRegion->faceCounts[m] > pMesh->faceCount ? pRegion->faceCounts[m]
+                                                  : pMesh->faceCount;
+  }
+  wld_trimMember(pWorldState, pRegion, m, pMesh->faceCount);
+  pChunk->faceCount = pMesh->faceCount;
+  pChunk->bounds = pMesh->bounds;
+  free(pMesh);
+  pChunk->pNewMesh = NULL;
+}
+
+// makes the region's geometry again, with the members' room back to back in
+// member order and room to spare after them. The new meshes are copied into
+// place, and the faces of the members that didn't change are copied over
+// from the old geometry on the GPU.
+static void wld_repackRegion(WorldState *pWorldState, MeshRegion *pRegion) {
+  ChunkGeometry *pOld = pRegion->pGeometry;
+  uint32_t faceCount = 0;
+  for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+    const Chunk *pChunk = pRegion->members[m];
+    if (pChunk != NULL) {
+      faceCount += wld_faceRoom(wld_memberFaces(pChunk));
+    }
+  }
+
+  ChunkGeometry *pNew = malloc(sizeof(ChunkGeometry));
+  pNew->faceCount = 0;
+  pRegion->pGeometry = pNew;
+  pRegion->faceCapacity = wld_faceRoom(faceCount);
+  if (faceCount > 0) {
+    pNew->origin = wu_packChunkOrigin(pRegion->cornerCoord);
+    void *pMapped;
+    vtp_alloc(&pNew->vertexBuffer, &pNew->vertexOffset, &pMapped,
+              &pNew->allocation, &pWorldState->vertexPool,
+              sizeof(Face) * pRegion->faceCapacity);
+  }
+
+  for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+    Chunk *pChunk = pRegion->members[m];
+    uint32_t oldFirst = pRegion->firstFaces[m];
+    if (pChunk == NULL) {
+      pRegion->firstFaces[m] = pNew->faceCount;
+      pRegion->faceCounts[m] = 0;
+      pRegion->faceCapacities[m] = 0;
+      continue;
+    }
+    wld_appendMember(pRegion, m, wld_memberFaces(pChunk));
+    if (pChunk->pNewMesh != NULL) {
+      wld_placeMember(pWorldState, pRegion, m);
+      continue;
+    }
+    if (pChunk->faceCount > 0) {
+      stg_copy(&pWorldState->staging, pOld->vertexBuffer,
+               pOld->vertexOffset + sizeof(Face) * oldFirst,
+               pNew->vertexBuffer,
+               pNew->vertexOffset + sizeof(Face) * pRegion->firstFaces[m],
+               sizeof(Face) * pChunk->faceCount);
+    }
+    wld_trimMember(pWorldState, pRegion, m, pChunk->faceCount);
+  }
+
+  // the old faces may still be drawn by the frames in flight, and are copied
+  // from by this tick's uploads
+  wld_pushCopiedGarbage(pWorldState, pOld);
+}
+
+// puts the members' new meshes into the region's geometry after its members
+// changed, or frees the region if it has none left. A new mesh goes in the
+// member's room if it fits, and in new room after the last member's if it
+// doesn't, so the faces of the other members stay where they are and only
+// the chunks that changed are copied. The geometry is only made again once
+// it has no room left for the meshes that moved.
+static void wld_buildRegion(WorldState *pWorldState, MeshRegion *pRegion) {
+  pRegion->queuedRebuild = false;
+  ChunkGeometry *pGeometry = pRegion->pGeometry;
+
+  if (pRegion->memberCount == 0) {
+    if (pRegion->drawIndex != DRAW_LIST_NONE) {
+      wld_drawListRemove(pWorldState, &pRegion->drawIndex);
+    }
+    wld_pushGarbage(pWorldState, pGeometry);
+    hashmap_delete(pWorldState->region_map,
+                   &(ivec3_MeshRegion_KVPair){
+                       .cornerCoord = V3(pRegion->cornerCoord)});
+    free(pRegion);
+    return;
+  }
+
+  // the room the meshes that outgrew theirs need after the last member's
+  uint32_t movedFaces = 0;
+  for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+    const Chunk *pChunk = pRegion->members[m];
+    if (pChunk != NULL &&
+        wld_memberFaces(pChunk) > pRegion->faceCapacities[m]) {
+      movedFaces += wld_faceRoom(wld_memberFaces(pChunk));
+    }
+  }
+
+  if (pGeometry == NULL ||
+      pGeometry->faceCount + movedFaces > pRegion->faceCapacity) {
+    wld_repackRegion(pWorldState, pRegion);
+  } else {
+    for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+      Chunk *pChunk = pRegion->members[m];
+      if (pChunk == NULL) {
+        // blank the faces of members that left
+        wld_trimMember(pWorldState, pRegion, m, 0);
+        continue;
+      }
+      if (pChunk->pNewMesh == NULL) {
+        continue;
+      }
+      if (pChunk->pNewMesh->faceCount > pRegion->faceCapacities[m]) {
+        wld_trimMember(pWorldState, pRegion, m, 0);
+        wld_appendMember(pRegion, m, pChunk->pNewMesh->faceCount);
+      }
+      wld_placeMember(pWorldState, pRegion, m);
+    }
+  }
+
+  // the region is drawn where its members' faces are
+  pGeometry = pRegion->pGeometry;
+  pRegion->memberFaceCount = 0;
+  for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+    const Chunk *pChunk = pRegion->members[m];
+    if (pChunk == NULL || pChunk->faceCount == 0) {
+      continue;
+    }
+    if (pRegion->memberFaceCount == 0) {
+      pGeometry->bounds = pChunk->bounds;
+    } else {
+      wld_growBounds(&pGeometry->bounds, &pChunk->bounds);
+    }
+    pRegion->memberFaceCount += pChunk->faceCount;
+  }
+  wld_drawListSetRegion(pWorldState, pRegion);
+}
+
+// puts the chunk in its clipmap slot, or in the map if the slot's occupant is
+// still in range
+static void wld_storeChunk(WorldState *pWorldState, Chunk *pChunk) {
+  Chunk **ppSlot = wld_clipmapSlot(pWorldState, pChunk->chunkCoord);
+  Chunk *pOccupant = *ppSlot;
+  if (pOccupant != NULL &&
+      wld_shouldBeLoaded(pWorldState, pOccupant->chunkCoord)) {
+    ivec3_Chunk_KVPair c = {.chunkCoord = V3(pChunk->chunkCoord),
+                            .pChunk = pChunk};
+    hashmap_set(pWorldState->chunk_map, &c);
+    return;
+  }
+
+  // the occupant is on its way out, move it to the map
+  if (pOccupant != NULL) {
+    ivec3_Chunk_KVPair c = {.chunkCoord = V3(pOccupant->chunkCoord),
+                            .pChunk = pOccupant};
+    hashmap_set(pWorldState->chunk_map, &c);
+  }
+  *ppSlot = pChunk;
+}
+
+// moves a chunk from the map into its clipmap slot if it's back in range
+static void wld_promoteChunk(WorldState *pWorldState, Chunk *pChunk) {
+  Chunk **ppSlot = wld_clipmapSlot(pWorldState, pChunk->chunkCoord);
+  if (*ppSlot == pChunk) {
+    return;
+  }
+  hashmap_delete(pWorldState->chunk_map,
+                 &(ivec3_Chunk_KVPair){.chunkCoord = V3(pChunk->chunkCoord)});
+  wld_storeChunk(pWorldState, pChunk);
+}
+
+// the face of the neighbour that touches us across face
+static BlockFaceKind wld_oppositeFace(BlockFaceKind face) {
+  switch (face) {
+  case Block_DOWN:
+    return Block_UP;
+  case Block_UP:
+    return Block_DOWN;
+  case Block_LEFT:
+    return Block_RIGHT;
+  case Block_RIGHT:
+    return Block_LEFT;
+  case Block_BACK:
+    return Block_FRONT;
+  case Block_FRONT:
+    return Block_BACK;
+  }
+  return face;
+}
+
+static void worker_mesh_chunk(uint32_t id, void *arg);
+
+static void wld_dispatchMesh(Chunk *pChunk) {
+  atomic_store_explicit(&pChunk->state, ChunkState_MESHING,
+                        memory_order_relaxed);
+  threadpool_error_t e = threadpool_add(pChunk->pWorldState->pool,
+                                        worker_mesh_chunk, pChunk, 0);
+  if (e != 0) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
+    PANIC();
+  }
+}
+
+// resolves one dependency of pChunk's next mesh task, dispatching it if it was
+// the last one. May be called from any thread.
+static void wld_releaseDep(Chunk *pChunk) {
+  if (atomic_fetch_sub_explicit(&pChunk->pendingDeps, 1,
+                                memory_order_acq_rel) == 1) {
+    wld_dispatchMesh(pChunk);
+  }
+}
+
+// adds a dependency to pChunk's next mesh task, unless it has already been
+// dispatched. Main thread only.
+static bool wld_tryAddDep(Chunk *pChunk) {
+  uint32_t deps =
+      atomic_load_explicit(&pChunk->pendingDeps, memory_order_relaxed);
+  while (deps != 0) {
+    if (atomic_compare_exchange_weak_explicit(&pChunk->pendingDeps, &deps,
+                                              deps + 1, memory_order_acq_rel,
+                                              memory_order_relaxed)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// records that dependent's mesh task waits on pChunk's generation. Returns
+// false if pChunk's generation is already over.
+static bool wld_addDependent(Chunk *pChunk, Chunk *dependent) {
+  bool added = false;
+  pthread_mutex_lock(&pChunk->lock);
+  if (!pChunk->genFinished) {
+    if (pChunk->dependents_len >= pChunk->dependents_cap) {
+      pChunk->dependents_cap =
+          pChunk->dependents_cap == 0 ? 6 : pChunk->dependents_cap * 2;
+      pChunk->dependents = realloc(pChunk->dependents,
+                                   pChunk->dependents_cap * sizeof(Chunk *));
+    }
+    pChunk->dependents[pChunk->dependents_len++] = dependent;
+    added = true;
+  }
+  pthread_mutex_unlock(&pChunk->lock);
+  return added;
+}
+
+// makes pChunk's next mesh task read its loaded neighbours, and wait for any
+// of them that are still generating. Main thread only, while pChunk holds a
+// dependency of its own so the task can't be dispatched halfway through.
+static void wld_linkMeshNeighbours(Chunk *pChunk) {
+  for (BlockFaceKind face = 0; face < 6; face++) {
+    if (pChunk->meshNeighbours[face] != NULL) {
+      continue;
+    }
+    ivec3 neighbourCoord;
+    wu_getAdjacentBlock(neighbourCoord, pChunk->chunkCoord, face);
+    Chunk *pNeighbour = wld_lookupChunk(pChunk->pWorldState, neighbourCoord);
+    if (pNeighbour == NULL) {
+      continue;
+    }
+
+    atomic_fetch_add_explicit(&pNeighbour->pins, 1, memory_order_relaxed);
+    pChunk->meshNeighbours[face] = pNeighbour;
+
+    atomic_fetch_add_explicit(&pChunk->pendingDeps, 1, memory_order_relaxed);
+    if (!wld_addDependent(pNeighbour, pChunk)) {
+      // it's already generated, nothing to wait for
+      atomic_fetch_sub_explicit(&pChunk->pendingDeps, 1, memory_order_relaxed);
+    }
+  }
+}
+
+// neighbours of pChunk whose mesh task hasn't been dispatched yet will also
+// wait for pChunk's generation, and read its data. Main thread only, before
+// pChunk's generation task is submitted.
+static void wld_linkDependentNeighbours(Chunk *pChunk) {
+  for (BlockFaceKind face = 0; face < 6; face++) {
+    ivec3 neighbourCoord;
+    wu_getAdjacentBlock(neighbourCoord, pChunk->chunkCoord, face);
+    Chunk *pNeighbour = wld_lookupChunk(pChunk->pWorldState, neighbourCoord);
+    if (pNeighbour == NULL || !wld_tryAddDep(pNeighbour)) {
+      continue;
+    }
+
+    BlockFaceKind back = wld_oppositeFace(face);
+    if (pNeighbour->meshNeighbours[back] == NULL) {
+      atomic_fetch_add_explicit(&pChunk->pins, 1, memory_order_relaxed);
+      pNeighbour->meshNeighbours[back] = pChunk;
+    }
+
+    if (!wld_addDependent(pChunk, pNeighbour)) {
+      // can't happen, our generation hasn't been submitted yet
+      wld_releaseDep(pNeighbour);
+    }
+  }
+}
+
+// recounts the opaque blocks in each of the chunk's bricks
+static void wld_countSolid(Chunk *pChunk) {
+  pChunk->solidCount = 0;
+  for (uint32_t bx = 0; bx < BRICKS_X; bx++) {
+    for (uint32_t by = 0; by < BRICKS_Y; by++) {
+      for (uint32_t bz = 0; bz < BRICKS_Z; bz++) {
+        uint16_t count = 0;
+        for (uint32_t x = bx * BRICK_SIZE; x < (bx + 1) * BRICK_SIZE; x++) {
+          for (uint32_t y = by * BRICK_SIZE; y < (by + 1) * BRICK_SIZE; y++) {
+            for (uint32_t z = bz * BRICK_SIZE; z < (bz + 1) * BRICK_SIZE;
+                 z++) {
+              count += !BLOCKS[pChunk->data.blocks[x][y][z]].transparent;
+            }
+          }
+        }
+        pChunk->brickSolidCount[bx][by][bz] = count;
+        pChunk->solidCount += count;
+      }
+    }
+  }
+}
+
+static void worker_generate_chunk(UNUSED uint32_t id, void *arg) {
+  Chunk *pChunk = arg;
+
+  assert(atomic_load(&pChunk->genState) == ChunkGen_QUEUED);
+
+  // the chunk may have gone out of range while this task sat in the queue
+  ChunkGenState result = ChunkGen_CANCELLED;
+  if (!atomic_load_explicit(&pChunk->cancelled, memory_order_relaxed)) {
+    atomic_store_explicit(&pChunk->genState, ChunkGen_RUNNING,
+                          memory_order_relaxed);
+    // generate chunk, worldgen bails early if we're cancelled midway
+    if (worldgen_state_gen_chunk(&pChunk->data, pChunk->chunkCoord,
+                                 pChunk->pWorldState->wgstate,
+                                 &pChunk->cancelled)) {
+      wld_countSolid(pChunk);
+      result = ChunkGen_DONE;
+    }
+  }
+
+  // publish the data (or the cancellation)
+  atomic_store_explicit(&pChunk->genState, result, memory_order_release);
+  atomic_store_explicit(&pChunk->state, ChunkState_WAITING,
+                        memory_order_relaxed);
+
+  // take the dependents, nobody can add themselves after this
+  pthread_mutex_lock(&pChunk->lock);
+  pChunk->genFinished = true;
+  Chunk **dependents = pChunk->dependents;
+  uint32_t dependents_len = pChunk->dependents_len;
+  pChunk->dependents = NULL;
+  pChunk->dependents_len = 0;
+  pChunk->dependents_cap = 0;
+  pthread_mutex_unlock(&pChunk->lock);
+
+  for (uint32_t i = 0; i < dependents_len; i++) {
+    wld_releaseDep(dependents[i]);
+  }
+  free(dependents);
+
+  // our own mesh task was waiting on this too
+  wld_releaseDep(pChunk);
+}
+
+static void worker_mesh_chunk(UNUSED uint32_t id, void *arg) {
+  Chunk *pChunk = arg;
+
+  WorldState *pWorldState = pChunk->pWorldState;
+
+  ChunkMeshResult *pResult = malloc(sizeof(ChunkMeshResult));
+  pResult->pChunk = pChunk;
+  pResult->valid = false;
+  pResult->faceCount = 0;
+  pResult->faceConnections = FACE_CONNECTIONS_ALL;
+
+  // don't bother meshing chunks that are about to be unloaded
+  if (wld_chunkDataReady(pChunk) &&
+      !atomic_load_explicit(&pChunk->cancelled, memory_order_relaxed)) {
+    pResult->valid = true;
+    // neighbours that don't have data count as missing
+    const ChunkData *pNeighbours[6];
+    pthread_rwlock_rdlock(&pChunk->dataLock);
+    for (uint32_t i = 0; i < 6; i++) {
+      Chunk *pNeighbour = pChunk->meshNeighbours[i];
+      if (pNeighbour != NULL && wld_chunkDataReady(pNeighbour)) {
+        pthread_rwlock_rdlock(&pNeighbour->dataLock);
+        pNeighbours[i] = &pNeighbour->data;
+      } else {
+        pNeighbours[i] = NULL;
+      }
+    }
+
+    vec3 chunkOffset;
+    worldChunkCoords_to_blockCoords(chunkOffset, pChunk->chunkCoord);
+
+    pResult->faceCount = wu_countChunkDataFaces(
+        pResult->bounds.min, pResult->bounds.max, &pChunk->data, pNeighbours);
+    if (pResult->faceCount > 0) {
+      vec3_add(pResult->bounds.min, pResult->bounds.min, chunkOffset);
+      vec3_add(pResult->bounds.max, pResult->bounds.max, chunkOffset);
+      // faces are placed relative to the corner of the mesh region
+      ivec3 regionOffset;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        regionOffset[axis] =
+            (pChunk->chunkCoord[axis] & (MESH_REGION_SIZE - 1)) *
+            wld_chunkSize[axis];
+      }
+      // mesh straight into the staging arena, so this is the only copy the
+      // CPU makes
+      wu_getFacesChunkData(wld_reserveMesh(pResult, pWorldState),
+                           regionOffset, &pChunk->data, pNeighbours);
+    }
+    pResult->faceConnections = wu_getChunkDataFaceConnections(&pChunk->data);
+
+    for (uint32_t i = 0; i < 6; i++) {
+      if (pNeighbours[i] != NULL) {
+        pthread_rwlock_unlock(&pChunk->meshNeighbours[i]->dataLock);
+      }
+    }
+    pthread_rwlock_unlock(&pChunk->dataLock);
+  }
+
+  // we're done reading our neighbours, let them go
+  for (uint32_t i = 0; i < 6; i++) {
+    Chunk *pNeighbour = pChunk->meshNeighbours[i];
+    if (pNeighbour != NULL) {
+      pChunk->meshNeighbours[i] = NULL;
+      atomic_fetch_sub_explicit(&pNeighbour->pins, 1, memory_order_release);
+    }
+  }
+
+  atomic_store_explicit(&pChunk->state, ChunkState_MESHED,
+                        memory_order_relaxed);
+
+  // hand the mesh to the main thread for upload
+  pResult->next = atomic_load_explicit(&pWorldState->completedMeshes,
+                                       memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+      &pWorldState->completedMeshes, &pResult->next, pResult,
+      memory_order_release, memory_order_relaxed)) {
+  }
+}
+
+// (re)starts generation of pChunk. Main thread only.
+static void wld_startGeneration(Chunk *pChunk) {
+  atomic_store_explicit(&pChunk->cancelled, false, memory_order_relaxed);
+  atomic_store_explicit(&pChunk->genState, ChunkGen_QUEUED,
+                        memory_order_relaxed);
+  atomic_store_explicit(&pChunk->state, ChunkState_GENERATING,
+                        memory_order_relaxed);
+  pChunk->genFinished = false;
+
+  // our mesh waits on our own generation, plus whatever linking adds
+  atomic_store_explicit(&pChunk->pendingDeps, 1, memory_order_relaxed);
+  wld_linkMeshNeighbours(pChunk);
+  wld_linkDependentNeighbours(pChunk);
+}
+
+// generates a chunk again after its generation was cancelled. Main thread
+// only.
+static void wld_restartGeneration(Chunk *pChunk) {
+  wld_startGeneration(pChunk);
+  threadpool_error_t e = threadpool_add(pChunk->pWorldState->pool,
+                                        worker_generate_chunk, pChunk, 0);
+  if (e != 0) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
+    PANIC();
+  }
+}
+
+// queues a new mesh task for a READY chunk. Main thread only.
+static void wld_startMesh(Chunk *pChunk) {
+  assert(atomic_load(&pChunk->state) == ChunkState_READY);
+  pChunk->dirty = false;
+  // neighbours that are still generating may hold up the task
+  atomic_store_explicit(&pChunk->state, ChunkState_WAITING,
+                        memory_order_relaxed);
+  // hold a dependency ourselves while linking
+  atomic_store_explicit(&pChunk->pendingDeps, 1, memory_order_relaxed);
+  wld_linkMeshNeighbours(pChunk);
+  wld_releaseDep(pChunk);
+}
+
+// creates all the chunks on the togenerate list and submits their generation
+// in one batch
+static void wld_processGenerate(WorldState *pWorldState) {
+  uint32_t len = ivec3_vec_len(pWorldState->togenerate);
+  if (len == 0) {
+    return;
+  }
+
+  void **tasks = malloc(len * sizeof(void *));
+  uint32_t taskCount = 0;
+
+  while (ivec3_vec_len(pWorldState->togenerate) > 0) {
+    ivec3 chunkCoord;
+    ivec3_vec_pop(pWorldState->togenerate, chunkCoord);
+
+    // check that we still even need to load this
+    if (!wld_shouldBeLoaded(pWorldState, chunkCoord)) {
+      continue;
+    }
+
+    // check we haven't already loaded this
+    if (wld_lookupChunk(pWorldState, chunkCoord) != NULL) {
+      continue;
+    }
+
+    Chunk *pChunk = new_Chunk(pWorldState, chunkCoord);
+    wld_storeChunk(pWorldState, pChunk);
+
+    wld_startGeneration(pChunk);
+    tasks[taskCount++] = pChunk;
+  }
+
+  threadpool_error_t e = threadpool_add_batch(
+      pWorldState->pool, worker_generate_chunk, tasks, taskCount, 0);
+  if (e != 0) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
+    PANIC();
+  }
+  free(tasks);
+}
+
+// uploads finished meshes, at most MAX_CHUNKS_TO_UPLOAD per tick
+static void wld_processMeshed(WorldState *pWorldState) {
+  // grab everything the workers finished since last tick
+  ChunkMeshResult *pCompleted = atomic_exchange_explicit(
+      &pWorldState->completedMeshes, NULL, memory_order_acquire);
+  while (pCompleted != NULL) {
+    ChunkMeshResult *next = pCompleted->next;
+    pCompleted->next = pWorldState->pendingUploads;
+    pWorldState->pendingUploads = pCompleted;
+    pCompleted = next;
+  }
+
+  uint32_t uploaded = 0;
+  while (uploaded < MAX_CHUNKS_TO_UPLOAD &&
+         pWorldState->pendingUploads != NULL) {
+    ChunkMeshResult *pResult = pWorldState->pendingUploads;
+    pWorldState->pendingUploads = pResult->next;
+
+    Chunk *pChunk = pResult->pChunk;
+    bool wanted = wld_shouldBeLoaded(pWorldState, pChunk->chunkCoord);
+
+    if (wanted && atomic_load_explicit(&pChunk->genState,
+                                       memory_order_relaxed) ==
+                      ChunkGen_CANCELLED) {
+      // cancelled, but then we came back in range, so generate it again
+      wld_releaseMesh(pResult, pWorldState);
+      free(pResult);
+      wld_restartGeneration(pChunk);
+      continue;
+    }
+
+    if (!pResult->valid) {
+      // the task was skipped while we were out of range, but we came back
+      pChunk->dirty = pChunk->dirty || wld_chunkDataReady(pChunk);
+    } else if (wanted) {
+      // the chunk's mesh region copies it into place at the end of the tick
+      pChunk->faceConnections = pResult->faceConnections;
+      wld_setChunkMesh(pWorldState, pChunk, pResult);
+      pResult = NULL;
+      uploaded++;
+    } else {
+      // stale meshes of chunks we're about to unload aren't worth uploading.
+      // If we come back before it's unloaded, it has to be meshed again.
+      wld_releaseMesh(pResult, pWorldState);
+      pChunk->dirty = true;
+    }
+
+    free(pResult);
+
+    atomic_store_explicit(&pChunk->state, ChunkState_READY,
+                          memory_order_relaxed);
+
+    // edited while the mesh was in flight
+    if (pChunk->dirty && wanted) {
+      wld_startMesh(pChunk);
+    }
+  }
+}
+
+// dispatches remeshes of edited chunks
+static void wld_processRemesh(WorldState *pWorldState) {
+  while (ivec3_vec_len(pWorldState->toremesh) > 0) {
+    ivec3 chunkCoord;
+    ivec3_vec_pop(pWorldState->toremesh, chunkCoord);
+
+    Chunk *pChunk = wld_lookupChunk(pWorldState, chunkCoord);
+    if (pChunk == NULL || !pChunk->dirty ||
+        !wld_shouldBeLoaded(pWorldState, chunkCoord)) {
+      continue;
+    }
+
+    switch (atomic_load_explicit(&pChunk->state, memory_order_relaxed)) {
+    case ChunkState_READY:
+      wld_startMesh(pChunk);
+      break;
+    case ChunkState_GENERATING:
+    case ChunkState_WAITING:
+      // the pending mesh task hasn't read anything yet
+      pChunk->dirty = false;
+      break;
+    default:
+      // wld_processMeshed remeshes once the mesh in flight comes back
+      break;
+    }
+  }
+}
+
+// frees chunks on the tounload list, at most MAX_CHUNKS_TO_UNLOAD per tick.
+// Chunks that tasks are still using are retried next tick.
+static void wld_processUnload(WorldState *pWorldState) {
+  ivec3_vec *retry;
+  new_ivec3_vec(&retry);
+
+  uint32_t unloaded = 0;
+  while (unloaded < MAX_CHUNKS_TO_UNLOAD &&
+         ivec3_vec_len(pWorldState->tounload) > 0) {
+    ivec3 chunkCoord;
+    ivec3_vec_pop(pWorldState->tounload, chunkCoord);
+
+    Chunk *pChunk = wld_lookupChunk(pWorldState, chunkCoord);
+    if (pChunk == NULL) {
+      continue;
+    }
+
+    // we came back in range before getting to it
+    if (wld_shouldBeLoaded(pWorldState, chunkCoord)) {
+      pChunk->queuedUnload = false;
+      continue;
+    }
+
+    if (atomic_load_explicit(&pChunk->state, memory_order_relaxed) !=
+            ChunkState_READY ||
+        atomic_load_explicit(&pChunk->pins, memory_order_acquire) != 0) {
+      ivec3_vec_push(retry, chunkCoord);
+      continue;
+    }
+
+    // remove from the store
+    wld_unstoreChunk(pWorldState, pChunk);
+
+    // stop drawing it, its faces leave the region's geometry when the region
+    // is built again
+    wld_leaveRegion(pWorldState, pChunk);
+    delete_Chunk(pChunk);
+    unloaded++;
+  }
+
+  while (ivec3_vec_len(retry) > 0) {
+    ivec3 chunkCoord;
+    ivec3_vec_pop(retry, chunkCoord);
+    ivec3_vec_push(pWorldState->tounload, chunkCoord);
+  }
+  delete_ivec3_vec(&retry);
+}
+
+// builds the mesh regions whose chunks changed this tick, each one once
+static void wld_processRebuild(WorldState *pWorldState) {
+  while (ivec3_vec_len(pWorldState->torebuild) > 0) {
+    ivec3 cornerCoord;
+    ivec3_vec_pop(pWorldState->torebuild, cornerCoord);
+    wld_buildRegion(pWorldState, wld_lookupRegion(pWorldState, cornerCoord));
+  }
+}
+
+void wld_update(            //
+    WorldState *pWorldState //
+) {
+  wld_processGenerate(pWorldState);
+  wld_processRemesh(pWorldState);
+  wld_processMeshed(pWorldState);
+  wld_processUnload(pWorldState);
+  wld_processRebuild(pWorldState);
+}
+
+static bool wld_cancelChunk(Chunk *pChunk, UNUSED void *udata) {
+  atomic_store_explicit(&pChunk->cancelled, true, memory_order_relaxed);
+  return true;
+}
+
+static bool wld_deleteChunk(Chunk *pChunk, void *udata) {
+  WorldState *pWorldState = udata;
+  if (pChunk->pNewMesh != NULL) {
+    wld_releaseMesh(pChunk->pNewMesh, pWorldState);
+    free(pChunk->pNewMesh);
+  }
+  delete_Chunk(pChunk);
+  return true;
+}
+
+static bool wld_deleteRegion(const void *item, void *udata) {
+  const ivec3_MeshRegion_KVPair *pPair = item;
+  VertexPool *pPool = udata;
+  if (pPair->pRegion->pGeometry != NULL) {
+    delete_ChunkGeometry(pPair->pRegion->pGeometry, pPool);
+    free(pPair->pRegion->pGeometry);
+  }
+  free(pPair->pRegion);
+  return true;
+}
+
+static void wld_freeMeshResults( //
+    ChunkMeshResult *pResult,    //
+    WorldState *pWorldState      //
+) {
+  while (pResult != NULL) {
+    ChunkMeshResult *next = pResult->next;
+    wld_releaseMesh(pResult, pWorldState);
+    free(pResult);
+    pResult = next;
+  }
+}
+
+void wld_delete_WorldState( //
+    WorldState *pWorldState //
+) {
+  // cancel all outstanding tasks, then wait for the workers to notice
+  wld_finishOcclusion(pWorldState, false);
+  wld_scanChunks(pWorldState, wld_cancelChunk, NULL);
+  threadpool_destroy(pWorldState->pool, threadpool_graceful);
+
+  // drop the meshes nobody will upload
+  wld_freeMeshResults(atomic_exchange(&pWorldState->completedMeshes, NULL),
+                      pWorldState);
+  wld_freeMeshResults(pWorldState->pendingUploads, pWorldState);
+
+  // clear the garbage, the GPU is done with all of it by now
+  wld_clearGarbage(pWorldState, UINT64_MAX);
+  // free garbage heap
+  free(pWorldState->garbage_data);
+
+  // free vectors
+  delete_ivec3_vec(&pWorldState->togenerate);
+  delete_ivec3_vec(&pWorldState->toremesh);
+  delete_ivec3_vec(&pWorldState->tounload);
+  delete_ivec3_vec(&pWorldState->torebuild);
+  delete_ivec3_vec(&pWorldState->topromote);
+
+  // iterate through the store and free the data, then the mesh regions and
+  // their geometries
+  wld_scanChunks(pWorldState, wld_deleteChunk, pWorldState);
+  hashmap_scan(pWorldState->region_map, wld_deleteRegion,
+               &pWorldState->vertexPool);
+  // free the highlight
+  if (pWorldState->pHighlightGeometry != NULL) {
+    delete_ChunkGeometry(pWorldState->pHighlightGeometry,
+                         &pWorldState->vertexPool);
+    free(pWorldState->pHighlightGeometry);
+  }
+  delete_VertexPool(&pWorldState->vertexPool);
+  delete_StagingRing(&pWorldState->staging);
+
+  // free the maps
+  hashmap_free(pWorldState->chunk_map);
+  hashmap_free(pWorldState->region_map);
+
+  // free the draw list
+  free(pWorldState->drawOffsets);
+  free(pWorldState->drawCounts);
+  free(pWorldState->drawOrigins);
+  free(pWorldState->drawBounds);
+  free(pWorldState->drawBlocks);
+  free(pWorldState->drawIndexes);
+  free(pWorldState->changedDraws);
+  free(pWorldState->drawChanged);
+  free(pWorldState->changedRecords);
+  free(pWorldState->blockBuffers);
+  free(pWorldState->cullQueue);
+  free(pWorldState->cullRegions);
+  delete_OcclusionBuffer(&pWorldState->occlusion);
+  pthread_cond_destroy(&pWorldState->pOcclusionJob->doneCond);
+  pthread_mutex_destroy(&pWorldState->pOcclusionJob->lock);
+  free(pWorldState->pOcclusionJob->occluders);
+  free(pWorldState->pOcclusionJob);
+  free(pWorldState->visibleBlocks);
+  free(pWorldState->visibleCommands);
+  free(pWorldState->visibleKeys);
+  free(pWorldState->visibleOrder);
+  free(pWorldState->batchBlocks);
+  free(pWorldState->batchCounts);
+  free(pWorldState->batchedCommands);
+}
+
+void wld_getFrustumPlanes(vec4 planes[6], const mat4x4 mvp) {
+  // each plane is the last row of the matrix plus or minus one of the others
+  // (Gribb & Hartmann). linmath matrices are column major, so row i is
+  // mvp[0][i], mvp[1][i], ... The near plane is the one for OpenGL's -w <= z,
+  // which is a bit looser than what vulkan clips to, so nothing visible gets
+  // culled.
+  for (uint32_t i = 0; i < 3; i++) {
+    for (uint32_t j = 0; j < 4; j++) {
+      planes[i * 2][j] = mvp[j][3] + mvp[j][i];
+      planes[i * 2 + 1][j] = mvp[j][3] - mvp[j][i];
+    }
+  }
+}
+
+bool wld_boundsInFrustum(     //
+    const vec4 planes[6],     //
+    const DrawBounds *pBounds //
+) {
+  for (uint32_t i = 0; i < 6; i++) {
+    // if even the corner furthest along the plane's normal is outside, the
+    // whole box is
+    float distance = planes[i][3];
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float corner =
+          planes[i][axis] > 0 ? pBounds->max[axis] : pBounds->min[axis];
+      distance += planes[i][axis] * corner;
+    }
+    if (distance < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the vertex draw i starts at. Its block's faces are drawn VERTEXES_PER_FACE
+// vertexes each, so this is where its first face is in the block times that.
+static uint32_t wld_drawFirstVertex( //
+    const WorldState *pWorldState,   //
+    const uint32_t i                 //
+) {
+  return (uint32_t)(pWorldState->drawOffsets[i] / sizeof(Face)) *
+         VERTEXES_PER_FACE;
+}
+
+// makes room for count visible draws
+static void wld_reserveVisible( //
+    WorldState *pWorldState,    //
+    const uint32_t count        //
+) {
+  if (count <= pWorldState->visible_cap) {
+    return;
+  }
+  while (pWorldState->visible_cap < count) {
+    pWorldState->visible_cap *= 2;
+  }
+  pWorldState->visibleBlocks = realloc(
+      pWorldState->visibleBlocks, pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->visibleCommands =
+      realloc(pWorldState->visibleCommands,
+              pWorldState->visible_cap * sizeof(VkDrawIndirectCommand));
+  pWorldState->visibleKeys = realloc(
+      pWorldState->visibleKeys, pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->visibleOrder = realloc(
+      pWorldState->visibleOrder, pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batchBlocks = realloc(
+      pWorldState->batchBlocks, pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batchCounts = realloc(
+      pWorldState->batchCounts, pWorldState->visible_cap * sizeof(uint32_t));
+  pWorldState->batchedCommands =
+      realloc(pWorldState->batchedCommands,
+              pWorldState->visible_cap * sizeof(VkDrawIndirectCommand));
+}
+
+// adds draw i to the visible draws if it's in the frustum, to be sorted by
+// key
+static void wld_pushVisibleDraw( //
+    WorldState *pWorldState,     //
+    const vec4 planes[6],        //
+    uint32_t i,                  //
+    const uint32_t key           //
+) {
+  if (wld_boundsInFrustum(planes, &pWorldState->drawBounds[i])) {
+    uint32_t v = pWorldState->visible_len++;
+    pWorldState->visibleBlocks[v] = pWorldState->drawBlocks[i];
+    pWorldState->visibleKeys[v] = key;
+    pWorldState->visibleCommands[v] = (VkDrawIndirectCommand){
+        .vertexCount = pWorldState->drawCounts[i],
+        .instanceCount = 1,
+        .firstVertex = wld_drawFirstVertex(pWorldState, i),
+        .firstInstance = pWorldState->drawOrigins[i],
+    };
+  }
+}
+
+// adds a draw of the faces of the region from firstFace up to endFace, if
+// there are any, to be sorted by key
+static void wld_pushRegionRun( //
+    WorldState *pWorldState,   //
+    const MeshRegion *pRegion, //
+    const uint32_t firstFace,  //
+    const uint32_t endFace,    //
+    const uint32_t key         //
+) {
+  if (firstFace == endFace) {
+    return;
+  }
+  const ChunkGeometry *pGeometry = pRegion->pGeometry;
+  uint32_t v = pWorldState->visible_len++;
+  pWorldState->visibleBlocks[v] = pGeometry->allocation.block;
+  pWorldState->visibleKeys[v] = key;
+  pWorldState->visibleCommands[v] = (VkDrawIndirectCommand){
+      .vertexCount = VERTEXES_PER_FACE * (endFace - firstFace),
+      .instanceCount = 1,
+      .firstVertex =
+          ((uint32_t)(pGeometry->vertexOffset / sizeof(Face)) + firstFace) *
+          VERTEXES_PER_FACE,
+      .firstInstance = pGeometry->origin,
+  };
+}
+
+// adds draws of the region's visible members, one for each run of them whose
+// room is next to each other in its faces, keyed by its nearest member. The
+// blank faces between their faces are drawn too, so room without faces in it
+// doesn't break up a run.
+static void wld_pushRegionDraws( //
+    WorldState *pWorldState,     //
+    const MeshRegion *pRegion    //
+) {
+  uint32_t firstFace = 0;
+  uint32_t endFace = 0;
+  // where the room of the run's last member ends
+  uint32_t endRoom = 0;
+  uint32_t key = HIGHLIGHT_DISTANCE_KEY;
+  for (uint32_t m = 0; m < MESH_REGION_CHUNKS; m++) {
+    const Chunk *pChunk = pRegion->members[m];
+    const uint32_t first = pRegion->firstFaces[m];
+    const uint32_t count = pRegion->faceCounts[m];
+    if (count == 0) {
+      if (firstFace != endFace && first == endRoom) {
+        endRoom += pRegion->faceCapacities[m];
+      }
+    } else if (pChunk == NULL ||
+               (pRegion->visibleMembers & ((uint64_t)1 << m)) == 0) {
+      wld_pushRegionRun(pWorldState, pRegion, firstFace, endFace, key);
+      firstFace = endFace;
+      key = HIGHLIGHT_DISTANCE_KEY;
+    } else {
+      if (firstFace != endFace && first != endRoom) {
+        wld_pushRegionRun(pWorldState, pRegion, firstFace, endFace, key);
+        firstFace = endFace;
+        key = HIGHLIGHT_DISTANCE_KEY;
+      }
+      if (firstFace == endFace) {
+        firstFace = first;
+      }
+      endFace = first + count;
+      endRoom = first + pRegion->faceCapacities[m];
+      uint32_t chunkKey = wld_chunkDistanceKey(pWorldState, pChunk->chunkCoord);
+      key = chunkKey < key ? chunkKey : key;
+    }
+  }
+  wld_pushRegionRun(pWorldState, pRegion, firstFace, endFace, key);
+}
+
+// counting sorts the visible draws by key into visibleOrder, so nearest first
+// with the highlight last. Draws with the same key keep their order.
+static void wld_sortVisibleDraws( //
+    WorldState *pWorldState       //
+) {
+  uint32_t starts[DISTANCE_KEYS] = {0};
+  for (uint32_t v = 0; v < pWorldState->visible_len; v++) {
+    starts[pWorldState->visibleKeys[v]]++;
+  }
+  uint32_t start = 0;
+  for (uint32_t key = 0; key < DISTANCE_KEYS; key++) {
+    uint32_t count = starts[key];
+    starts[key] = start;
+    start += count;
+  }
+  for (uint32_t v = 0; v < pWorldState->visible_len; v++) {
+    pWorldState->visibleOrder[starts[pWorldState->visibleKeys[v]]++] = v;
+  }
+}
+
+// finds the batch of the visible draws from block, or returns batch_len if
+// there isn't one yet. There's one per vertex pool block in use, so there are
+// only a few to look through.
+static uint32_t wld_findBatch(     //
+    const WorldState *pWorldState, //
+    const uint32_t block           //
+) {
+  uint32_t b = 0;
+  while (b < pWorldState->batch_len && pWorldState->batchBlocks[b] != block) {
+    b++;
+  }
+  return b;
+}
+
+// groups the visible draws into batches that share a vertex pool block, so
+// that each batch takes one indirect draw. Draws keep the order of
+// visibleOrder within a batch, and the batches are in the order of their
+// first draws.
+static void wld_batchVisibleDraws( //
+    WorldState *pWorldState        //
+) {
+  // count the draws in each batch
+  pWorldState->batch_len = 0;
+  for (uint32_t n = 0; n < pWorldState->visible_len; n++) {
+    uint32_t block = pWorldState->visibleBlocks[pWorldState->visibleOrder[n]];
+    uint32_t b = wld_findBatch(pWorldState, block);
+    if (b == pWorldState->batch_len) {
+      pWorldState->batchBlocks[b] = block;
+      pWorldState->batchCounts[b] = 0;
+      pWorldState->batch_len++;
+    }
+    pWorldState->batchCounts[b]++;
+  }
+
+  // then place each draw after the ones of the batches before it. The counts
+  // are used as where the next draw of each batch goes, and put back after.
+  uint32_t start = 0;
+  for (uint32_t b = 0; b < pWorldState->batch_len; b++) {
+    uint32_t count = pWorldState->batchCounts[b];
+    pWorldState->batchCounts[b] = start;
+    start += count;
+  }
+  for (uint32_t n = 0; n < pWorldState->visible_len; n++) {
+    uint32_t v = pWorldState->visibleOrder[n];
+    uint32_t b = wld_findBatch(pWorldState, pWorldState->visibleBlocks[v]);
+    pWorldState->batchedCommands[pWorldState->batchCounts[b]++] =
+        pWorldState->visibleCommands[v];
+  }
+  start = 0;
+  for (uint32_t b = 0; b < pWorldState->batch_len; b++) {
+    uint32_t end = pWorldState->batchCounts[b];
+    pWorldState->batchCounts[b] = end - start;
+    start = end;
+  }
+}
+
+// breadth first search outwards from the camera's chunk, only crossing from
+// one face of a chunk to another if they're connected through air, only
+// entering chunks in the frustum, and never turning back in a direction it
+// already went. The chunks reached are left in cullQueue, nearest first, and
+// their number is returned. (Tommaso Checchi's "advanced cave culling" for
+// Minecraft.)
+static uint32_t wld_findVisibleChunks( //
+    WorldState *pWorldState,           //
+    Chunk *pCameraChunk,               //
+    const vec4 planes[6]               //
+) {
+  uint32_t frame = ++pWorldState->cullFrame;
+  pCameraChunk->cullFrame = frame;
+  pCameraChunk->cullDirections = 0;
+  pWorldState->cullQueue[0] = pCameraChunk;
+  uint32_t queueStart = 0;
+  uint32_t queueEnd = 1;
+
+  while (queueStart < queueEnd) {
+    Chunk *pChunk = pWorldState->cullQueue[queueStart++];
+
+    for (BlockFaceKind face = 0; face < 6; face++) {
+      // going back the way we came can't reveal anything new
+      if (pChunk->cullDirections & (1u << wld_oppositeFace(face))) {
+        continue;
+      }
+      // the camera can see out of every face of its own chunk
+      if (pChunk != pCameraChunk &&
+          (pChunk->cullEntry == face ||
+           !(pChunk->faceConnections &
+             (1u << wu_facePairBit(pChunk->cullEntry, face))))) {
+        continue;
+      }
+
+      ivec3 neighbourCoord;
+      wu_getAdjacentBlock(neighbourCoord, pChunk->chunkCoord, face);
+      Chunk *pNeighbour = wld_lookupChunk(pWorldState, neighbourCoord);
+      if (pNeighbour == NULL || pNeighbour->cullFrame == frame) {
+        continue;
+      }
+
+      DrawBounds chunkBounds;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        chunkBounds.min[axis] =
+            (float)(neighbourCoord[axis] * wld_chunkSize[axis]);
+        chunkBounds.max[axis] =
+            chunkBounds.min[axis] + (float)wld_chunkSize[axis];
+      }
+      if (!wld_boundsInFrustum(planes, &chunkBounds)) {
+        continue;
+      }
+
+      pNeighbour->cullFrame = frame;
+      pNeighbour->cullDirections = pChunk->cullDirections | (1u << face);
+      pNeighbour->cullEntry = wld_oppositeFace(face);
+      if (queueEnd >= pWorldState->cull_cap) {
+        pWorldState->cull_cap *= 2;
+        pWorldState->cullQueue = realloc(
+            pWorldState->cullQueue, pWorldState->cull_cap * sizeof(Chunk *));
+        pWorldState->cullRegions =
+            realloc(pWorldState->cullRegions,
+                    pWorldState->cull_cap * sizeof(MeshRegion *));
+      }
+      pWorldState->cullQueue[queueEnd++] = pNeighbour;
+    }
+  }
+  return queueEnd;
+}
+
+// true if every brick from min up to but not including max is completely
+// solid and not yet drawn as part of another occluder
+static bool wld_bricksSolid(                        //
+    const Chunk *pChunk,                            //
+    const bool drawn[BRICKS_X][BRICKS_Y][BRICKS_Z], //
+    const uint32_t min[3],                          //
+    const uint32_t max[3]                           //
+) {
+  for (uint32_t bx = min[0]; bx < max[0]; bx++) {
+    for (uint32_t by = min[1]; by < max[1]; by++) {
+      for (uint32_t bz = min[2]; bz < max[2]; bz++) {
+        if (drawn[bx][by][bz] || pChunk->brickSolidCount[bx][by][bz] !=
+                                     BRICK_SIZE * BRICK_SIZE * BRICK_SIZE) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// adds the chunk's completely solid bricks to the occluders. Neighbouring
+// bricks are merged into bigger boxes first: a row along x, then rows of those
+// along y, then layers along z. That leaves far fewer faces to draw, since the
+// ones between two solid bricks can't be seen anyway. A chunk that's all solid
+// is one box.
+static void wld_collectOccluders( //
+    wld_OcclusionJob *pJob,       //
+    const Chunk *pChunk,          //
+    const vec4 planes[6]          //
+) {
+  if (!wld_chunkDataReady(pChunk) || pChunk->solidCount == 0) {
+    return;
+  }
+
+  ivec3 chunkOffset;
+  worldChunkCoords_to_iBlockCoords(chunkOffset, pChunk->chunkCoord);
+
+  const uint32_t bricks[3] = {BRICKS_X, BRICKS_Y, BRICKS_Z};
+  bool drawn[BRICKS_X][BRICKS_Y][BRICKS_Z] = {0};
+  for (uint32_t bz = 0; bz < BRICKS_Z; bz++) {
+    for (uint32_t by = 0; by < BRICKS_Y; by++) {
+      for (uint32_t bx = 0; bx < BRICKS_X; bx++) {
+        uint32_t min[3] = {bx, by, bz};
+        uint32_t max[3] = {bx + 1, by + 1, bz + 1};
+        if (!wld_bricksSolid(pChunk, drawn, min, max)) {
+          continue;
+        }
+        // grow the box one layer of bricks at a time, along each axis in turn
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          while (max[axis] < bricks[axis]) {
+            uint32_t layerMin[3] = {min[0], min[1], min[2]};
+            uint32_t layerMax[3] = {max[0], max[1], max[2]};
+            layerMin[axis] = max[axis];
+            layerMax[axis] = max[axis] + 1;
+            if (!wld_bricksSolid(pChunk, drawn, layerMin, layerMax)) {
+              break;
+            }
+            max[axis]++;
+          }
+        }
+        for (uint32_t x = min[0]; x < max[0]; x++) {
+          for (uint32_t y = min[1]; y < max[1]; y++) {
+            for (uint32_t z = min[2]; z < max[2]; z++) {
+              drawn[x][y][z] = true;
+            }
+          }
+        }
+
+        DrawBounds box;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          box.min[axis] =
+              (float)(chunkOffset[axis] + (int32_t)min[axis] * BRICK_SIZE);
+          box.max[axis] =
+              (float)(chunkOffset[axis] + (int32_t)max[axis] * BRICK_SIZE);
+        }
+        if (wld_boundsInFrustum(planes, &box)) {
+          if (pJob->occluder_len == pJob->occluder_cap) {
+            pJob->occluder_cap *= 2;
+            pJob->occluders = realloc(
+                pJob->occluders, pJob->occluder_cap * sizeof(DrawBounds));
+          }
+          pJob->occluders[pJob->occluder_len++] = box;
+        }
+      }
+    }
+  }
+}
+
+// collects the occluders of the chunks nearest the camera, as found by
+// wld_findVisibleChunks, to be drawn with mvp
+static void wld_prepareOcclusion(  //
+    wld_OcclusionJob *pJob,        //
+    const WorldState *pWorldState, //
+    const uint32_t reached,        //
+    const mat4x4 mvp,              //
+    const vec4 planes[6]           //
+) {
+  memcpy(pJob->mvp, mvp, sizeof(mat4x4));
+  pJob->editCount = pWorldState->editCount;
+  pJob->occluder_len = 0;
+  for (uint32_t i = 0; i < reached && i < OCCLUDER_CHUNKS; i++) {
+    wld_collectOccluders(pJob, pWorldState->cullQueue[i], planes);
+  }
+}
+
+// draws the occluders and builds the pyramid. Only touches the occlusion
+// buffer and the job, so it can run on a worker while the world changes.
+static void wld_drawOcclusion(   //
+    OcclusionBuffer *pOcclusion, //
+    const wld_OcclusionJob *pJob //
+) {
+  occ_clear(pOcclusion, pJob->mvp);
+  for (uint32_t i = 0; i < pJob->occluder_len; i++) {
+    occ_drawBox(pOcclusion, pJob->occluders[i].min, pJob->occluders[i].max);
+  }
+  occ_buildPyramid(pOcclusion);
+}
+
+static void worker_draw_occlusion(UNUSED uint32_t id, void *arg) {
+  WorldState *pWorldState = arg;
+  wld_OcclusionJob *pJob = pWorldState->pOcclusionJob;
+  if (atomic_exchange_explicit(&pJob->claimed, true, memory_order_acq_rel)) {
+    // wld_getDrawList got there first and drew them itself
+    return;
+  }
+  wld_drawOcclusion(&pWorldState->occlusion, pJob);
+  pthread_mutex_lock(&pJob->lock);
+  pJob->done = true;
+  pthread_cond_signal(&pJob->doneCond);
+  pthread_mutex_unlock(&pJob->lock);
+}
+
+// waits for the occluders started by wld_startOcclusion. If no worker has
+// started on them yet they're drawn here instead, so a busy threadpool can't
+// hold up the frame, or not at all if they're no longer wanted. Afterwards the
+// job and the occlusion buffer are ours again.
+static void wld_finishOcclusion( //
+    WorldState *pWorldState,     //
+    const bool wanted            //
+) {
+  wld_OcclusionJob *pJob = pWorldState->pOcclusionJob;
+  if (!pJob->pending) {
+    return;
+  }
+  pJob->pending = false;
+  if (!atomic_exchange_explicit(&pJob->claimed, true, memory_order_acq_rel)) {
+    if (wanted) {
+      wld_drawOcclusion(&pWorldState->occlusion, pJob);
+    }
+    return;
+  }
+  pthread_mutex_lock(&pJob->lock);
+  while (!pJob->done) {
+    pthread_cond_wait(&pJob->doneCond, &pJob->lock);
+  }
+  pthread_mutex_unlock(&pJob->lock);
+}
+
+void wld_startOcclusion(    //
+    const mat4x4 mvp,       //
+    WorldState *pWorldState //
+) {
+  wld_finishOcclusion(pWorldState, false);
+  Chunk *pCameraChunk = wld_lookupChunk(pWorldState, pWorldState->centerLoc);
+  if (pCameraChunk == NULL) {
+    return;
+  }
+
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, mvp);
+  uint32_t reached = wld_findVisibleChunks(pWorldState, pCameraChunk, planes);
+  wld_OcclusionJob *pJob = pWorldState->pOcclusionJob;
+  wld_prepareOcclusion(pJob, pWorldState, reached, mvp, planes);
+
+  pthread_mutex_lock(&pJob->lock);
+  pJob->done = false;
+  pthread_mutex_unlock(&pJob->lock);
+  pJob->pending = true;
+  // a task left over from a job wld_getDrawList drew itself may be the one to
+  // claim this, which is fine, it's all in the job
+  atomic_store_explicit(&pJob->claimed, false, memory_order_release);
+  threadpool_error_t e = threadpool_add(pWorldState->pool,
+                                        worker_draw_occlusion, pWorldState, 0);
+  if (e != 0) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
+    PANIC();
+  }
+}
+
+// false if the box is hidden behind the occluders
+static bool wld_boundsMaybeVisible( //
+    WorldState *pWorldState,        //
+    const DrawBounds *pBounds       //
+) {
+  vec3 min;
+  vec3 max;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    min[axis] = pBounds->min[axis] - OCCLUDEE_MARGIN;
+    max[axis] = pBounds->max[axis] + OCCLUDEE_MARGIN;
   }
-  pWorldState->garbage_len = 0;
+  return occ_testBox(&pWorldState->occlusion, min, max);
 }
 
-// argument struct that the worker thread takes ownership of
-typedef struct {
-  ivec3 worldChunkCoord;
-  ChunkDataState *pDataAndState;
-  const worldgen_state *pWgstate;
-} WorkerThreadData;
+void wld_getDrawList(                         //
+    const VkDrawIndirectCommand **ppCommands, //
+    uint32_t *pDrawCount,                     //
+    const uint32_t **ppBatchBlocks,           //
+    const uint32_t **ppBatchCounts,           //
+    uint32_t *pBatchCount,                    //
+    const mat4x4 mvp,                         //
+    WorldState *pWorldState                   //
+) {
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, mvp);
+
+  pWorldState->visible_len = 0;
+  Chunk *pCameraChunk = wld_lookupChunk(pWorldState, pWorldState->centerLoc);
+  if (pCameraChunk == NULL) {
+    // nowhere to start the search from, fall back to the frustum alone, and
+    // draw whole regions
+    wld_reserveVisible(pWorldState, pWorldState->draw_len);
+    for (uint32_t i = 0; i < pWorldState->draw_len; i++) {
+      uint32_t key =
+          i == pWorldState->highlightDrawIndex
+              ? HIGHLIGHT_DISTANCE_KEY
+              : wld_boundsDistanceKey(pWorldState, &pWorldState->drawBounds[i]);
+      wld_pushVisibleDraw(pWorldState, planes, i, key);
+    }
+  } else {
+    uint32_t reached =
+        wld_findVisibleChunks(pWorldState, pCameraChunk, planes);
+
+    // the nearest chunks hide most of what's behind them. Use the occluders
+    // wld_startOcclusion drew, unless they're for another view or blocks have
+    // been edited since.
+    wld_OcclusionJob *pJob = pWorldState->pOcclusionJob;
+    bool ahead = pJob->pending &&
+                 memcmp(pJob->mvp, mvp, sizeof(mat4x4)) == 0 &&
+                 pJob->editCount == pWorldState->editCount;
+    wld_finishOcclusion(pWorldState, ahead);
+    if (!ahead) {
+      wld_prepareOcclusion(pJob, pWorldState, reached, mvp, planes);
+      wld_drawOcclusion(&pWorldState->occlusion, pJob);
+    }
 
-static void worker_generate_chunk(UNUSED uint32_t id, void *arg) {
-  WorkerThreadData *pwtd = arg;
+    // mark the visible chunks in their regions
+    uint32_t frame = pWorldState->cullFrame;
+    uint32_t regionCount = 0;
+    for (uint32_t i = 0; i < reached; i++) {
+      const Chunk *pChunk = pWorldState->cullQueue[i];
+      MeshRegion *pRegion = pChunk->pRegion;
+      if (pRegion == NULL || pChunk->faceCount == 0 ||
+          !wld_boundsInFrustum(planes, &pChunk->bounds) ||
+          !wld_boundsMaybeVisible(pWorldState, &pChunk->bounds)) {
+        continue;
+      }
+      if (pRegion->cullFrame != frame) {
+        pRegion->cullFrame = frame;
+        pRegion->visibleMembers = 0;
+        pWorldState->cullRegions[regionCount++] = pRegion;
+      }
+      pRegion->visibleMembers |= (uint64_t)1
+                                 << wld_regionMember(pChunk->chunkCoord);
+    }
+
+    // every run has a visible chunk in it, plus there's the highlight
+    wld_reserveVisible(pWorldState, reached + 1);
+    for (uint32_t r = 0; r < regionCount; r++) {
+      wld_pushRegionDraws(pWorldState, pWorldState->cullRegions[r]);
+    }
+    if (pWorldState->highlightDrawIndex != DRAW_LIST_NONE) {
+      wld_pushVisibleDraw(pWorldState, planes, pWorldState->highlightDrawIndex,
+                          HIGHLIGHT_DISTANCE_KEY);
+    }
+  }
 
-  assert(!pwtd->pDataAndState->initialized);
+  // nearest first, so that what's hidden behind them fails the depth test
+  // before it's shaded
+  wld_sortVisibleDraws(pWorldState);
+  wld_batchVisibleDraws(pWorldState);
 
-  // generate chunk and then set intitialized to true
-  worldgen_state_gen_chunk(&pwtd->pDataAndState->data, pwtd->worldChunkCoord,
-                           pwtd->pWgstate);
-  pwtd->pDataAndState->initialized = true;
+  *ppCommands = pWorldState->batchedCommands;
+  *pDrawCount = pWorldState->visible_len;
+  *ppBatchBlocks = pWorldState->batchBlocks;
+  *ppBatchCounts = pWorldState->batchCounts;
+  *pBatchCount = pWorldState->batch_len;
 
-  // free argument
-  free(pwtd);
+  // anything thrown out from now on might be in this frame's draws
+  pWorldState->frame++;
 }
 
-void wld_update(            //
+void wld_getDrawListSize(   //
+    uint32_t *pDrawCount,   //
+    uint32_t *pBlockCount,  //
     WorldState *pWorldState //
 ) {
-  // process stuff off the togenerate list
-  for (uint32_t i = 0; ivec3_vec_len(pWorldState->togenerate) > 0; i++) {
-    ivec3_Chunk_KVPair c;
-    ivec3_vec_pop(pWorldState->togenerate, c.chunkCoord);
+  *pDrawCount = pWorldState->draw_len;
+  uint64_t generation;
+  *pBlockCount =
+      vtp_getBlockBuffers(NULL, &generation, 0, &pWorldState->vertexPool);
+}
 
-    // check that we still even need to load this
-    if (!wld_shouldBeLoaded(pWorldState, c.chunkCoord)) {
-      continue;
+static int wld_uint32_compare(const void *a, const void *b) {
+  uint32_t ua = *(const uint32_t *)a;
+  uint32_t ub = *(const uint32_t *)b;
+  return ua < ub ? -1 : ua > ub ? 1 : 0;
+}
+
+void wld_getDrawChanges(                     //
+    const uint32_t **ppChangedIndexes,       //
+    const CullDrawRecord **ppChangedRecords, //
+    uint32_t *pChangeCount,                  //
+    uint32_t *pDrawCount,                    //
+    const bool all,                          //
+    WorldState *pWorldState                  //
+) {
+  // each block draws its draws in the order of the list. It's only sorted
+  // when the keys move, or when every draw is sent anyway, since each draw
+  // the sort moves has to be sent again. Once the world is loaded, the draws
+  // added in between are new chunks at the edge of it, far away anyway.
+  if (all || !ivec3_eq(pWorldState->sortedCenter, pWorldState->centerLoc)) {
+    wld_drawListSort(pWorldState);
+    ivec3_dup(pWorldState->sortedCenter, pWorldState->centerLoc);
+  }
+  if (all) {
+    for (uint32_t i = 0; i < pWorldState->draw_len; i++) {
+      wld_drawListChanged(pWorldState, i);
     }
+  }
 
-    // check we haven't already loaded this
-    if (hashmap_get(pWorldState->chunk_map, &c) != NULL) {
+  // in order, so that draws next to each other can be copied together.
+  // Draws removed from the end of the list since they changed are skipped.
+  qsort(pWorldState->changedDraws, pWorldState->changed_len, sizeof(uint32_t),
+        wld_uint32_compare);
+  uint32_t changeCount = 0;
+  for (uint32_t c = 0; c < pWorldState->changed_len; c++) {
+    uint32_t i = pWorldState->changedDraws[c];
+    pWorldState->drawChanged[i] = false;
+    if (i >= pWorldState->draw_len) {
       continue;
     }
-
-    // right now, we don't have any geometry or data
-    // We set the initialized flag to false to signal that we haven't yet
-    // generated it
-    c.pDataAndState = malloc(sizeof(ChunkDataState));
-    c.pDataAndState->initialized = false;
-    c.pGeometry = NULL;
-
-    // hashmap will clone the chunk to load
-    hashmap_set(pWorldState->chunk_map, &c);
-
-    WorkerThreadData *arg = malloc(sizeof(WorkerThreadData));
-    *arg = (WorkerThreadData){.pDataAndState = c.pDataAndState,
-                              .pWgstate = pWorldState->wgstate,
-                              .worldChunkCoord = V3(c.chunkCoord)};
-
-    threadpool_error_t e =
-        threadpool_add(pWorldState->pool, worker_generate_chunk, arg, 0);
-    if (e != 0) {
-      LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
-      PANIC();
+    const DrawBounds *pBounds = &pWorldState->drawBounds[i];
+    CullDrawRecord *pRecord = &pWorldState->changedRecords[changeCount];
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      pRecord->min[axis] = pBounds->min[axis];
+      pRecord->max[axis] = pBounds->max[axis];
     }
-    // push the chunk coord to the chunks to generating vector
-    ivec3_vec_push(pWorldState->generating, c.chunkCoord);
+    pRecord->min[3] = 0;
+    pRecord->max[3] = 0;
+    pRecord->vertexCount = pWorldState->drawCounts[i];
+    pRecord->firstVertex = wld_drawFirstVertex(pWorldState, i);
+    pRecord->block = pWorldState->drawBlocks[i];
+    pRecord->origin = pWorldState->drawOrigins[i];
+    pWorldState->changedDraws[changeCount++] = i;
   }
+  pWorldState->changed_len = 0;
 
-  // process stuff on the generating list
-  for (int32_t i = (int32_t)ivec3_vec_len(pWorldState->generating) - 1; i >= 0;
-       i--) {
-    ivec3_Chunk_KVPair key;
-    ivec3_vec_get(pWorldState->generating, (uint32_t)i, key.chunkCoord);
+  *ppChangedIndexes = pWorldState->changedDraws;
+  *ppChangedRecords = pWorldState->changedRecords;
+  *pChangeCount = changeCount;
+  *pDrawCount = pWorldState->draw_len;
 
-    ivec3_Chunk_KVPair *generating = hashmap_get(pWorldState->chunk_map, &key);
+  // anything thrown out from now on might be in this frame's draws
+  pWorldState->frame++;
+}
 
-    // check if the data is initialized
-    if (generating->pDataAndState->initialized) {
-      // this gets rid of the current chunk coord, but in an O(1) fashion
-      ivec3_vec_swapAndPop(pWorldState->generating, (uint32_t)i);
-      // add this to the tomesh coordinates
-      ivec3_vec_push(pWorldState->tomesh, key.chunkCoord);
-    }
+void wld_getBlockBuffers(            //
+    const VkBuffer **ppBlockBuffers, //
+    uint32_t *pBlockCount,           //
+    uint64_t *pBlockGeneration,      //
+    WorldState *pWorldState          //
+) {
+  // workers may add blocks while we look, so make room until they all fit
+  uint32_t blockCount = vtp_getBlockBuffers(
+      pWorldState->blockBuffers, pBlockGeneration,
+      pWorldState->blockBuffer_cap, &pWorldState->vertexPool);
+  while (blockCount > pWorldState->blockBuffer_cap) {
+    pWorldState->blockBuffer_cap = blockCount * 2;
+    pWorldState->blockBuffers =
+        realloc(pWorldState->blockBuffers,
+                pWorldState->blockBuffer_cap * sizeof(VkBuffer));
+    blockCount = vtp_getBlockBuffers(
+        pWorldState->blockBuffers, pBlockGeneration,
+        pWorldState->blockBuffer_cap, &pWorldState->vertexPool);
   }
 
-  // process stuff on the to mesh list
-  for (uint32_t i = 0;
-       i < MAX_CHUNKS_TO_MESH && ivec3_vec_len(pWorldState->tomesh) > 0; i++) {
-    ivec3_Chunk_KVPair chunkToMesh;
-    ivec3_vec_pop(pWorldState->tomesh, chunkToMesh.chunkCoord);
-
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_get(pWorldState->chunk_map, &chunkToMesh);
+  *ppBlockBuffers = pWorldState->blockBuffers;
+  *pBlockCount = blockCount;
+}
 
-    if (pChunk->pGeometry != NULL) {
-      // if some data already exists, place this geometry in the Garbage heap,
-      // and make a new one
-      wld_pushGarbage(pWorldState, pChunk->pGeometry);
-    }
-    pChunk->pGeometry = malloc(sizeof(ChunkGeometry));
+static bool wld_recenterChunk(Chunk *pChunk, void *udata) {
+  WorldState *pWorldState = udata;
 
-    vec3 chunkOffset;
-    worldChunkCoords_to_blockCoords(chunkOffset, pChunk->chunkCoord);
+  // tell the workers whether they should still bother. If we've come back in
+  // range before a worker noticed, this un-cancels the task.
+  bool wanted = wld_shouldBeLoaded(pWorldState, pChunk->chunkCoord);
+  atomic_store_explicit(&pChunk->cancelled, !wanted, memory_order_relaxed);
 
-    new_ChunkGeometry(pChunk->pGeometry, &pChunk->pDataAndState->data,
-                      chunkOffset, pWorldState->device,
-                      pWorldState->physicalDevice, pWorldState->commandPool,
-                      pWorldState->queue);
+  if (!wanted) {
+    if (!pChunk->queuedUnload) {
+      pChunk->queuedUnload = true;
+      ivec3_vec_push(pWorldState->tounload, pChunk->chunkCoord);
+    }
+  } else if (atomic_load_explicit(&pChunk->state, memory_order_relaxed) ==
+                 ChunkState_READY &&
+             atomic_load_explicit(&pChunk->genState, memory_order_relaxed) ==
+                 ChunkGen_CANCELLED) {
+    // its generation got cancelled and it came back in range after the
+    // result was drained, so nothing else will restart it
+    wld_restartGeneration(pChunk);
+  } else if (atomic_load_explicit(&pChunk->state, memory_order_relaxed) ==
+                 ChunkState_READY &&
+             pChunk->dirty) {
+    // its mesh was dropped while it was out of range, or it was edited then,
+    // and nothing else will mesh it again
+    ivec3_vec_push(pWorldState->toremesh, pChunk->chunkCoord);
+  }
 
-    // push onto the ready list
-    // push the chunk coord to the chunks to mesh
-    ivec3_vec_push(pWorldState->ready, pChunk->chunkCoord);
+  // chunks back in range that got pushed out of their slot move back into it
+  if (wanted && *wld_clipmapSlot(pWorldState, pChunk->chunkCoord) != pChunk) {
+    ivec3_vec_push(pWorldState->topromote, pChunk->chunkCoord);
   }
+  return true;
+}
 
-  // process stuff on the ready list
-  for (int32_t i = (int32_t)ivec3_vec_len(pWorldState->ready) - 1; i >= 0;
-       i--) {
-    ivec3 chunkCoords;
-    ivec3_vec_get(pWorldState->ready, (uint32_t)i, chunkCoords);
+void wld_set_center(         //
+    WorldState *pWorldState, //
+    const ivec3 centerLoc    //
+) {
+  // set our center location
+  ivec3_dup(pWorldState->centerLoc, centerLoc);
 
-    // check that we still even need to have this
-    if (!wld_shouldBeLoaded(pWorldState, chunkCoords)) {
-      // this gets rid of the current chunk coord, but in an O(1) fashion
-      ivec3_vec_swapAndPop(pWorldState->ready, (uint32_t)i);
-      // add this to the unload coordinates
-      ivec3_vec_push(pWorldState->tounload, chunkCoords);
+  // initialize all of our neighboring chunks to be on the load list
+  for (int32_t x = -RENDER_RADIUS_X; x <= RENDER_RADIUS_X; x++) {
+    for (int32_t y = -RENDER_RADIUS_Y; y <= RENDER_RADIUS_Y; y++) {
+      for (int32_t z = -RENDER_RADIUS_Z; z <= RENDER_RADIUS_Z; z++) {
+        ivec3 chunkCoord;
+        ivec3_add(chunkCoord, centerLoc, (ivec3){x, y, z});
+        ivec3_vec_push(pWorldState->togenerate, chunkCoord);
+      }
     }
   }
 
-  // finally process stuff on the unload list
-  for (uint32_t i = 0;
-       i < MAX_CHUNKS_TO_UNLOAD && ivec3_vec_len(pWorldState->tounload) > 0;
-       i++) {
-    ivec3_Chunk_KVPair c;
-    ivec3_vec_pop(pWorldState->tounload, c.chunkCoord);
+  // queue everything that fell out of range for unloading
+  wld_scanChunks(pWorldState, wld_recenterChunk, pWorldState);
 
-    // remove from hashmap
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_delete(pWorldState->chunk_map, c.chunkCoord);
-
-    free(pChunk->pDataAndState);
-
-    // put chunk geometry on garbage pile
-    wld_pushGarbage(pWorldState, pChunk->pGeometry);
+  // can't modify the store while scanning it, so promote afterwards
+  while (ivec3_vec_len(pWorldState->topromote) > 0) {
+    ivec3 chunkCoord;
+    ivec3_vec_pop(pWorldState->topromote, chunkCoord);
+    wld_promoteChunk(pWorldState, wld_lookupChunk(pWorldState, chunkCoord));
   }
 }
 
-static bool wld_delete_HashmapData(const void *item, void *udata) {
-  const ivec3_Chunk_KVPair *pChunk = item;
-  const VkDevice device = udata;
-  if (pChunk->pGeometry != NULL) {
-    delete_ChunkGeometry(pChunk->pGeometry, device);
-    free(pChunk->pGeometry);
+void wld_new_BlockCursor(    //
+    BlockCursor *pCursor,    //
+    WorldState *pWorldState, //
+    const ivec3 iBlockCoords //
+) {
+  pCursor->pWorldState = pWorldState;
+  iBlockCoords_to_worldChunkCoords(pCursor->chunkCoord, pCursor->chunkIndex,
+                                   iBlockCoords);
+  pCursor->pChunk = wld_lookupChunk(pWorldState, pCursor->chunkCoord);
+}
+
+void wld_cursor_move(        //
+    BlockCursor *pCursor,    //
+    const ivec3 iBlockCoords //
+) {
+  ivec3 chunkCoord;
+  iBlockCoords_to_worldChunkCoords(chunkCoord, pCursor->chunkIndex,
+                                   iBlockCoords);
+  if (!ivec3_eq(chunkCoord, pCursor->chunkCoord)) {
+    ivec3_dup(pCursor->chunkCoord, chunkCoord);
+    pCursor->pChunk = wld_lookupChunk(pCursor->pWorldState, chunkCoord);
   }
-  free(pChunk->pDataAndState);
-  return true;
 }
 
-void wld_delete_WorldState( //
-    WorldState *pWorldState //
+void wld_cursor_step(     //
+    BlockCursor *pCursor, //
+    const uint32_t axis,  //
+    const int32_t delta   //
 ) {
-  // wait for generating blocks to finish
-  threadpool_destroy(pWorldState->pool, threadpool_graceful);
+  int32_t i = pCursor->chunkIndex[axis] + delta;
+  if (i >= 0 && i < wld_chunkSize[axis]) {
+    pCursor->chunkIndex[axis] = i;
+    return;
+  }
 
-  // delete any blocks in the to generate stack
-  ivec3_vec_clear(pWorldState->togenerate);
+  // crossed into another chunk
+  int32_t chunks = i >= 0 ? i / wld_chunkSize[axis]
+                          : (i + 1) / wld_chunkSize[axis] - 1;
+  pCursor->chunkCoord[axis] += chunks;
+  pCursor->chunkIndex[axis] = i - chunks * wld_chunkSize[axis];
+  pCursor->pChunk =
+      wld_lookupChunk(pCursor->pWorldState, pCursor->chunkCoord);
+}
 
-  // go through each 
+void wld_cursor_get_coords(    //
+    ivec3 iBlockCoords,        //
+    const BlockCursor *pCursor //
+) {
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    iBlockCoords[axis] = pCursor->chunkCoord[axis] * wld_chunkSize[axis] +
+                         pCursor->chunkIndex[axis];
+  }
+}
 
-  // clear the garbage
-  wld_clearGarbage(pWorldState);
-  // free garbage heap
-  free(pWorldState->garbage_data);
+bool wld_cursor_get_block(     //
+    BlockIndex *pBlock,        //
+    const BlockCursor *pCursor //
+) {
+  const Chunk *pChunk = pCursor->pChunk;
+  if (pChunk == NULL || !wld_chunkDataReady(pChunk)) {
+    return false;
+  }
 
-  // free vectors
-  delete_ivec3_vec(&pWorldState->togenerate);
-  delete_ivec3_vec(&pWorldState->generating);
-  delete_ivec3_vec(&pWorldState->tomesh);
-  delete_ivec3_vec(&pWorldState->ready);
-  delete_ivec3_vec(&pWorldState->tounload);
+  *pBlock = pChunk->data.blocks[pCursor->chunkIndex[0]][pCursor->chunkIndex[1]]
+                               [pCursor->chunkIndex[2]];
+  return true;
+}
 
-  // iterate through hashmap and free the geometries and data
-  hashmap_scan(pWorldState->chunk_map, wld_delete_HashmapData,
-               pWorldState->device);
+// schedules a remesh of the chunk, if it hasn't been already
+static void wld_markChunkDirty(WorldState *pWorldState, Chunk *pChunk) {
+  if (!pChunk->dirty) {
+    pChunk->dirty = true;
+    ivec3_vec_push(pWorldState->toremesh, pChunk->chunkCoord);
+  }
+}
 
-  // free the map
-  hashmap_free(pWorldState->chunk_map);
+// schedules a remesh of the chunk at the coordinates, if it's loaded
+static void wld_markDirty(WorldState *pWorldState, const ivec3 chunkCoord) {
+  Chunk *pChunk = wld_lookupChunk(pWorldState, chunkCoord);
+  if (pChunk != NULL) {
+    wld_markChunkDirty(pWorldState, pChunk);
+  }
+}
 
-  // free the highlights
-  delete_Buffer(&pWorldState->highlightVertexBuffer, pWorldState->device);
-  delete_DeviceMemory(&pWorldState->highlightVertexBufferMemory,
-                      pWorldState->device);
+// schedules remeshes after the blocks in the box between min and max
+// (inclusive, chunk local) were edited
+static void wld_markEditDirty( //
+    WorldState *pWorldState,   //
+    Chunk *pChunk,             //
+    const ivec3 min,           //
+    const ivec3 max            //
+) {
+  pWorldState->editCount++;
+  wld_markChunkDirty(pWorldState, pChunk);
+
+  // meshes cull faces against their neighbours, so blocks on the boundary
+  // affect the neighbour's mesh too
+  const BlockFaceKind lowFaces[3] = {Block_LEFT, Block_UP, Block_BACK};
+  const BlockFaceKind highFaces[3] = {Block_RIGHT, Block_DOWN, Block_FRONT};
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    ivec3 neighbourCoord;
+    if (min[axis] == 0) {
+      wu_getAdjacentBlock(neighbourCoord, pChunk->chunkCoord, lowFaces[axis]);
+      wld_markDirty(pWorldState, neighbourCoord);
+    }
+    if (max[axis] == wld_chunkSize[axis] - 1) {
+      wu_getAdjacentBlock(neighbourCoord, pChunk->chunkCoord, highFaces[axis]);
+      wld_markDirty(pWorldState, neighbourCoord);
+    }
+  }
 }
 
-void wld_count_vertexBuffers(     //
-    uint32_t *pVertexBufferCount, //
-    const WorldState *pWorldState //
+bool wld_cursor_set_block( //
+    BlockCursor *pCursor,  //
+    BlockIndex block       //
 ) {
+  Chunk *pChunk = pCursor->pChunk;
+  if (pChunk == NULL || !wld_chunkDataReady(pChunk)) {
+    return false;
+  }
 
-  uint32_t count = 0;
+  const ivec3 *pChunkIndex = &pCursor->chunkIndex;
 
-  if (pWorldState->has_highlight) {
-    count++;
-  }
+  BlockIndex *pBlock = &pChunk->data.blocks[(*pChunkIndex)[0]]
+                                           [(*pChunkIndex)[1]]
+                                           [(*pChunkIndex)[2]];
+  int32_t solidChange =
+      (int32_t)!BLOCKS[block].transparent - !BLOCKS[*pBlock].transparent;
 
+  // a mesh task may be reading this concurrently, in which case we wait for it
+  // to finish. The dirty flag makes sure its stale mesh gets redone.
+  pthread_rwlock_wrlock(&pChunk->dataLock);
+  *pBlock = block;
+  pthread_rwlock_unlock(&pChunk->dataLock);
 
+  pChunk->solidCount += (uint32_t)solidChange;
+  pChunk->brickSolidCount[(*pChunkIndex)[0] / BRICK_SIZE]
+                         [(*pChunkIndex)[1] / BRICK_SIZE]
+                         [(*pChunkIndex)[2] / BRICK_SIZE] +=
+      (uint16_t)solidChange;
 
-  for (uint32_t i = 0; i < ivec3_vec_len(pWorldState->ready); i++) {
-    // get coord
-    ivec3_Chunk_KVPair lookup_tmp;
-    ivec3_vec_get(pWorldState->ready, i, lookup_tmp.chunkCoord);
+  wld_markEditDirty(pCursor->pWorldState, pChunk, *pChunkIndex, *pChunkIndex);
+  return true;
+}
 
-    // get chunk
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_get(pWorldState->chunk_map, &lookup_tmp);
+// the shape of a batch edit inside its bounding box
+typedef struct {
+  bool sphere;
+  // only used for spheres, in global block coordinates
+  ivec3 center;
+  int64_t radiusSquared;
+} wld_EditShape;
+
+// fills the part of the box between min and max (inclusive, global block
+// coordinates) that is inside shape, one chunk at a time. Returns the number of
+// blocks set.
+static uint32_t wld_fillShape(   //
+    WorldState *pWorldState,     //
+    const ivec3 min,             //
+    const ivec3 max,             //
+    const wld_EditShape *pShape, //
+    BlockIndex block             //
+) {
+  ivec3 minChunk;
+  ivec3 minIndex;
+  ivec3 maxChunk;
+  ivec3 maxIndex;
+  iBlockCoords_to_worldChunkCoords(minChunk, minIndex, min);
+  iBlockCoords_to_worldChunkCoords(maxChunk, maxIndex, max);
 
-    // if chunk not empty add
-    if (pChunk->pGeometry->vertexCount > 0) {
-      count++;
+  uint32_t count = 0;
+  ivec3 chunkCoord;
+  for (chunkCoord[0] = minChunk[0]; chunkCoord[0] <= maxChunk[0];
+       chunkCoord[0]++) {
+    for (chunkCoord[1] = minChunk[1]; chunkCoord[1] <= maxChunk[1];
+         chunkCoord[1]++) {
+      for (chunkCoord[2] = minChunk[2]; chunkCoord[2] <= maxChunk[2];
+           chunkCoord[2]++) {
+        Chunk *pChunk = wld_lookupChunk(pWorldState, chunkCoord);
+        if (pChunk == NULL || !wld_chunkDataReady(pChunk)) {
+          continue;
+        }
+
+        // the part of the box inside this chunk, chunk local
+        ivec3 lo;
+        ivec3 hi;
+        ivec3 corner;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          lo[axis] = chunkCoord[axis] == minChunk[axis] ? minIndex[axis] : 0;
+          hi[axis] = chunkCoord[axis] == maxChunk[axis]
+                         ? maxIndex[axis]
+                         : wld_chunkSize[axis] - 1;
+          corner[axis] = chunkCoord[axis] * wld_chunkSize[axis];
+        }
+
+        uint32_t chunkCount = 0;
+        pthread_rwlock_wrlock(&pChunk->dataLock);
+        for (int32_t x = lo[0]; x <= hi[0]; x++) {
+          for (int32_t y = lo[1]; y <= hi[1]; y++) {
+            BlockIndex *pRow = pChunk->data.blocks[x][y];
+            if (!pShape->sphere) {
+              for (int32_t z = lo[2]; z <= hi[2]; z++) {
+                pRow[z] = block;
+              }
+              chunkCount += (uint32_t)(hi[2] - lo[2] + 1);
+              continue;
+            }
+
+            int64_t dx = corner[0] + x - pShape->center[0];
+            int64_t dy = corner[1] + y - pShape->center[1];
+            for (int32_t z = lo[2]; z <= hi[2]; z++) {
+              int64_t dz = corner[2] + z - pShape->center[2];
+              if (dx * dx + dy * dy + dz * dz <= pShape->radiusSquared) {
+                pRow[z] = block;
+                chunkCount++;
+              }
+            }
+          }
+        }
+        pthread_rwlock_unlock(&pChunk->dataLock);
+
+        if (chunkCount > 0) {
+          wld_countSolid(pChunk);
+          wld_markEditDirty(pWorldState, pChunk, lo, hi);
+          count += chunkCount;
+        }
+      }
     }
   }
+  return count;
+}
 
-  for (uint32_t i = 0; i < ivec3_vec_len(pWorldState->tomesh); i++) {
-    // get coord
-    ivec3_Chunk_KVPair lookup_tmp;
-    ivec3_vec_get(pWorldState->tomesh, i, lookup_tmp.chunkCoord);
+uint32_t wld_set_blocks_region(  //
+    BlockIndex block,            //
+    WorldState *pWorldState,     //
+    const ivec3 iBlockCoordsMin, //
+    const ivec3 iBlockCoordsMax  //
+) {
+  wld_EditShape box = {.sphere = false};
+  return wld_fillShape(pWorldState, iBlockCoordsMin, iBlockCoordsMax, &box,
+                       block);
+}
 
-    // get chunk
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_get(pWorldState->chunk_map, &lookup_tmp);
+uint32_t wld_set_blocks_sphere(     //
+    BlockIndex block,               //
+    WorldState *pWorldState,        //
+    const ivec3 iBlockCoordsCenter, //
+    const uint32_t radius           //
+) {
+  wld_EditShape sphere = {.sphere = true,
+                          .center = V3(iBlockCoordsCenter),
+                          .radiusSquared = (int64_t)radius * radius};
+  ivec3 min;
+  ivec3 max;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    min[axis] = iBlockCoordsCenter[axis] - (int32_t)radius;
+    max[axis] = iBlockCoordsCenter[axis] + (int32_t)radius;
+  }
+  return wld_fillShape(pWorldState, min, max, &sphere, block);
+}
 
-    // if chunk exists and is not empty add
-    if (pChunk->pGeometry != NULL && pChunk->pGeometry->vertexCount > 0) {
-      count++;
+// one entry of a list of edits, split up by chunk
+typedef struct {
+  ivec3 chunkCoord;
+  ivec3 chunkIndex;
+  // position in the original list, so later edits to a block win
+  uint32_t order;
+  BlockIndex block;
+} wld_BlockEdit;
+
+static int wld_BlockEdit_compare(const void *a, const void *b) {
+  const wld_BlockEdit *pa = a;
+  const wld_BlockEdit *pb = b;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (pa->chunkCoord[axis] != pb->chunkCoord[axis]) {
+      return pa->chunkCoord[axis] < pb->chunkCoord[axis] ? -1 : 1;
     }
   }
-
-  *pVertexBufferCount = count;
+  return pa->order < pb->order ? -1 : pa->order > pb->order ? 1 : 0;
 }
 
-// these buffers are for reading only! don't delete or modify
-void wld_getVertexBuffers(        //
-    VkBuffer *pVertexBuffers,     //
-    uint32_t *pVertexCounts,      //
-    const WorldState *pWorldState //
+uint32_t wld_set_blocks(        //
+    WorldState *pWorldState,    //
+    const ivec3 *pIBlockCoords, //
+    const BlockIndex *pBlocks,  //
+    const uint32_t editCount    //
 ) {
-  uint32_t count = 0;
-
-  if (pWorldState->has_highlight) {
-    pVertexCounts[count] = 6;
-    pVertexBuffers[count] = pWorldState->highlightVertexBuffer;
-    count++;
+  if (editCount == 0) {
+    return 0;
   }
 
-  for (uint32_t i = 0; i < ivec3_vec_len(pWorldState->ready); i++) {
-    // get coord
-    ivec3_Chunk_KVPair lookup_tmp;
-    ivec3_vec_get(pWorldState->ready, i, lookup_tmp.chunkCoord);
-
-    // get chunk
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_get(pWorldState->chunk_map, &lookup_tmp);
-
-    // write data
-    if (pChunk->pGeometry->vertexCount > 0) {
-      pVertexCounts[count] = pChunk->pGeometry->vertexCount;
-      pVertexBuffers[count] = pChunk->pGeometry->vertexBuffer;
-      count++;
-    }
+  // group the edits by chunk
+  wld_BlockEdit *pEdits = malloc(editCount * sizeof(wld_BlockEdit));
+  for (uint32_t i = 0; i < editCount; i++) {
+    iBlockCoords_to_worldChunkCoords(pEdits[i].chunkCoord,
+                                     pEdits[i].chunkIndex, pIBlockCoords[i]);
+    pEdits[i].order = i;
+    pEdits[i].block = pBlocks[i];
   }
+  qsort(pEdits, editCount, sizeof(wld_BlockEdit), wld_BlockEdit_compare);
 
-  for (uint32_t i = 0; i < ivec3_vec_len(pWorldState->tomesh); i++) {
-    // get coord
-    ivec3_Chunk_KVPair lookup_tmp;
-    ivec3_vec_get(pWorldState->tomesh, i, lookup_tmp.chunkCoord);
+  uint32_t count = 0;
+  uint32_t start = 0;
+  while (start < editCount) {
+    // find the edits in this chunk
+    uint32_t end = start + 1;
+    while (end < editCount &&
+           ivec3_eq(pEdits[end].chunkCoord, pEdits[start].chunkCoord)) {
+      end++;
+    }
 
-    // get chunk
-    ivec3_Chunk_KVPair *pChunk =
-        hashmap_get(pWorldState->chunk_map, &lookup_tmp);
+    Chunk *pChunk = wld_lookupChunk(pWorldState, pEdits[start].chunkCoord);
+    if (pChunk != NULL && wld_chunkDataReady(pChunk)) {
+      // bounds of the edited blocks, to find the neighbours that need remeshing
+      ivec3 lo;
+      ivec3 hi;
+      ivec3_dup(lo, pEdits[start].chunkIndex);
+      ivec3_dup(hi, pEdits[start].chunkIndex);
+
+      pthread_rwlock_wrlock(&pChunk->dataLock);
+      for (uint32_t i = start; i < end; i++) {
+        const wld_BlockEdit *pEdit = &pEdits[i];
+        pChunk->data.blocks[pEdit->chunkIndex[0]][pEdit->chunkIndex[1]]
+                           [pEdit->chunkIndex[2]] = pEdit->block;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          if (pEdit->chunkIndex[axis] < lo[axis]) {
+            lo[axis] = pEdit->chunkIndex[axis];
+          }
+          if (pEdit->chunkIndex[axis] > hi[axis]) {
+            hi[axis] = pEdit->chunkIndex[axis];
+          }
+        }
+      }
+      pthread_rwlock_unlock(&pChunk->dataLock);
 
-    // write data
-    if (pChunk->pGeometry != NULL && pChunk->pGeometry->vertexCount > 0) {
-      pVertexCounts[count] = pChunk->pGeometry->vertexCount;
-      pVertexBuffers[count] = pChunk->pGeometry->vertexBuffer;
-      count++;
+      wld_countSolid(pChunk);
+      wld_markEditDirty(pWorldState, pChunk, lo, hi);
+      count += end - start;
     }
+    start = end;
   }
 
+  free(pEdits);
+  return count;
 }
 
-void wld_set_center(         //
-    WorldState *pWorldState, //
-    const ivec3 centerLoc    //
-) {
-  // set our center location
-  ivec3_dup(pWorldState->centerLoc, centerLoc);
-
-  // initialize all of our neighboring chunks to be on the load list
-  for (int32_t x = -RENDER_RADIUS_X; x <= RENDER_RADIUS_X; x++) {
-    for (int32_t y = -RENDER_RADIUS_Y; y <= RENDER_RADIUS_Y; y++) {
-      for (int32_t z = -RENDER_RADIUS_Z; z <= RENDER_RADIUS_Z; z++) {
-        ivec3 chunkCoord;
-        ivec3_add(chunkCoord, centerLoc, (ivec3){x, y, z});
-        ivec3_vec_push(pWorldState->togenerate, chunkCoord);
-      }
-    }
+// a batch of tasks the thread that owns the world waits on
+typedef struct {
+  // tasks still running. The last one to finish signals done
+  atomic_uint remaining;
+  pthread_mutex_t lock;
+  pthread_cond_t done;
+} wld_TaskGroup;
+
+// called by each task of the group when it's done
+static void wld_finishGroupTask(wld_TaskGroup *pGroup) {
+  if (atomic_fetch_sub_explicit(&pGroup->remaining, 1, memory_order_acq_rel) ==
+      1) {
+    pthread_mutex_lock(&pGroup->lock);
+    pthread_cond_signal(&pGroup->done);
+    pthread_mutex_unlock(&pGroup->lock);
   }
 }
 
-bool wld_get_block_at( //
-    BlockIndex *pBlock,       //
-    WorldState *pWorldState,  //
-    const ivec3 iBlockCoords  //
+// runs fn on each of the args on the threadpool, and waits for all of them.
+// Nothing can edit or unload chunks while we wait, so the tasks may read them
+// without locking the chunk store.
+static void wld_runTaskGroup(           //
+    wld_TaskGroup *pGroup,              //
+    WorldState *pWorldState,            //
+    void (*fn)(uint32_t id, void *arg), //
+    void *const *ppArgs,                //
+    uint32_t count                      //
 ) {
-  vec3 blockCoords;
-  ivec3_to_vec3(blockCoords, iBlockCoords);
-
-  // get world chunk coord
-  ivec3_Chunk_KVPair lookup_tmp;
-  blockCoords_to_worldChunkCoords(lookup_tmp.chunkCoord, blockCoords);
-
-  // get chunk
-  ivec3_Chunk_KVPair *pChunk = hashmap_get(pWorldState->chunk_map, &lookup_tmp);
-
-  if (pChunk == NULL || !pChunk->pDataAndState->initialized) {
-    return false;
+  atomic_init(&pGroup->remaining, count);
+  pthread_mutex_init(&pGroup->lock, NULL);
+  pthread_cond_init(&pGroup->done, NULL);
+
+  threadpool_error_t e =
+      threadpool_add_batch(pWorldState->pool, fn, ppArgs, count, 0);
+  if (e != 0) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "couldn't add task to threadpool!");
+    PANIC();
   }
 
-  // get corner block of world chunk
-  ivec3 iBlockCoord_Corner;
-  worldChunkCoords_to_iBlockCoords(iBlockCoord_Corner, pChunk->chunkCoord);
+  pthread_mutex_lock(&pGroup->lock);
+  while (atomic_load_explicit(&pGroup->remaining, memory_order_acquire) != 0) {
+    pthread_cond_wait(&pGroup->done, &pGroup->lock);
+  }
+  pthread_mutex_unlock(&pGroup->lock);
 
-  // get intra-chunk offset
-  ivec3 intraChunkOffset;
-  ivec3_sub(intraChunkOffset, iBlockCoords, iBlockCoord_Corner);
+  pthread_cond_destroy(&pGroup->done);
+  pthread_mutex_destroy(&pGroup->lock);
+}
 
-  assert(intraChunkOffset[0] + iBlockCoord_Corner[0] == iBlockCoords[0]);
+// shared by all the tasks of one parallel wld_copy_region
+typedef struct {
+  BlockIndex *pOut;
+  // corner of the region and its size, in blocks
+  ivec3 min;
+  ivec3 dims;
+  wld_TaskGroup group;
+} wld_RegionCopy;
+
+// copies the part of a region that lies inside one chunk
+typedef struct {
+  wld_RegionCopy *pCopy;
+  Chunk *pChunk;
+  // chunk local bounds of the part, inclusive
+  ivec3 lo;
+  ivec3 hi;
+} wld_RegionCopyPart;
+
+static void wld_copyRegionPart(const wld_RegionCopyPart *pPart) {
+  const wld_RegionCopy *pCopy = pPart->pCopy;
+  Chunk *pChunk = pPart->pChunk;
+
+  // the region coordinates of the chunk's corner
+  ivec3 offset;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    offset[axis] =
+        pChunk->chunkCoord[axis] * wld_chunkSize[axis] - pCopy->min[axis];
+  }
 
-  // chunk index
-  ivec3 chunkIndex = {
-      (intraChunkOffset[0] % CHUNK_X_SIZE + CHUNK_X_SIZE) % CHUNK_X_SIZE,
-      (intraChunkOffset[1] % CHUNK_Y_SIZE + CHUNK_Y_SIZE) % CHUNK_Y_SIZE,
-      (intraChunkOffset[2] % CHUNK_Z_SIZE + CHUNK_Z_SIZE) % CHUNK_Z_SIZE};
+  // rows along z are contiguous in both the chunk and the output
+  size_t rowLength = (size_t)(pPart->hi[2] - pPart->lo[2] + 1);
+  pthread_rwlock_rdlock(&pChunk->dataLock);
+  for (int32_t x = pPart->lo[0]; x <= pPart->hi[0]; x++) {
+    for (int32_t y = pPart->lo[1]; y <= pPart->hi[1]; y++) {
+      size_t outIndex = ((size_t)(offset[0] + x) * (size_t)pCopy->dims[1] +
+                         (size_t)(offset[1] + y)) *
+                            (size_t)pCopy->dims[2] +
+                        (size_t)(offset[2] + pPart->lo[2]);
+      memcpy(&pCopy->pOut[outIndex], &pChunk->data.blocks[x][y][pPart->lo[2]],
+             rowLength * sizeof(BlockIndex));
+    }
+  }
+  pthread_rwlock_unlock(&pChunk->dataLock);
+}
 
-  *pBlock = pChunk->pDataAndState->data
-                .blocks[chunkIndex[0]][chunkIndex[1]][chunkIndex[2]];
-  return true;
+static void worker_copy_region_part(UNUSED uint32_t id, void *arg) {
+  wld_RegionCopyPart *pPart = arg;
+  wld_copyRegionPart(pPart);
+  wld_finishGroupTask(&pPart->pCopy->group);
 }
 
-bool wld_set_block_at( //
-    BlockIndex block,         //
-    WorldState *pWorldState,  //
-    const ivec3 iBlockCoords  //
+// splits the region into one part per generated chunk. Chunks that aren't
+// generated are pushed to pMissing if it isn't NULL. Returns the number of
+// missing chunks, and the parts in *ppParts.
+static uint32_t wld_splitRegion(  //
+    wld_RegionCopyPart **ppParts, //
+    uint32_t *pPartCount,         //
+    ivec3_vec *pMissing,          //
+    wld_RegionCopy *pCopy,        //
+    WorldState *pWorldState,      //
+    const ivec3 min,              //
+    const ivec3 max               //
 ) {
-  vec3 blockCoords;
-  ivec3_to_vec3(blockCoords, iBlockCoords);
+  ivec3 minChunk;
+  ivec3 minIndex;
+  ivec3 maxChunk;
+  ivec3 maxIndex;
+  iBlockCoords_to_worldChunkCoords(minChunk, minIndex, min);
+  iBlockCoords_to_worldChunkCoords(maxChunk, maxIndex, max);
+
+  uint32_t maxParts = (uint32_t)((maxChunk[0] - minChunk[0] + 1) *
+                                 (maxChunk[1] - minChunk[1] + 1) *
+                                 (maxChunk[2] - minChunk[2] + 1));
+  wld_RegionCopyPart *pParts = malloc(maxParts * sizeof(wld_RegionCopyPart));
+  uint32_t partCount = 0;
+  uint32_t missingCount = 0;
 
-  // get world chunk coord
-  ivec3_Chunk_KVPair lookup_tmp;
-  blockCoords_to_worldChunkCoords(lookup_tmp.chunkCoord, blockCoords);
+  ivec3 chunkCoord;
+  for (chunkCoord[0] = minChunk[0]; chunkCoord[0] <= maxChunk[0];
+       chunkCoord[0]++) {
+    for (chunkCoord[1] = minChunk[1]; chunkCoord[1] <= maxChunk[1];
+         chunkCoord[1]++) {
+      for (chunkCoord[2] = minChunk[2]; chunkCoord[2] <= maxChunk[2];
+           chunkCoord[2]++) {
+        Chunk *pChunk = wld_lookupChunk(pWorldState, chunkCoord);
+        if (pChunk == NULL || !wld_chunkDataReady(pChunk)) {
+          if (pMissing != NULL) {
+            ivec3_vec_push(pMissing, chunkCoord);
+          }
+          missingCount++;
+          continue;
+        }
+
+        wld_RegionCopyPart *pPart = &pParts[partCount++];
+        pPart->pCopy = pCopy;
+        pPart->pChunk = pChunk;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          pPart->lo[axis] =
+              chunkCoord[axis] == minChunk[axis] ? minIndex[axis] : 0;
+          pPart->hi[axis] = chunkCoord[axis] == maxChunk[axis]
+                                ? maxIndex[axis]
+                                : wld_chunkSize[axis] - 1;
+        }
+      }
+    }
+  }
 
-  // get chunk
-  ivec3_Chunk_KVPair *pChunk = hashmap_get(pWorldState->chunk_map, &lookup_tmp);
+  *ppParts = pParts;
+  *pPartCount = partCount;
+  return missingCount;
+}
 
-  if (pChunk == NULL || !pChunk->pDataAndState->initialized) {
-    return false;
+// copies the region, splitting the work between the threadpool's workers if
+// parallel is set
+static uint32_t wld_copyRegion(  //
+    BlockIndex *pOut,            //
+    ivec3_vec *pMissing,         //
+    WorldState *pWorldState,     //
+    const ivec3 iBlockCoordsMin, //
+    const ivec3 iBlockCoordsMax, //
+    bool parallel                //
+) {
+  wld_RegionCopy copy;
+  copy.pOut = pOut;
+  ivec3_dup(copy.min, iBlockCoordsMin);
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    copy.dims[axis] = iBlockCoordsMax[axis] - iBlockCoordsMin[axis] + 1;
   }
 
-  // get corner block of world chunk
-  ivec3 iBlockCoord_Corner;
-  worldChunkCoords_to_iBlockCoords(iBlockCoord_Corner, pChunk->chunkCoord);
+  wld_RegionCopyPart *pParts;
+  uint32_t partCount;
+  uint32_t missingCount =
+      wld_splitRegion(&pParts, &partCount, pMissing, &copy, pWorldState,
+                      iBlockCoordsMin, iBlockCoordsMax);
 
-  // get intra-chunk offset
-  ivec3 intraChunkOffset;
-  ivec3_sub(intraChunkOffset, iBlockCoords, iBlockCoord_Corner);
+  if (!parallel || partCount <= 1) {
+    for (uint32_t i = 0; i < partCount; i++) {
+      wld_copyRegionPart(&pParts[i]);
+    }
+    free(pParts);
+    return missingCount;
+  }
 
-  assert(intraChunkOffset[0] + iBlockCoord_Corner[0] == iBlockCoords[0]);
+  void **ppArgs = malloc(partCount * sizeof(void *));
+  for (uint32_t i = 0; i < partCount; i++) {
+    ppArgs[i] = &pParts[i];
+  }
+  wld_runTaskGroup(&copy.group, pWorldState, worker_copy_region_part, ppArgs,
+                   partCount);
+  free(ppArgs);
+  free(pParts);
+  return missingCount;
+}
 
-  // chunk index
-  ivec3 chunkIndex = {
-      (intraChunkOffset[0] % CHUNK_X_SIZE + CHUNK_X_SIZE) % CHUNK_X_SIZE,
-      (intraChunkOffset[1] % CHUNK_Y_SIZE + CHUNK_Y_SIZE) % CHUNK_Y_SIZE,
-      (intraChunkOffset[2] % CHUNK_Z_SIZE + CHUNK_Z_SIZE) % CHUNK_Z_SIZE};
+uint32_t wld_copy_region(        //
+    BlockIndex *pOut,            //
+    ivec3_vec *pMissing,         //
+    WorldState *pWorldState,     //
+    const ivec3 iBlockCoordsMin, //
+    const ivec3 iBlockCoordsMax  //
+) {
+  return wld_copyRegion(pOut, pMissing, pWorldState, iBlockCoordsMin,
+                        iBlockCoordsMax, false);
+}
 
-  pChunk->pDataAndState->data
-      .blocks[chunkIndex[0]][chunkIndex[1]][chunkIndex[2]] = block;
+uint32_t wld_copy_region_parallel( //
+    BlockIndex *pOut,              //
+    ivec3_vec *pMissing,           //
+    WorldState *pWorldState,       //
+    const ivec3 iBlockCoordsMin,   //
+    const ivec3 iBlockCoordsMax    //
+) {
+  return wld_copyRegion(pOut, pMissing, pWorldState, iBlockCoordsMin,
+                        iBlockCoordsMax, true);
+}
 
-  // if the block is in the ready vec, then put it back into the needs_mesh
-  for (int32_t i = (int32_t)ivec3_vec_len(pWorldState->ready) - 1; i >= 0;
-       i--) {
-    ivec3 chunkCoords;
-    ivec3_vec_get(pWorldState->ready, (uint32_t)i, chunkCoords);
-    if (ivec3_eq(pChunk->chunkCoord, chunkCoords)) {
-      // this gets rid of the current chunk coord, but in an O(1) fashion
-      ivec3_vec_swapAndPop(pWorldState->ready, (uint32_t)i);
-      // add this to the unload coordinates
-      ivec3_vec_push(pWorldState->tomesh, chunkCoords);
-    }
-  }
+bool wld_get_block_at(       //
+    BlockIndex *pBlock,      //
+    WorldState *pWorldState, //
+    const ivec3 iBlockCoords //
+) {
+  BlockCursor cursor;
+  wld_new_BlockCursor(&cursor, pWorldState, iBlockCoords);
+  return wld_cursor_get_block(pBlock, &cursor);
+}
 
-  return true;
+bool wld_set_block_at(       //
+    BlockIndex block,        //
+    WorldState *pWorldState, //
+    const ivec3 iBlockCoords //
+) {
+  BlockCursor cursor;
+  wld_new_BlockCursor(&cursor, pWorldState, iBlockCoords);
+  return wld_cursor_set_block(&cursor, block);
 }
 
 static int32_t signum(float x) { return x > 0 ? 1 : x < 0 ? -1 : 0; }
@@ -657,6 +3251,184 @@ static float intbound(float s, float ds) {
 
 const static float epsilonf = 0.001f;
 
+// how much air around a block the raycast knows about without reading it
+typedef enum {
+  // only the block itself
+  EmptySpan_BLOCK,
+  // the whole brick
+  EmptySpan_BRICK,
+  // the whole chunk
+  EmptySpan_CHUNK,
+} EmptySpan;
+
+static EmptySpan wld_emptySpan(const BlockCursor *pCursor) {
+  const Chunk *pChunk = pCursor->pChunk;
+  if (pChunk->solidCount == 0) {
+    return EmptySpan_CHUNK;
+  }
+  if (pChunk->brickSolidCount[pCursor->chunkIndex[0] / BRICK_SIZE]
+                             [pCursor->chunkIndex[1] / BRICK_SIZE]
+                             [pCursor->chunkIndex[2] / BRICK_SIZE] == 0) {
+    return EmptySpan_BRICK;
+  }
+  return EmptySpan_BLOCK;
+}
+
+// the t at which the ray crosses its nth block boundary along one axis. It's
+// worked out from n rather than summed step by step, so skipping over many
+// boundaries at once gives exactly the t that stepping over them would.
+static float wld_traceCrossing( //
+    const float tFirst,         //
+    const float tDelta,         //
+    const uint32_t n            //
+) {
+  return n == 0 ? tFirst : tFirst + (float)n * tDelta;
+}
+
+// true if crossing a along one axis at tA comes before crossing b along
+// another at tB. Ties go to the later axis, so Z before Y before X.
+static bool wld_traceBefore( //
+    const float tA,          //
+    const uint32_t a,        //
+    const float tB,          //
+    const uint32_t b         //
+) {
+  return tA < tB || (tA == tB && a > b);
+}
+
+// the state of a ray partway through wld_trace_to_solid
+typedef struct {
+  // the block the ray is in
+  BlockCursor cursor;
+  // which way the ray moves along each axis
+  int32_t step[3];
+  // the t of the first boundary crossing along each axis
+  float tFirst[3];
+  // the change in t between crossings along each axis (always positive)
+  float tDelta[3];
+  // how many boundaries the ray has crossed along each axis
+  uint32_t crossed[3];
+  // the t of the next boundary crossing along each axis
+  float tMax[3];
+} wld_Ray;
+
+static BlockFaceKind wld_traceFace(const uint32_t axis, const int32_t step) {
+  switch (axis) {
+  case 0:
+    return step == 1 ? Block_LEFT : Block_RIGHT;
+  case 1:
+    return step == 1 ? Block_UP : Block_DOWN;
+  default:
+    return step == 1 ? Block_BACK : Block_FRONT;
+  }
+}
+
+// moves the ray over n boundaries along the axis
+static void wld_traceAdvance( //
+    wld_Ray *pRay,            //
+    const uint32_t axis,      //
+    const uint32_t n          //
+) {
+  wld_cursor_step(&pRay->cursor, axis, (int32_t)n * pRay->step[axis]);
+  pRay->crossed[axis] += n;
+  pRay->tMax[axis] = wld_traceCrossing(
+      pRay->tFirst[axis], pRay->tDelta[axis], pRay->crossed[axis]);
+}
+
+// moves the ray into the next block. Returns false if that's past the radius.
+static bool wld_traceStep(    //
+    wld_Ray *pRay,            //
+    BlockFaceKind *dest_face, //
+    const float radius        //
+) {
+  // tMax stores the t-value at which we cross a cube boundary along each
+  // axis. Therefore, choosing the least tMax chooses the closest cube
+  // boundary. Axes the ray doesn't move along have an infinite tMax.
+  const float *tMax = pRay->tMax;
+  uint32_t next;
+  if (tMax[0] < tMax[1]) {
+    next = tMax[0] < tMax[2] ? 0 : 2;
+  } else {
+    next = tMax[1] < tMax[2] ? 1 : 2;
+  }
+  if (pRay->tMax[next] > radius) {
+    return false;
+  }
+  wld_traceAdvance(pRay, next, 1);
+  // Record the normal vector of the cube face we entered.
+  *dest_face = wld_traceFace(next, pRay->step[next]);
+  return true;
+}
+
+// moves the ray to the first block outside the empty brick or chunk it's in,
+// without reading or stepping through the blocks on the way. It lands on the
+// same block, with the same face and tMax, that stepping block by block would.
+// Returns false if the ray runs out before leaving.
+static bool wld_traceSkip(    //
+    wld_Ray *pRay,            //
+    BlockFaceKind *dest_face, //
+    const float radius,       //
+    const EmptySpan span      //
+) {
+  // how many boundaries each axis crosses before leaving the span
+  uint32_t toLeave[3] = {0, 0, 0};
+  // the axis the ray leaves through, and when
+  uint32_t exitAxis = 3;
+  float exitT = INFINITY;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (pRay->step[axis] == 0) {
+      continue;
+    }
+    int32_t i = pRay->cursor.chunkIndex[axis];
+    int32_t lo = span == EmptySpan_CHUNK ? 0 : i / BRICK_SIZE * BRICK_SIZE;
+    int32_t hi = span == EmptySpan_CHUNK ? wld_chunkSize[axis] - 1
+                                         : lo + BRICK_SIZE - 1;
+    toLeave[axis] = (uint32_t)(pRay->step[axis] > 0 ? hi - i + 1 : i - lo + 1);
+    float t = wld_traceCrossing(pRay->tFirst[axis], pRay->tDelta[axis],
+                                pRay->crossed[axis] + toLeave[axis] - 1);
+    if (exitAxis == 3 || wld_traceBefore(t, axis, exitT, exitAxis)) {
+      exitAxis = axis;
+      exitT = t;
+    }
+  }
+  if (exitT > radius) {
+    return false;
+  }
+
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (pRay->step[axis] == 0 || axis == exitAxis) {
+      continue;
+    }
+    // find the first crossing along this axis that doesn't come before the
+    // exit. Dividing gets close; the loops fix up the rounding.
+    uint32_t first = pRay->crossed[axis];
+    uint32_t last = first + toLeave[axis] - 1;
+    uint32_t n = first;
+    float estimate = (exitT - pRay->tFirst[axis]) / pRay->tDelta[axis];
+    if (estimate > (float)first) {
+      n = estimate < (float)last ? (uint32_t)estimate : last;
+    }
+    while (n > first &&
+           !wld_traceBefore(wld_traceCrossing(pRay->tFirst[axis],
+                                              pRay->tDelta[axis], n - 1),
+                            axis, exitT, exitAxis)) {
+      n--;
+    }
+    while (n < last &&
+           wld_traceBefore(wld_traceCrossing(pRay->tFirst[axis],
+                                             pRay->tDelta[axis], n),
+                           axis, exitT, exitAxis)) {
+      n++;
+    }
+    if (n > first) {
+      wld_traceAdvance(pRay, axis, n - first);
+    }
+  }
+  wld_traceAdvance(pRay, exitAxis, toLeave[exitAxis]);
+  *dest_face = wld_traceFace(exitAxis, pRay->step[exitAxis]);
+  return true;
+}
+
 /**
  * Call the callback with (x,y,z,value,face) of all blocks along the line
  * segment from point 'origin' in vector direction 'direction' of length
@@ -683,6 +3455,7 @@ bool wld_trace_to_solid(      //
   //   • Imposed a distance limit.
   //   • The face passed through to reach the current cube is provided to
   //     the callback.
+  //   • Empty bricks and chunks are crossed in one jump.
 
   // The foundation of this algorithm is a parameterized representation of
   // the provided ray,
@@ -690,115 +3463,195 @@ bool wld_trace_to_solid(      //
   // except that t is not actually stored; rather, at any given point in the
   // traversal, we keep track of the *greater* t values which we would have
   // if we took a step sufficient to cross a cube boundary along that axis
-  // (i.e. change the integer part of the coordinate) in the variables
-  // tMaxX, tMaxY, and tMaxZ.
-
-  // Cube containing origin point.
-  int32_t x = (int32_t)(floorf(origin[0]));
-  int32_t y = (int32_t)(floorf(origin[1]));
-  int32_t z = (int32_t)(floorf(origin[2]));
-  // Break out direction vector.
-  float dx = direction[0];
-  float dy = direction[1];
-  float dz = direction[2];
-  // Direction to increment x,y,z when stepping.
-  int32_t stepX = signum(dx);
-  int32_t stepY = signum(dy);
-  int32_t stepZ = signum(dz);
-  // See description above. The initial values depend on the fractional
-  // part of the origin.
-  float tMaxX = intbound(origin[0], dx);
-  float tMaxY = intbound(origin[1], dy);
-  float tMaxZ = intbound(origin[2], dz);
-  // The change in t when taking a step (always positive).
-  float tDeltaX = (float)stepX / dx;
-  float tDeltaY = (float)stepY / dy;
-  float tDeltaZ = (float)stepZ / dz;
+  // (i.e. change the integer part of the coordinate) in tMax.
 
   // Avoids an infinite loop.
   // reject if the direction is zero
-  assert(
-      !(fabsf(dx) < epsilonf && fabsf(dy) < epsilonf && fabsf(dz) < epsilonf));
+  assert(!(fabsf(direction[0]) < epsilonf && fabsf(direction[1]) < epsilonf &&
+           fabsf(direction[2]) < epsilonf));
+
+  wld_Ray ray;
+  // Cube containing origin point.
+  wld_new_BlockCursor(&ray.cursor, pWorldState,
+                      (ivec3){(int32_t)floorf(origin[0]),
+                              (int32_t)floorf(origin[1]),
+                              (int32_t)floorf(origin[2])});
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    // Direction to increment x,y,z when stepping.
+    ray.step[axis] = signum(direction[axis]);
+    // See description above. The initial values depend on the fractional
+    // part of the origin.
+    ray.tFirst[axis] = intbound(origin[axis], direction[axis]);
+    ray.tDelta[axis] = (float)ray.step[axis] / direction[axis];
+    ray.crossed[axis] = 0;
+    ray.tMax[axis] = ray.step[axis] == 0 ? INFINITY : ray.tFirst[axis];
+  }
 
   // Rescale from units of 1 cube-edge to units of 'direction' so we can
   // compare with 't'.
-  float radius = (float)(max_dist) / sqrtf(dx * dx + dy * dy + dz * dz);
+  float radius = (float)(max_dist) / sqrtf(direction[0] * direction[0] +
+                                            direction[1] * direction[1] +
+                                            direction[2] * direction[2]);
+
   while (true) {
     // get block here
-    ivec3 coord = {x, y, z};
     BlockIndex bi;
-    bool success = wld_get_block_at(&bi, pWorldState, coord);
+    bool success = wld_cursor_get_block(&bi, &ray.cursor);
     if (!success) {
       break;
     }
 
     if (!BLOCKS[bi].transparent) {
-      ivec3_dup(dest_iBlockCoords, coord);
+      wld_cursor_get_coords(dest_iBlockCoords, &ray.cursor);
       return true;
     }
 
-    // tMaxX stores the t-value at which we cross a cube boundary along the
-    // X axis, and similarly for Y and Z. Therefore, choosing the least tMax
-    // chooses the closest cube boundary. Only the first case of the four
-    // has been commented in detail.
-    if (tMaxX < tMaxY) {
-      if (tMaxX < tMaxZ) {
-        if (tMaxX > radius)
-          break;
-        // Update which cube we are now in.
-        x += stepX;
-        // Adjust tMaxX to the next X-oriented boundary crossing.
-        tMaxX += tDeltaX;
-        // Record the normal vector of the cube face we entered.
-        *dest_face = stepX == 1 ? Block_LEFT : Block_RIGHT;
-      } else {
-        if (tMaxZ > radius)
-          break;
-        z += stepZ;
-        tMaxZ += tDeltaZ;
-        *dest_face = stepZ == 1 ? Block_BACK : Block_FRONT;
-      }
-    } else {
-      if (tMaxY < tMaxZ) {
-        if (tMaxY > radius)
-          break;
-        y += stepY;
-        tMaxY += tDeltaY;
-        *dest_face = stepY == 1 ? Block_UP : Block_DOWN;
-      } else {
-        // Identical to the second case, repeated for simplicity in
-        // the conditionals.
-        if (tMaxZ > radius)
-          break;
-        z += stepZ;
-        tMaxZ += tDeltaZ;
-        *dest_face = stepZ == 1 ? Block_BACK : Block_FRONT;
-      }
+    // if the whole brick or chunk we're in is air, jump straight out of it
+    const EmptySpan span = wld_emptySpan(&ray.cursor);
+    bool inRange = span == EmptySpan_BLOCK
+                       ? wld_traceStep(&ray, dest_face, radius)
+                       : wld_traceSkip(&ray, dest_face, radius, span);
+    if (!inRange) {
+      return false;
     }
   }
 
   return false;
 }
 
+// shared by all the tasks of one wld_trace_to_solid_batch
+typedef struct {
+  bool *pHits;
+  ivec3 *pCoords;
+  BlockFaceKind *pFaces;
+  const vec3 *pOrigins;
+  const vec3 *pDirections;
+  const uint32_t *pMaxDists;
+  WorldState *pWorldState;
+  wld_TaskGroup group;
+} wld_RayBatch;
+
+// traces the rays from start up to but not including end
+typedef struct {
+  wld_RayBatch *pBatch;
+  uint32_t start;
+  uint32_t end;
+} wld_RayBatchPart;
+
+static void wld_traceRayBatchPart(const wld_RayBatchPart *pPart) {
+  const wld_RayBatch *pBatch = pPart->pBatch;
+  for (uint32_t i = pPart->start; i < pPart->end; i++) {
+    pBatch->pHits[i] = wld_trace_to_solid(
+        pBatch->pCoords[i], &pBatch->pFaces[i], pBatch->pOrigins[i],
+        pBatch->pDirections[i], pBatch->pMaxDists[i], pBatch->pWorldState);
+  }
+}
+
+static void worker_trace_ray_batch_part(UNUSED uint32_t id, void *arg) {
+  wld_RayBatchPart *pPart = arg;
+  wld_traceRayBatchPart(pPart);
+  wld_finishGroupTask(&pPart->pBatch->group);
+}
+
+uint32_t wld_trace_to_solid_batch( //
+    bool *pHits,                   //
+    ivec3 *dest_iBlockCoords,      //
+    BlockFaceKind *dest_faces,     //
+    const vec3 *origins,           //
+    const vec3 *directions,        //
+    const uint32_t *max_dists,     //
+    const uint32_t rayCount,       //
+    WorldState *pWorldState        //
+) {
+  wld_RayBatch batch = {
+      .pHits = pHits,
+      .pCoords = dest_iBlockCoords,
+      .pFaces = dest_faces,
+      .pOrigins = origins,
+      .pDirections = directions,
+      .pMaxDists = max_dists,
+      .pWorldState = pWorldState,
+  };
+
+  // rays are split into runs of consecutive ones, so rays the caller put next
+  // to each other walk the same chunks on the same worker
+  uint32_t partCount = (rayCount + RAYS_PER_TASK - 1) / RAYS_PER_TASK;
+  wld_RayBatchPart *pParts = malloc(partCount * sizeof(wld_RayBatchPart));
+  for (uint32_t i = 0; i < partCount; i++) {
+    pParts[i].pBatch = &batch;
+    pParts[i].start = i * RAYS_PER_TASK;
+    pParts[i].end = i + 1 == partCount ? rayCount : (i + 1) * RAYS_PER_TASK;
+  }
+
+  if (partCount <= 1) {
+    for (uint32_t i = 0; i < partCount; i++) {
+      wld_traceRayBatchPart(&pParts[i]);
+    }
+  } else {
+    void **ppArgs = malloc(partCount * sizeof(void *));
+    for (uint32_t i = 0; i < partCount; i++) {
+      ppArgs[i] = &pParts[i];
+    }
+    wld_runTaskGroup(&batch.group, pWorldState, worker_trace_ray_batch_part,
+                     ppArgs, partCount);
+    free(ppArgs);
+  }
+  free(pParts);
+
+  uint32_t hitCount = 0;
+  for (uint32_t i = 0; i < rayCount; i++) {
+    hitCount += pHits[i];
+  }
+  return hitCount;
+}
+
 /// highlight updates the world's highlighted block and
 void wld_highlight_face(      //
     const ivec3 iBlockCoords, //
     BlockFaceKind face,       //
     WorldState *pWorldState   //
 ) {
-  // get new highlight buffer
-  Vertex highlightVertexes[6];
-  wu_getVertexesHighlight(highlightVertexes, iBlockCoords, face);
-  // update buffer
-  updateBuffer(pWorldState->highlightVertexBuffer, highlightVertexes,
-               sizeof(highlightVertexes), pWorldState->commandPool,
-               pWorldState->queue, pWorldState->device);
-  pWorldState->has_highlight = true;
+  // only upload it again if it's a different face
+  ChunkGeometry *pGeometry = pWorldState->pHighlightGeometry;
+  if (pGeometry == NULL ||
+      !ivec3_eq(pWorldState->highlightIBlockCoords, iBlockCoords) ||
+      pWorldState->highlightFace != face) {
+    ivec3 chunkCoord;
+    Face highlight = wu_getFaceHighlight(chunkCoord, iBlockCoords, face);
+    DrawBounds bounds;
+    wu_getFaceBounds(bounds.min, bounds.max, iBlockCoords, face);
+
+    // the old highlight may still be in use by the frames in flight
+    wld_pushGarbage(pWorldState, pGeometry);
+    pGeometry = malloc(sizeof(ChunkGeometry));
+    new_ChunkGeometry(pGeometry, &highlight, 1,
+                      wu_packChunkOrigin(chunkCoord), &bounds, pWorldState);
+    pWorldState->pHighlightGeometry = pGeometry;
+    ivec3_dup(pWorldState->highlightIBlockCoords, iBlockCoords);
+    pWorldState->highlightFace = face;
+  }
+
+  if (pWorldState->highlightDrawIndex == DRAW_LIST_NONE) {
+    wld_drawListPush(pWorldState, pGeometry->vertexOffset,
+                     VERTEXES_PER_FACE * pGeometry->faceCount,
+                     pGeometry->origin, &pGeometry->bounds,
+                     pGeometry->allocation.block,
+                     &pWorldState->highlightDrawIndex);
+  } else {
+    uint32_t i = pWorldState->highlightDrawIndex;
+    pWorldState->drawOffsets[i] = pGeometry->vertexOffset;
+    pWorldState->drawOrigins[i] = pGeometry->origin;
+    pWorldState->drawBounds[i] = pGeometry->bounds;
+    pWorldState->drawBlocks[i] = pGeometry->allocation.block;
+    wld_drawListChanged(pWorldState, i);
+  }
 }
 
 /// highlight updates the world's highlighted block and
 void wld_clear_highlight_face( //
     WorldState *pWorldState    //
 ) {
-  pWorldState->has_highlight = false;
+  if (pWorldState->highlightDrawIndex != DRAW_LIST_NONE) {
+    wld_drawListRemove(pWorldState, &pWorldState->highlightDrawIndex);
+  }
 }
@@ -2,6 +2,7 @@
 #define SRC_WORLD_H_
 
 #include <hashmap.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <vec_ivec3.h>
@@ -10,10 +11,42 @@
 
 #include "vulkan_utils.h"
 
+#include "occlusion.h"
+#include "staging.h"
+#include "vertex_pool.h"
 #include "world_utils.h"
 #include "worldgen.h"
 
+typedef struct Chunk_s Chunk;
 typedef struct ChunkGeometry_s ChunkGeometry;
+typedef struct ChunkMeshResult_s ChunkMeshResult;
+typedef struct MeshRegion_s MeshRegion;
+
+// geometry that's been replaced or unloaded, and the frame it was thrown out
+// before
+typedef struct {
+  ChunkGeometry *pGeometry;
+  uint64_t frame;
+} Garbage;
+
+// draw list index of something that isn't being drawn
+#define DRAW_LIST_NONE UINT32_MAX
+
+// side length of the clipmap in chunks, must be a power of two
+#define CLIPMAP_SIZE 8
+
+// side length of the mesh regions in chunks, must be a power of two. The
+// meshes of a region's chunks sit next to each other in one range of the
+// vertex pool, so a region whose chunks are all visible takes one draw.
+#define MESH_REGION_SIZE 4
+#define MESH_REGION_CHUNKS                                                     \
+  (MESH_REGION_SIZE * MESH_REGION_SIZE * MESH_REGION_SIZE)
+
+// axis aligned box containing a draw's faces, in world coordinates
+typedef struct {
+  vec3 min;
+  vec3 max;
+} DrawBounds;
 
 /// wld_WorldState
 /// ---------------------
@@ -32,8 +65,6 @@ typedef struct {
   // so make sure you delete world state before deleting these
   VkDevice device;
   VkPhysicalDevice physicalDevice;
-  VkQueue queue;
-  VkCommandPool commandPool;
 
   // borrowed, not owned
   worldgen_state *wgstate;
@@ -41,39 +72,135 @@ typedef struct {
   // threadpool to allocate tasks to
   struct threadpool_t *pool;
 
-  // hashmap storing chunks
+  // the shared buffers chunk meshes are placed in
+  VertexPool vertexPool;
+  // workers mesh into its arena, and the meshes are copied to the vertex
+  // pool by the uploads wld_flushUploads submits
+  StagingRing staging;
+
+  // loaded chunks live in the clipmap, a window around centerLoc that wraps
+  // around, indexed by chunk coordinates modulo CLIPMAP_SIZE.
+  // Chunks in range never collide. Out of range chunks waiting to be unloaded
+  // may collide with ones in range, and those move to chunk_map.
+  Chunk *clipmap[CLIPMAP_SIZE][CLIPMAP_SIZE][CLIPMAP_SIZE];
+  // hashmap storing chunks that didn't fit in the clipmap
   struct hashmap *chunk_map;
+  // hashmap of the mesh regions with meshed chunks in them, by the
+  // coordinates of the chunk at their corner
+  struct hashmap *region_map;
 
   // vector of the coordinates of chunks to generate
   ivec3_vec *togenerate;
-  // vector of the coordinates of chunks that are asynchronously generating
-  ivec3_vec *generating;
-  // vector of the coordinates of chunks to mesh
-  ivec3_vec *tomesh;
-  // vector of the coordinates of ready chunks
-  ivec3_vec *ready;
+  // vector of the coordinates of edited chunks that need a new mesh
+  ivec3_vec *toremesh;
   // vector of the coordinates of chunks to unload
   ivec3_vec *tounload;
+  // vector of the corners of mesh regions whose chunks changed, to be put
+  // back together at the end of the tick
+  ivec3_vec *torebuild;
+  // scratch vector of the coordinates of chunks to move into the clipmap
+  ivec3_vec *topromote;
+
+  // stack of meshes the workers finished, pushed to by the worker threads
+  _Atomic(ChunkMeshResult *) completedMeshes;
+  // meshes taken off completedMeshes that haven't been uploaded yet
+  ChunkMeshResult *pendingUploads;
 
-  // vector of garbage
+  // vector of garbage, in the order it was thrown out
   uint32_t garbage_cap;
   uint32_t garbage_len;
-  ChunkGeometry **garbage_data;
+  Garbage *garbage_data;
+  // the number of draw lists handed out by wld_getDrawList or
+  // wld_getDrawChanges. Each is a frame that may be drawing what was in it,
+  // so garbage thrown out now can still be in use by frames before this one.
+  uint64_t frame;
+
+  // the draw list, kept up to date as geometry is uploaded and unloaded.
+  // There's a draw for each mesh region, and one for the highlight.
+  // These are parallel arrays of length draw_len.
+  uint32_t draw_cap;
+  uint32_t draw_len;
+  VkDeviceSize *drawOffsets;
+  uint32_t *drawCounts;
+  // packed by wu_packChunkOrigin, passed to the shader as firstInstance
+  uint32_t *drawOrigins;
+  DrawBounds *drawBounds;
+  // the vertex pool block each draw's faces are in
+  uint32_t *drawBlocks;
+  // points to where the owner of each draw keeps its index
+  uint32_t **drawIndexes;
+  // the center the draw list was last sorted around by wld_getDrawChanges
+  ivec3 sortedCenter;
+
+  // the draws changed since the last wld_getDrawChanges, for the copy of the
+  // draw list that's culled on the GPU. drawChanged[i] is true if i is in
+  // changedDraws. Both have room for draw_cap draws.
+  uint32_t changed_len;
+  uint32_t *changedDraws;
+  bool *drawChanged;
+  // what the changed draws are now, filled in by wld_getDrawChanges
+  CullDrawRecord *changedRecords;
+  // the buffers of the vertex pool blocks, filled in by wld_getBlockBuffers
+  uint32_t blockBuffer_cap;
+  VkBuffer *blockBuffers;
 
-  bool has_highlight;
-  VkBuffer highlightVertexBuffer;
-  VkDeviceMemory highlightVertexBufferMemory;
+  // scratch queue of chunks for the visibility search in wld_getDrawList
+  uint32_t cull_cap;
+  Chunk **cullQueue;
+  // scratch list of the mesh regions it found visible chunks in, in the
+  // order it found them, with room for cull_cap of them
+  MeshRegion **cullRegions;
+  // incremented by every visibility search, to tell which chunks it reached
+  uint32_t cullFrame;
+  // depth buffer the chunks nearest the camera are drawn into as occluders
+  OcclusionBuffer occlusion;
+  // the occluders wld_startOcclusion has a worker draw
+  struct wld_OcclusionJob *pOcclusionJob;
+  // incremented by every edit to the blocks
+  uint64_t editCount;
+
+  // the draws that passed culling in the last wld_getDrawList, and the keys
+  // they're sorted front to back by. visibleOrder has their indexes in
+  // sorted order. These and the batches have room for visible_cap draws.
+  uint32_t visible_cap;
+  uint32_t visible_len;
+  uint32_t *visibleBlocks;
+  VkDrawIndirectCommand *visibleCommands;
+  uint32_t *visibleKeys;
+  uint32_t *visibleOrder;
+  // the same draws grouped by vertex pool block. Batch i draws the next
+  // batchCounts[i] of batchedCommands from block batchBlocks[i].
+  uint32_t batch_len;
+  uint32_t *batchBlocks;
+  uint32_t *batchCounts;
+  VkDrawIndirectCommand *batchedCommands;
+
+  // index of the highlight in the draw list, DRAW_LIST_NONE if not shown
+  uint32_t highlightDrawIndex;
+  // the last highlighted face, NULL if nothing has been highlighted yet.
+  // A new face gets new geometry, so the old one can still be drawn by the
+  // frames in flight.
+  ChunkGeometry *pHighlightGeometry;
+  ivec3 highlightIBlockCoords;
+  BlockFaceKind highlightFace;
 } WorldState;
 
 /// Creates a new worldState with the given center
-void wld_new_WorldState(                  //
-    WorldState *pWorldState,              //
-    const ivec3 centerLoc,                //
-    worldgen_state *wgstate,              //
-    const VkQueue queue,                  //
-    const VkCommandPool commandPool,      //
-    const VkDevice device,                //
-    const VkPhysicalDevice physicalDevice //
+/// --- PRECONDITIONS ---
+/// * graphicsQueue belongs to graphicsQueueFamilyIndex, and the world is
+///   drawn from it. The uploads go on it too, since they overwrite faces
+///   that the frames before may still be drawing.
+/// * workerThreads is how many threads generate, mesh and trace rays for the
+///   world, 0 for one per online CPU, at most MAX_THREADS
+void wld_new_WorldState(                     //
+    WorldState *pWorldState,                 //
+    const ivec3 centerLoc,                   //
+    worldgen_state *wgstate,                 //
+    const uint32_t workerThreads,            //
+    const VkQueue graphicsQueue,             //
+    const uint32_t graphicsQueueFamilyIndex, //
+    const VkDevice device,                   //
+    const VkPhysicalDevice physicalDevice    //
 );
 
 /// --- PRECONDITIONS ---
@@ -120,28 +247,348 @@ bool wld_trace_to_solid(      //
     WorldState *pWorldState   //
 );
 
-/// gets rid of the garbage buffers, make sure none of it is in use
-void wld_clearGarbage(WorldState *pWorldState);
+/// traces many rays at once, splitting them between the world's worker
+/// threads. Rays next to each other in the arrays are traced by the same
+/// worker, so keep rays that go the same way together.
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * every array has rayCount elements
+/// * no direction is zero
+/// * must be called from the thread that owns pWorldState, not from a task
+/// --- POSTCONDITIONS ---
+/// * for each ray i, pHits[i], dest_iBlockCoords[i] and dest_faces[i] are set
+///   the same way wld_trace_to_solid sets its result, block and face
+/// * returns the number of rays that hit a solid block
+uint32_t wld_trace_to_solid_batch( //
+    bool *pHits,                   //
+    ivec3 *dest_iBlockCoords,      //
+    BlockFaceKind *dest_faces,     //
+    const vec3 *origins,           //
+    const vec3 *directions,        //
+    const uint32_t *max_dists,     //
+    const uint32_t rayCount,       //
+    WorldState *pWorldState        //
+);
+
+/// frees the garbage that none of the frames still in flight can be using
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * the GPU is done with the first completedFrames draw lists handed out by
+///   wld_getDrawList or wld_getDrawChanges
+/// --- POSTCONDITIONS ---
+/// * garbage thrown out before the draw list of frame completedFrames was
+///   handed out is freed, as are vertex pool blocks left empty
+void wld_clearGarbage(             //
+    WorldState *pWorldState,       //
+    const uint64_t completedFrames //
+);
+
+/// submits the geometry uploaded since the last call
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * called once per frame after waiting on the frame in flight fence, and
+///   before the draw list is recorded
+/// --- POSTCONDITIONS ---
+/// * returns a semaphore the frame's submission must wait on before reading
+///   faces, or VK_NULL_HANDLE if nothing was uploaded
+VkSemaphore wld_flushUploads( //
+    WorldState *pWorldState   //
+);
+
+/// gets how much of the vertex pool the chunk meshes take up
+void wld_getVertexPoolStats( //
+    VertexPoolStats *pStats, //
+    WorldState *pWorldState  //
+);
+
+/// starts drawing the occluders for the next wld_getDrawList on a worker, so
+/// that it overlaps with wld_update
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * mvp is the matrix the next frame will be drawn with
+/// * the world's center is the chunk the camera is in
+/// --- POSTCONDITIONS ---
+/// * the next wld_getDrawList uses these occluders if it's given the same
+///   mvp and no blocks were edited in between. Otherwise it draws its own
+///   and these are thrown away. Chunks loaded or meshed in between aren't
+///   among these occluders, which only means less is culled
+/// * nothing else about the world may be touched by the worker, so it's free
+///   to change until then
+void wld_startOcclusion(    //
+    const mat4x4 mvp,       //
+    WorldState *pWorldState //
+);
+
+/// gets the draws in the current draw list that the camera can see
+/// --- PRECONDITIONS ---
+/// * all pointers are valid
+/// * pWorldState is valid
+/// * mvp is the matrix the draws will be rendered with
+/// * the world's center is the chunk the camera is in
+/// --- POSTCONDITIONS ---
+/// * draws whose bounds are entirely outside mvp's view frustum are left out
+/// * if the center chunk is loaded, each chunk is culled on its own instead:
+///   chunks outside the frustum, chunks that can't be seen from the center
+///   through air (going by which of their faces are connected) and chunks
+///   hidden behind the solid bricks of the chunks nearest to it are left out
+/// * `*ppCommands` is set to an array of `*pDrawCount` commands for
+///   vkCmdDrawIndirect. The chunks left in a mesh region are drawn by one
+///   command per run of them that's next to each other in the region's
+///   faces, so a region with nothing culled takes one
+/// * the commands are grouped into `*pBatchCount` batches of draws from the
+///   same vertex pool block. Batch i draws the next `(*ppBatchCounts)[i]`
+///   commands from the faces in block `(*ppBatchBlocks)[i]`, see
+///   wld_getBlockBuffers
+/// * each command's firstVertex is VERTEXES_PER_FACE times the index of its
+///   first face in the block, and its firstInstance is its region's origin
+/// * the commands are sorted front to back by their nearest chunk's distance
+///   from the center, within each batch and by the nearest of each batch,
+///   with the highlight last. Drawn in order, hidden faces fail the depth
+///   test before they're shaded.
+/// * the arrays are owned by pWorldState, and are valid until the next call
+///   to any function taking pWorldState. Don't modify them
+void wld_getDrawList(                         //
+    const VkDrawIndirectCommand **ppCommands, //
+    uint32_t *pDrawCount,                     //
+    const uint32_t **ppBatchBlocks,           //
+    const uint32_t **ppBatchCounts,           //
+    uint32_t *pBatchCount,                    //
+    const mat4x4 mvp,                         //
+    WorldState *pWorldState                   //
+);
+
+/// gets the planes of the view frustum of mvp
+/// --- POSTCONDITIONS ---
+/// * a point p is inside plane i when dot(planes[i], (p, 1)) >= 0
+void wld_getFrustumPlanes(vec4 planes[6], const mat4x4 mvp);
+
+/// checks whether a box might be inside the frustum made by planes
+/// --- PRECONDITIONS ---
+/// * planes are from wld_getFrustumPlanes
+/// * pBounds is valid
+/// --- POSTCONDITIONS ---
+/// * returns false if the box is entirely outside one of the planes
+/// * returns true otherwise, including for some boxes just outside the
+///   frustum's corners and edges
+bool wld_boundsInFrustum(     //
+    const vec4 planes[6],     //
+    const DrawBounds *pBounds //
+);
+
+/// gets how big the draw list is, for sizing a copy of it on the GPU
+/// --- PRECONDITIONS ---
+/// * all pointers are valid
+/// * pWorldState is valid
+/// --- POSTCONDITIONS ---
+/// * `*pDrawCount` is set to the number of draws in the draw list
+/// * `*pBlockCount` is set to the number of vertex pool blocks draws can be
+///   in. Draws are only ever in blocks with lower indexes than this until the
+///   next wld_update.
+void wld_getDrawListSize(   //
+    uint32_t *pDrawCount,   //
+    uint32_t *pBlockCount,  //
+    WorldState *pWorldState //
+);
+
+/// gets what changed in the draw list since the last call, to keep a copy of
+/// it on the GPU that's culled there instead of by wld_getDrawList
+/// --- PRECONDITIONS ---
+/// * all pointers are valid
+/// * pWorldState is valid
+/// --- POSTCONDITIONS ---
+/// * if the center moved since the last sort, or all is true, the draw list
+///   is sorted front to back by the distance of each draw's nearest point
+///   from the center, which changes the draws that moved. Draws added since
+///   the last sort are at the end.
+/// * if all is true, every draw counts as changed, for starting a new copy
+/// * draw `(*ppChangedIndexes)[i]` is now `(*ppChangedRecords)[i]`, for
+///   i < `*pChangeCount`, and the indexes are in ascending order. Each
+///   record's block is the vertex pool block its faces are in, and the
+///   commands it makes are like wld_getDrawList's. The draws not in there
+///   haven't changed.
+/// * `*pDrawCount` is set to the number of draws. Records at or past it
+///   aren't draws anymore.
+/// * the arrays are owned by pWorldState, and are valid until the next call
+///   to any function taking pWorldState. Don't modify them
+/// * counts as handing out a draw list to the frame being recorded, like
+///   wld_getDrawList does
+void wld_getDrawChanges(                     //
+    const uint32_t **ppChangedIndexes,       //
+    const CullDrawRecord **ppChangedRecords, //
+    uint32_t *pChangeCount,                  //
+    uint32_t *pDrawCount,                    //
+    const bool all,                          //
+    WorldState *pWorldState                  //
+);
 
-/// returns the number of vertex buffers
-/// this number won't change unless you call wld_showGeometryUpdates
+/// gets the buffers of the vertex pool blocks, which the faces of the draws
+/// in each block are pulled from
 /// --- PRECONDITIONS ---
-/// * pVertexBufferCount is valid
+/// * all pointers are valid
 /// * pWorldState is valid
-/// * state is AVAILABLE or UNAVAILABLE
 /// --- POSTCONDITIONS ---
-/// * sets `*pVertexBufferCount` to the current number of vertex buffers
-void wld_count_vertexBuffers(     //
-    uint32_t *pVertexBufferCount, //
-    const WorldState *pWorldState //
+/// * `*ppBlockBuffers` is set to an array of the `*pBlockCount` blocks'
+///   buffers, by block index. Trimmed blocks have no draws, and are
+///   VK_NULL_HANDLE.
+/// * every draw handed out since the last wld_update is in one of them
+/// * `*pBlockGeneration` changes whenever a block is freed. If it's the same
+///   as last time, so is every block whose buffer is the same.
+/// * the array is owned by pWorldState, and is valid until the next call to
+///   any function taking pWorldState. Don't modify it
+void wld_getBlockBuffers(            //
+    const VkBuffer **ppBlockBuffers, //
+    uint32_t *pBlockCount,           //
+    uint64_t *pBlockGeneration,      //
+    WorldState *pWorldState          //
 );
 
-/// writes the vertex buffers and vertex counts to a set of arrays
-/// this data won't change unless you call wld_showGeometryUpdates
-void wld_getVertexBuffers(        //
-    VkBuffer *pVertexBuffers,     //
-    uint32_t *pVertexCounts,      //
-    const WorldState *pWorldState //
+/// BlockCursor
+/// ---------------------
+/// Points at a block, and caches the chunk containing it, so that accessing
+/// nearby blocks only looks up a chunk when crossing into a new one
+/// --- THREAD SAFETY ---
+/// Only valid until the next call to wld_update or wld_set_center, since
+/// those can unload the cached chunk
+typedef struct {
+  WorldState *pWorldState;
+  // chunk containing the block
+  ivec3 chunkCoord;
+  // offset of the block inside the chunk
+  ivec3 chunkIndex;
+  // NULL if the chunk isn't loaded
+  Chunk *pChunk;
+} BlockCursor;
+
+/// --- PRECONDITIONS ---
+/// * pCursor is valid
+/// * pWorldState is valid
+/// --- POSTCONDITIONS ---
+/// * pCursor points at the block at iBlockCoords
+void wld_new_BlockCursor(    //
+    BlockCursor *pCursor,    //
+    WorldState *pWorldState, //
+    const ivec3 iBlockCoords //
+);
+
+/// points the cursor at the block at iBlockCoords
+void wld_cursor_move(        //
+    BlockCursor *pCursor,    //
+    const ivec3 iBlockCoords //
+);
+
+/// moves the cursor delta blocks along axis (0 is x, 1 is y, 2 is z)
+void wld_cursor_step(     //
+    BlockCursor *pCursor, //
+    const uint32_t axis,  //
+    const int32_t delta   //
+);
+
+/// writes the global block coordinates the cursor points at
+void wld_cursor_get_coords(    //
+    ivec3 iBlockCoords,        //
+    const BlockCursor *pCursor //
+);
+
+/// --- PRECONDITIONS ---
+/// * pBlock is valid
+/// * pCursor is valid
+/// --- POSTCONDITIONS ---
+/// * if the block's chunk is generated, sets `*pBlock` and returns true
+/// * otherwise returns false
+bool wld_cursor_get_block(     //
+    BlockIndex *pBlock,        //
+    const BlockCursor *pCursor //
+);
+
+/// --- PRECONDITIONS ---
+/// * pCursor is valid
+/// --- POSTCONDITIONS ---
+/// * if the block's chunk is generated, sets the block, schedules the affected
+///   chunks to be remeshed and returns true
+/// * otherwise returns false
+bool wld_cursor_set_block( //
+    BlockCursor *pCursor,  //
+    BlockIndex block       //
+);
+
+/// sets every block in the box between iBlockCoordsMin and iBlockCoordsMax
+/// (inclusive). Each affected chunk is written once and remeshed once.
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * iBlockCoordsMin is less than or equal to iBlockCoordsMax on every axis
+/// --- POSTCONDITIONS ---
+/// * returns the number of blocks set. Blocks in chunks that aren't generated
+///   are skipped
+uint32_t wld_set_blocks_region(  //
+    BlockIndex block,            //
+    WorldState *pWorldState,     //
+    const ivec3 iBlockCoordsMin, //
+    const ivec3 iBlockCoordsMax  //
+);
+
+/// sets every block within radius of iBlockCoordsCenter. Each affected chunk
+/// is written once and remeshed once.
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// --- POSTCONDITIONS ---
+/// * returns the number of blocks set. Blocks in chunks that aren't generated
+///   are skipped
+uint32_t wld_set_blocks_sphere(     //
+    BlockIndex block,               //
+    WorldState *pWorldState,        //
+    const ivec3 iBlockCoordsCenter, //
+    const uint32_t radius           //
+);
+
+/// sets pIBlockCoords[i] to pBlocks[i] for each i < editCount. Edits are
+/// grouped by chunk so each affected chunk is written once and remeshed once.
+/// If a block is listed more than once, the last edit wins.
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * pIBlockCoords and pBlocks are arrays of length editCount
+/// --- POSTCONDITIONS ---
+/// * returns the number of edits applied. Edits in chunks that aren't
+///   generated are skipped
+uint32_t wld_set_blocks(        //
+    WorldState *pWorldState,    //
+    const ivec3 *pIBlockCoords, //
+    const BlockIndex *pBlocks,  //
+    const uint32_t editCount    //
+);
+
+/// copies the blocks in the box between iBlockCoordsMin and iBlockCoordsMax
+/// (inclusive) into pOut, one chunk at a time
+/// --- PRECONDITIONS ---
+/// * pWorldState is valid
+/// * iBlockCoordsMin is less than or equal to iBlockCoordsMax on every axis
+/// * pOut has room for the whole box. It's laid out like ChunkData: block
+///   (x, y, z) of the box, relative to iBlockCoordsMin, is at
+///   `pOut[(x * sizeY + y) * sizeZ + z]`
+/// * pMissing is NULL or valid
+/// --- POSTCONDITIONS ---
+/// * the blocks of every generated chunk in the box are written to pOut
+/// * the parts of pOut in chunks that aren't generated are left untouched
+/// * the coordinates of those chunks are pushed to pMissing if it isn't NULL
+/// * returns the number of chunks that weren't generated
+uint32_t wld_copy_region(        //
+    BlockIndex *pOut,            //
+    ivec3_vec *pMissing,         //
+    WorldState *pWorldState,     //
+    const ivec3 iBlockCoordsMin, //
+    const ivec3 iBlockCoordsMax  //
+);
+
+/// same as wld_copy_region, but splits the copy between the world's worker
+/// threads and waits for them. Worth it for boxes spanning many chunks.
+/// --- PRECONDITIONS ---
+/// * same as wld_copy_region
+/// * must be called from the thread that owns pWorldState, not from a task
+uint32_t wld_copy_region_parallel( //
+    BlockIndex *pOut,              //
+    ivec3_vec *pMissing,           //
+    WorldState *pWorldState,       //
+    const ivec3 iBlockCoordsMin,   //
+    const ivec3 iBlockCoordsMax    //
 );
 
 bool wld_get_block_at(       //
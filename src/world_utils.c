@@ -1,6 +1,7 @@
 #include "world_utils.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 
 // converts from world chunk coordinates to global block coordinates
 void worldChunkCoords_to_iBlockCoords( //
@@ -31,6 +32,25 @@ void worldChunkCoords_to_blockCoords( //
   ivec3_to_vec3(blockCoords, tmp);
 }
 
+// rounds towards negative infinity, unlike the / operator
+static int32_t wu_floorDiv(int32_t a, int32_t b) {
+  int32_t q = a / b;
+  return (a % b != 0 && (a < 0) != (b < 0)) ? q - 1 : q;
+}
+
+void iBlockCoords_to_worldChunkCoords( //
+    ivec3 worldChunkCoords,            //
+    ivec3 chunkIndex,                  //
+    const ivec3 iBlockCoords           //
+) {
+  worldChunkCoords[0] = wu_floorDiv(iBlockCoords[0], CHUNK_X_SIZE);
+  worldChunkCoords[1] = wu_floorDiv(iBlockCoords[1], CHUNK_Y_SIZE);
+  worldChunkCoords[2] = wu_floorDiv(iBlockCoords[2], CHUNK_Z_SIZE);
+  chunkIndex[0] = iBlockCoords[0] - worldChunkCoords[0] * CHUNK_X_SIZE;
+  chunkIndex[1] = iBlockCoords[1] - worldChunkCoords[1] * CHUNK_Y_SIZE;
+  chunkIndex[2] = iBlockCoords[2] - worldChunkCoords[2] * CHUNK_Z_SIZE;
+}
+
 bool wu_loadChunkData(ChunkData *pC, const char *filename) {
   FILE *file = fopen(filename, "rb");
   if (!file) {
@@ -52,11 +72,79 @@ bool wu_loadChunkData(ChunkData *pC, const char *filename) {
   return true;
 }
 
-uint32_t wu_countChunkDataVertexes( //
-    const ChunkData *pCd            //
+// true if the block at (x, y, z), relative to pCd's corner, is transparent.
+// The coordinates may be up to one block outside of pCd, in which case the
+// neighbour on that side is consulted. Missing neighbours count as transparent.
+static bool wu_transparentAt(              //
+    const ChunkData *pCd,                  //
+    const ChunkData *const pNeighbours[6], //
+    int32_t x,                             //
+    int32_t y,                             //
+    int32_t z                              //
+) {
+  const ChunkData *pSrc = pCd;
+  BlockFaceKind side;
+  if (x < 0) {
+    side = Block_LEFT;
+    x += CHUNK_X_SIZE;
+  } else if (x >= CHUNK_X_SIZE) {
+    side = Block_RIGHT;
+    x -= CHUNK_X_SIZE;
+  } else if (y < 0) {
+    side = Block_UP;
+    y += CHUNK_Y_SIZE;
+  } else if (y >= CHUNK_Y_SIZE) {
+    side = Block_DOWN;
+    y -= CHUNK_Y_SIZE;
+  } else if (z < 0) {
+    side = Block_BACK;
+    z += CHUNK_Z_SIZE;
+  } else if (z >= CHUNK_Z_SIZE) {
+    side = Block_FRONT;
+    z -= CHUNK_Z_SIZE;
+  } else {
+    return BLOCKS[pSrc->blocks[x][y][z]].transparent;
+  }
+
+  pSrc = pNeighbours == NULL ? NULL : pNeighbours[side];
+  if (pSrc == NULL) {
+    return true;
+  }
+  return BLOCKS[pSrc->blocks[x][y][z]].transparent;
+}
+
+// grows the box from lo to hi to take in a face of block. The face is the one
+// facing along axis, on the low side of the block if side is 0, or the high
+// side if it's 1.
+static void wu_growBounds(  //
+    int32_t lo[3],          //
+    int32_t hi[3],          //
+    const int32_t block[3], //
+    const uint32_t axis,    //
+    const int32_t side      //
+) {
+  for (uint32_t i = 0; i < 3; i++) {
+    int32_t faceLo = block[i];
+    int32_t faceHi = block[i] + 1;
+    if (i == axis) {
+      faceLo = block[i] + side;
+      faceHi = faceLo;
+    }
+    lo[i] = faceLo < lo[i] ? faceLo : lo[i];
+    hi[i] = faceHi > hi[i] ? faceHi : hi[i];
+  }
+}
+
+uint32_t wu_countChunkDataFaces(          //
+    vec3 min,                             //
+    vec3 max,                             //
+    const ChunkData *pCd,                 //
+    const ChunkData *const pNeighbours[6] //
 ) {
   // first look through all blocks and count how many opaque we have
   uint32_t faceCount = 0;
+  int32_t lo[3] = {CHUNK_X_SIZE, CHUNK_Y_SIZE, CHUNK_Z_SIZE};
+  int32_t hi[3] = {0, 0, 0};
 
   for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
     for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
@@ -65,50 +153,83 @@ uint32_t wu_countChunkDataVertexes( //
         if (BLOCKS[pCd->blocks[x][y][z]].transparent) {
           continue;
         }
+        const int32_t block[3] = {(int32_t)x, (int32_t)y, (int32_t)z};
 
         // left face
-        if (x == 0 || BLOCKS[pCd->blocks[x - 1][y][z]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x - 1, (int32_t)y,
+                             (int32_t)z)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 0, 0);
         }
         // right face
-        if (x == CHUNK_X_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x + 1][y][z]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x + 1, (int32_t)y,
+                             (int32_t)z)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 0, 1);
         }
 
         // upper face
-        if (y == 0 || BLOCKS[pCd->blocks[x][y - 1][z]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y - 1,
+                             (int32_t)z)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 1, 0);
         }
         // lower face
-        if (y == CHUNK_Y_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x][y + 1][z]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y + 1,
+                             (int32_t)z)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 1, 1);
         }
 
         // front face
-        if (z == 0 || BLOCKS[pCd->blocks[x][y][z - 1]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y,
+                             (int32_t)z - 1)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 2, 0);
         }
         // back face
-        if (z == CHUNK_Z_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x][y][z + 1]].transparent) {
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y,
+                             (int32_t)z + 1)) {
           faceCount++;
+          wu_growBounds(lo, hi, block, 2, 1);
         }
       }
     }
   }
 
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    min[axis] = (float)lo[axis];
+    max[axis] = (float)hi[axis];
+  }
+
   // now set answer
-  return faceCount * 6;
+  return faceCount;
 }
 
-// returns the number of vertexes written
-uint32_t wu_getVertexesChunkData( //
-    Vertex *pVertexes,            //
-    const vec3 offset,            //
-    const ChunkData *pCd          //
+// packs a face of the block at (x, y, z) in its mesh region
+static Face wu_packFace(      //
+    const uint32_t x,         //
+    const uint32_t y,         //
+    const uint32_t z,         //
+    const BlockFaceKind kind, //
+    const BlockIndex block    //
 ) {
+  return x | y << FACE_Y_SHIFT | z << FACE_Z_SHIFT |
+         (uint32_t)kind << FACE_KIND_SHIFT |
+         (uint32_t)block << FACE_BLOCK_SHIFT;
+}
+
+uint32_t wu_getFacesChunkData(            //
+    Face *pFaces,                         //
+    const ivec3 offset,                   //
+    const ChunkData *pCd,                 //
+    const ChunkData *const pNeighbours[6] //
+) {
+  // packed faces have x, y and z in separate bit fields, and the block's
+  // coordinates plus the offset never overflow them, so the offset can be
+  // added to the packed face
+  const Face base = wu_packFace((uint32_t)offset[0], (uint32_t)offset[1],
+                                (uint32_t)offset[2], 0, 0);
   uint32_t i = 0;
   for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
     for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
@@ -119,202 +240,171 @@ uint32_t wu_getVertexesChunkData( //
           continue;
         }
 
-        // get chunk location
-        const float fx = (float)x + offset[0];
-        const float fy = (float)y + offset[1];
-        const float fz = (float)z + offset[2];
-
-        // calculate vertexes
-        const vec3 v000 = {fx + 0, fy + 0, fz + 0};
-        const vec3 v100 = {fx + 1, fy + 0, fz + 0};
-        const vec3 v001 = {fx + 0, fy + 0, fz + 1};
-        const vec3 v101 = {fx + 1, fy + 0, fz + 1};
-        const vec3 v010 = {fx + 0, fy + 1, fz + 0};
-        const vec3 v110 = {fx + 1, fy + 1, fz + 0};
-        const vec3 v011 = {fx + 0, fy + 1, fz + 1};
-        const vec3 v111 = {fx + 1, fy + 1, fz + 1};
-
-        const float xoff = BLOCK_TILE_TEX_XSIZE;
-        const float yoff = BLOCK_TILE_TEX_YSIZE;
-
-        // clang-format off
-
         // left face
-        if (x == 0 || BLOCKS[pCd->blocks[x - 1][y][z]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_LEFT;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v000), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v010), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v001), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v001), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v010), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v011), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x - 1, (int32_t)y,
+                             (int32_t)z)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_LEFT, bi);
         }
         // right face
-        if (x == CHUNK_X_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x + 1][y][z]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_RIGHT;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v100), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v101), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v110), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v101), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v111), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v110), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x + 1, (int32_t)y,
+                             (int32_t)z)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_RIGHT, bi);
         }
 
         // upper face
-        if (y == 0 || BLOCKS[pCd->blocks[x][y - 1][z]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_UP;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v001), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v100), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v000), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v001), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v101), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v100), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y - 1,
+                             (int32_t)z)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_UP, bi);
         }
         // lower face
-        if (y == CHUNK_Y_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x][y + 1][z]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_DOWN;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v010), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v110), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v011), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v110), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v111), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v011), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y + 1,
+                             (int32_t)z)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_DOWN, bi);
         }
 
         // back face
-        if (z == 0 || BLOCKS[pCd->blocks[x][y][z - 1]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_BACK;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v000), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v100), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v010), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v100), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v110), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v010), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+yoff}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y,
+                             (int32_t)z - 1)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_BACK, bi);
         }
 
         // front face
-        if (z == CHUNK_Z_SIZE - 1 ||
-            BLOCKS[pCd->blocks[x][y][z + 1]].transparent) {
-          const float bx = BLOCK_TILE_TEX_XSIZE*Block_FRONT;
-          const float by = BLOCK_TILE_TEX_YSIZE*bi;
-          pVertexes[i++] = (Vertex){.position=V3(v011), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v101), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v001), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-          pVertexes[i++] = (Vertex){.position=V3(v011), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v111), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+yoff}};
-          pVertexes[i++] = (Vertex){.position=V3(v101), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+0.0f}};
+        if (wu_transparentAt(pCd, pNeighbours, (int32_t)x, (int32_t)y,
+                             (int32_t)z + 1)) {
+          pFaces[i++] = base + wu_packFace(x, y, z, Block_FRONT, bi);
         }
-        // clang-format on
       }
     }
   }
   return i;
 }
 
-// returns the number of vertexes written
-void wu_getVertexesHighlight( //
-    Vertex pVertexes[6],      //
+Face wu_getFaceHighlight(     //
+    ivec3 worldChunkCoords,   //
     const ivec3 iBlockCoords, //
     const BlockFaceKind face  //
 ) {
+  ivec3 chunkIndex;
+  iBlockCoords_to_worldChunkCoords(worldChunkCoords, chunkIndex, iBlockCoords);
+  // the highlight is drawn with the texture of air
+  return wu_packFace((uint32_t)chunkIndex[0], (uint32_t)chunkIndex[1],
+                     (uint32_t)chunkIndex[2], face, 0);
+}
 
-  BlockIndex bi = 0;
+uint32_t wu_packChunkOrigin(const ivec3 worldChunkCoords) {
+  const uint32_t x = (uint32_t)worldChunkCoords[0];
+  const uint32_t y = (uint32_t)worldChunkCoords[1];
+  const uint32_t z = (uint32_t)worldChunkCoords[2];
+  return (x & ((1u << CHUNK_ORIGIN_X_BITS) - 1)) |
+         (y & ((1u << CHUNK_ORIGIN_Y_BITS) - 1)) << CHUNK_ORIGIN_X_BITS |
+         (z & ((1u << CHUNK_ORIGIN_Z_BITS) - 1))
+             << (CHUNK_ORIGIN_X_BITS + CHUNK_ORIGIN_Y_BITS);
+}
 
-  // get chunk location
-  const float fx = (float)iBlockCoords[0];
-  const float fy = (float)iBlockCoords[1];
-  const float fz = (float)iBlockCoords[2];
+uint32_t wu_facePairBit(BlockFaceKind a, BlockFaceKind b) {
+  if (a > b) {
+    BlockFaceKind tmp = a;
+    a = b;
+    b = tmp;
+  }
+  // pairs are numbered (0, 1), (0, 2) ... (0, 5), (1, 2) ... (4, 5)
+  return a * (11 - a) / 2 + (b - a - 1);
+}
 
-  // calculate vertexes
-  const vec3 v000 = {fx + 0, fy + 0, fz + 0};
-  const vec3 v100 = {fx + 1, fy + 0, fz + 0};
-  const vec3 v001 = {fx + 0, fy + 0, fz + 1};
-  const vec3 v101 = {fx + 1, fy + 0, fz + 1};
-  const vec3 v010 = {fx + 0, fy + 1, fz + 0};
-  const vec3 v110 = {fx + 1, fy + 1, fz + 0};
-  const vec3 v011 = {fx + 0, fy + 1, fz + 1};
-  const vec3 v111 = {fx + 1, fy + 1, fz + 1};
+uint16_t wu_getChunkDataFaceConnections(const ChunkData *pCd) {
+  const uint32_t blockCount = CHUNK_X_SIZE * CHUNK_Y_SIZE * CHUNK_Z_SIZE;
+  // blocks are indexed the way they're laid out in pCd->blocks
+  const BlockIndex *pBlocks = &pCd->blocks[0][0][0];
+  bool *pVisited = calloc(blockCount, sizeof(bool));
+  uint16_t *pStack = malloc(blockCount * sizeof(uint16_t));
+
+  const ivec3 size = {CHUNK_X_SIZE, CHUNK_Y_SIZE, CHUNK_Z_SIZE};
+  const uint32_t strides[3] = {CHUNK_Y_SIZE * CHUNK_Z_SIZE, CHUNK_Z_SIZE, 1};
+  // the faces on the low and high side of each axis
+  const BlockFaceKind lowFaces[3] = {Block_LEFT, Block_UP, Block_BACK};
+  const BlockFaceKind highFaces[3] = {Block_RIGHT, Block_DOWN, Block_FRONT};
+
+  uint16_t connections = 0;
+  for (uint32_t start = 0; start < blockCount; start++) {
+    if (pVisited[start] || !BLOCKS[pBlocks[start]].transparent) {
+      continue;
+    }
 
-  const float xoff = BLOCK_TILE_TEX_XSIZE;
-  const float yoff = BLOCK_TILE_TEX_YSIZE;
+    // flood fill the pocket containing start, noting which faces it touches
+    uint32_t touched = 0;
+    uint32_t stackLen = 0;
+    pVisited[start] = true;
+    pStack[stackLen++] = (uint16_t)start;
+    while (stackLen > 0) {
+      uint32_t i = pStack[--stackLen];
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        int32_t coord = (int32_t)(i / strides[axis]) % size[axis];
+        if (coord == 0) {
+          touched |= 1u << lowFaces[axis];
+        } else if (!pVisited[i - strides[axis]] &&
+                   BLOCKS[pBlocks[i - strides[axis]]].transparent) {
+          pVisited[i - strides[axis]] = true;
+          pStack[stackLen++] = (uint16_t)(i - strides[axis]);
+        }
+        if (coord == size[axis] - 1) {
+          touched |= 1u << highFaces[axis];
+        } else if (!pVisited[i + strides[axis]] &&
+                   BLOCKS[pBlocks[i + strides[axis]]].transparent) {
+          pVisited[i + strides[axis]] = true;
+          pStack[stackLen++] = (uint16_t)(i + strides[axis]);
+        }
+      }
+    }
 
-  // clang-format off
-  switch(face) {
-  case Block_LEFT: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_LEFT;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v000), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-    pVertexes[1] = (Vertex){.position=V3(v010), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-    pVertexes[2] = (Vertex){.position=V3(v001), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-    pVertexes[3] = (Vertex){.position=V3(v001), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-    pVertexes[4] = (Vertex){.position=V3(v010), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v011), .normal={-1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
-    break;
-  }
-  case Block_RIGHT: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_RIGHT;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v100), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+0.0f}};
-    pVertexes[1] = (Vertex){.position=V3(v101), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-    pVertexes[2] = (Vertex){.position=V3(v110), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
-    pVertexes[3] = (Vertex){.position=V3(v101), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+0.0f}};
-    pVertexes[4] = (Vertex){.position=V3(v111), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+0.0f, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v110), .normal={1.0f, 0.0f, 0.0f}, .texCoords= {bx+xoff, by+yoff}};
-    break;
-  }
-  case Block_UP: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_UP;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v001), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[1] = (Vertex){.position=V3(v100), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
-    pVertexes[2] = (Vertex){.position=V3(v000), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[3] = (Vertex){.position=V3(v001), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[4] = (Vertex){.position=V3(v101), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v100), .normal={0.0f, -1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
-    break;
+    for (BlockFaceKind a = 0; a < 6; a++) {
+      for (BlockFaceKind b = a + 1; b < 6; b++) {
+        if ((touched & (1u << a)) && (touched & (1u << b))) {
+          connections |= (uint16_t)(1u << wu_facePairBit(a, b));
+        }
+      }
+    }
   }
-  case Block_DOWN: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_DOWN;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v010), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+0.0f}};
-    pVertexes[1] = (Vertex){.position=V3(v110), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[2] = (Vertex){.position=V3(v011), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
-    pVertexes[3] = (Vertex){.position=V3(v110), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[4] = (Vertex){.position=V3(v111), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v011), .normal={0.0f, 1.0f, 0.0f}, .texCoords={bx+xoff, by+yoff}};
+
+  free(pStack);
+  free(pVisited);
+  return connections;
+}
+
+void wu_getFaceBounds(        //
+    vec3 min,                 //
+    vec3 max,                 //
+    const ivec3 iBlockCoords, //
+    const BlockFaceKind face  //
+) {
+  // the axis the face looks along, and which side of the block it's on
+  uint32_t axis;
+  int32_t side;
+  switch (face) {
+  case Block_LEFT:
+  case Block_RIGHT:
+    axis = 0;
+    side = face == Block_RIGHT;
     break;
-  }
-  case Block_BACK: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_BACK;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v000), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+0.0f}};
-    pVertexes[1] = (Vertex){.position=V3(v100), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[2] = (Vertex){.position=V3(v010), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+yoff}};
-    pVertexes[3] = (Vertex){.position=V3(v100), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[4] = (Vertex){.position=V3(v110), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v010), .normal={0.0f, 0.0f, -1.0f}, .texCoords={bx+xoff, by+yoff}};
+  case Block_UP:
+  case Block_DOWN:
+    axis = 1;
+    side = face == Block_DOWN;
     break;
-  }
-  case Block_FRONT: {
-    const float bx = BLOCK_TILE_TEX_XSIZE*Block_FRONT;
-    const float by = BLOCK_TILE_TEX_YSIZE*bi;
-    pVertexes[0] = (Vertex){.position=V3(v011), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[1] = (Vertex){.position=V3(v101), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+0.0f}};
-    pVertexes[2] = (Vertex){.position=V3(v001), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+0.0f}};
-    pVertexes[3] = (Vertex){.position=V3(v011), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+0.0f, by+yoff}};
-    pVertexes[4] = (Vertex){.position=V3(v111), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+yoff}};
-    pVertexes[5] = (Vertex){.position=V3(v101), .normal={0.0f, 0.0f, 1.0f}, .texCoords={bx+xoff, by+0.0f}};
+  default:
+    axis = 2;
+    side = face == Block_FRONT;
     break;
   }
+  const int32_t block[3] = {iBlockCoords[0], iBlockCoords[1],
+                            iBlockCoords[2]};
+  // start empty, so the face is all that's in it
+  int32_t lo[3] = {block[0] + 1, block[1] + 1, block[2] + 1};
+  int32_t hi[3] = {block[0], block[1], block[2]};
+  wu_growBounds(lo, hi, block, axis, side);
+  for (uint32_t i = 0; i < 3; i++) {
+    min[i] = (float)lo[i];
+    max[i] = (float)hi[i];
   }
-  // clang-format on
 }
 
 void wu_getAdjacentBlock(        //
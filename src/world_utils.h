@@ -32,30 +32,101 @@ void worldChunkCoords_to_blockCoords( //
     const ivec3 worldChunkCoords      //
 );
 
+/// splits global block coordinates into the coordinates of the chunk
+/// containing the block and the block's offset inside that chunk, using
+/// integer math only
+void iBlockCoords_to_worldChunkCoords( //
+    ivec3 worldChunkCoords,            //
+    ivec3 chunkIndex,                  //
+    const ivec3 iBlockCoords           //
+);
+
 bool wu_loadChunkData(ChunkData *pC, const char *filename);
 
-uint32_t wu_countChunkDataVertexes( //
-    const ChunkData *pCd            //
+/// counts the faces wu_getFacesChunkData will write
+/// --- PRECONDITIONS ---
+/// * pCd is valid
+/// * pNeighbours is NULL or is indexed by BlockFaceKind: pNeighbours[face] is
+///   the chunk on the other side of that face (see wu_getAdjacentBlock), or
+///   NULL if it isn't loaded
+/// --- POSTCONDITIONS ---
+/// * faces against an opaque block in a neighbour are culled, faces on the
+///   side of a missing neighbour are kept
+/// * if there are any faces, min and max are set to the smallest box
+///   containing them, relative to the chunk's corner. This way the mesh never
+///   has to be read back after it's written.
+uint32_t wu_countChunkDataFaces(          //
+    vec3 min,                             //
+    vec3 max,                             //
+    const ChunkData *pCd,                 //
+    const ChunkData *const pNeighbours[6] //
 );
 
-uint32_t wu_getVertexesChunkData( //
-    Vertex *pVertexes,            //
-    const vec3 offset,            //
-    const ChunkData *pCd          //
+/// writes the mesh of pCd to pFaces
+/// --- PRECONDITIONS ---
+/// * pFaces has room for wu_countChunkDataFaces(pCd, pNeighbours) faces
+/// * offset is where the chunk's corner is in its mesh region, in blocks. No
+///   coordinate is negative, and a Face has room for it plus the chunk's size
+/// * pNeighbours is as in wu_countChunkDataFaces
+/// --- POSTCONDITIONS ---
+/// * returns the number of faces written
+/// * the faces are placed relative to the region's corner, the region's draw
+///   says where that is (see wu_packChunkOrigin)
+uint32_t wu_getFacesChunkData(            //
+    Face *pFaces,                         //
+    const ivec3 offset,                   //
+    const ChunkData *pCd,                 //
+    const ChunkData *const pNeighbours[6] //
 );
 
-void wu_getVertexesHighlight( //
-    Vertex pVertexes[6],      //
+/// gets the face drawn over the given face of a block to highlight it
+/// --- POSTCONDITIONS ---
+/// * worldChunkCoords is set to the chunk the face is placed relative to
+Face wu_getFaceHighlight(     //
+    ivec3 worldChunkCoords,   //
     const ivec3 iBlockCoords, //
     const BlockFaceKind face  //
 );
 
-void wu_getVertexesHighlight( //
-    Vertex pVertexes[6],      //
+/// gets the smallest box containing the given face of a block
+void wu_getFaceBounds(        //
+    vec3 min,                 //
+    vec3 max,                 //
     const ivec3 iBlockCoords, //
     const BlockFaceKind face  //
 );
 
+// bits of each chunk coordinate kept by wu_packChunkOrigin
+#define CHUNK_ORIGIN_X_BITS 11
+#define CHUNK_ORIGIN_Y_BITS 10
+#define CHUNK_ORIGIN_Z_BITS 11
+
+/// packs a chunk's coordinates into the firstInstance of its draws, which is
+/// how assets/shaders/shader.vert finds where the chunk's faces go
+/// --- POSTCONDITIONS ---
+/// * only the low CHUNK_ORIGIN_*_BITS of each coordinate are kept. The shader
+///   puts the chunk at the coordinates nearest the world's center that match
+///   them, so chunks within half that range of the center are drawn in the
+///   right place.
+uint32_t wu_packChunkOrigin(const ivec3 worldChunkCoords);
+
+/// face connection mask with every pair of faces connected
+#define FACE_CONNECTIONS_ALL 0x7FFF
+
+/// the bit of a face connection mask standing for the pair of faces a and b
+/// --- PRECONDITIONS ---
+/// * a != b
+uint32_t wu_facePairBit(BlockFaceKind a, BlockFaceKind b);
+
+/// works out which pairs of the chunk's faces can see each other through
+/// blocks that aren't opaque, by flood filling the chunk's air pockets
+/// --- PRECONDITIONS ---
+/// * pCd is valid
+/// --- POSTCONDITIONS ---
+/// * bit wu_facePairBit(a, b) of the result is set if some air pocket touches
+///   both face a and face b of the chunk
+uint16_t wu_getChunkDataFaceConnections(const ChunkData *pCd);
+
 void wu_getAdjacentBlock(        //
     ivec3 destiBlockCoords,      //
     const ivec3 srciBlockCoords, //
@@ -24,10 +24,11 @@ void delete_worldgen_state(worldgen_state *state) {
 }
 
 // generate chunk data
-void worldgen_state_gen_chunk(    //
+bool worldgen_state_gen_chunk(    //
     ChunkData *pCd,               //
     const ivec3 worldChunkCoords, //
-    const worldgen_state *state   //
+    const worldgen_state *state,  //
+    const atomic_bool *pCancel    //
 ) {
   // generate chunk, we need to give it the block coordinate to generate at
   vec3 chunkOffset;
@@ -35,6 +36,12 @@ void worldgen_state_gen_chunk(    //
 
   double scale1 = 20.0;
   for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    // a slice is 2 * 32 * 32 noise samples, cheap enough to check once per
+    // slice
+    if (pCancel != NULL &&
+        atomic_load_explicit(pCancel, memory_order_relaxed)) {
+      return false;
+    }
     for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
       for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
         // calculate world coordinates in blocks
@@ -55,4 +62,5 @@ void worldgen_state_gen_chunk(    //
       }
     }
   }
+  return true;
 }
@@ -1,6 +1,8 @@
 #ifndef WORLDGEN_H
 #define WORLDGEN_H
 
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "world_utils.h"
@@ -9,7 +11,10 @@ typedef struct worldgen_state_t worldgen_state;
 
 worldgen_state* new_worldgen_state(uint32_t seed);
 
-void worldgen_state_gen_chunk(ChunkData *pCd, const ivec3 chunkOffset, const worldgen_state* state);
+/// generates the chunk at chunkOffset into pCd
+/// pCancel may be NULL. If it is set while generating, generation stops early,
+/// pCd is left partially written and false is returned.
+bool worldgen_state_gen_chunk(ChunkData *pCd, const ivec3 chunkOffset, const worldgen_state* state, const atomic_bool *pCancel);
 
 void delete_worldgen_state(worldgen_state* state);
 
@@ -0,0 +1,107 @@
+// times a frame of occlusion culling on the CPU: clearing the buffer, drawing
+// the solid bricks of a hilly terrain, building the pyramid, and testing the
+// chunks in range against it, from a camera turning around above the ground.
+// usage: bench_occlusion [frames]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "harness.h"
+#include "occlusion.h"
+
+#define DEFAULT_FRAMES 200u
+// the terrain is this many bricks across on x and z
+#define TERRAIN_BRICKS 24
+#define BRICK 8.0f
+#define CHUNK 32.0f
+
+int main(int argc, char **argv) {
+  uint32_t frames = DEFAULT_FRAMES;
+  if (argc > 1) {
+    frames = (uint32_t)strtoul(argv[1], NULL, 10);
+  }
+
+  // columns of bricks, up to 3 high
+  uint32_t seed = 38;
+  vec3 *pBrickMins = malloc(TERRAIN_BRICKS * TERRAIN_BRICKS * 3 * sizeof(vec3));
+  uint32_t brickCount = 0;
+  for (int32_t x = 0; x < TERRAIN_BRICKS; x++) {
+    for (int32_t z = 0; z < TERRAIN_BRICKS; z++) {
+      uint32_t height = 1 + tst_random(&seed) % 3;
+      for (uint32_t y = 0; y < height; y++) {
+        pBrickMins[brickCount][0] = (float)(x - TERRAIN_BRICKS / 2) * BRICK;
+        pBrickMins[brickCount][1] = ((float)y - 3) * BRICK;
+        pBrickMins[brickCount][2] = (float)(z - TERRAIN_BRICKS / 2) * BRICK;
+        brickCount++;
+      }
+    }
+  }
+
+  // chunks around the camera, as in the world's draw list
+  const int32_t radius = TST_LOADED_RADIUS;
+  const uint32_t chunkCount = (uint32_t)((2 * radius + 1) * (2 * radius + 1) *
+                                         (2 * radius + 1));
+  vec3 *pChunkMins = malloc(chunkCount * sizeof(vec3));
+  uint32_t chunk = 0;
+  for (int32_t x = -radius; x <= radius; x++) {
+    for (int32_t y = -radius; y <= radius; y++) {
+      for (int32_t z = -radius; z <= radius; z++) {
+        pChunkMins[chunk][0] = (float)x * CHUNK;
+        pChunkMins[chunk][1] = (float)y * CHUNK;
+        pChunkMins[chunk][2] = (float)z * CHUNK;
+        chunk++;
+      }
+    }
+  }
+
+  OcclusionBuffer occlusion;
+  new_OcclusionBuffer(&occlusion);
+  double drawSeconds = 0;
+  double pyramidSeconds = 0;
+  double testSeconds = 0;
+  uint64_t culled = 0;
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    float yaw = (float)frame * 0.01f;
+    vec3 eye = {0, 2, 0};
+    vec3 center = {cosf(yaw), 1.8f, sinf(yaw)};
+    mat4x4 proj;
+    mat4x4 view;
+    mat4x4 mvp;
+    mat4x4_perspective(proj, 1.2f, 16.0f / 9.0f, 0.1f, 500.0f);
+    mat4x4_look_at(view, eye, center, (vec3){0, 1, 0});
+    mat4x4_mul(mvp, proj, view);
+
+    double start = tst_seconds();
+    occ_clear(&occlusion, mvp);
+    for (uint32_t i = 0; i < brickCount; i++) {
+      vec3 max = {pBrickMins[i][0] + BRICK, pBrickMins[i][1] + BRICK,
+                  pBrickMins[i][2] + BRICK};
+      occ_drawBox(&occlusion, pBrickMins[i], max);
+    }
+    double drawn = tst_seconds();
+    occ_buildPyramid(&occlusion);
+    double built = tst_seconds();
+    for (uint32_t i = 0; i < chunkCount; i++) {
+      vec3 max = {pChunkMins[i][0] + CHUNK, pChunkMins[i][1] + CHUNK,
+                  pChunkMins[i][2] + CHUNK};
+      culled += !occ_testBox(&occlusion, pChunkMins[i], max);
+    }
+    double tested = tst_seconds();
+    drawSeconds += drawn - start;
+    pyramidSeconds += built - drawn;
+    testSeconds += tested - built;
+  }
+
+  printf("bench_occlusion: %u frames, %u occluders, %u boxes tested\n", frames,
+         brickCount, chunkCount);
+  printf("  draw    %.1f us/frame\n", drawSeconds * 1e6 / frames);
+  printf("  pyramid %.1f us/frame\n", pyramidSeconds * 1e6 / frames);
+  printf("  test    %.1f us/frame, %.1f%% culled\n", testSeconds * 1e6 / frames,
+         100.0 * (double)culled / ((double)frames * chunkCount));
+
+  delete_OcclusionBuffer(&occlusion);
+  free(pBrickMins);
+  free(pChunkMins);
+  return 0;
+}
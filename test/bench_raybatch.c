@@ -0,0 +1,111 @@
+// times wld_trace_to_solid_batch against tracing the same rays one at a time,
+// on a world with the given number of worker threads. The rays are cast from
+// a few viewpoints in fans, the way picking or visibility rays would be.
+// usage: bench_raybatch [threads] [rays]
+// threads defaults to 0, one per online CPU
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "harness.h"
+
+#define DEFAULT_RAYS 1000000u
+// rays cast from each viewpoint
+#define RAYS_PER_VIEW 4096u
+#define MAX_DIST 100u
+
+int main(int argc, char **argv) {
+  uint32_t threads = 0;
+  uint32_t rayCount = DEFAULT_RAYS;
+  if (argc > 1) {
+    threads = (uint32_t)strtoul(argv[1], NULL, 10);
+  }
+  if (argc > 2) {
+    rayCount = (uint32_t)strtoul(argv[2], NULL, 10);
+  }
+  if (threads > MAX_THREADS) {
+    printf("bench_raybatch: at most %u threads\n", MAX_THREADS);
+    return 1;
+  }
+
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("bench_raybatch: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, threads, &headless);
+
+  vec3 *pOrigins = malloc(rayCount * sizeof(vec3));
+  vec3 *pDirections = malloc(rayCount * sizeof(vec3));
+  uint32_t *pMaxDists = malloc(rayCount * sizeof(uint32_t));
+  bool *pHits = malloc(rayCount * sizeof(bool));
+  ivec3 *pBlocks = malloc(rayCount * sizeof(ivec3));
+  BlockFaceKind *pFaces = malloc(rayCount * sizeof(BlockFaceKind));
+  uint32_t seed = 35;
+  vec3 view = {0};
+  vec3 forward = {0};
+  for (uint32_t i = 0; i < rayCount; i++) {
+    if (i % RAYS_PER_VIEW == 0) {
+      // somewhere in the air, or a cave
+      BlockIndex block;
+      do {
+        view[0] = tst_randomFloat(&seed, -60, 60);
+        view[1] = tst_randomFloat(&seed, -20, 40);
+        view[2] = tst_randomFloat(&seed, -60, 60);
+        ivec3 iView = {(int32_t)floorf(view[0]), (int32_t)floorf(view[1]),
+                       (int32_t)floorf(view[2])};
+        wld_get_block_at(&block, &ws, iView);
+      } while (!BLOCKS[block].transparent);
+      float yaw = tst_randomFloat(&seed, 0, 6.2831853f);
+      forward[0] = cosf(yaw);
+      forward[1] = tst_randomFloat(&seed, -0.5f, 0.5f);
+      forward[2] = sinf(yaw);
+    }
+    // a fan about a radian wide around the view direction
+    vec3_dup(pOrigins[i], view);
+    pDirections[i][0] = forward[0] + tst_randomFloat(&seed, -0.5f, 0.5f);
+    pDirections[i][1] = forward[1] + tst_randomFloat(&seed, -0.5f, 0.5f);
+    pDirections[i][2] = forward[2] + tst_randomFloat(&seed, -0.5f, 0.5f);
+    pMaxDists[i] = MAX_DIST;
+  }
+
+  double start = tst_seconds();
+  uint32_t batchHits = wld_trace_to_solid_batch(
+      pHits, pBlocks, pFaces, pOrigins, pDirections, pMaxDists, rayCount, &ws);
+  double batchSeconds = tst_seconds() - start;
+
+  uint32_t singleHits = 0;
+  start = tst_seconds();
+  for (uint32_t i = 0; i < rayCount; i++) {
+    singleHits += wld_trace_to_solid(pBlocks[i], &pFaces[i], pOrigins[i],
+                                     pDirections[i], pMaxDists[i], &ws);
+  }
+  double singleSeconds = tst_seconds() - start;
+
+  printf("bench_raybatch: %u rays, %u hits, %u worker threads "
+         "(0 for one per CPU)\n",
+         rayCount, batchHits, threads);
+  printf("  batch  %.0f rays/s\n", rayCount / batchSeconds);
+  printf("  single %.0f rays/s\n", rayCount / singleSeconds);
+  int result = 0;
+  if (batchHits != singleHits) {
+    printf("  the batch hit %u rays, one at a time %u\n", batchHits,
+           singleHits);
+    result = 1;
+  }
+
+  free(pOrigins);
+  free(pDirections);
+  free(pMaxDists);
+  free(pHits);
+  free(pBlocks);
+  free(pFaces);
+  vkDeviceWaitIdle(headless.device);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  return result;
+}
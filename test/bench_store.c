@@ -0,0 +1,145 @@
+// times block lookups through the world's clipmap store against the same
+// lookups through a hashmap of chunks, the way the world used to store them.
+// usage: bench_store [lookups]
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <hashmap.h>
+
+#include "harness.h"
+
+#define DEFAULT_LOOKUPS 10000000u
+
+typedef struct {
+  ivec3 chunkCoord;
+  ChunkData *pData;
+} ChunkDataEntry;
+
+static int ChunkDataEntry_compare(const void *a, const void *b,
+                                  UNUSED void *udata) {
+  const ChunkDataEntry *pa = a;
+  const ChunkDataEntry *pb = b;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (pa->chunkCoord[axis] != pb->chunkCoord[axis]) {
+      return pa->chunkCoord[axis] < pb->chunkCoord[axis] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+static uint64_t ChunkDataEntry_hash(const void *item, uint64_t seed0,
+                                    uint64_t seed1) {
+  const ChunkDataEntry *pEntry = item;
+  return hashmap_sip(pEntry->chunkCoord, sizeof(ivec3), seed0, seed1);
+}
+
+static bool ChunkDataEntry_free(const void *item, UNUSED void *udata) {
+  const ChunkDataEntry *pEntry = item;
+  free(pEntry->pData);
+  return true;
+}
+
+// looks a block up the way wld_get_block_at did with the hashmap
+static bool hashmapGetBlock(BlockIndex *pBlock, struct hashmap *pMap,
+                            const ivec3 iBlockCoords) {
+  ChunkDataEntry key;
+  ivec3 chunkIndex;
+  iBlockCoords_to_worldChunkCoords(key.chunkCoord, chunkIndex, iBlockCoords);
+  ChunkDataEntry *pEntry = hashmap_get(pMap, &key);
+  if (pEntry == NULL) {
+    return false;
+  }
+  *pBlock = pEntry->pData->blocks[chunkIndex[0]][chunkIndex[1]][chunkIndex[2]];
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t lookups = DEFAULT_LOOKUPS;
+  if (argc > 1) {
+    lookups = (uint32_t)strtoul(argv[1], NULL, 10);
+  }
+
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("bench_store: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  // copy every loaded chunk into a hashmap of its own
+  struct hashmap *pMap =
+      hashmap_new(sizeof(ChunkDataEntry), 0, 0, 0, ChunkDataEntry_hash,
+                  ChunkDataEntry_compare, NULL, NULL);
+  for (int32_t x = -TST_LOADED_RADIUS; x <= TST_LOADED_RADIUS; x++) {
+    for (int32_t y = -TST_LOADED_RADIUS; y <= TST_LOADED_RADIUS; y++) {
+      for (int32_t z = -TST_LOADED_RADIUS; z <= TST_LOADED_RADIUS; z++) {
+        ChunkDataEntry entry = {.chunkCoord = {x, y, z},
+                                .pData = malloc(sizeof(ChunkData))};
+        ivec3 min, max;
+        worldChunkCoords_to_iBlockCoords(min, entry.chunkCoord);
+        ivec3_add(
+            max, min,
+            (ivec3){CHUNK_X_SIZE - 1, CHUNK_Y_SIZE - 1, CHUNK_Z_SIZE - 1});
+        wld_copy_region(&entry.pData->blocks[0][0][0], NULL, &ws, min, max);
+        hashmap_set(pMap, &entry);
+      }
+    }
+  }
+
+  // random blocks in range, some of them a little out of it
+  const int32_t extent = (TST_LOADED_RADIUS + 1) * CHUNK_X_SIZE + 16;
+  ivec3 *pCoords = malloc(lookups * sizeof(ivec3));
+  uint32_t seed = 30;
+  for (uint32_t i = 0; i < lookups; i++) {
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      pCoords[i][axis] =
+          (int32_t)(tst_random(&seed) % (uint32_t)(2 * extent)) - extent;
+    }
+  }
+
+  uint64_t clipmapSum = 0;
+  uint32_t clipmapFound = 0;
+  double start = tst_seconds();
+  for (uint32_t i = 0; i < lookups; i++) {
+    BlockIndex block;
+    if (wld_get_block_at(&block, &ws, pCoords[i])) {
+      clipmapSum += block;
+      clipmapFound++;
+    }
+  }
+  double clipmapSeconds = tst_seconds() - start;
+
+  uint64_t hashmapSum = 0;
+  uint32_t hashmapFound = 0;
+  start = tst_seconds();
+  for (uint32_t i = 0; i < lookups; i++) {
+    BlockIndex block;
+    if (hashmapGetBlock(&block, pMap, pCoords[i])) {
+      hashmapSum += block;
+      hashmapFound++;
+    }
+  }
+  double hashmapSeconds = tst_seconds() - start;
+
+  printf("bench_store: %u lookups, %u in loaded chunks\n", lookups,
+         clipmapFound);
+  printf("  clipmap %.2f ns/lookup\n", clipmapSeconds * 1e9 / lookups);
+  printf("  hashmap %.2f ns/lookup\n", hashmapSeconds * 1e9 / lookups);
+  int result = 0;
+  if (clipmapSum != hashmapSum || clipmapFound != hashmapFound) {
+    printf("  the stores disagree\n");
+    result = 1;
+  }
+
+  free(pCoords);
+  hashmap_scan(pMap, ChunkDataEntry_free, NULL);
+  hashmap_free(pMap);
+  vkDeviceWaitIdle(headless.device);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  return result;
+}
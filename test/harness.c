@@ -0,0 +1,144 @@
+#include "harness.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+ErrVal new_HeadlessDevice(    //
+    HeadlessDevice *pHeadless //
+) {
+  // no window, so no surface or swapchain extensions
+  new_Instance(&pHeadless->instance, 0, NULL, 0, NULL, false, false,
+               "headless test");
+
+  ErrVal deviceResult =
+      getPhysicalDevice(&pHeadless->physicalDevice, pHeadless->instance);
+  if (deviceResult != ERR_OK) {
+    delete_Instance(&pHeadless->instance);
+    return (ERR_NOTSUPPORTED);
+  }
+
+  // same queues as the game, see new_AppGraphicsGlobalState in src/main.c
+  uint32_t graphicsQueueCount;
+  ErrVal queueResult = getQueueFamilyIndexByCapability(
+      &pHeadless->graphicsIndex, &graphicsQueueCount,
+      pHeadless->physicalDevice, VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+  if (queueResult != ERR_OK) {
+    delete_Instance(&pHeadless->instance);
+    return (ERR_NOTSUPPORTED);
+  }
+  // the staging ring can upload from a transfer queue as well
+  if (getTransferQueueFamilyIndex(&pHeadless->transferIndex,
+                                  pHeadless->physicalDevice) != ERR_OK) {
+    pHeadless->transferIndex = pHeadless->graphicsIndex;
+  }
+
+  ErrVal createResult =
+      new_Device(&pHeadless->device, pHeadless->physicalDevice,
+                 pHeadless->graphicsIndex, graphicsQueueCount,
+                 pHeadless->transferIndex, 0, NULL);
+  if (createResult != ERR_OK) {
+    delete_Instance(&pHeadless->instance);
+    return (ERR_NOTSUPPORTED);
+  }
+
+  getQueue(&pHeadless->graphicsQueue, pHeadless->device,
+           pHeadless->graphicsIndex, 0);
+  getQueue(&pHeadless->transferQueue, pHeadless->device,
+           pHeadless->transferIndex, 0);
+  new_CommandPool(&pHeadless->commandPool, pHeadless->device,
+                  pHeadless->graphicsIndex);
+  return (ERR_OK);
+}
+
+void delete_HeadlessDevice(   //
+    HeadlessDevice *pHeadless //
+) {
+  delete_CommandPool(&pHeadless->commandPool, pHeadless->device);
+  delete_Device(&pHeadless->device);
+  delete_Instance(&pHeadless->instance);
+}
+
+void tst_waitSemaphore(              //
+    const HeadlessDevice *pHeadless, //
+    const VkSemaphore semaphore      //
+) {
+  if (semaphore != VK_NULL_HANDLE) {
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &semaphore;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    VkResult submitResult = vkQueueSubmit(pHeadless->graphicsQueue, 1,
+                                          &submitInfo, VK_NULL_HANDLE);
+    if (submitResult != VK_SUCCESS) {
+      LOG_ERROR_ARGS(ERR_LEVEL_FATAL, "failed to wait on semaphore: %s",
+                     vkstrerror(submitResult));
+      PANIC();
+    }
+  }
+  vkDeviceWaitIdle(pHeadless->device);
+}
+
+void tst_tickWorld(                 //
+    WorldState *pWorldState,        //
+    const HeadlessDevice *pHeadless //
+) {
+  wld_update(pWorldState);
+  tst_waitSemaphore(pHeadless, wld_flushUploads(pWorldState));
+  // no draw lists are handed out, so nothing else can be using the garbage
+  wld_clearGarbage(pWorldState, UINT64_MAX);
+}
+
+// whether every chunk in range of the origin is generated
+static bool tst_worldLoaded(WorldState *pWorldState) {
+  for (int32_t x = -TST_LOADED_RADIUS; x <= TST_LOADED_RADIUS; x++) {
+    for (int32_t y = -TST_LOADED_RADIUS; y <= TST_LOADED_RADIUS; y++) {
+      for (int32_t z = -TST_LOADED_RADIUS; z <= TST_LOADED_RADIUS; z++) {
+        BlockIndex block;
+        ivec3 iBlockCoords = {x * CHUNK_X_SIZE, y * CHUNK_Y_SIZE,
+                              z * CHUNK_Z_SIZE};
+        if (!wld_get_block_at(&block, pWorldState, iBlockCoords)) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+void tst_new_LoadedWorld(           //
+    WorldState *pWorldState,        //
+    worldgen_state *pWorldgen,      //
+    const uint32_t workerThreads,   //
+    const HeadlessDevice *pHeadless //
+) {
+  wld_new_WorldState(pWorldState, (ivec3){0, 0, 0}, pWorldgen, workerThreads,
+                     pHeadless->graphicsQueue, pHeadless->graphicsIndex,
+                     pHeadless->device, pHeadless->physicalDevice);
+  while (!tst_worldLoaded(pWorldState)) {
+    tst_tickWorld(pWorldState, pHeadless);
+    struct timespec wait = {.tv_sec = 0, .tv_nsec = 1000000};
+    nanosleep(&wait, NULL);
+  }
+}
+
+uint32_t tst_random(uint32_t *pState) {
+  uint32_t x = *pState;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *pState = x;
+  return x;
+}
+
+float tst_randomFloat(uint32_t *pState, const float min, const float max) {
+  return min + (max - min) * (float)(tst_random(pState) >> 8) /
+                   (float)(1u << 24);
+}
+
+double tst_seconds(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
@@ -0,0 +1,92 @@
+#ifndef TEST_HARNESS_H_
+#define TEST_HARNESS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "vulkan_utils.h"
+#include "world.h"
+#include "worldgen.h"
+
+// RENDER_RADIUS_* in src/world.c, how far from the center chunks are loaded
+#define TST_LOADED_RADIUS 3
+
+/// HeadlessDevice
+/// ---------------------
+/// A logical device without a window or surface, for tests that need to run
+/// things on the GPU. A software device like lavapipe is enough.
+typedef struct {
+  VkInstance instance;
+  VkPhysicalDevice physicalDevice;
+  VkDevice device;
+  // the family the game draws, culls and uploads from, and one with a
+  // dedicated transfer queue if there is one, otherwise the same
+  uint32_t graphicsIndex;
+  uint32_t transferIndex;
+  VkQueue graphicsQueue;
+  VkQueue transferQueue;
+  // for one time command buffers on the graphics queue
+  VkCommandPool commandPool;
+} HeadlessDevice;
+
+/// --- PRECONDITIONS ---
+/// * pHeadless is a valid pointer
+/// --- POSTCONDITIONS ---
+/// * returns ERR_NOTSUPPORTED if there is no Vulkan device to run on
+/// * on success, *pHeadless is a valid HeadlessDevice
+/// --- CLEANUP ---
+/// * call delete_HeadlessDevice
+ErrVal new_HeadlessDevice(    //
+    HeadlessDevice *pHeadless //
+);
+
+/// --- PRECONDITIONS ---
+/// * pHeadless is valid, and nothing created from its device is left
+/// --- POSTCONDITIONS ---
+/// * all resources held by pHeadless are released
+void delete_HeadlessDevice(   //
+    HeadlessDevice *pHeadless //
+);
+
+/// makes the graphics queue wait on semaphore, like a frame's submission
+/// would, then waits for the device to go idle
+/// --- PRECONDITIONS ---
+/// * semaphore is VK_NULL_HANDLE or has a pending signal
+/// --- POSTCONDITIONS ---
+/// * the device is idle, and semaphore is unsignaled
+void tst_waitSemaphore(              //
+    const HeadlessDevice *pHeadless, //
+    const VkSemaphore semaphore      //
+);
+
+/// creates a world around the origin and runs it until every chunk in range
+/// is generated
+/// --- PRECONDITIONS ---
+/// * pHeadless is valid
+/// * workerThreads is as for wld_new_WorldState
+/// --- CLEANUP ---
+/// * call wld_delete_WorldState once the device is idle
+void tst_new_LoadedWorld(           //
+    WorldState *pWorldState,        //
+    worldgen_state *pWorldgen,      //
+    const uint32_t workerThreads,   //
+    const HeadlessDevice *pHeadless //
+);
+
+/// runs one frame of the world: updates it, submits its uploads and waits
+/// for them, and frees its garbage
+void tst_tickWorld(                 //
+    WorldState *pWorldState,        //
+    const HeadlessDevice *pHeadless //
+);
+
+/// the next number from a xorshift generator, *pState must not be 0
+uint32_t tst_random(uint32_t *pState);
+
+/// a random float in [min, max)
+float tst_randomFloat(uint32_t *pState, const float min, const float max);
+
+/// seconds on a monotonic clock
+double tst_seconds(void);
+
+#endif // TEST_HARNESS_H_
@@ -0,0 +1,207 @@
+// checks the buddy allocator against a bitmap of which units are in use.
+// Random sequences of allocations and frees must hand out aligned runs that
+// don't overlap, keep freeUnits and bud_largestFree right, and merge all the
+// way back to one run once everything is freed. Runs without a device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "buddy.h"
+#include "harness.h"
+
+#define MAX_ORDER 10u
+#define UNIT_COUNT (1u << MAX_ORDER)
+#define ROUNDS 20u
+#define STEPS_PER_ROUND 5000u
+// the longest run the random allocations ask for
+#define MAX_ALLOC 100u
+
+typedef struct {
+  uint32_t unit;
+  uint32_t length;
+} Run;
+
+static uint32_t roundUp(const uint32_t unitCount) {
+  uint32_t length = 1;
+  while (length < unitCount) {
+    length *= 2;
+  }
+  return length;
+}
+
+static bool runFree(const bool *pUsed, const uint32_t unit,
+                    const uint32_t length) {
+  for (uint32_t i = unit; i < unit + length; i++) {
+    if (pUsed[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the longest aligned run with nothing in use. Since freed runs always merge
+// with their other half, that's the longest run the allocator has.
+static uint32_t refLargestFree(const bool *pUsed) {
+  for (uint32_t length = UNIT_COUNT; length > 0; length /= 2) {
+    for (uint32_t unit = 0; unit < UNIT_COUNT; unit += length) {
+      if (runFree(pUsed, unit, length)) {
+        return length;
+      }
+    }
+  }
+  return 0;
+}
+
+static uint32_t refFreeUnits(const bool *pUsed) {
+  uint32_t count = 0;
+  for (uint32_t i = 0; i < UNIT_COUNT; i++) {
+    count += pUsed[i] ? 0 : 1;
+  }
+  return count;
+}
+
+static uint32_t expectCounts(const BuddyAllocator *pBuddy, const bool *pUsed,
+                             const char *step) {
+  uint32_t failures = 0;
+  if (pBuddy->freeUnits != refFreeUnits(pUsed)) {
+    printf("  after %s: %u free units, expected %u\n", step, pBuddy->freeUnits,
+           refFreeUnits(pUsed));
+    failures++;
+  }
+  if (bud_largestFree(pBuddy) != refLargestFree(pUsed)) {
+    printf("  after %s: largest free run %u, expected %u\n", step,
+           bud_largestFree(pBuddy), refLargestFree(pUsed));
+    failures++;
+  }
+  return failures;
+}
+
+// allocates unitCount units, which must succeed exactly when an aligned run
+// long enough is free, and marks them in use
+static uint32_t allocChecked(BuddyAllocator *pBuddy, bool *pUsed, Run *pRuns,
+                             uint32_t *pRunCount, const uint32_t unitCount) {
+  uint32_t length = roundUp(unitCount);
+  bool fits = length <= refLargestFree(pUsed);
+  uint32_t unit = UINT32_MAX;
+  bool result = bud_alloc(&unit, pBuddy, unitCount);
+  if (result != fits) {
+    printf("  allocating %u units %s, expected it to %s\n", unitCount,
+           result ? "succeeded" : "failed", fits ? "succeed" : "fail");
+    return 1;
+  }
+  if (!result) {
+    return 0;
+  }
+  if (unit % length != 0 || unit + length > UNIT_COUNT ||
+      !runFree(pUsed, unit, length)) {
+    printf("  allocating %u units gave unit %u, which isn't free\n", unitCount,
+           unit);
+    return 1;
+  }
+  memset(pUsed + unit, true, length);
+  pRuns[(*pRunCount)++] = (Run){unit, length};
+  return 0;
+}
+
+static void freeRun(BuddyAllocator *pBuddy, bool *pUsed, Run *pRuns,
+                    uint32_t *pRunCount, const uint32_t index) {
+  bud_free(pBuddy, pRuns[index].unit);
+  memset(pUsed + pRuns[index].unit, false, pRuns[index].length);
+  pRuns[index] = pRuns[--(*pRunCount)];
+}
+
+// single units fill the range exactly, then freeing every other one leaves
+// nothing longer than one unit free
+static uint32_t checkSingleUnits(bool *pUsed, Run *pRuns) {
+  BuddyAllocator buddy;
+  new_BuddyAllocator(&buddy, MAX_ORDER);
+  memset(pUsed, false, UNIT_COUNT);
+  uint32_t runCount = 0;
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i <= UNIT_COUNT; i++) {
+    failures += allocChecked(&buddy, pUsed, pRuns, &runCount, 1);
+  }
+  failures += expectCounts(&buddy, pUsed, "filling with single units");
+
+  for (uint32_t i = 0; i < runCount;) {
+    if (pRuns[i].unit % 2 == 0) {
+      freeRun(&buddy, pUsed, pRuns, &runCount, i);
+    } else {
+      i++;
+    }
+  }
+  failures += expectCounts(&buddy, pUsed, "freeing the even units");
+  failures += allocChecked(&buddy, pUsed, pRuns, &runCount, 2);
+
+  while (runCount > 0) {
+    freeRun(&buddy, pUsed, pRuns, &runCount, runCount - 1);
+  }
+  failures += expectCounts(&buddy, pUsed, "freeing the single units");
+  delete_BuddyAllocator(&buddy);
+  return failures;
+}
+
+// random allocations and frees, leaning towards allocating early in each
+// round and towards freeing late, so the range fills up and empties again.
+// After each round everything is freed, which must merge back into one run.
+static uint32_t checkRandom(bool *pUsed, Run *pRuns) {
+  BuddyAllocator buddy;
+  new_BuddyAllocator(&buddy, MAX_ORDER);
+  memset(pUsed, false, UNIT_COUNT);
+  uint32_t runCount = 0;
+  uint32_t seed = 39;
+  uint32_t failures = 0;
+  uint32_t refused = 0;
+  for (uint32_t round = 0; round < ROUNDS && failures == 0; round++) {
+    for (uint32_t step = 0; step < STEPS_PER_ROUND && failures == 0; step++) {
+      uint32_t allocChance = step < STEPS_PER_ROUND / 2 ? 70 : 30;
+      if (runCount == 0 || tst_random(&seed) % 100 < allocChance) {
+        // mostly small runs, like most chunk meshes
+        uint32_t unitCount = tst_random(&seed) % 4 == 0
+                                 ? 1 + tst_random(&seed) % MAX_ALLOC
+                                 : 1 + tst_random(&seed) % 8;
+        bool fits = roundUp(unitCount) <= refLargestFree(pUsed);
+        refused += fits ? 0 : 1;
+        failures +=
+            allocChecked(&buddy, pUsed, pRuns, &runCount, unitCount);
+      } else {
+        freeRun(&buddy, pUsed, pRuns, &runCount,
+                tst_random(&seed) % runCount);
+      }
+      failures += expectCounts(&buddy, pUsed, "a random step");
+    }
+
+    while (runCount > 0) {
+      freeRun(&buddy, pUsed, pRuns, &runCount, tst_random(&seed) % runCount);
+    }
+    failures += expectCounts(&buddy, pUsed, "freeing everything");
+    uint32_t unit = UINT32_MAX;
+    if (!bud_alloc(&unit, &buddy, UNIT_COUNT) || unit != 0) {
+      printf("  round %u: the whole range can't be allocated once freed\n",
+             round);
+      failures++;
+    } else {
+      bud_free(&buddy, unit);
+    }
+  }
+  // a run that never fills the range doesn't test running out
+  if (refused == 0) {
+    printf("  no allocation was refused\n");
+    failures++;
+  }
+  delete_BuddyAllocator(&buddy);
+  return failures;
+}
+
+int main(void) {
+  bool *pUsed = malloc(UNIT_COUNT * sizeof(bool));
+  Run *pRuns = malloc(UNIT_COUNT * sizeof(Run));
+  uint32_t failures = checkSingleUnits(pUsed, pRuns);
+  failures += checkRandom(pUsed, pRuns);
+  free(pRuns);
+  free(pUsed);
+
+  printf("test_buddy: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
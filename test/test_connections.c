@@ -0,0 +1,254 @@
+// checks which faces of a chunk wu_getChunkDataFaceConnections says are
+// connected through air, on hand built chunks whose answer is known and on
+// random ones checked against a flood fill from each face. Runs without a
+// device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "world_utils.h"
+
+#define AIR 0
+#define STONE 2
+#define RANDOM_CHUNKS 40u
+// blocks in each tunnel carved through the random chunks
+#define TUNNEL_LENGTH 400u
+
+static const char *faceNames[6] = {"down", "up", "left", "right", "back",
+                                   "front"};
+
+static uint16_t pairMask(const BlockFaceKind a, const BlockFaceKind b) {
+  return (uint16_t)(1u << wu_facePairBit(a, b));
+}
+
+static void fill(ChunkData *pCd, const BlockIndex block) {
+  for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+      for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+        pCd->blocks[x][y][z] = block;
+      }
+    }
+  }
+}
+
+static uint32_t expectConnections(const ChunkData *pCd, const char *name,
+                                  const uint16_t expected) {
+  uint16_t connections = wu_getChunkDataFaceConnections(pCd);
+  if (connections == expected) {
+    return 0;
+  }
+  printf("  %s: got %04x, expected %04x\n", name, connections, expected);
+  return 1;
+}
+
+// every pair of faces has its own bit, whichever order they're given in
+static uint32_t checkPairBits(void) {
+  uint32_t failures = 0;
+  uint16_t seen = 0;
+  for (BlockFaceKind a = 0; a < 6; a++) {
+    for (BlockFaceKind b = a + 1; b < 6; b++) {
+      uint32_t bit = wu_facePairBit(a, b);
+      if (bit >= 15 || (seen & (1u << bit)) || bit != wu_facePairBit(b, a)) {
+        printf("  pair %s %s has bit %u\n", faceNames[a], faceNames[b], bit);
+        failures++;
+      }
+      seen |= (uint16_t)(1u << bit);
+    }
+  }
+  if (seen != FACE_CONNECTIONS_ALL) {
+    printf("  pair bits cover %04x\n", seen);
+    failures++;
+  }
+  return failures;
+}
+
+static uint32_t checkHandBuilt(ChunkData *pCd) {
+  uint32_t failures = 0;
+
+  fill(pCd, AIR);
+  failures += expectConnections(pCd, "all air", FACE_CONNECTIONS_ALL);
+
+  fill(pCd, STONE);
+  failures += expectConnections(pCd, "all stone", 0);
+
+  // a single hole in the middle touches nothing
+  pCd->blocks[10][10][10] = AIR;
+  failures += expectConnections(pCd, "enclosed hole", 0);
+
+  // a straight tunnel through x
+  fill(pCd, STONE);
+  for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    pCd->blocks[x][5][5] = AIR;
+  }
+  failures += expectConnections(pCd, "tunnel along x",
+                                pairMask(Block_LEFT, Block_RIGHT));
+
+  // and a second one through z that doesn't meet it
+  for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+    pCd->blocks[20][20][z] = AIR;
+  }
+  failures += expectConnections(pCd, "two tunnels",
+                                pairMask(Block_LEFT, Block_RIGHT) |
+                                    pairMask(Block_BACK, Block_FRONT));
+
+  // joining them connects all four faces
+  for (uint32_t y = 5; y <= 20; y++) {
+    pCd->blocks[20][y][5] = AIR;
+  }
+  failures += expectConnections(
+      pCd, "joined tunnels",
+      pairMask(Block_LEFT, Block_RIGHT) | pairMask(Block_LEFT, Block_BACK) |
+          pairMask(Block_LEFT, Block_FRONT) |
+          pairMask(Block_RIGHT, Block_BACK) |
+          pairMask(Block_RIGHT, Block_FRONT) |
+          pairMask(Block_BACK, Block_FRONT));
+
+  // a bend from the low x face to the low y face, which is up
+  fill(pCd, STONE);
+  for (uint32_t x = 0; x <= 7; x++) {
+    pCd->blocks[x][7][3] = AIR;
+  }
+  for (uint32_t y = 0; y <= 7; y++) {
+    pCd->blocks[7][y][3] = AIR;
+  }
+  failures += expectConnections(pCd, "bend", pairMask(Block_LEFT, Block_UP));
+
+  // a pocket in the corner touches three faces
+  fill(pCd, STONE);
+  pCd->blocks[CHUNK_X_SIZE - 1][CHUNK_Y_SIZE - 1][0] = AIR;
+  failures += expectConnections(pCd, "corner",
+                                pairMask(Block_RIGHT, Block_DOWN) |
+                                    pairMask(Block_RIGHT, Block_BACK) |
+                                    pairMask(Block_DOWN, Block_BACK));
+
+  // blocks touching only diagonally aren't connected, so this joins just the
+  // two faces at each end
+  fill(pCd, STONE);
+  for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    pCd->blocks[x][x][9] = AIR;
+  }
+  failures += expectConnections(pCd, "diagonal",
+                                pairMask(Block_LEFT, Block_UP) |
+                                    pairMask(Block_RIGHT, Block_DOWN));
+
+  // a wall across the middle of air splits off the left and right faces
+  fill(pCd, AIR);
+  for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+    for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+      pCd->blocks[CHUNK_X_SIZE / 2][y][z] = STONE;
+    }
+  }
+  failures += expectConnections(pCd, "wall",
+                                (uint16_t)(FACE_CONNECTIONS_ALL &
+                                           ~pairMask(Block_LEFT, Block_RIGHT)));
+
+  // a hole in the wall joins them again
+  pCd->blocks[CHUNK_X_SIZE / 2][3][30] = AIR;
+  failures += expectConnections(pCd, "holed wall", FACE_CONNECTIONS_ALL);
+  return failures;
+}
+
+// true if face b can be reached from face a through air. A flood fill from
+// every air block on face a.
+static bool refConnected(const ChunkData *pCd, const BlockFaceKind a,
+                         const BlockFaceKind b, bool *pVisited,
+                         ivec3 *pStack) {
+  const int32_t size[3] = {CHUNK_X_SIZE, CHUNK_Y_SIZE, CHUNK_Z_SIZE};
+  // the axis each face is on, and whether it's on the high side
+  const uint32_t faceAxis[6] = {1, 1, 0, 0, 2, 2};
+  const bool faceHigh[6] = {true, false, false, true, false, true};
+
+  memset(pVisited, 0, CHUNK_X_SIZE * CHUNK_Y_SIZE * CHUNK_Z_SIZE);
+  uint32_t stackLen = 0;
+  for (int32_t x = 0; x < size[0]; x++) {
+    for (int32_t y = 0; y < size[1]; y++) {
+      for (int32_t z = 0; z < size[2]; z++) {
+        ivec3 p = {x, y, z};
+        bool onA = p[faceAxis[a]] == (faceHigh[a] ? size[faceAxis[a]] - 1 : 0);
+        if (onA && BLOCKS[pCd->blocks[x][y][z]].transparent) {
+          pVisited[(x * size[1] + y) * size[2] + z] = true;
+          ivec3_dup(pStack[stackLen++], p);
+        }
+      }
+    }
+  }
+
+  while (stackLen > 0) {
+    ivec3 p;
+    ivec3_dup(p, pStack[--stackLen]);
+    if (p[faceAxis[b]] == (faceHigh[b] ? size[faceAxis[b]] - 1 : 0)) {
+      return true;
+    }
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      for (int32_t delta = -1; delta <= 1; delta += 2) {
+        ivec3 q;
+        ivec3_dup(q, p);
+        q[axis] += delta;
+        if (q[axis] < 0 || q[axis] >= size[axis]) {
+          continue;
+        }
+        bool *pSeen = &pVisited[(q[0] * size[1] + q[1]) * size[2] + q[2]];
+        if (!*pSeen && BLOCKS[pCd->blocks[q[0]][q[1]][q[2]]].transparent) {
+          *pSeen = true;
+          ivec3_dup(pStack[stackLen++], q);
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// random chunks of stone with tunnels wandering through them
+static uint32_t checkRandom(ChunkData *pCd) {
+  const uint32_t blockCount = CHUNK_X_SIZE * CHUNK_Y_SIZE * CHUNK_Z_SIZE;
+  const int32_t size[3] = {CHUNK_X_SIZE, CHUNK_Y_SIZE, CHUNK_Z_SIZE};
+  bool *pVisited = malloc(blockCount * sizeof(bool));
+  ivec3 *pStack = malloc(blockCount * sizeof(ivec3));
+  uint32_t seed = 37;
+  uint32_t failures = 0;
+  for (uint32_t c = 0; c < RANDOM_CHUNKS; c++) {
+    fill(pCd, STONE);
+    uint32_t tunnels = 1 + c % 4;
+    for (uint32_t t = 0; t < tunnels; t++) {
+      ivec3 p;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        p[axis] = (int32_t)(tst_random(&seed) % (uint32_t)size[axis]);
+      }
+      for (uint32_t step = 0; step < TUNNEL_LENGTH; step++) {
+        pCd->blocks[p[0]][p[1]][p[2]] = AIR;
+        uint32_t axis = tst_random(&seed) % 3;
+        int32_t delta = tst_random(&seed) % 2 == 0 ? -1 : 1;
+        if (p[axis] + delta >= 0 && p[axis] + delta < size[axis]) {
+          p[axis] += delta;
+        }
+      }
+    }
+    uint16_t expected = 0;
+    for (BlockFaceKind a = 0; a < 6; a++) {
+      for (BlockFaceKind b = a + 1; b < 6; b++) {
+        if (refConnected(pCd, a, b, pVisited, pStack)) {
+          expected |= pairMask(a, b);
+        }
+      }
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "random chunk %u", c);
+    failures += expectConnections(pCd, name, expected);
+  }
+  free(pStack);
+  free(pVisited);
+  return failures;
+}
+
+int main(void) {
+  ChunkData *pCd = malloc(sizeof(ChunkData));
+  uint32_t failures = checkPairBits();
+  failures += checkHandBuilt(pCd);
+  failures += checkRandom(pCd);
+  free(pCd);
+
+  printf("test_connections: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
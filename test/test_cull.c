@@ -0,0 +1,441 @@
+// checks culling on the GPU. The changed draw records are staged and merged
+// into copies by hand first, without a device. Then, on a device, a loaded
+// world is culled for a number of frames while it's edited and recentered:
+// the copy of the draw list is read back and compared with what
+// wld_getDrawChanges said it should hold, and the commands and counts each
+// block got are compared with the draws in view, which should be in the
+// order of the draw list across all the chunks the shader splits it into.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harness.h"
+#include "utils.h"
+
+#define CULL_SHADER_PATH "assets/shaders/cull.comp.spv"
+#define STAGED_DRAWS 1000u
+#define FRAMES 40u
+#define EDITS_PER_FRAME 20u
+// every this many frames the world moves over a chunk
+#define RECENTER_INTERVAL 10u
+
+// stages random ascending indexes and checks that the copies put each record
+// where it goes, with one copy per run of consecutive indexes
+static uint32_t checkStaging(void) {
+  uint32_t *pIndexes = malloc(STAGED_DRAWS * sizeof(uint32_t));
+  CullDrawRecord *pRecords = malloc(STAGED_DRAWS * sizeof(CullDrawRecord));
+  CullDrawRecord *pStaging = malloc(STAGED_DRAWS * sizeof(CullDrawRecord));
+  VkBufferCopy *pCopies = malloc(STAGED_DRAWS * sizeof(VkBufferCopy));
+
+  uint32_t seed = 44;
+  uint32_t index = 0;
+  uint32_t runs = 0;
+  for (uint32_t i = 0; i < STAGED_DRAWS; i++) {
+    // mostly next to the last one, sometimes after a gap
+    uint32_t gap = tst_random(&seed) % 3 == 0 ? 1 + tst_random(&seed) % 5 : 0;
+    index += i == 0 ? gap : gap + 1;
+    runs += i == 0 || gap > 0;
+    pIndexes[i] = index;
+    for (uint32_t axis = 0; axis < 4; axis++) {
+      pRecords[i].min[axis] = tst_randomFloat(&seed, -100, 100);
+      pRecords[i].max[axis] = tst_randomFloat(&seed, -100, 100);
+    }
+    pRecords[i].vertexCount = tst_random(&seed);
+    pRecords[i].firstVertex = tst_random(&seed);
+    pRecords[i].block = tst_random(&seed);
+    pRecords[i].origin = tst_random(&seed);
+  }
+
+  uint32_t copyCount = stageCullDrawRecords(pCopies, pStaging, STAGED_DRAWS,
+                                            pIndexes, pRecords);
+  uint32_t failures = 0;
+  if (copyCount != runs) {
+    printf("  %u copies for %u runs\n", copyCount, runs);
+    failures++;
+  }
+  // do the copies into a record buffer of our own
+  CullDrawRecord *pDestination = calloc(index + 1, sizeof(CullDrawRecord));
+  VkDeviceSize covered = 0;
+  for (uint32_t c = 0; c < copyCount; c++) {
+    memcpy((uint8_t *)pDestination + pCopies[c].dstOffset,
+           (const uint8_t *)pStaging + pCopies[c].srcOffset,
+           (size_t)pCopies[c].size);
+    covered += pCopies[c].size;
+  }
+  if (covered != STAGED_DRAWS * sizeof(CullDrawRecord)) {
+    printf("  the copies cover %llu bytes\n", (unsigned long long)covered);
+    failures++;
+  }
+  for (uint32_t i = 0; i < STAGED_DRAWS; i++) {
+    if (memcmp(&pDestination[pIndexes[i]], &pRecords[i],
+               sizeof(CullDrawRecord)) != 0) {
+      printf("  draw %u wasn't copied\n", pIndexes[i]);
+      failures++;
+      break;
+    }
+  }
+
+  free(pDestination);
+  free(pIndexes);
+  free(pRecords);
+  free(pStaging);
+  free(pCopies);
+  return failures;
+}
+
+// the buffers the culling shader uses, all host visible so they can be read
+// back. In the game the record, command and offset buffers are device local.
+typedef struct {
+  uint32_t drawCapacity;
+  uint32_t blockCapacity;
+  VkBuffer buffers[5];
+  VkDeviceMemory memories[5];
+  CullDrawRecord *pRecords;
+  CullDrawRecord *pStaging;
+  VkDrawIndirectCommand *pCommands;
+  uint32_t *pCounts;
+  VkBufferCopy *pCopies;
+} CullBuffers;
+
+enum {
+  RECORD_BUFFER,
+  STAGING_BUFFER,
+  COMMAND_BUFFER,
+  COUNT_BUFFER,
+  OFFSET_BUFFER
+};
+
+static void new_CullBuffers(CullBuffers *pBuffers,
+                            const HeadlessDevice *pHeadless,
+                            const VkDescriptorSet descriptorSet,
+                            const uint32_t drawCapacity,
+                            const uint32_t blockCapacity) {
+  const uint32_t chunkCapacity =
+      (drawCapacity + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE;
+  const VkDeviceSize sizes[5] = {
+      drawCapacity * sizeof(CullDrawRecord),
+      drawCapacity * sizeof(CullDrawRecord),
+      (VkDeviceSize)blockCapacity * drawCapacity *
+          sizeof(VkDrawIndirectCommand),
+      blockCapacity * sizeof(uint32_t),
+      (VkDeviceSize)blockCapacity * chunkCapacity * sizeof(uint32_t),
+  };
+  const VkBufferUsageFlags usages[5] = {
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+      VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+  };
+  void *ppMapped[5];
+  for (uint32_t i = 0; i < 5; i++) {
+    ErrVal result = new_Buffer_DeviceMemory(
+        &pBuffers->buffers[i], &pBuffers->memories[i], sizes[i],
+        pHeadless->physicalDevice, pHeadless->device, usages[i],
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    if (result != ERR_OK) {
+      LOG_ERROR(ERR_LEVEL_FATAL, "failed to create culling buffer");
+      PANIC();
+    }
+    vkMapMemory(pHeadless->device, pBuffers->memories[i], 0, sizes[i], 0,
+                &ppMapped[i]);
+  }
+  pBuffers->pRecords = ppMapped[RECORD_BUFFER];
+  pBuffers->pStaging = ppMapped[STAGING_BUFFER];
+  pBuffers->pCommands = ppMapped[COMMAND_BUFFER];
+  pBuffers->pCounts = ppMapped[COUNT_BUFFER];
+  pBuffers->pCopies = malloc(drawCapacity * sizeof(VkBufferCopy));
+  pBuffers->drawCapacity = drawCapacity;
+  pBuffers->blockCapacity = blockCapacity;
+  updateCullDescriptorSet(descriptorSet, pHeadless->device,
+                          pBuffers->buffers[RECORD_BUFFER],
+                          pBuffers->buffers[COMMAND_BUFFER],
+                          pBuffers->buffers[COUNT_BUFFER],
+                          pBuffers->buffers[OFFSET_BUFFER]);
+}
+
+static void delete_CullBuffers(CullBuffers *pBuffers,
+                               const HeadlessDevice *pHeadless) {
+  for (uint32_t i = 0; i < 5; i++) {
+    vkUnmapMemory(pHeadless->device, pBuffers->memories[i]);
+    delete_Buffer(&pBuffers->buffers[i], pHeadless->device);
+    delete_DeviceMemory(&pBuffers->memories[i], pHeadless->device);
+  }
+  free(pBuffers->pCopies);
+}
+
+typedef enum {
+  CULL_OUT,
+  // close enough to a plane that float rounding on the GPU may go either way
+  CULL_BORDER,
+  CULL_IN,
+} CullResult;
+
+// the culling shader's test, with some slack
+static CullResult cullRecord(const CullDrawRecord *pRecord, vec4 planes[6]) {
+  CullResult result = CULL_IN;
+  for (uint32_t p = 0; p < 6; p++) {
+    float distance = planes[p][3];
+    float magnitude = fabsf(planes[p][3]);
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float corner =
+          planes[p][axis] > 0 ? pRecord->max[axis] : pRecord->min[axis];
+      distance += planes[p][axis] * corner;
+      magnitude += fabsf(planes[p][axis] * corner);
+    }
+    float epsilon = 1e-4f * magnitude + 1e-6f;
+    if (distance < -epsilon) {
+      return CULL_OUT;
+    }
+    if (distance <= epsilon) {
+      result = CULL_BORDER;
+    }
+  }
+  return result;
+}
+
+static bool commandIsDraw(const VkDrawIndirectCommand *pCommand,
+                          const CullDrawRecord *pRecord) {
+  return pCommand->vertexCount == pRecord->vertexCount &&
+         pCommand->instanceCount == 1 &&
+         pCommand->firstVertex == pRecord->firstVertex &&
+         pCommand->firstInstance == pRecord->origin;
+}
+
+// checks that each block got a command for each of its draws in view, in
+// the order of the draw list, and none for the ones out of it
+static uint32_t checkBlocks(const CullBuffers *pBuffers,
+                            const CullDrawRecord *pMirror,
+                            const uint32_t drawCount,
+                            const uint32_t blockCount, vec4 planes[6]) {
+  uint32_t failures = 0;
+  uint32_t *pCandidates = malloc(drawCount * sizeof(uint32_t));
+  bool *pInView = malloc(drawCount * sizeof(bool));
+  for (uint32_t block = 0; block < blockCount; block++) {
+    uint32_t candidateCount = 0;
+    for (uint32_t i = 0; i < drawCount; i++) {
+      CullResult result = cullRecord(&pMirror[i], planes);
+      if (pMirror[i].block == block && result != CULL_OUT) {
+        pCandidates[candidateCount] = i;
+        pInView[candidateCount] = result == CULL_IN;
+        candidateCount++;
+      }
+    }
+
+    // walk the commands alongside the draws that may be in them, which the
+    // ones on the border may or may not be
+    const uint32_t count = pBuffers->pCounts[block];
+    const VkDrawIndirectCommand *pCommands =
+        pBuffers->pCommands + (size_t)block * pBuffers->drawCapacity;
+    uint32_t slot = 0;
+    bool missing = false;
+    for (uint32_t c = 0; c < candidateCount && !missing; c++) {
+      if (slot < count &&
+          commandIsDraw(&pCommands[slot], &pMirror[pCandidates[c]])) {
+        slot++;
+      } else if (pInView[c]) {
+        printf("  block %u is missing draw %u, or has it out of order\n",
+               block, pCandidates[c]);
+        failures++;
+        missing = true;
+      }
+    }
+    if (!missing && slot != count) {
+      printf("  block %u command %u isn't one of its draws in view\n", block,
+             slot);
+      failures++;
+    }
+  }
+
+  for (uint32_t i = 0; i < drawCount; i++) {
+    if (pMirror[i].block >= blockCount) {
+      printf("  draw %u is in block %u of %u\n", i, pMirror[i].block,
+             blockCount);
+      failures++;
+      break;
+    }
+  }
+  free(pCandidates);
+  free(pInView);
+  return failures;
+}
+
+static uint32_t checkCulling(const HeadlessDevice *pHeadless) {
+  uint32_t *pShaderCode;
+  uint32_t shaderLength;
+  readShaderFile(CULL_SHADER_PATH, &shaderLength, &pShaderCode);
+  VkShaderModule shaderModule;
+  new_ShaderModule(&shaderModule, pHeadless->device, shaderLength,
+                   pShaderCode);
+  free(pShaderCode);
+  VkPipelineLayout pipelineLayout;
+  VkDescriptorSetLayout descriptorSetLayout;
+  new_CullPipelineLayoutDescriptorSetLayout(
+      &pipelineLayout, &descriptorSetLayout, pHeadless->device);
+  VkPipeline pipeline;
+  new_CullPipeline(&pipeline, pHeadless->device, shaderModule, pipelineLayout,
+                   VK_NULL_HANDLE);
+  VkDescriptorPool descriptorPool;
+  VkDescriptorSet descriptorSet;
+  new_StorageDescriptorPoolAndSets(&descriptorPool, &descriptorSet, 1,
+                                   CULL_BINDING_COUNT, descriptorSetLayout,
+                                   pHeadless->device);
+  VkCommandBuffer commandBuffer;
+  new_CommandBuffers(&commandBuffer, 1, pHeadless->commandPool,
+                     pHeadless->device);
+
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, pHeadless);
+
+  CullBuffers buffers = {0};
+  // what the copy of the draw list should hold
+  CullDrawRecord *pMirror = NULL;
+  bool resend = true;
+
+  uint32_t failures = 0;
+  uint32_t seed = 48;
+  uint32_t culledCount = 0;
+  uint32_t mostDraws = 0;
+  for (uint32_t frame = 0; frame < FRAMES && failures == 0; frame++) {
+    if (frame % RECENTER_INTERVAL == RECENTER_INTERVAL - 1) {
+      ivec3 center;
+      ivec3_add(center, ws.centerLoc, (ivec3){1, 0, 0});
+      wld_set_center(&ws, center);
+    }
+    for (uint32_t i = 0; i < EDITS_PER_FRAME; i++) {
+      ivec3 edit = {(int32_t)(tst_random(&seed) % 96) - 48,
+                    (int32_t)(tst_random(&seed) % 32) - 16,
+                    (int32_t)(tst_random(&seed) % 96) - 48};
+      wld_set_block_at(tst_random(&seed) % 2 ? 0 : 2, &ws, edit);
+    }
+    tst_tickWorld(&ws, pHeadless);
+
+    // grow like drawAppFrame in src/main.c, starting over with a new copy
+    uint32_t drawCount;
+    uint32_t blockCount;
+    wld_getDrawListSize(&drawCount, &blockCount, &ws);
+    if (drawCount > buffers.drawCapacity ||
+        blockCount > buffers.blockCapacity) {
+      if (buffers.drawCapacity > 0) {
+        delete_CullBuffers(&buffers, pHeadless);
+      }
+      new_CullBuffers(&buffers, pHeadless, descriptorSet, 2 * drawCount + 1,
+                      2 * blockCount + 1);
+      free(pMirror);
+      pMirror = calloc(buffers.drawCapacity, sizeof(CullDrawRecord));
+      resend = true;
+    }
+
+    const uint32_t *pChangedIndexes;
+    const CullDrawRecord *pChangedRecords;
+    uint32_t changeCount;
+    wld_getDrawChanges(&pChangedIndexes, &pChangedRecords, &changeCount,
+                       &drawCount, resend, &ws);
+    resend = false;
+    for (uint32_t i = 0; i < changeCount; i++) {
+      if (i > 0 && pChangedIndexes[i] <= pChangedIndexes[i - 1]) {
+        printf("  frame %u: changed draws out of order\n", frame);
+        failures++;
+        break;
+      }
+      pMirror[pChangedIndexes[i]] = pChangedRecords[i];
+    }
+    uint32_t copyCount =
+        stageCullDrawRecords(buffers.pCopies, buffers.pStaging, changeCount,
+                             pChangedIndexes, pChangedRecords);
+
+    // look somewhere new from somewhere near the center
+    vec3 eye = {tst_randomFloat(&seed, -20, 20),
+                tst_randomFloat(&seed, -10, 10),
+                tst_randomFloat(&seed, -20, 20)};
+    eye[0] += (float)(ws.centerLoc[0] * CHUNK_X_SIZE);
+    eye[1] += (float)(ws.centerLoc[1] * CHUNK_Y_SIZE);
+    eye[2] += (float)(ws.centerLoc[2] * CHUNK_Z_SIZE);
+    vec3 target = {eye[0] + tst_randomFloat(&seed, -1, 1),
+                   eye[1] + tst_randomFloat(&seed, -0.5f, 0.5f),
+                   eye[2] + tst_randomFloat(&seed, -1, 1)};
+    mat4x4 projection, view, mvp;
+    mat4x4_perspective(projection, 1.2f, 1.5f, 0.01f, 1000.0f);
+    mat4x4_look_at(view, eye, target, (vec3){0, 1, 0});
+    mat4x4_mul(mvp, projection, view);
+
+    CullPushConstants constants;
+    wld_getFrustumPlanes(constants.planes, mvp);
+    constants.drawCount = drawCount;
+    constants.commandsPerBlock = buffers.drawCapacity;
+    beginOneTimeCommandBuffer(commandBuffer);
+    recordCullCommands(                  //
+        commandBuffer,                   //
+        pipelineLayout,                  //
+        pipeline,                        //
+        descriptorSet,                   //
+        buffers.buffers[RECORD_BUFFER],  //
+        buffers.buffers[STAGING_BUFFER], //
+        copyCount,                       //
+        buffers.pCopies,                 //
+        blockCount,                      //
+        &constants                       //
+    );
+    endCommandBuffer(commandBuffer);
+    VkSubmitInfo submitInfo = {0};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &commandBuffer;
+    vkQueueSubmit(pHeadless->graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkDeviceWaitIdle(pHeadless->device);
+
+    if (memcmp(buffers.pRecords, pMirror, drawCount * sizeof(CullDrawRecord)) !=
+        0) {
+      printf("  frame %u: the copy of the draw list is wrong\n", frame);
+      failures++;
+    }
+    failures += checkBlocks(&buffers, pMirror, drawCount, blockCount,
+                            constants.planes);
+    for (uint32_t i = 0; i < blockCount; i++) {
+      culledCount += buffers.pCounts[i];
+    }
+    mostDraws = drawCount > mostDraws ? drawCount : mostDraws;
+  }
+  // with one chunk, nothing is put together from the others
+  if (failures == 0 && mostDraws <= CULL_WORKGROUP_SIZE) {
+    printf("  at most %u draws, which fit in one chunk\n", mostDraws);
+    failures++;
+  }
+  printf("test_cull: %u draws in view over %u frames\n", culledCount, FRAMES);
+
+  vkDeviceWaitIdle(pHeadless->device);
+  free(pMirror);
+  delete_CullBuffers(&buffers, pHeadless);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_CommandBuffers(&commandBuffer, 1, pHeadless->commandPool,
+                        pHeadless->device);
+  delete_DescriptorPool(&descriptorPool, pHeadless->device);
+  delete_Pipeline(&pipeline, pHeadless->device);
+  delete_CullPipelineLayoutDescriptorSetLayout(
+      &pipelineLayout, &descriptorSetLayout, pHeadless->device);
+  delete_ShaderModule(&shaderModule, pHeadless->device);
+  return failures;
+}
+
+int main(void) {
+  uint32_t failures = checkStaging();
+
+  HeadlessDevice headless;
+  if (access(CULL_SHADER_PATH, R_OK) != 0) {
+    printf("test_cull: culling skipped, no " CULL_SHADER_PATH "\n");
+  } else if (new_HeadlessDevice(&headless) == ERR_OK) {
+    failures += checkCulling(&headless);
+    delete_HeadlessDevice(&headless);
+  } else {
+    printf("test_cull: culling skipped, no Vulkan device\n");
+  }
+
+  printf("test_cull: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
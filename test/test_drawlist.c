@@ -0,0 +1,233 @@
+// checks the draws wld_getDrawList hands out, on a device. A loaded world is
+// looked at from a camera turning around in it while it's edited, with its
+// meshes spread over several vertex pool blocks. The visible draws must be
+// sorted nearest first, then grouped into one batch per vertex pool block
+// without changing their order within a block, and every command must draw
+// faces of a draw in the draw list from that block.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+#define AIR 0
+#define FRAMES 30u
+#define EDITS_PER_FRAME 10u
+
+static void makeMvp(mat4x4 mvp, const vec3 eye, const vec3 center) {
+  mat4x4 projection;
+  mat4x4_perspective(projection, 1.2f, 16.0f / 9.0f, 0.1f, 200.0f);
+  mat4x4 view;
+  mat4x4_look_at(view, eye, center, (vec3){0, 1, 0});
+  mat4x4_mul(mvp, projection, view);
+}
+
+// visibleOrder holds each visible draw once, by ascending key, and keeps the
+// order they were found in among equal keys
+static uint32_t checkOrder(const WorldState *pWorldState,
+                           const uint32_t frame) {
+  bool *pSeen = calloc(pWorldState->visible_len + 1, sizeof(bool));
+  uint32_t failures = 0;
+  for (uint32_t n = 0; n < pWorldState->visible_len; n++) {
+    uint32_t v = pWorldState->visibleOrder[n];
+    if (v >= pWorldState->visible_len || pSeen[v]) {
+      printf("  frame %u: draw %u is in the order twice or isn't visible\n",
+             frame, v);
+      failures++;
+      break;
+    }
+    pSeen[v] = true;
+    if (n > 0) {
+      uint32_t prev = pWorldState->visibleOrder[n - 1];
+      uint32_t prevKey = pWorldState->visibleKeys[prev];
+      uint32_t key = pWorldState->visibleKeys[v];
+      if (prevKey > key || (prevKey == key && prev > v)) {
+        printf("  frame %u: draw %u with key %u comes after %u with key %u\n",
+               frame, v, key, prev, prevKey);
+        failures++;
+      }
+    }
+  }
+  free(pSeen);
+  return failures;
+}
+
+// the batches must be the draws of visibleOrder split up by block, with the
+// blocks in the order they first come up
+static uint32_t checkBatches(const WorldState *pWorldState,
+                             const VkDrawIndirectCommand *pCommands,
+                             const uint32_t drawCount,
+                             const uint32_t *pBatchBlocks,
+                             const uint32_t *pBatchCounts,
+                             const uint32_t batchCount, const uint32_t frame) {
+  const uint32_t visibleLen = pWorldState->visible_len;
+  uint32_t *pBlocks = malloc((visibleLen + 1) * sizeof(uint32_t));
+  uint32_t blockCount = 0;
+  for (uint32_t n = 0; n < visibleLen; n++) {
+    uint32_t block =
+        pWorldState->visibleBlocks[pWorldState->visibleOrder[n]];
+    uint32_t b = 0;
+    while (b < blockCount && pBlocks[b] != block) {
+      b++;
+    }
+    if (b == blockCount) {
+      pBlocks[blockCount++] = block;
+    }
+  }
+
+  uint32_t failures = 0;
+  if (drawCount != visibleLen || batchCount != blockCount) {
+    printf("  frame %u: %u commands in %u batches, expected %u in %u\n",
+           frame, drawCount, batchCount, visibleLen, blockCount);
+    failures++;
+  }
+  uint32_t command = 0;
+  for (uint32_t b = 0; b < batchCount && failures == 0; b++) {
+    if (pBatchBlocks[b] != pBlocks[b]) {
+      printf("  frame %u: batch %u is block %u, expected %u\n", frame, b,
+             pBatchBlocks[b], pBlocks[b]);
+      failures++;
+      break;
+    }
+    uint32_t count = 0;
+    for (uint32_t n = 0; n < visibleLen; n++) {
+      uint32_t v = pWorldState->visibleOrder[n];
+      if (pWorldState->visibleBlocks[v] != pBlocks[b]) {
+        continue;
+      }
+      if (count == pBatchCounts[b] ||
+          memcmp(&pCommands[command + count], &pWorldState->visibleCommands[v],
+                 sizeof(VkDrawIndirectCommand)) != 0) {
+        printf("  frame %u: command %u of batch %u isn't visible draw %u\n",
+               frame, count, b, v);
+        failures++;
+        break;
+      }
+      count++;
+    }
+    if (failures == 0 && count != pBatchCounts[b]) {
+      printf("  frame %u: batch %u has %u commands, expected %u\n", frame, b,
+             pBatchCounts[b], count);
+      failures++;
+    }
+    command += pBatchCounts[b];
+  }
+  free(pBlocks);
+  return failures;
+}
+
+// every visible draw is some of the faces of a draw from the same block
+static uint32_t checkCommands(const WorldState *pWorldState,
+                              const uint32_t frame) {
+  uint32_t failures = 0;
+  for (uint32_t v = 0; v < pWorldState->visible_len; v++) {
+    const VkDrawIndirectCommand *pCommand = &pWorldState->visibleCommands[v];
+    bool found = false;
+    for (uint32_t i = 0; i < pWorldState->draw_len && !found; i++) {
+      uint32_t firstVertex = (uint32_t)(pWorldState->drawOffsets[i] /
+                                        sizeof(Face)) *
+                             VERTEXES_PER_FACE;
+      found = pWorldState->drawBlocks[i] == pWorldState->visibleBlocks[v] &&
+              pWorldState->drawOrigins[i] == pCommand->firstInstance &&
+              pCommand->firstVertex >= firstVertex &&
+              pCommand->firstVertex + pCommand->vertexCount <=
+                  firstVertex + pWorldState->drawCounts[i];
+    }
+    if (!found || pCommand->vertexCount == 0 ||
+        pCommand->vertexCount % VERTEXES_PER_FACE != 0 ||
+        pCommand->instanceCount != 1) {
+      printf("  frame %u: visible draw %u (first vertex %u, %u vertexes) "
+             "isn't part of a draw\n",
+             frame, v, pCommand->firstVertex, pCommand->vertexCount);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_drawlist: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(43);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  // somewhere in the air of the center chunk
+  vec3 eye = {16.5f, 16.5f, 16.5f};
+  for (int32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+    BlockIndex block;
+    wld_get_block_at(&block, &ws, (ivec3){16, y, 16});
+    if (BLOCKS[block].transparent) {
+      eye[1] = (float)y + 0.5f;
+      break;
+    }
+  }
+
+  // fill what room is left in the vertex pool, so that the meshes of the
+  // edited chunks go to new blocks and there's more than one batch
+  for (;;) {
+    VertexPoolStats stats;
+    vtp_getStats(&stats, &ws.vertexPool);
+    if (stats.largestFree == 0) {
+      break;
+    }
+    VkBuffer buffer;
+    VkDeviceSize offset;
+    void *pMapped;
+    VertexAllocation allocation;
+    vtp_alloc(&buffer, &offset, &pMapped, &allocation, &ws.vertexPool,
+              stats.largestFree);
+  }
+
+  uint32_t seed = 43;
+  uint32_t failures = 0;
+  uint32_t mostBatches = 0;
+  for (uint32_t frame = 0; frame < FRAMES; frame++) {
+    for (uint32_t i = 0; i < EDITS_PER_FRAME; i++) {
+      ivec3 coords = {
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_X_SIZE)) - CHUNK_X_SIZE,
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_Y_SIZE)) - CHUNK_Y_SIZE,
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_Z_SIZE)) - CHUNK_Z_SIZE};
+      wld_set_block_at(AIR, &ws, coords);
+    }
+    tst_tickWorld(&ws, &headless);
+
+    float yaw = (float)frame * 0.5f;
+    mat4x4 mvp;
+    makeMvp(mvp, eye,
+            (vec3){eye[0] + cosf(yaw), eye[1] - 0.3f, eye[2] + sinf(yaw)});
+    const VkDrawIndirectCommand *pCommands;
+    uint32_t drawCount;
+    const uint32_t *pBatchBlocks;
+    const uint32_t *pBatchCounts;
+    uint32_t batchCount;
+    wld_getDrawList(&pCommands, &drawCount, &pBatchBlocks, &pBatchCounts,
+                    &batchCount, mvp, &ws);
+
+    failures += checkOrder(&ws, frame);
+    failures += checkBatches(&ws, pCommands, drawCount, pBatchBlocks,
+                             pBatchCounts, batchCount, frame);
+    failures += checkCommands(&ws, frame);
+    if (drawCount == 0) {
+      printf("  frame %u: nothing is visible\n", frame);
+      failures++;
+    }
+    mostBatches = batchCount > mostBatches ? batchCount : mostBatches;
+  }
+  if (mostBatches < 2) {
+    printf("  there was never more than one batch\n");
+    failures++;
+  }
+
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  printf("test_drawlist: up to %u batches, %u failures\n", mostBatches,
+         failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+// checks the frustum planes against clipping points by hand, and the box test
+// against boxes whose answer is known: some placed around a camera, and
+// random ones that either have a point inside the frustum or lie wholly
+// outside one of its planes. Runs without a device.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "harness.h"
+
+#define POINT_COUNT 100000u
+#define BOX_COUNT 100000u
+// points this close to a plane, relative to w, aren't checked
+#define PLANE_MARGIN 0.001f
+
+// a camera at eye looking at center, like the game's
+static void makeMvp(mat4x4 mvp, const vec3 eye, const vec3 center) {
+  mat4x4 projection;
+  mat4x4_perspective(projection, 1.2f, 16.0f / 9.0f, 0.1f, 200.0f);
+  mat4x4 view;
+  mat4x4_look_at(view, eye, center, (vec3){0, 1, 0});
+  mat4x4_mul(mvp, projection, view);
+}
+
+// how far inside the clip volume p is, as a fraction of w. Negative if it's
+// outside.
+static float clipDepth(const mat4x4 mvp, const vec3 p) {
+  vec4 clip;
+  mat4x4_mul_vec4(clip, mvp, (vec4){p[0], p[1], p[2], 1});
+  if (clip[3] <= 0) {
+    return -1;
+  }
+  float depth = INFINITY;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    depth = fminf(depth, (clip[3] - fabsf(clip[axis])) / clip[3]);
+  }
+  return depth;
+}
+
+static bool insidePlanes(const vec4 planes[6], const vec3 p) {
+  for (uint32_t i = 0; i < 6; i++) {
+    if (vec3_mul_inner(planes[i], p) + planes[i][3] < 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// with no transform the planes are the faces of the clip cube
+static uint32_t checkIdentityPlanes(void) {
+  mat4x4 identity;
+  mat4x4_identity(identity);
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, identity);
+  const vec4 expected[6] = {
+      {1, 0, 0, 1}, {-1, 0, 0, 1}, {0, 1, 0, 1},
+      {0, -1, 0, 1}, {0, 0, 1, 1}, {0, 0, -1, 1},
+  };
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i < 6; i++) {
+    for (uint32_t j = 0; j < 4; j++) {
+      if (planes[i][j] != expected[i][j]) {
+        printf("  identity plane %u is (%g %g %g %g)\n", i, planes[i][0],
+               planes[i][1], planes[i][2], planes[i][3]);
+        failures++;
+        break;
+      }
+    }
+  }
+  return failures;
+}
+
+// a point is inside all the planes exactly when the mvp puts it inside the
+// clip volume
+static uint32_t checkPlanes(const mat4x4 mvp, const vec3 eye) {
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, mvp);
+  uint32_t seed = 36;
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i < POINT_COUNT; i++) {
+    vec3 p = {eye[0] + tst_randomFloat(&seed, -250, 250),
+              eye[1] + tst_randomFloat(&seed, -250, 250),
+              eye[2] + tst_randomFloat(&seed, -250, 250)};
+    float depth = clipDepth(mvp, p);
+    if (fabsf(depth) < PLANE_MARGIN) {
+      continue;
+    }
+    if (insidePlanes(planes, p) != (depth > 0)) {
+      if (failures < 10) {
+        printf("  point (%g %g %g) disagrees with the clip volume\n", p[0],
+               p[1], p[2]);
+      }
+      failures++;
+    }
+  }
+  return failures;
+}
+
+static uint32_t expectBox(const vec4 planes[6], const char *name,
+                          const DrawBounds bounds, const bool inside) {
+  if (wld_boundsInFrustum(planes, &bounds) == inside) {
+    return 0;
+  }
+  printf("  %s: expected %s\n", name, inside ? "inside" : "outside");
+  return 1;
+}
+
+// boxes around a camera at the origin looking down -z
+static uint32_t checkKnownBoxes(void) {
+  mat4x4 mvp;
+  makeMvp(mvp, (vec3){0, 0, 0}, (vec3){0, 0, -1});
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, mvp);
+
+  uint32_t failures = 0;
+  failures += expectBox(planes, "straight ahead",
+                        (DrawBounds){{-1, -1, -11}, {1, 1, -9}}, true);
+  failures += expectBox(planes, "behind",
+                        (DrawBounds){{-1, -1, 9}, {1, 1, 11}}, false);
+  failures += expectBox(planes, "around the camera",
+                        (DrawBounds){{-5, -5, -5}, {5, 5, 5}}, true);
+  failures += expectBox(planes, "past the far plane",
+                        (DrawBounds){{-1, -1, -300}, {1, 1, -250}}, false);
+  failures += expectBox(planes, "closer than the near plane",
+                        (DrawBounds){{-0.01f, -0.01f, -0.05f},
+                                     {0.01f, 0.01f, -0.02f}},
+                        false);
+  failures += expectBox(planes, "far to the left",
+                        (DrawBounds){{-100, -1, -11}, {-90, 1, -9}}, false);
+  failures += expectBox(planes, "far above",
+                        (DrawBounds){{-1, 90, -11}, {1, 100, -9}}, false);
+  failures += expectBox(planes, "across the left edge",
+                        (DrawBounds){{-100, -1, -11}, {0, 1, -9}}, true);
+  failures += expectBox(planes, "across the far plane",
+                        (DrawBounds){{-1, -1, -250}, {1, 1, -150}}, true);
+  failures += expectBox(planes, "a sliver along the view",
+                        (DrawBounds){{0, 0, -200}, {0, 0, -1}}, true);
+  return failures;
+}
+
+// random boxes with a point inside the frustum must be kept, and ones with
+// all their corners outside the same plane must be culled
+static uint32_t checkRandomBoxes(const mat4x4 mvp, const vec3 eye) {
+  vec4 planes[6];
+  wld_getFrustumPlanes(planes, mvp);
+  uint32_t seed = 3636;
+  uint32_t failures = 0;
+  uint32_t kept = 0;
+  uint32_t culled = 0;
+  for (uint32_t i = 0; i < BOX_COUNT; i++) {
+    DrawBounds bounds;
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      float a = eye[axis] + tst_randomFloat(&seed, -220, 220);
+      float b = a + tst_randomFloat(&seed, 0, 40);
+      bounds.min[axis] = a;
+      bounds.max[axis] = b;
+    }
+    bool result = wld_boundsInFrustum(planes, &bounds);
+
+    // a point well inside the frustum means the box must be kept
+    vec3 p;
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      p[axis] = tst_randomFloat(&seed, bounds.min[axis], bounds.max[axis]);
+    }
+    if (clipDepth(mvp, p) > PLANE_MARGIN) {
+      kept++;
+      if (!result) {
+        printf("  box %u holds a visible point but was culled\n", i);
+        failures++;
+      }
+      continue;
+    }
+
+    // every corner well outside one plane means it must be culled
+    for (uint32_t plane = 0; plane < 6; plane++) {
+      bool allOutside = true;
+      for (uint32_t corner = 0; corner < 8 && allOutside; corner++) {
+        vec3 c = {corner & 1 ? bounds.max[0] : bounds.min[0],
+                  corner & 2 ? bounds.max[1] : bounds.min[1],
+                  corner & 4 ? bounds.max[2] : bounds.min[2]};
+        allOutside = vec3_mul_inner(planes[plane], c) + planes[plane][3] <
+                     -PLANE_MARGIN;
+      }
+      if (allOutside) {
+        culled++;
+        if (result) {
+          printf("  box %u is outside plane %u but was kept\n", i, plane);
+          failures++;
+        }
+        break;
+      }
+    }
+  }
+  if (kept == 0 || culled == 0) {
+    printf("  random boxes: %u kept and %u culled, expected some of each\n",
+           kept, culled);
+    failures++;
+  }
+  return failures;
+}
+
+int main(void) {
+  const vec3 eye = {3, 70, -2};
+  mat4x4 mvp;
+  makeMvp(mvp, eye, (vec3){10, 64, 8});
+
+  uint32_t failures = checkIdentityPlanes();
+  failures += checkPlanes(mvp, eye);
+  failures += checkKnownBoxes();
+  failures += checkRandomBoxes(mvp, eye);
+
+  printf("test_frustum: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
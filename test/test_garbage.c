@@ -0,0 +1,163 @@
+// checks when wld_clearGarbage frees geometry, on a device. A loaded world is
+// run like main.c runs it, editing blocks and moving the highlight every
+// frame and its center now and then, and clearing the garbage the frames in
+// flight are done with. Nothing a frame still in flight could be drawing may
+// be freed, and what they're all done with must be, in the order it was
+// thrown out.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+#define AIR 0
+#define STONE 2
+#define FRAMES 60u
+// like MAX_FRAMES_IN_FLIGHT in src/main.c
+#define FRAMES_IN_FLIGHT 2u
+#define EDITS_PER_FRAME 4u
+// the center moves one chunk along x every this many frames
+#define MOVE_INTERVAL 20u
+
+// garbage thrown out since the last draw list was handed out must be kept
+// until the next one is done, or the one after it if the uploads copy from it
+static uint32_t checkThrownOut(const WorldState *pWorldState,
+                               const uint32_t before, const uint32_t frame) {
+  uint32_t failures = 0;
+  for (uint32_t i = before; i < pWorldState->garbage_len; i++) {
+    uint64_t until = pWorldState->garbage_data[i].frame;
+    if (until != pWorldState->frame && until != pWorldState->frame + 1) {
+      printf("  frame %u: garbage kept until %llu, %llu lists handed out\n",
+             frame, (unsigned long long)until,
+             (unsigned long long)pWorldState->frame);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+// what's left must be the garbage from before with some of the front freed.
+// None of what's freed may be kept for a draw list after completedFrames,
+// and everything kept for one before it must be freed. Garbage kept for
+// completedFrames itself can wait behind some thrown out earlier in the same
+// tick that's kept one frame longer.
+static uint32_t checkCleared(const WorldState *pWorldState,
+                             const Garbage *pBefore, const uint32_t beforeLen,
+                             const uint64_t completedFrames,
+                             const uint32_t frame, uint32_t *pFreed) {
+  uint32_t freed = beforeLen - pWorldState->garbage_len;
+  *pFreed += freed;
+  if (pWorldState->garbage_len > beforeLen ||
+      memcmp(pWorldState->garbage_data, pBefore + freed,
+             pWorldState->garbage_len * sizeof(Garbage)) != 0) {
+    printf("  frame %u: the garbage left isn't what was behind the freed\n",
+           frame);
+    return 1;
+  }
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i < freed; i++) {
+    if (pBefore[i].frame > completedFrames) {
+      printf("  frame %u: freed garbage kept until %llu, only %llu done\n",
+             frame, (unsigned long long)pBefore[i].frame,
+             (unsigned long long)completedFrames);
+      failures++;
+    }
+  }
+  for (uint32_t i = freed; i < beforeLen; i++) {
+    if (pBefore[i].frame < completedFrames ||
+        (i == freed && pBefore[i].frame == completedFrames)) {
+      printf("  frame %u: garbage kept until %llu wasn't freed, %llu done\n",
+             frame, (unsigned long long)pBefore[i].frame,
+             (unsigned long long)completedFrames);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_garbage: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(41);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  Garbage *pBefore = NULL;
+  uint32_t seed = 41;
+  uint32_t failures = 0;
+  uint32_t freed = 0;
+  uint32_t held = 0;
+  for (uint32_t frame = 0; frame < FRAMES; frame++) {
+    uint32_t before = ws.garbage_len;
+    for (uint32_t i = 0; i < EDITS_PER_FRAME; i++) {
+      ivec3 coords = {
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_X_SIZE)) - CHUNK_X_SIZE,
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_Y_SIZE)) - CHUNK_Y_SIZE,
+          (int32_t)(tst_random(&seed) % (2 * CHUNK_Z_SIZE)) - CHUNK_Z_SIZE};
+      wld_set_block_at(tst_random(&seed) % 2 ? STONE : AIR, &ws, coords);
+    }
+    // which throws out the last highlight
+    wld_highlight_face(
+        (ivec3){(int32_t)(tst_random(&seed) % CHUNK_X_SIZE), 0, 0},
+        Block_UP, &ws);
+    if (frame % MOVE_INTERVAL == MOVE_INTERVAL - 1) {
+      wld_set_center(&ws, (ivec3){(int32_t)(frame / MOVE_INTERVAL) + 1, 0, 0});
+    }
+
+    wld_update(&ws);
+    failures += checkThrownOut(&ws, before, frame);
+
+    // the draw lists of the frames in flight are done up to this one, as
+    // after waiting on its fence
+    if (ws.frame >= FRAMES_IN_FLIGHT) {
+      uint64_t completedFrames = ws.frame - FRAMES_IN_FLIGHT + 1;
+      pBefore = realloc(pBefore, (ws.garbage_len + 1) * sizeof(Garbage));
+      memcpy(pBefore, ws.garbage_data, ws.garbage_len * sizeof(Garbage));
+      before = ws.garbage_len;
+      wld_clearGarbage(&ws, completedFrames);
+      failures += checkCleared(&ws, pBefore, before, completedFrames, frame,
+                               &freed);
+      held += ws.garbage_len;
+    }
+    tst_waitSemaphore(&headless, wld_flushUploads(&ws));
+
+    const uint32_t *pChangedIndexes;
+    const CullDrawRecord *pChangedRecords;
+    uint32_t changeCount;
+    uint32_t drawCount;
+    uint64_t handedOut = ws.frame;
+    wld_getDrawChanges(&pChangedIndexes, &pChangedRecords, &changeCount,
+                       &drawCount, frame == 0, &ws);
+    if (ws.frame != handedOut + 1) {
+      printf("  frame %u: handing out a draw list went from %llu to %llu\n",
+             frame, (unsigned long long)handedOut,
+             (unsigned long long)ws.frame);
+      failures++;
+    }
+  }
+
+  // a run where nothing waits or nothing is freed doesn't test the order
+  if (freed == 0 || held == 0) {
+    printf("  %u pieces of garbage freed, %u kept back, expected some of "
+           "each\n",
+           freed, held);
+    failures++;
+  }
+  wld_clearGarbage(&ws, UINT64_MAX);
+  if (ws.garbage_len != 0) {
+    printf("  %u pieces of garbage left after the GPU is done\n",
+           ws.garbage_len);
+    failures++;
+  }
+
+  free(pBefore);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  printf("test_garbage: %u freed, %u failures\n", freed, failures);
+  return failures == 0 ? 0 : 1;
+}
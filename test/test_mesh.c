@@ -0,0 +1,215 @@
+// checks the chunk mesher against a simple one that looks at every side of
+// every block. wu_getFacesChunkData must write the same faces, in the same
+// order, and wu_countChunkDataFaces must count them and give the smallest box
+// around them, for chunks from empty to full with every kind of neighbour
+// around them. Runs without a device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+
+#define AIR 0
+#define STONE 2
+#define RANDOM_CHUNKS 60u
+#define MAX_FACES (CHUNK_X_SIZE * CHUNK_Y_SIZE * CHUNK_Z_SIZE * 6)
+
+// the way each face kind looks, in the order the mesher goes through them
+static const BlockFaceKind faceOrder[6] = {Block_LEFT, Block_RIGHT, Block_UP,
+                                           Block_DOWN, Block_BACK, Block_FRONT};
+static const int32_t faceSteps[6][3] = {{-1, 0, 0}, {1, 0, 0},  {0, -1, 0},
+                                        {0, 1, 0},  {0, 0, -1}, {0, 0, 1}};
+
+static void fill(ChunkData *pCd, const BlockIndex block) {
+  for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+      for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+        pCd->blocks[x][y][z] = block;
+      }
+    }
+  }
+}
+
+// whether the block at p, which may be just outside the chunk, can be seen
+// through. A face against a neighbour that isn't loaded is kept.
+static bool refTransparent(const ChunkData *pCd,
+                           const ChunkData *const pNeighbours[6],
+                           const int32_t p[3]) {
+  const int32_t size[3] = {CHUNK_X_SIZE, CHUNK_Y_SIZE, CHUNK_Z_SIZE};
+  // the neighbour on the low and high side of each axis
+  const BlockFaceKind sides[3][2] = {{Block_LEFT, Block_RIGHT},
+                                     {Block_UP, Block_DOWN},
+                                     {Block_BACK, Block_FRONT}};
+  const ChunkData *pSrc = pCd;
+  int32_t q[3] = {p[0], p[1], p[2]};
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (q[axis] < 0 || q[axis] >= size[axis]) {
+      pSrc = pNeighbours == NULL ? NULL
+                                 : pNeighbours[sides[axis][q[axis] >= 0]];
+      q[axis] = (q[axis] + size[axis]) % size[axis];
+    }
+  }
+  return pSrc == NULL || BLOCKS[pSrc->blocks[q[0]][q[1]][q[2]]].transparent;
+}
+
+static uint32_t refMesh(Face *pFaces, const ivec3 offset,
+                        const ChunkData *pCd,
+                        const ChunkData *const pNeighbours[6]) {
+  uint32_t count = 0;
+  for (int32_t x = 0; x < CHUNK_X_SIZE; x++) {
+    for (int32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+      for (int32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+        BlockIndex block = pCd->blocks[x][y][z];
+        if (BLOCKS[block].transparent) {
+          continue;
+        }
+        for (uint32_t f = 0; f < 6; f++) {
+          int32_t p[3] = {x + faceSteps[f][0], y + faceSteps[f][1],
+                          z + faceSteps[f][2]};
+          if (refTransparent(pCd, pNeighbours, p)) {
+            pFaces[count++] =
+                (uint32_t)(x + offset[0]) |
+                (uint32_t)(y + offset[1]) << FACE_Y_SHIFT |
+                (uint32_t)(z + offset[2]) << FACE_Z_SHIFT |
+                (uint32_t)faceOrder[f] << FACE_KIND_SHIFT |
+                (uint32_t)block << FACE_BLOCK_SHIFT;
+          }
+        }
+      }
+    }
+  }
+  return count;
+}
+
+static uint32_t checkChunk(const char *name, const ChunkData *pCd,
+                           const ChunkData *const pNeighbours[6],
+                           Face *pFaces, Face *pExpected) {
+  const ivec3 offset = {32, 64, 96};
+  uint32_t expectedCount = refMesh(pExpected, offset, pCd, pNeighbours);
+  vec3 min;
+  vec3 max;
+  uint32_t counted = wu_countChunkDataFaces(min, max, pCd, pNeighbours);
+  uint32_t written = wu_getFacesChunkData(pFaces, offset, pCd, pNeighbours);
+  if (counted != expectedCount || written != expectedCount) {
+    printf("  %s: counted %u faces and wrote %u, expected %u\n", name,
+           counted, written, expectedCount);
+    return 1;
+  }
+  if (memcmp(pFaces, pExpected, written * sizeof(Face)) != 0) {
+    printf("  %s: wrote other faces than expected\n", name);
+    return 1;
+  }
+  if (written == 0) {
+    return 0;
+  }
+
+  // the smallest box around the faces, relative to the chunk's corner
+  vec3 refMin;
+  vec3 refMax;
+  for (uint32_t i = 0; i < written; i++) {
+    const Face face = pExpected[i];
+    ivec3 block = {(int32_t)(face & 0x7f) - offset[0],
+                   (int32_t)(face >> FACE_Y_SHIFT & 0x7f) - offset[1],
+                   (int32_t)(face >> FACE_Z_SHIFT & 0x7f) - offset[2]};
+    vec3 faceMin;
+    vec3 faceMax;
+    wu_getFaceBounds(faceMin, faceMax, block,
+                     (BlockFaceKind)(face >> FACE_KIND_SHIFT & 0x7));
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      refMin[axis] = i == 0 || faceMin[axis] < refMin[axis] ? faceMin[axis]
+                                                             : refMin[axis];
+      refMax[axis] = i == 0 || faceMax[axis] > refMax[axis] ? faceMax[axis]
+                                                             : refMax[axis];
+    }
+  }
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    if (min[axis] != refMin[axis] || max[axis] != refMax[axis]) {
+      printf("  %s: bounds (%g %g %g) to (%g %g %g), expected (%g %g %g) to "
+             "(%g %g %g)\n",
+             name, min[0], min[1], min[2], max[0], max[1], max[2], refMin[0],
+             refMin[1], refMin[2], refMax[0], refMax[1], refMax[2]);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(void) {
+  ChunkData *pCd = malloc(sizeof(ChunkData));
+  ChunkData *pAir = malloc(sizeof(ChunkData));
+  ChunkData *pStone = malloc(sizeof(ChunkData));
+  Face *pFaces = malloc(MAX_FACES * sizeof(Face));
+  Face *pExpected = malloc(MAX_FACES * sizeof(Face));
+  fill(pAir, AIR);
+  fill(pStone, STONE);
+  const ChunkData *airAround[6] = {pAir, pAir, pAir, pAir, pAir, pAir};
+  const ChunkData *stoneAround[6] = {pStone, pStone, pStone,
+                                     pStone, pStone, pStone};
+
+  uint32_t failures = checkChunk("air", pAir, NULL, pFaces, pExpected);
+  failures +=
+      checkChunk("stone, nothing around", pStone, NULL, pFaces, pExpected);
+  failures +=
+      checkChunk("stone in stone", pStone, stoneAround, pFaces, pExpected);
+  failures += checkChunk("stone in air", pStone, airAround, pFaces, pExpected);
+
+  // a single block in a corner, and in the opposite one
+  fill(pCd, AIR);
+  pCd->blocks[0][0][0] = STONE;
+  failures += checkChunk("low corner", pCd, stoneAround, pFaces, pExpected);
+  fill(pCd, AIR);
+  pCd->blocks[CHUNK_X_SIZE - 1][CHUNK_Y_SIZE - 1][CHUNK_Z_SIZE - 1] = STONE;
+  failures += checkChunk("high corner", pCd, NULL, pFaces, pExpected);
+
+  // a slab across the chunk along each axis, in stone. Only the two faces
+  // of the slab can be seen, so they alone make the bounds along that axis.
+  const char *slabNames[3] = {"x slab", "y slab", "z slab"};
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    fill(pCd, AIR);
+    for (uint32_t a = 0; a < CHUNK_X_SIZE; a++) {
+      for (uint32_t b = 0; b < CHUNK_Y_SIZE; b++) {
+        uint32_t p[3];
+        p[axis] = 5;
+        p[(axis + 1) % 3] = a;
+        p[(axis + 2) % 3] = b;
+        pCd->blocks[p[0]][p[1]][p[2]] = STONE;
+      }
+    }
+    failures +=
+        checkChunk(slabNames[axis], pCd, stoneAround, pFaces, pExpected);
+  }
+
+  // random blocks of every kind, from sparse to dense, with a random mix of
+  // missing, air and stone neighbours
+  uint32_t seed = 42;
+  char name[32];
+  for (uint32_t c = 0; c < RANDOM_CHUNKS; c++) {
+    uint32_t density = 1 + c * 100 / RANDOM_CHUNKS;
+    for (uint32_t x = 0; x < CHUNK_X_SIZE; x++) {
+      for (uint32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+        for (uint32_t z = 0; z < CHUNK_Z_SIZE; z++) {
+          pCd->blocks[x][y][z] =
+              tst_random(&seed) % 100 < density
+                  ? (BlockIndex)(tst_random(&seed) % BLOCKS_LEN)
+                  : AIR;
+        }
+      }
+    }
+    const ChunkData *neighbours[6];
+    for (uint32_t f = 0; f < 6; f++) {
+      uint32_t kind = tst_random(&seed) % 3;
+      neighbours[f] = kind == 0 ? NULL : kind == 1 ? pAir : pStone;
+    }
+    snprintf(name, sizeof(name), "random chunk %u", c);
+    failures += checkChunk(name, pCd, neighbours, pFaces, pExpected);
+  }
+
+  free(pExpected);
+  free(pFaces);
+  free(pStone);
+  free(pAir);
+  free(pCd);
+  printf("test_mesh: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
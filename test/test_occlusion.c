@@ -0,0 +1,328 @@
+// checks the occlusion buffer on the CPU: a few boxes placed around a wall by
+// hand, then random scenes, where no box that can be seen from the camera
+// may be culled. Then, on a device, that a world's draw list is the same
+// whether its occluders were drawn ahead by wld_startOcclusion or not.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "harness.h"
+#include "occlusion.h"
+
+#define SCENE_COUNT 200u
+#define OCCLUDERS_PER_SCENE 20u
+#define BOXES_PER_SCENE 200u
+// points sampled along each axis of a box to find one that can be seen
+#define SAMPLES 5u
+// the reference grows occluders by this much, so that a point just grazing
+// one still counts as hidden and rounding can't fail the test
+#define GRAZE 0.01f
+#define AHEAD_FRAMES 60u
+#define STONE 2
+
+static void makeMvp(mat4x4 mvp, const vec3 eye, const vec3 center) {
+  mat4x4 proj;
+  mat4x4 view;
+  mat4x4_perspective(proj, 1.2f, 16.0f / 9.0f, 0.1f, 500.0f);
+  mat4x4_look_at(view, (float *)eye, (float *)center, (vec3){0, 1, 0});
+  mat4x4_mul(mvp, proj, view);
+}
+
+// whether the segment from a to b passes through the box
+static bool segmentHitsBox(const vec3 a, const vec3 b, const vec3 min,
+                           const vec3 max) {
+  float tNear = 0;
+  float tFar = 1;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    float d = b[axis] - a[axis];
+    float lo = min[axis] - GRAZE;
+    float hi = max[axis] + GRAZE;
+    if (d == 0) {
+      if (a[axis] < lo || a[axis] > hi) {
+        return false;
+      }
+      continue;
+    }
+    float t0 = (lo - a[axis]) / d;
+    float t1 = (hi - a[axis]) / d;
+    if (t0 > t1) {
+      float swap = t0;
+      t0 = t1;
+      t1 = swap;
+    }
+    tNear = t0 > tNear ? t0 : tNear;
+    tFar = t1 < tFar ? t1 : tFar;
+  }
+  return tNear <= tFar;
+}
+
+// whether the point is inside the view volume of mvp
+static bool pointOnScreen(const mat4x4 mvp, const vec3 p) {
+  vec4 world = {p[0], p[1], p[2], 1};
+  vec4 clip;
+  mat4x4_mul_vec4(clip, (vec4 *)mvp, world);
+  return clip[3] > 0 && fabsf(clip[0]) <= clip[3] &&
+         fabsf(clip[1]) <= clip[3] && fabsf(clip[2]) <= clip[3];
+}
+
+// whether some point of the box can be seen from eye past the occluders
+static bool boxSeen(const mat4x4 mvp, const vec3 eye, const vec3 min,
+                    const vec3 max, const vec3 *pOccluderMins,
+                    const vec3 *pOccluderMaxes, const uint32_t occluderCount) {
+  for (uint32_t sx = 0; sx < SAMPLES; sx++) {
+    for (uint32_t sy = 0; sy < SAMPLES; sy++) {
+      for (uint32_t sz = 0; sz < SAMPLES; sz++) {
+        const uint32_t sample[3] = {sx, sy, sz};
+        vec3 p;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          p[axis] = min[axis] + (max[axis] - min[axis]) * (float)sample[axis] /
+                                    (float)(SAMPLES - 1);
+        }
+        if (!pointOnScreen(mvp, p)) {
+          continue;
+        }
+        bool hidden = false;
+        for (uint32_t i = 0; i < occluderCount && !hidden; i++) {
+          hidden = segmentHitsBox(eye, p, pOccluderMins[i], pOccluderMaxes[i]);
+        }
+        if (!hidden) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+typedef struct {
+  const char *name;
+  vec3 min;
+  vec3 max;
+  bool visible;
+} PlacedBox;
+
+// a wall in front of a camera at the origin looking down -z
+static uint32_t checkPlacedBoxes(OcclusionBuffer *pOcclusion) {
+  const vec3 eye = {0, 0, 0};
+  mat4x4 mvp;
+  makeMvp(mvp, eye, (vec3){0, 0, -1});
+  occ_clear(pOcclusion, mvp);
+  occ_drawBox(pOcclusion, (vec3){-4, -4, -12}, (vec3){4, 4, -10});
+  // crosses the near plane, so it mustn't hide anything
+  occ_drawBox(pOcclusion, (vec3){20, -4, -5}, (vec3){30, 4, 1});
+  occ_buildPyramid(pOcclusion);
+
+  const PlacedBox boxes[] = {
+      {"behind the wall", {-2, -2, -40}, {2, 2, -30}, false},
+      {"right behind the wall", {-3, -3, -13}, {3, 3, -12.5f}, false},
+      {"in front of the wall", {-2, -2, -8}, {2, 2, -6}, true},
+      {"beside the wall", {20, -2, -40}, {24, 2, -30}, true},
+      {"wider than the wall", {-20, -2, -40}, {20, 2, -30}, true},
+      {"through the wall", {-1, -1, -20}, {1, 1, -5}, true},
+      {"behind the camera", {-2, -2, 5}, {2, 2, 10}, true},
+      {"behind the near occluder", {24, -2, -40}, {26, 2, -30}, true},
+  };
+  uint32_t failures = 0;
+  for (uint32_t i = 0; i < sizeof(boxes) / sizeof(boxes[0]); i++) {
+    if (occ_testBox(pOcclusion, boxes[i].min, boxes[i].max) !=
+        boxes[i].visible) {
+      printf("  box %s should %sbe visible\n", boxes[i].name,
+             boxes[i].visible ? "" : "not ");
+      failures++;
+    }
+  }
+  return failures;
+}
+
+// random boxes around random occluders; returns how many were culled
+// wrongly, and counts the ones culled at all in *pCulled
+static uint32_t checkRandomScenes(OcclusionBuffer *pOcclusion,
+                                  uint32_t *pCulled) {
+  uint32_t seed = 38;
+  uint32_t failures = 0;
+  *pCulled = 0;
+  for (uint32_t scene = 0; scene < SCENE_COUNT; scene++) {
+    const vec3 eye = {0, 0, 0};
+    const vec3 center = {tst_randomFloat(&seed, -1, 1),
+                         tst_randomFloat(&seed, -0.5f, 0.5f),
+                         tst_randomFloat(&seed, -1, 1)};
+    mat4x4 mvp;
+    makeMvp(mvp, eye, center);
+    occ_clear(pOcclusion, mvp);
+
+    // bricks and chunks, like the world draws
+    vec3 occluderMins[OCCLUDERS_PER_SCENE];
+    vec3 occluderMaxes[OCCLUDERS_PER_SCENE];
+    for (uint32_t i = 0; i < OCCLUDERS_PER_SCENE; i++) {
+      float size = tst_random(&seed) % 2 ? 8.0f : 32.0f;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        occluderMins[i][axis] = tst_randomFloat(&seed, -40, 40);
+        occluderMaxes[i][axis] = occluderMins[i][axis] + size;
+      }
+      occ_drawBox(pOcclusion, occluderMins[i], occluderMaxes[i]);
+    }
+    occ_buildPyramid(pOcclusion);
+
+    for (uint32_t i = 0; i < BOXES_PER_SCENE; i++) {
+      vec3 min;
+      vec3 max;
+      if (i % 2 == 0) {
+        // anywhere
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          min[axis] = tst_randomFloat(&seed, -100, 100);
+          max[axis] = min[axis] + tst_randomFloat(&seed, 0.5f, 16);
+        }
+      } else {
+        // small, and just behind an edge of an occluder, where being off by
+        // a texel shows
+        const uint32_t occluder = tst_random(&seed) % OCCLUDERS_PER_SCENE;
+        const uint32_t along = tst_random(&seed) % 3;
+        const uint32_t corner = tst_random(&seed);
+        const float behind = tst_randomFloat(&seed, 1.05f, 2);
+        for (uint32_t axis = 0; axis < 3; axis++) {
+          float edge =
+              axis == along
+                  ? tst_randomFloat(&seed, occluderMins[occluder][axis],
+                                    occluderMaxes[occluder][axis])
+                  : (corner >> axis & 1 ? occluderMaxes[occluder][axis]
+                                        : occluderMins[occluder][axis]);
+          float size = tst_randomFloat(&seed, 0.1f, 1);
+          min[axis] = edge * behind + tst_randomFloat(&seed, -0.5f, 0.5f) -
+                      size / 2;
+          max[axis] = min[axis] + size;
+        }
+      }
+      if (occ_testBox(pOcclusion, min, max)) {
+        continue;
+      }
+      (*pCulled)++;
+      if (boxSeen(mvp, eye, min, max, occluderMins, occluderMaxes,
+                  OCCLUDERS_PER_SCENE)) {
+        printf("  scene %u: box (%f %f %f) (%f %f %f) is seen but culled\n",
+               scene, (double)min[0], (double)min[1], (double)min[2],
+               (double)max[0], (double)max[1], (double)max[2]);
+        failures++;
+      }
+    }
+  }
+  return failures;
+}
+
+// the draw list of a loaded world, from a camera turning around in the air
+// of the center chunk, must come out the same whether the occluders were
+// drawn ahead on a worker or by wld_getDrawList. Sometimes the worker is
+// given time to finish first, sometimes blocks are placed in between, and
+// sometimes they were started for another view.
+static uint32_t checkDrawnAhead(const HeadlessDevice *pHeadless) {
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, pHeadless);
+
+  // somewhere in the air of the center chunk, with ground nearby
+  vec3 eye = {16.5f, 16.5f, 16.5f};
+  for (int32_t y = 0; y < CHUNK_Y_SIZE; y++) {
+    BlockIndex block;
+    wld_get_block_at(&block, &ws, (ivec3){16, y, 16});
+    if (BLOCKS[block].transparent) {
+      eye[1] = (float)y + 0.5f;
+      break;
+    }
+  }
+
+  VkDrawIndirectCommand *pExpected = NULL;
+  uint32_t failures = 0;
+  for (uint32_t frame = 0; frame < AHEAD_FRAMES; frame++) {
+    float yaw = (float)frame * 0.4f;
+    vec3 center = {eye[0] + cosf(yaw), eye[1] + 0.3f * sinf(yaw * 0.7f),
+                   eye[2] + sinf(yaw)};
+    mat4x4 mvp;
+    makeMvp(mvp, eye, center);
+
+    if (frame % 5 == 4) {
+      // started for where the camera was looking a moment ago
+      mat4x4 earlier;
+      makeMvp(earlier, eye,
+              (vec3){eye[0] + cosf(yaw - 0.4f), center[1],
+                     eye[2] + sinf(yaw - 0.4f)});
+      wld_startOcclusion(earlier, &ws);
+    } else {
+      wld_startOcclusion(mvp, &ws);
+    }
+    if (frame % 2 == 0) {
+      struct timespec wait = {.tv_sec = 0, .tv_nsec = 5000000};
+      nanosleep(&wait, NULL);
+    }
+    if (frame % 3 == 0) {
+      // fill the 8 cubed brick a little way ahead with stone, which makes a
+      // new occluder
+      ivec3 brick;
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        float ahead = eye[axis] + 16.0f * (center[axis] - eye[axis]);
+        brick[axis] = (int32_t)floorf(ahead / 8.0f) * 8;
+      }
+      for (int32_t x = 0; x < 8; x++) {
+        for (int32_t y = 0; y < 8; y++) {
+          for (int32_t z = 0; z < 8; z++) {
+            wld_set_block_at(
+                STONE, &ws, (ivec3){brick[0] + x, brick[1] + y, brick[2] + z});
+          }
+        }
+      }
+    }
+
+    const VkDrawIndirectCommand *pCommands;
+    uint32_t drawCount;
+    const uint32_t *pBatchBlocks;
+    const uint32_t *pBatchCounts;
+    uint32_t batchCount;
+    wld_getDrawList(&pCommands, &drawCount, &pBatchBlocks, &pBatchCounts,
+                    &batchCount, mvp, &ws);
+    uint32_t aheadCount = drawCount;
+    pExpected = realloc(pExpected, (aheadCount + 1) *
+                                       sizeof(VkDrawIndirectCommand));
+    memcpy(pExpected, pCommands, aheadCount * sizeof(VkDrawIndirectCommand));
+
+    // nothing started this time, so it draws its own
+    wld_getDrawList(&pCommands, &drawCount, &pBatchBlocks, &pBatchCounts,
+                    &batchCount, mvp, &ws);
+    if (drawCount != aheadCount ||
+        memcmp(pCommands, pExpected,
+               drawCount * sizeof(VkDrawIndirectCommand)) != 0) {
+      printf("  frame %u: %u draws with the occluders drawn ahead, %u "
+             "without\n",
+             frame, aheadCount, drawCount);
+      failures++;
+    }
+  }
+
+  free(pExpected);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  return failures;
+}
+
+int main(void) {
+  OcclusionBuffer occlusion;
+  new_OcclusionBuffer(&occlusion);
+
+  uint32_t failures = checkPlacedBoxes(&occlusion);
+  uint32_t culled;
+  failures += checkRandomScenes(&occlusion, &culled);
+
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) == ERR_OK) {
+    failures += checkDrawnAhead(&headless);
+    delete_HeadlessDevice(&headless);
+  } else {
+    printf("test_occlusion: draw lists skipped, no Vulkan device\n");
+  }
+
+  printf("test_occlusion: %u random boxes culled, %u failures\n", culled,
+         failures);
+  delete_OcclusionBuffer(&occlusion);
+  // random scenes that cull nothing test nothing
+  return failures == 0 && culled > 0 ? 0 : 1;
+}
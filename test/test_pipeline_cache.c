@@ -0,0 +1,131 @@
+// checks the pipeline cache file, on a device. What savePipelineCache writes
+// must read back as the cache's data, and a file that's missing, cut short
+// anywhere, or has any one byte changed must be ignored instead. That covers
+// a header from another device or driver as well as corrupted data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "harness.h"
+
+static uint8_t *readWholeFile(const char *path, size_t *pSize) {
+  FILE *fp = fopen(path, "rb");
+  if (fp == NULL) {
+    return NULL;
+  }
+  fseek(fp, 0, SEEK_END);
+  *pSize = (size_t)ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  uint8_t *pFile = malloc(*pSize);
+  if (fread(pFile, *pSize, 1, fp) != 1) {
+    free(pFile);
+    pFile = NULL;
+  }
+  fclose(fp);
+  return pFile;
+}
+
+static void writeWholeFile(const char *path, const uint8_t *pFile,
+                           const size_t size) {
+  FILE *fp = fopen(path, "wb");
+  fwrite(pFile, size, 1, fp);
+  fclose(fp);
+}
+
+// the file at path must be ignored
+static uint32_t expectIgnored(const char *path, const char *name,
+                              const VkPhysicalDevice physicalDevice) {
+  void *pData;
+  size_t size;
+  readPipelineCacheFile(&pData, &size, path, physicalDevice);
+  if (pData == NULL && size == 0) {
+    return 0;
+  }
+  printf("  %s: read %zu bytes, expected it to be ignored\n", name, size);
+  free(pData);
+  return 1;
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_pipeline_cache: skipped, no Vulkan device\n");
+    return 0;
+  }
+  const VkPhysicalDevice physicalDevice = headless.physicalDevice;
+  char path[] = "/tmp/test_pipeline_cache_XXXXXX";
+  close(mkstemp(path));
+  remove(path);
+
+  uint32_t failures = expectIgnored(path, "missing file", physicalDevice);
+
+  // an empty cache still has the driver's header as its data
+  VkPipelineCache cache;
+  new_PipelineCache(&cache, path, physicalDevice, headless.device);
+  size_t cacheSize;
+  vkGetPipelineCacheData(headless.device, cache, &cacheSize, NULL);
+  uint8_t *pCacheData = malloc(cacheSize);
+  vkGetPipelineCacheData(headless.device, cache, &cacheSize, pCacheData);
+  if (savePipelineCache(cache, path, physicalDevice, headless.device) !=
+      ERR_OK) {
+    printf("  saving the cache failed\n");
+    failures++;
+  }
+
+  void *pData;
+  size_t size;
+  readPipelineCacheFile(&pData, &size, path, physicalDevice);
+  if (pData == NULL || size != cacheSize ||
+      memcmp(pData, pCacheData, size) != 0) {
+    printf("  read back %zu bytes, expected the cache's %zu\n", size,
+           cacheSize);
+    failures++;
+  }
+  free(pData);
+
+  // and new_PipelineCache starts from it
+  VkPipelineCache loaded;
+  new_PipelineCache(&loaded, path, physicalDevice, headless.device);
+  delete_PipelineCache(&loaded, headless.device);
+
+  size_t fileSize;
+  uint8_t *pFile = readWholeFile(path, &fileSize);
+  if (pFile == NULL || fileSize <= cacheSize) {
+    printf("  the file has no room for a header\n");
+    failures++;
+  } else {
+    char name[64];
+    for (size_t i = 0; i < fileSize; i++) {
+      pFile[i] ^= 0x5a;
+      writeWholeFile(path, pFile, fileSize);
+      snprintf(name, sizeof(name), "byte %zu changed", i);
+      failures += expectIgnored(path, name, physicalDevice);
+      pFile[i] ^= 0x5a;
+    }
+    for (size_t length = 0; length < fileSize; length++) {
+      writeWholeFile(path, pFile, length);
+      snprintf(name, sizeof(name), "cut short to %zu bytes", length);
+      failures += expectIgnored(path, name, physicalDevice);
+    }
+  }
+
+  // saving where the file can't be written fails
+  char unwritable[sizeof(path) + sizeof("/missing/pipeline_cache.bin")];
+  snprintf(unwritable, sizeof(unwritable), "%s/missing/pipeline_cache.bin",
+           path);
+  if (savePipelineCache(cache, unwritable, physicalDevice, headless.device) ==
+      ERR_OK) {
+    printf("  saving to %s succeeded\n", unwritable);
+    failures++;
+  }
+
+  remove(path);
+  free(pFile);
+  free(pCacheData);
+  delete_PipelineCache(&cache, headless.device);
+  delete_HeadlessDevice(&headless);
+  printf("test_pipeline_cache: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+// traces random rays through a loaded world with wld_trace_to_solid_batch and
+// one at a time with wld_trace_to_solid, and checks that every ray gets the
+// same result. A batch too small to be split between workers is checked too.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "harness.h"
+
+#define RAY_COUNT 20000u
+// fewer rays than a task of the batch traces
+#define SMALL_RAY_COUNT 100u
+
+// counts the rays of the batch whose result differs from a single trace
+static uint32_t countMismatches( //
+    const bool *pHits,           //
+    const ivec3 *pBlocks,        //
+    const BlockFaceKind *pFaces, //
+    const vec3 *pOrigins,        //
+    const vec3 *pDirections,     //
+    const uint32_t *pMaxDists,   //
+    const uint32_t rayCount,     //
+    WorldState *pWorldState      //
+) {
+  uint32_t mismatches = 0;
+  for (uint32_t i = 0; i < rayCount; i++) {
+    ivec3 block = {0};
+    BlockFaceKind face = 0;
+    bool hit = wld_trace_to_solid(block, &face, pOrigins[i], pDirections[i],
+                                  pMaxDists[i], pWorldState);
+    if (hit != pHits[i] ||
+        (hit && (!ivec3_eq(block, pBlocks[i]) || face != pFaces[i]))) {
+      printf("  ray %u: batch hit %d (%d %d %d) face %d, single hit %d "
+             "(%d %d %d) face %d\n",
+             i, pHits[i], pBlocks[i][0], pBlocks[i][1], pBlocks[i][2],
+             pFaces[i], hit, block[0], block[1], block[2], face);
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_raybatch: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  vec3 *pOrigins = malloc(RAY_COUNT * sizeof(vec3));
+  vec3 *pDirections = malloc(RAY_COUNT * sizeof(vec3));
+  uint32_t *pMaxDists = malloc(RAY_COUNT * sizeof(uint32_t));
+  bool *pHits = malloc(RAY_COUNT * sizeof(bool));
+  ivec3 *pBlocks = malloc(RAY_COUNT * sizeof(ivec3));
+  BlockFaceKind *pFaces = malloc(RAY_COUNT * sizeof(BlockFaceKind));
+  uint32_t seed = 11;
+  for (uint32_t i = 0; i < RAY_COUNT; i++) {
+    pOrigins[i][0] = tst_randomFloat(&seed, -100, 100);
+    pOrigins[i][1] = tst_randomFloat(&seed, -40, 40);
+    pOrigins[i][2] = tst_randomFloat(&seed, -100, 100);
+    do {
+      for (uint32_t axis = 0; axis < 3; axis++) {
+        pDirections[i][axis] = tst_randomFloat(&seed, -1, 1);
+      }
+    } while (vec3_len(pDirections[i]) < 0.01f);
+    pMaxDists[i] = tst_random(&seed) % 120;
+  }
+
+  // a ray that starts in a solid block has no face to report, and its face is
+  // left as it was, so it has to start out the same as the single traces'
+  for (uint32_t i = 0; i < RAY_COUNT; i++) {
+    pFaces[i] = 0;
+  }
+  uint32_t hitCount = wld_trace_to_solid_batch(pHits, pBlocks, pFaces, pOrigins,
+                                               pDirections, pMaxDists,
+                                               RAY_COUNT, &ws);
+  uint32_t mismatches = countMismatches(pHits, pBlocks, pFaces, pOrigins,
+                                        pDirections, pMaxDists, RAY_COUNT, &ws);
+  uint32_t hitsCounted = 0;
+  for (uint32_t i = 0; i < RAY_COUNT; i++) {
+    hitsCounted += pHits[i];
+  }
+  if (hitCount != hitsCounted) {
+    printf("  returned %u hits, but %u rays hit\n", hitCount, hitsCounted);
+    mismatches++;
+  }
+
+  for (uint32_t i = 0; i < SMALL_RAY_COUNT; i++) {
+    pFaces[i] = 0;
+  }
+  wld_trace_to_solid_batch(pHits, pBlocks, pFaces, pOrigins, pDirections,
+                           pMaxDists, SMALL_RAY_COUNT, &ws);
+  mismatches += countMismatches(pHits, pBlocks, pFaces, pOrigins, pDirections,
+                                pMaxDists, SMALL_RAY_COUNT, &ws);
+
+  printf("test_raybatch: %u rays, %u hits, %u mismatches\n", RAY_COUNT,
+         hitCount, mismatches);
+
+  free(pOrigins);
+  free(pDirections);
+  free(pMaxDists);
+  free(pHits);
+  free(pBlocks);
+  free(pFaces);
+  vkDeviceWaitIdle(headless.device);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  return mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// checks that editing a chunk leaves its mesh region's faces where they are,
+// on a device. Blocks away from the edges of the chunks around the center are
+// flipped between air and stone, so only their own chunk is meshed again, and
+// then flipped back. A region only gets new room in the vertex pool once its
+// members outgrow the room it has, which putting a block back can't do, so
+// that must never move the region's draw or change how many faces it draws.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "harness.h"
+
+#define AIR 0
+#define STONE 2
+#define EDITS 40u
+// how many ticks in a row nothing may change in for the world to count as
+// meshed, and how many an edit may take to be meshed
+#define QUIET_TICKS 200u
+#define MAX_TICKS 10000u
+
+// where a region's draw is in the vertex pool, and how many faces it draws
+typedef struct {
+  uint32_t block;
+  VkDeviceSize offset;
+  uint32_t count;
+} RegionDraw;
+
+static void sleepTick(void) {
+  struct timespec wait = {.tv_sec = 0, .tv_nsec = 1000000};
+  nanosleep(&wait, NULL);
+}
+
+// ticks the world, and returns whether draw i changed
+static bool tickChanged(WorldState *pWorldState,
+                        const HeadlessDevice *pHeadless, const uint32_t i,
+                        uint32_t *pChangeCount) {
+  tst_tickWorld(pWorldState, pHeadless);
+  const uint32_t *pChangedIndexes;
+  const CullDrawRecord *pChangedRecords;
+  uint32_t drawCount;
+  wld_getDrawChanges(&pChangedIndexes, &pChangedRecords, pChangeCount,
+                     &drawCount, false, pWorldState);
+  for (uint32_t c = 0; c < *pChangeCount; c++) {
+    if (pChangedIndexes[c] == i) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// ticks the world until draw i changes, as it does once its region is built
+// again
+static bool waitForDraw(WorldState *pWorldState,
+                        const HeadlessDevice *pHeadless, const uint32_t i) {
+  for (uint32_t tick = 0; tick < MAX_TICKS; tick++) {
+    uint32_t changeCount;
+    if (tickChanged(pWorldState, pHeadless, i, &changeCount)) {
+      return true;
+    }
+    sleepTick();
+  }
+  return false;
+}
+
+// the index of the draw of the region the chunk is in, or DRAW_LIST_NONE
+static uint32_t findRegionDraw(const WorldState *pWorldState,
+                               const ivec3 chunkCoord) {
+  ivec3 cornerCoord;
+  for (uint32_t axis = 0; axis < 3; axis++) {
+    cornerCoord[axis] = chunkCoord[axis] & ~(MESH_REGION_SIZE - 1);
+  }
+  uint32_t origin = wu_packChunkOrigin(cornerCoord);
+  for (uint32_t i = 0; i < pWorldState->draw_len; i++) {
+    if (pWorldState->drawOrigins[i] == origin) {
+      return i;
+    }
+  }
+  return DRAW_LIST_NONE;
+}
+
+static RegionDraw getRegionDraw(const WorldState *pWorldState,
+                                const uint32_t i) {
+  return (RegionDraw){.block = pWorldState->drawBlocks[i],
+                      .offset = pWorldState->drawOffsets[i],
+                      .count = pWorldState->drawCounts[i]};
+}
+
+static bool sameRegionDraw(const RegionDraw *pA, const RegionDraw *pB) {
+  return pA->block == pB->block && pA->offset == pB->offset &&
+         pA->count == pB->count;
+}
+
+// flips the block between air and stone
+static void flipBlock(WorldState *pWorldState, const ivec3 iBlockCoords) {
+  BlockIndex block;
+  wld_get_block_at(&block, pWorldState, iBlockCoords);
+  wld_set_block_at(BLOCKS[block].transparent ? STONE : AIR, pWorldState,
+                   iBlockCoords);
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_regions: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(47);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  // wait for the chunks at the edge to be meshed too
+  uint32_t failures = 0;
+  uint32_t quiet = 0;
+  for (uint32_t tick = 0; quiet < QUIET_TICKS; tick++) {
+    if (tick == MAX_TICKS) {
+      printf("  the world never stopped changing\n");
+      failures++;
+      break;
+    }
+    uint32_t changeCount;
+    tickChanged(&ws, &headless, DRAW_LIST_NONE, &changeCount);
+    quiet = changeCount == 0 ? quiet + 1 : 0;
+    sleepTick();
+  }
+
+  uint32_t seed = 47;
+  uint32_t edits = 0;
+  uint32_t moved = 0;
+  for (uint32_t e = 0; e < EDITS && failures == 0; e++) {
+    ivec3 chunkCoord = {(int32_t)(tst_random(&seed) % 3) - 1,
+                        (int32_t)(tst_random(&seed) % 3) - 1,
+                        (int32_t)(tst_random(&seed) % 3) - 1};
+    ivec3 iBlockCoords = {
+        chunkCoord[0] * CHUNK_X_SIZE + 1 +
+            (int32_t)(tst_random(&seed) % (CHUNK_X_SIZE - 2)),
+        chunkCoord[1] * CHUNK_Y_SIZE + 1 +
+            (int32_t)(tst_random(&seed) % (CHUNK_Y_SIZE - 2)),
+        chunkCoord[2] * CHUNK_Z_SIZE + 1 +
+            (int32_t)(tst_random(&seed) % (CHUNK_Z_SIZE - 2))};
+    uint32_t i = findRegionDraw(&ws, chunkCoord);
+    if (i == DRAW_LIST_NONE) {
+      continue;
+    }
+    RegionDraw before = getRegionDraw(&ws, i);
+
+    flipBlock(&ws, iBlockCoords);
+    if (!waitForDraw(&ws, &headless, i)) {
+      printf("  edit %u: region never built again\n", e);
+      failures++;
+      break;
+    }
+    RegionDraw edited = getRegionDraw(&ws, i);
+    moved += sameRegionDraw(&before, &edited) ? 0 : 1;
+
+    flipBlock(&ws, iBlockCoords);
+    if (!waitForDraw(&ws, &headless, i)) {
+      printf("  edit %u: region never built again after putting it back\n",
+             e);
+      failures++;
+      break;
+    }
+    RegionDraw restored = getRegionDraw(&ws, i);
+    if (!sameRegionDraw(&edited, &restored)) {
+      printf("  edit %u: putting it back moved the draw from %llu in block "
+             "%u with %u vertexes to %llu in block %u with %u\n",
+             e, (unsigned long long)edited.offset, edited.block, edited.count,
+             (unsigned long long)restored.offset, restored.block,
+             restored.count);
+      failures++;
+    }
+    edits++;
+  }
+
+  // with no room to spare, every edit that adds faces would move its region
+  if (edits == 0 || moved * 2 > edits) {
+    printf("  %u of %u edits moved their region, expected under half\n",
+           moved, edits);
+    failures++;
+  }
+
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  printf("test_regions: %u of %u edits moved their region, %u failures\n",
+         moved, edits, failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,262 @@
+// checks the staging ring. Its bookkeeping is run through sequences of
+// reservations and retirements by hand, without a device. Then, on a device,
+// random data is uploaded through it for a number of frames, enough to wrap
+// around the ring and overflow it, with some of it zeroed again, and read
+// back.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "harness.h"
+#include "staging.h"
+
+// the buffer uploads go to is bigger than the ring, so uploading all of it
+// at once overflows
+#define UPLOAD_SIZE (STAGING_RING_SIZE + ((VkDeviceSize)4 << 20))
+#define MAX_PIECE_SIZE ((VkDeviceSize)256 << 10)
+#define FRAMES 30u
+// every this many frames, the frame copies instead of uploading
+#define COPY_INTERVAL 5u
+// and the frame this far into each interval zeroes instead
+#define FILL_FRAME 2u
+
+static uint32_t expectRing(const StagingRing *pRing, const char *step,
+                           const VkDeviceSize head, const VkDeviceSize tail,
+                           const VkDeviceSize used) {
+  if (pRing->head == head && pRing->tail == tail && pRing->used == used) {
+    return 0;
+  }
+  printf("  after %s: head %llu tail %llu used %llu, expected %llu %llu %llu\n",
+         step, (unsigned long long)pRing->head,
+         (unsigned long long)pRing->tail, (unsigned long long)pRing->used,
+         (unsigned long long)head, (unsigned long long)tail,
+         (unsigned long long)used);
+  return 1;
+}
+
+static uint32_t expectReserve(StagingRing *pRing, const char *step,
+                              const VkDeviceSize size, const bool fits,
+                              const VkDeviceSize offset) {
+  VkDeviceSize reserved = UINT64_MAX;
+  bool result = stg_reserve(&reserved, pRing, size);
+  if (result == fits && (!fits || reserved == offset)) {
+    return 0;
+  }
+  printf("  %s: reserve %llu gave %d at %llu, expected %d at %llu\n", step,
+         (unsigned long long)size, result, (unsigned long long)reserved, fits,
+         (unsigned long long)offset);
+  return 1;
+}
+
+// a batch of copies alone, retired after the ring started over, mustn't
+// move the tail
+static uint32_t checkCopyOnlyBatch(void) {
+  StagingRing ring = {0};
+  StagingBatch uploads = {0};
+  StagingBatch copies = {0};
+  StagingBatch later = {0};
+  uint32_t failures = 0;
+
+  failures += expectReserve(&ring, "first upload", 100, true, 0);
+  stg_claimRing(&ring, &uploads);
+  stg_claimRing(&ring, &copies);
+  stg_retireBatch(&ring, &uploads);
+  failures += expectRing(&ring, "retiring the uploads", 112, 112, 0);
+
+  // the ring is empty, so this starts over from the beginning
+  failures += expectReserve(&ring, "next upload", 64, true, 0);
+  stg_retireBatch(&ring, &copies);
+  failures += expectRing(&ring, "retiring the copies", 64, 0, 64);
+
+  stg_claimRing(&ring, &later);
+  stg_retireBatch(&ring, &later);
+  failures += expectRing(&ring, "retiring the next upload", 64, 64, 0);
+  return failures;
+}
+
+// uploads that don't fit before the end of the ring wrap around to the start
+static uint32_t checkWrap(void) {
+  StagingRing ring = {0};
+  StagingBatch first = {0};
+  StagingBatch second = {0};
+  uint32_t failures = 0;
+
+  failures += expectReserve(&ring, "first", 1024, true, 0);
+  stg_claimRing(&ring, &first);
+  failures += expectReserve(&ring, "second", STAGING_RING_SIZE - 2048, true,
+                            1024);
+  stg_claimRing(&ring, &second);
+  failures += expectReserve(&ring, "while full to the first", 2048, false, 0);
+  failures += expectRing(&ring, "failing", STAGING_RING_SIZE - 1024, 0,
+                         STAGING_RING_SIZE - 1024);
+
+  stg_retireBatch(&ring, &first);
+  failures += expectReserve(&ring, "up to the end", 1024, true,
+                            STAGING_RING_SIZE - 1024);
+  failures += expectReserve(&ring, "after the end", 10, true, 0);
+  failures += expectReserve(&ring, "past the tail", 1024, false, 0);
+  failures += expectRing(&ring, "wrapping", 16, 1024, STAGING_RING_SIZE - 1008);
+
+  // skipping the end of the ring to wrap counts as used, until the batch
+  // that skipped it is retired
+  stg_retireBatch(&ring, &second);
+  failures += expectRing(&ring, "retiring the second", 16,
+                         STAGING_RING_SIZE - 1024, 1040);
+  failures += expectReserve(&ring, "after the wrap", 512, true, 16);
+  return failures;
+}
+
+// fills the range with random bytes
+static void randomBytes(uint8_t *pBytes, const VkDeviceSize size,
+                        uint32_t *pSeed) {
+  for (VkDeviceSize i = 0; i < size; i++) {
+    pBytes[i] = (uint8_t)tst_random(pSeed);
+  }
+}
+
+static uint32_t compareBuffer(const HeadlessDevice *pHeadless,
+                              const char *name, const VkBuffer buffer,
+                              const uint8_t *pExpected) {
+  VkBuffer readback;
+  VkDeviceMemory readbackMemory;
+  ErrVal result = new_Buffer_DeviceMemory(
+      &readback, &readbackMemory, UPLOAD_SIZE, pHeadless->physicalDevice,
+      pHeadless->device, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  if (result != ERR_OK) {
+    LOG_ERROR(ERR_LEVEL_FATAL, "failed to create readback buffer");
+    PANIC();
+  }
+  copyBuffer(readback, buffer, UPLOAD_SIZE, pHeadless->commandPool,
+             pHeadless->graphicsQueue, pHeadless->device);
+
+  void *pMapped;
+  vkMapMemory(pHeadless->device, readbackMemory, 0, UPLOAD_SIZE, 0, &pMapped);
+  uint32_t failures = 0;
+  const uint8_t *pActual = pMapped;
+  for (VkDeviceSize i = 0; i < UPLOAD_SIZE; i++) {
+    if (pActual[i] != pExpected[i]) {
+      printf("  %s differs first at byte %llu\n", name, (unsigned long long)i);
+      failures++;
+      break;
+    }
+  }
+  vkUnmapMemory(pHeadless->device, readbackMemory);
+  delete_Buffer(&readback, pHeadless->device);
+  delete_DeviceMemory(&readbackMemory, pHeadless->device);
+  return failures;
+}
+
+// uploads pieces of random data through the ring, some straight from memory
+// and some through the arena, and copies between buffers on the GPU
+static uint32_t checkUploads(const HeadlessDevice *pHeadless) {
+  StagingRing ring;
+  new_StagingRing(&ring, pHeadless->device, pHeadless->physicalDevice,
+                  pHeadless->transferQueue, pHeadless->transferIndex, 0);
+
+  // written to from the transfer queue, read back from the graphics queue
+  const uint32_t queueFamilyIndices[2] = {pHeadless->graphicsIndex,
+                                          pHeadless->transferIndex};
+  const uint32_t queueFamilyCount =
+      pHeadless->graphicsIndex == pHeadless->transferIndex ? 1 : 2;
+  VkBuffer buffers[2];
+  VkDeviceMemory memories[2];
+  for (uint32_t i = 0; i < 2; i++) {
+    ErrVal result = new_SharedBuffer_DeviceMemory(
+        &buffers[i], &memories[i], UPLOAD_SIZE, pHeadless->physicalDevice,
+        pHeadless->device,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, queueFamilyCount,
+        queueFamilyIndices);
+    if (result != ERR_OK) {
+      LOG_ERROR(ERR_LEVEL_FATAL, "failed to create upload buffer");
+      PANIC();
+    }
+  }
+  // what the uploads and the copies of them should hold
+  uint8_t *pExpected = calloc(UPLOAD_SIZE, 1);
+  uint8_t *pExpectedCopy = calloc(UPLOAD_SIZE, 1);
+
+  uint32_t seed = 40;
+  for (uint32_t frame = 0; frame < FRAMES; frame++) {
+    if (frame % COPY_INTERVAL == COPY_INTERVAL - 1) {
+      // nothing but a copy, so the batch takes no room in the ring
+      stg_copy(&ring, buffers[0], 0, buffers[1], 0, UPLOAD_SIZE);
+      memcpy(pExpectedCopy, pExpected, UPLOAD_SIZE);
+    } else if (frame % COPY_INTERVAL == FILL_FRAME) {
+      // a random window in two fills, which take no room in the ring either
+      VkDeviceSize start = tst_random(&seed) % (UPLOAD_SIZE - 8) / 4 * 4;
+      VkDeviceSize end = start + 8 + tst_random(&seed) % (UPLOAD_SIZE / 4);
+      end = end < UPLOAD_SIZE ? end / 4 * 4 : UPLOAD_SIZE;
+      VkDeviceSize middle = start + (end - start) / 8 * 4;
+      memset(pExpected + start, 0, (size_t)(end - start));
+      stg_fill(&ring, buffers[0], start, middle - start);
+      stg_fill(&ring, buffers[0], middle, end - middle);
+    } else {
+      // the first frame uploads all of it, the rest a random window
+      VkDeviceSize start = 0;
+      VkDeviceSize end = UPLOAD_SIZE;
+      if (frame > 0) {
+        start = tst_random(&seed) % UPLOAD_SIZE;
+        end = start + tst_random(&seed) % (UPLOAD_SIZE / 4);
+        end = end < UPLOAD_SIZE ? end : UPLOAD_SIZE;
+      }
+      // every other piece, then the ones in between, so that uploads next to
+      // each other in the ring don't always go next to each other
+      // each pass splits the window the same way
+      const uint32_t piecesSeed = tst_random(&seed);
+      for (uint32_t pass = 0; pass < 2; pass++) {
+        uint32_t pieceSeed = piecesSeed;
+        uint32_t piece = 0;
+        for (VkDeviceSize offset = start; offset < end; piece++) {
+          VkDeviceSize size = 1 + tst_random(&pieceSeed) % MAX_PIECE_SIZE;
+          size = offset + size < end ? size : end - offset;
+          if (piece % 2 == pass) {
+            randomBytes(pExpected + offset, size, &seed);
+            if (tst_random(&seed) % 4 == 0) {
+              StagedData staged;
+              void *pStaged = stg_stage(&staged, &ring, size);
+              memcpy(pStaged, pExpected + offset, (size_t)size);
+              stg_uploadStaged(&ring, buffers[0], offset, &staged, size);
+            } else {
+              stg_upload(&ring, buffers[0], offset, pExpected + offset, size);
+            }
+          }
+          offset += size;
+        }
+      }
+    }
+    tst_waitSemaphore(pHeadless, stg_flush(&ring));
+  }
+
+  uint32_t failures = compareBuffer(pHeadless, "upload", buffers[0], pExpected);
+  failures += compareBuffer(pHeadless, "copy", buffers[1], pExpectedCopy);
+
+  free(pExpected);
+  free(pExpectedCopy);
+  vkDeviceWaitIdle(pHeadless->device);
+  for (uint32_t i = 0; i < 2; i++) {
+    delete_Buffer(&buffers[i], pHeadless->device);
+    delete_DeviceMemory(&memories[i], pHeadless->device);
+  }
+  delete_StagingRing(&ring);
+  return failures;
+}
+
+int main(void) {
+  uint32_t failures = checkCopyOnlyBatch();
+  failures += checkWrap();
+
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) == ERR_OK) {
+    failures += checkUploads(&headless);
+    delete_HeadlessDevice(&headless);
+  } else {
+    printf("test_staging: uploads skipped, no Vulkan device\n");
+  }
+
+  printf("test_staging: %u failures\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+// traces random rays through a loaded world with wld_trace_to_solid and with
+// a plain DDA that steps through and reads every block on the way, and checks
+// that both find the same block and face. Blocks are edited along the way so
+// that the bricks and chunks the traversal jumps over have to be kept up to
+// date.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "harness.h"
+
+#define RAY_COUNT 40000u
+#define EDIT_INTERVAL 1000u
+
+static int32_t ref_signum(float x) { return x > 0 ? 1 : x < 0 ? -1 : 0; }
+
+static float ref_intbound(float s, float ds) {
+  bool sIsInteger = roundf(s) == s;
+  if (ds < 0 && sIsInteger)
+    return 0;
+
+  float ceils;
+  if (s == 0.0f) {
+    ceils = 1.0f;
+  } else {
+    ceils = ceilf(s);
+  }
+
+  return (ds > 0 ? ceils - s : s - floorf(s)) / fabsf(ds);
+}
+
+// the t of the nth boundary crossing along one axis, computed the same way
+// wld_trace_to_solid does so that both agree on ties to the bit
+static float ref_crossing(float tFirst, float tDelta, uint32_t n) {
+  return n == 0 ? tFirst : tFirst + (float)n * tDelta;
+}
+
+// wld_trace_to_solid without the skipping of empty bricks and chunks
+static bool ref_trace_to_solid( //
+    ivec3 dest_iBlockCoords,    //
+    BlockFaceKind *dest_face,   //
+    const vec3 origin,          //
+    const vec3 direction,       //
+    const uint32_t max_dist,    //
+    WorldState *pWorldState     //
+) {
+  int32_t x = (int32_t)(floorf(origin[0]));
+  int32_t y = (int32_t)(floorf(origin[1]));
+  int32_t z = (int32_t)(floorf(origin[2]));
+  float dx = direction[0];
+  float dy = direction[1];
+  float dz = direction[2];
+  int32_t stepX = ref_signum(dx);
+  int32_t stepY = ref_signum(dy);
+  int32_t stepZ = ref_signum(dz);
+  float tMaxX = ref_intbound(origin[0], dx);
+  float tMaxY = ref_intbound(origin[1], dy);
+  float tMaxZ = ref_intbound(origin[2], dz);
+  float tDeltaX = (float)stepX / dx;
+  float tDeltaY = (float)stepY / dy;
+  float tDeltaZ = (float)stepZ / dz;
+  const float tFirstX = tMaxX;
+  const float tFirstY = tMaxY;
+  const float tFirstZ = tMaxZ;
+  uint32_t nX = 0;
+  uint32_t nY = 0;
+  uint32_t nZ = 0;
+
+  float radius = (float)(max_dist) / sqrtf(dx * dx + dy * dy + dz * dz);
+  while (true) {
+    ivec3 coord = {x, y, z};
+    BlockIndex bi;
+    if (!wld_get_block_at(&bi, pWorldState, coord)) {
+      break;
+    }
+
+    if (!BLOCKS[bi].transparent) {
+      ivec3_dup(dest_iBlockCoords, coord);
+      return true;
+    }
+
+    if (tMaxX < tMaxY) {
+      if (tMaxX < tMaxZ) {
+        if (tMaxX > radius)
+          break;
+        x += stepX;
+        tMaxX = ref_crossing(tFirstX, tDeltaX, ++nX);
+        *dest_face = stepX == 1 ? Block_LEFT : Block_RIGHT;
+      } else {
+        if (tMaxZ > radius)
+          break;
+        z += stepZ;
+        tMaxZ = ref_crossing(tFirstZ, tDeltaZ, ++nZ);
+        *dest_face = stepZ == 1 ? Block_BACK : Block_FRONT;
+      }
+    } else {
+      if (tMaxY < tMaxZ) {
+        if (tMaxY > radius)
+          break;
+        y += stepY;
+        tMaxY = ref_crossing(tFirstY, tDeltaY, ++nY);
+        *dest_face = stepY == 1 ? Block_UP : Block_DOWN;
+      } else {
+        if (tMaxZ > radius)
+          break;
+        z += stepZ;
+        tMaxZ = ref_crossing(tFirstZ, tDeltaZ, ++nZ);
+        *dest_face = stepZ == 1 ? Block_BACK : Block_FRONT;
+      }
+    }
+  }
+
+  return false;
+}
+
+int main(void) {
+  HeadlessDevice headless;
+  if (new_HeadlessDevice(&headless) != ERR_OK) {
+    printf("test_trace: skipped, no Vulkan device\n");
+    return 0;
+  }
+  worldgen_state *pWorldgen = new_worldgen_state(42);
+  WorldState ws;
+  tst_new_LoadedWorld(&ws, pWorldgen, 0, &headless);
+
+  uint32_t seed = 9;
+  uint32_t mismatches = 0;
+  uint32_t hits = 0;
+  for (uint32_t i = 0; i < RAY_COUNT; i++) {
+    vec3 origin = {tst_randomFloat(&seed, -100, 100),
+                   tst_randomFloat(&seed, -40, 40),
+                   tst_randomFloat(&seed, -100, 100)};
+    if (i % 4 == 0) {
+      // start on block boundaries too
+      origin[0] = floorf(origin[0]) + 0.5f;
+      origin[1] = floorf(origin[1]);
+    }
+    vec3 direction = {tst_randomFloat(&seed, -1, 1),
+                      tst_randomFloat(&seed, -1, 1),
+                      tst_randomFloat(&seed, -1, 1)};
+    if (i % 5 == 0) {
+      // and parallel to an axis plane
+      direction[i % 3 == 1 ? 1 : 2] = 0;
+    }
+    for (uint32_t axis = 0; axis < 3; axis++) {
+      // the DDA never leaves a boundary it starts on and doesn't move along
+      if (direction[axis] == 0 && floorf(origin[axis]) == origin[axis]) {
+        origin[axis] += 0.25f;
+      }
+    }
+    uint32_t maxDist = tst_random(&seed) % 120;
+
+    ivec3 block = {0};
+    ivec3 refBlock = {0};
+    BlockFaceKind face = 0;
+    BlockFaceKind refFace = 0;
+    bool hit =
+        wld_trace_to_solid(block, &face, origin, direction, maxDist, &ws);
+    bool refHit = ref_trace_to_solid(refBlock, &refFace, origin, direction,
+                                     maxDist, &ws);
+    if (hit != refHit ||
+        (hit && (!ivec3_eq(block, refBlock) || face != refFace))) {
+      printf("  ray %u from (%f %f %f) along (%f %f %f): hit %d (%d %d %d) "
+             "face %d, expected hit %d (%d %d %d) face %d\n",
+             i, (double)origin[0], (double)origin[1], (double)origin[2],
+             (double)direction[0], (double)direction[1], (double)direction[2],
+             hit, block[0], block[1], block[2], face, refHit, refBlock[0],
+             refBlock[1], refBlock[2], refFace);
+      mismatches++;
+    }
+    hits += hit;
+
+    if (i % EDIT_INTERVAL == 0) {
+      // carve out or fill in a block, which may empty or fill its brick
+      ivec3 edit = {(int32_t)(tst_random(&seed) % 160) - 80,
+                    (int32_t)(tst_random(&seed) % 60) - 40,
+                    (int32_t)(tst_random(&seed) % 160) - 80};
+      wld_set_block_at(tst_random(&seed) % 2 ? 0 : 2, &ws, edit);
+    }
+  }
+
+  printf("test_trace: %u rays, %u hits, %u mismatches\n", RAY_COUNT, hits,
+         mismatches);
+
+  vkDeviceWaitIdle(headless.device);
+  wld_delete_WorldState(&ws);
+  delete_worldgen_state(pWorldgen);
+  delete_HeadlessDevice(&headless);
+  return mismatches == 0 ? 0 : 1;
+}